@@ -0,0 +1,334 @@
+/******************************************************************************
+*                           Matrix allocation                                 *
+*                                                                             *
+* Every array is preceded by a small header recording where it came from, so *
+* releaseMatrix can return it to the right place regardless of which sources *
+* are enabled when it is released.                                            *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "allocator.hpp"
+
+enum BlockSource {
+  HEAP_BLOCK,
+  POOL_BLOCK,
+  ARENA_BLOCK
+};
+
+struct BlockHeader {
+  void* base;
+  std::size_t bytes;
+  int source;
+  int sizeClass;
+};
+
+// Size classes of the pools are powers of two from 2^MIN_CLASS to 
+// 2^MAX_CLASS bytes. Larger arrays always use the heap
+static const int MIN_CLASS = 5;
+static const int MAX_CLASS = 20;
+
+// Extra bytes needed to fit the header and align the array
+static const std::size_t BLOCK_OVERHEAD = sizeof(BlockHeader) + 
+                                          MATRIX_ALIGNMENT - 1;
+
+/*
+* State kept separately by every thread.
+*/
+struct ThreadAllocator {
+  MatrixArena* arena = nullptr;
+  bool pooling = false;
+  std::vector<void*> freeLists[MAX_CLASS + 1];
+  AllocatorStatistics statistics = {};
+
+  ~ThreadAllocator() {
+    for (auto& list : freeLists) {
+      for (void* base : list) {
+        ::operator delete(base);
+      }
+    }
+  }
+};
+
+static thread_local ThreadAllocator threadAllocator;
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Places an aligned array with its header inside the block starting at base.
+*/
+static double* placeBlock(void* base, std::size_t bytes, int source, 
+                          int sizeClass) {
+  std::uintptr_t address = (std::uintptr_t)base + sizeof(BlockHeader);
+  address = (address + MATRIX_ALIGNMENT - 1) & ~(MATRIX_ALIGNMENT - 1);
+  BlockHeader* header = (BlockHeader*)address - 1;
+  header->base = base;
+  header->bytes = bytes;
+  header->source = source;
+  header->sizeClass = sizeClass;
+  return (double*)address;
+}
+
+/*
+* Records an allocation of the given size in the statistics.
+*/
+static void recordAllocation(AllocatorStatistics& statistics, 
+                             std::size_t bytes) {
+  statistics.allocations++;
+  statistics.bytesServed += bytes;
+  statistics.bytesInUse += bytes;
+  statistics.highWaterMark = std::max(statistics.highWaterMark, 
+                                      statistics.bytesInUse);
+}
+
+/*
+* Returns the smallest size class holding the given number of bytes, or -1 if
+* the array is too large for the pools.
+*/
+static int sizeClassFor(std::size_t bytes) {
+  int sizeClass = MIN_CLASS;
+  while (((std::size_t)1 << sizeClass) < bytes) {
+    sizeClass++;
+  }
+  return (sizeClass <= MAX_CLASS) ? sizeClass : -1;
+}
+
+/*
+* Allocates an aligned array of the given number of bytes from the active 
+* arena, the pools or the heap. Used for matrices of every element type.
+*/
+void* allocateMatrixBytes(std::size_t bytes) {
+  ThreadAllocator& state = threadAllocator;
+
+  // Bump allocation from the arena
+  MatrixArena* arena = state.arena;
+  if (arena != nullptr) {
+    std::size_t size = bytes + BLOCK_OVERHEAD;
+    if (arena->used + size <= arena->capacity) {
+      double* data = placeBlock(arena->buffer + arena->used, bytes, 
+                                ARENA_BLOCK, 0);
+      arena->used = (char*)data + bytes - arena->buffer;
+      recordAllocation(arena->statistics, bytes);
+      arena->statistics.bytesInUse = arena->used;
+      arena->statistics.highWaterMark = std::max(
+        arena->statistics.highWaterMark, (long)arena->used);
+      return data;
+    }
+    arena->statistics.heapFallbacks++;
+  }
+
+  // Size class pools
+  if (state.pooling) {
+    int sizeClass = sizeClassFor(bytes);
+    if (sizeClass >= 0) {
+      std::vector<void*>& list = state.freeLists[sizeClass];
+      void* base;
+      if (!list.empty()) {
+        base = list.back();
+        list.pop_back();
+        state.statistics.poolHits++;
+      } else {
+        base = ::operator new(((std::size_t)1 << sizeClass) + BLOCK_OVERHEAD);
+      }
+      std::size_t size = (std::size_t)1 << sizeClass;
+      recordAllocation(state.statistics, size);
+      return placeBlock(base, size, POOL_BLOCK, sizeClass);
+    }
+  }
+
+  // Global heap
+  void* base = ::operator new(bytes + BLOCK_OVERHEAD);
+  recordAllocation(state.statistics, bytes);
+  return placeBlock(base, bytes, HEAP_BLOCK, 0);
+}
+
+/******************************************************************************
+* ARENA                                                                       *
+******************************************************************************/
+
+/*
+* Creates an arena holding the given number of bytes. The region is allocated
+* once, here, and reused every time a scope using the arena ends.
+*
+* bytes - The size of the arena in bytes, including a small header and 
+*         alignment padding per matrix
+*/
+MatrixArena::MatrixArena(std::size_t bytes) :
+  buffer((char*)::operator new(bytes)),
+  capacity(bytes),
+  used(0),
+  statistics()
+{}
+
+/*
+* Frees the region of the arena.
+*/
+MatrixArena::~MatrixArena() {
+  ::operator delete(buffer);
+}
+
+/*
+* Returns the size of the arena in bytes.
+*/
+std::size_t MatrixArena::getCapacity() const {
+  return capacity;
+}
+
+/*
+* Returns the number of bytes of the arena currently handed out.
+*/
+std::size_t MatrixArena::getUsed() const {
+  return used;
+}
+
+/*
+* Returns the counters of the arena. bytesInUse and highWaterMark include the
+* headers and alignment padding, so they can be compared to the capacity.
+*/
+const AllocatorStatistics& MatrixArena::getStatistics() const {
+  return statistics;
+}
+
+/*
+* Sets every counter of the arena back to zero, apart from bytesInUse.
+*/
+void MatrixArena::resetStatistics() {
+  statistics = AllocatorStatistics();
+  statistics.bytesInUse = used;
+  statistics.highWaterMark = used;
+}
+
+/*
+* Makes the arena the source of every matrix allocated on this thread until 
+* the scope ends. Scopes can be nested, also on the same arena.
+*
+* scope_arena - The arena to allocate from
+*/
+ArenaScope::ArenaScope(MatrixArena& scope_arena) :
+  arena(scope_arena),
+  previous(threadAllocator.arena),
+  mark(scope_arena.used)
+{
+  threadAllocator.arena = &arena;
+}
+
+/*
+* Frees every matrix allocated from the arena during the scope, in O(1), and 
+* restores the previous source of allocations.
+*/
+ArenaScope::~ArenaScope() {
+  arena.used = mark;
+  arena.statistics.bytesInUse = mark;
+  threadAllocator.arena = previous;
+}
+
+/*
+* Suspends the active arena of this thread until the scope ends, so that the
+* arrays allocated meanwhile come from the pools or the heap and outlive any
+* ArenaScope. Used whenever an existing matrix or image gets a new array.
+*/
+HeapScope::HeapScope() :
+  previous(threadAllocator.arena)
+{
+  threadAllocator.arena = nullptr;
+}
+
+/*
+* Makes the suspended arena, if any, the source of allocations again.
+*/
+HeapScope::~HeapScope() {
+  threadAllocator.arena = previous;
+}
+
+/******************************************************************************
+* PUBLIC FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Allocates an array for the given number of doubles. The array is aligned to
+* MATRIX_ALIGNMENT bytes and must be released with releaseMatrix.
+*/
+double* allocateMatrix(long count) {
+  return (double*)allocateMatrixBytes((std::size_t)count * sizeof(double));
+}
+
+/*
+* Releases an array returned by allocateMatrix. Arena arrays are freed when 
+* their scope ends, so releasing them does nothing, and pool arrays are kept 
+* in the free lists of the calling thread.
+*/
+void releaseMatrix(double* data) {
+  releaseMatrixBytes(data);
+}
+
+/*
+* Releases an array returned by allocateMatrixBytes, in the same way as 
+* releaseMatrix.
+*/
+void releaseMatrixBytes(void* data) {
+  if (data == nullptr) {
+    return;
+  }
+  BlockHeader* header = (BlockHeader*)data - 1;
+  ThreadAllocator& state = threadAllocator;
+  if (header->source == POOL_BLOCK) {
+    state.freeLists[header->sizeClass].push_back(header->base);
+    state.statistics.bytesInUse -= header->bytes;
+  } else if (header->source == HEAP_BLOCK) {
+    state.statistics.bytesInUse -= header->bytes;
+    ::operator delete(header->base);
+  }
+}
+
+/*
+* Returns true if the array returned by allocateMatrixBytes came from an
+* arena, so that it is freed when the scope it was allocated in ends.
+*/
+bool isArenaArray(const void* data) {
+  return (data != nullptr) && 
+         (((const BlockHeader*)data - 1)->source == ARENA_BLOCK);
+}
+
+/*
+* Enables or disables the size class pools for the calling thread. Arrays 
+* already in the pools stay there until releaseMatrixPools is called.
+*/
+void setMatrixPooling(bool enabled) {
+  threadAllocator.pooling = enabled;
+}
+
+/*
+* Returns every array kept in the pools of the calling thread to the heap.
+*/
+void releaseMatrixPools() {
+  for (auto& list : threadAllocator.freeLists) {
+    for (void* base : list) {
+      ::operator delete(base);
+    }
+    list.clear();
+  }
+}
+
+/*
+* Returns the counters of the heap and pool allocations made by the calling 
+* thread. Arena allocations are counted by the arena.
+*/
+AllocatorStatistics allocatorStatistics() {
+  return threadAllocator.statistics;
+}
+
+/*
+* Sets the counters of the calling thread back to zero, apart from 
+* bytesInUse.
+*/
+void resetAllocatorStatistics() {
+  long inUse = threadAllocator.statistics.bytesInUse;
+  threadAllocator.statistics = AllocatorStatistics();
+  threadAllocator.statistics.bytesInUse = inUse;
+  threadAllocator.statistics.highWaterMark = inUse;
+}
@@ -0,0 +1,127 @@
+/******************************************************************************
+*                           Matrix allocation                                 *
+*                                                                             *
+* Every array used by a Matrix is obtained from allocateMatrix and returned   *
+* through releaseMatrix. By default these use the global heap, but a thread   *
+* can opt in to two faster sources:                                           *
+*                                                                             *
+* - A MatrixArena is a contiguous region from which arrays are handed out by  *
+*   bumping a pointer. While an ArenaScope is alive, every matrix created on  *
+*   that thread comes from the arena, and when the scope ends all of them are *
+*   freed at once by resetting the pointer. Matrices created inside a scope   *
+*   must therefore be destroyed before the scope ends. Requests that do not   *
+*   fit in the arena fall back to the global heap.                            *
+* - Arrays that grow or replace the array of a matrix or image that already   *
+*   exists, such as pushRow(), reserve(), assignments and the outputs that    *
+*   filters resize, never come from the arena, since the owner may outlive    *
+*   the scope. Moving a matrix created inside the scope into one declared     *
+*   outside of it still leaves that matrix with an arena array, so a          *
+*   HeapScope, which suspends the arena, is needed for such results:          *
+*                                                                             *
+*     MatrixArena arena(1 << 20);                                             *
+*     Matrix track(0, 2);                                                     *
+*     Matrix pose(2, 1);                                                      *
+*     {                                                                       *
+*       ArenaScope frame(arena);                                              *
+*       Matrix detection(1, 2);      // From the arena                        *
+*       track.pushRow(detection);    // Grows from the heap                   *
+*       HeapScope keep;                                                       *
+*       pose = detection.T();        // Without keep, freed with the frame    *
+*     }                                                                       *
+*                                                                             *
+* - Size class pools keep the arrays of destroyed matrices in per-thread free *
+*   lists, rounded up to a power of two, and hand them out again instead of   *
+*   calling the heap.                                                         *
+*                                                                             *
+* Counters for the bytes served, the high-water mark and the number of heap   *
+* fallbacks are kept per arena and per thread, to help size arenas.           *
+*                                                                             *
+* A matrix can also use an array that comes from elsewhere, such as a decoded *
+* frame or a shared memory segment, without copying it. A borrowed array is   *
+* never released by the matrix, and an adopted array is released by calling  *
+* the BufferDeleter given with it instead of releaseMatrix.                   *
+*                                                                             *
+******************************************************************************/
+#ifndef ALLOCATOR_HPP
+#define ALLOCATOR_HPP
+
+#include <cstddef>
+
+// Alignment in bytes of every array handed out for a matrix
+const std::size_t MATRIX_ALIGNMENT = 64;
+
+struct AllocatorStatistics {
+  long allocations;       // Number of arrays handed out
+  long bytesServed;       // Total bytes of the arrays handed out
+  long bytesInUse;        // Bytes currently in use
+  long highWaterMark;     // Largest value bytesInUse has reached
+  long heapFallbacks;     // Arena requests that had to use the heap instead
+  long poolHits;          // Pool requests served from a free list
+};
+
+void* allocateMatrixBytes(std::size_t bytes);
+void releaseMatrixBytes(void* data);
+bool isArenaArray(const void* data);
+
+class MatrixArena {
+  friend class ArenaScope;
+  friend void* allocateMatrixBytes(std::size_t bytes);
+  private:
+    char* buffer;
+    std::size_t capacity;
+    std::size_t used;
+    AllocatorStatistics statistics;
+
+  public:
+    explicit MatrixArena(std::size_t bytes);
+    MatrixArena(const MatrixArena&) = delete;
+    MatrixArena& operator=(const MatrixArena&) = delete;
+    ~MatrixArena();
+
+    std::size_t getCapacity() const;
+    std::size_t getUsed() const;
+    const AllocatorStatistics& getStatistics() const;
+    void resetStatistics();
+};
+
+class ArenaScope {
+  private:
+    MatrixArena& arena;
+    MatrixArena* previous;
+    std::size_t mark;
+
+  public:
+    explicit ArenaScope(MatrixArena& scope_arena);
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+    ~ArenaScope();
+};
+
+class HeapScope {
+  private:
+    MatrixArena* previous;
+
+  public:
+    HeapScope();
+    HeapScope(const HeapScope&) = delete;
+    HeapScope& operator=(const HeapScope&) = delete;
+    ~HeapScope();
+};
+
+// Releases an array adopted by a matrix, together with the context pointer
+// given when the array was adopted
+template <typename Type>
+using BufferDeleter = void (*)(Type* data, void* context);
+
+// Deleter of borrowed arrays, which leaves them to their owner
+template <typename Type>
+void keepBuffer(Type*, void*) {}
+
+double* allocateMatrix(long count);
+void releaseMatrix(double* data);
+void setMatrixPooling(bool enabled);
+void releaseMatrixPools();
+AllocatorStatistics allocatorStatistics();
+void resetAllocatorStatistics();
+
+#endif
@@ -0,0 +1,392 @@
+/******************************************************************************
+*                          Linear assignment                                  *
+*                                                                             *
+* The solver keeps a dual value for every row and column, and adds the rows  *
+* one at a time. For each new row, a Dijkstra search on the reduced costs    *
+* finds the cheapest alternating path to an unassigned column, after which   *
+* the duals are updated and the assignments along the path are flipped, as   *
+* in the rectangular algorithm described by Crouse (2016).                    *
+*                                                                             *
+* The search only tracks the columns it has reached, and resets only those   *
+* afterwards, so with a SparseCost the work per row depends on the number of *
+* candidate pairs near it rather than on the number of columns. The costs    *
+* are visited through a relax function, which is a loop over a row of the    *
+* matrix for dense costs and over the compressed entries of a row for sparse *
+* costs. With a gate, every row i has a private extra column numColumns + i  *
+* of cost gate, which stands for leaving the row unassigned.                 *
+*                                                                             *
+******************************************************************************/
+#include <cmath>
+#include <utility>
+
+#include "assignment.hpp"
+
+// States of a column during a search
+static const unsigned char UNSEEN = 0;
+static const unsigned char FRONTIER = 1;
+static const unsigned char SCANNED = 2;
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns the largest feasible cost for the given gate. Costs are compared
+* with c <= limit, which also rejects NaN.
+*/
+static double costLimit(double gate) {
+  return std::isfinite(gate) ? gate : std::numeric_limits<double>::max();
+}
+
+/*
+* Prints an error and throws if the gate is NaN or negative.
+*/
+static void checkGate(double gate) {
+  if (!(gate >= 0)) {
+    std::cout << "Unable to solve an assignment problem with gate " << gate
+              << ", since the gate must not be negative\n";
+    throw std::invalid_argument("Invalid assignment gate.");
+  }
+}
+
+/******************************************************************************
+* SPARSE COSTS                                                                *
+******************************************************************************/
+
+SparseCost::SparseCost() : rows(0), cols(0) {}
+
+SparseCost::SparseCost(int num_rows, int num_columns) : rows(0), cols(0) {
+  reset(num_rows, num_columns);
+}
+
+/*
+* Removes all entries and sets the size of the problem, keeping the storage.
+*/
+void SparseCost::reset(int num_rows, int num_columns) {
+  if ((num_rows < 0) || (num_columns < 0)) {
+    std::cout << "Unable to create sparse costs of size (" << num_rows
+              << ", " << num_columns << ")\n";
+    throw std::invalid_argument("Invalid sparse cost size.");
+  }
+  rows = num_rows;
+  cols = num_columns;
+  entryRows.clear();
+  entryColumns.clear();
+  entryCosts.clear();
+}
+
+void SparseCost::reserve(long entries) {
+  entryRows.reserve(entries);
+  entryColumns.reserve(entries);
+  entryCosts.reserve(entries);
+}
+
+/*
+* Adds the pair (row, column) with the given cost.
+*/
+void SparseCost::add(int row, int column, double cost) {
+  if ((row < 0) || (row >= rows) || (column < 0) || (column >= cols)) {
+    std::cout << "Index (" << row << ", " << column << ") out of bounds for "
+              << "sparse costs of size (" << rows << ", " << cols << ")\n";
+    throw std::out_of_range("Sparse cost index out of bounds.");
+  }
+  entryRows.push_back(row);
+  entryColumns.push_back(column);
+  entryCosts.push_back(cost);
+}
+
+int SparseCost::getRows() const {
+  return rows;
+}
+
+int SparseCost::getColumns() const {
+  return cols;
+}
+
+long SparseCost::getCount() const {
+  return (long)entryCosts.size();
+}
+
+int SparseCost::getRow(long entry) const {
+  return entryRows[entry];
+}
+
+int SparseCost::getColumn(long entry) const {
+  return entryColumns[entry];
+}
+
+double SparseCost::getCost(long entry) const {
+  return entryCosts[entry];
+}
+
+/******************************************************************************
+* SOLVER                                                                      *
+******************************************************************************/
+
+LinearAssignment::LinearAssignment() : rows(0), cols(0), totalCost(0) {}
+
+/*
+* Solves the problem with numRows rows and numColumns columns, and stores the
+* results for the original problem, of which it is the transpose if
+* transposed is set. relax(i, visit) must call visit(j, cost) for the
+* feasible columns j of row i.
+*/
+template <typename Relax>
+void LinearAssignment::run(int numRows, int numColumns, double gate,
+                           bool transposed, Relax relax) {
+  bool gated = std::isfinite(gate);
+  int total = numColumns + (gated ? numRows : 0);
+  rowDual.assign(numRows, 0);
+  rowCost.assign(numRows, 0);
+  columnForRow.assign(numRows, -1);
+  columnDual.assign(total, 0);
+  shortest.assign(total, std::numeric_limits<double>::infinity());
+  pathCost.resize(total);
+  path.resize(total);
+  rowForColumn.assign(total, -1);
+  columnState.assign(total, UNSEEN);
+  scannedRows.reserve(numRows);
+  touched.reserve(total);
+  frontier.reserve(total);
+
+  for (int current = 0; current < numRows; current++) {
+    // Dijkstra search for the cheapest path from the new row to a free column
+    scannedRows.clear();
+    touched.clear();
+    frontier.clear();
+    double minimum = 0;
+    int sink = -1;
+    int row = current;
+    while (sink == -1) {
+      scannedRows.push_back(row);
+      double base = minimum - rowDual[row];
+      auto visit = [&](int j, double cost) {
+        if (columnState[j] == SCANNED) {
+          return;
+        }
+        double reduced = base + cost - columnDual[j];
+        if (reduced < shortest[j]) {
+          if (columnState[j] == UNSEEN) {
+            columnState[j] = FRONTIER;
+            touched.push_back(j);
+            frontier.push_back(j);
+          }
+          shortest[j] = reduced;
+          path[j] = row;
+          pathCost[j] = cost;
+        }
+      };
+      relax(row, visit);
+      if (gated) {
+        visit(numColumns + row, gate);
+      }
+
+      // Closest reached column, preferring free columns on ties
+      if (frontier.empty()) {
+        for (int j : touched) {
+          shortest[j] = std::numeric_limits<double>::infinity();
+          columnState[j] = UNSEEN;
+        }
+        std::cout << "Unable to solve the assignment problem, since row "
+                  << current << " has no feasible assignment left\n";
+        throw std::invalid_argument("No feasible assignment.");
+      }
+      int best = 0;
+      double lowest = shortest[frontier[0]];
+      for (int index = 1; index < (int)frontier.size(); index++) {
+        int j = frontier[index];
+        if ((shortest[j] < lowest) ||
+            ((shortest[j] == lowest) && (rowForColumn[j] == -1))) {
+          lowest = shortest[j];
+          best = index;
+        }
+      }
+      int column = frontier[best];
+      frontier[best] = frontier.back();
+      frontier.pop_back();
+      columnState[column] = SCANNED;
+      minimum = lowest;
+      if (rowForColumn[column] == -1) {
+        sink = column;
+      } else {
+        row = rowForColumn[column];
+      }
+    }
+
+    // Update the duals so the reduced costs stay nonnegative
+    rowDual[current] += minimum;
+    for (int i : scannedRows) {
+      if (i != current) {
+        rowDual[i] += minimum - shortest[columnForRow[i]];
+      }
+    }
+    for (int j : touched) {
+      if (columnState[j] == SCANNED) {
+        columnDual[j] -= minimum - shortest[j];
+      }
+      shortest[j] = std::numeric_limits<double>::infinity();
+      columnState[j] = UNSEEN;
+    }
+
+    // Flip the assignments along the path
+    int column = sink;
+    while (true) {
+      int i = path[column];
+      rowForColumn[column] = i;
+      rowCost[i] = pathCost[column];
+      std::swap(columnForRow[i], column);
+      if (i == current) {
+        break;
+      }
+    }
+  }
+
+  // Results for the original problem
+  rowAssignment.assign(rows, -1);
+  columnAssignment.assign(cols, -1);
+  totalCost = 0;
+  for (int i = 0; i < numRows; i++) {
+    int j = columnForRow[i];
+    if (j >= numColumns) {
+      continue;
+    }
+    totalCost += rowCost[i];
+    if (transposed) {
+      rowAssignment[j] = i;
+      columnAssignment[i] = j;
+    } else {
+      rowAssignment[i] = j;
+      columnAssignment[j] = i;
+    }
+  }
+}
+
+/*
+* Assigns the rows of the cost matrix to its columns and returns the sum of
+* the assigned costs.
+*
+* cost - The costs of every pair, with rows as tracks and columns as
+*        detections
+* gate - Largest cost of a feasible pair, and the cost of leaving a row
+*        unassigned. Without a gate every row or every column is assigned
+*/
+double LinearAssignment::solve(const MatrixView& cost, double gate) {
+  checkGate(gate);
+  rows = cost.getRows();
+  cols = cost.getColumns();
+  double limit = costLimit(gate);
+  bool transposed = !std::isfinite(gate) && (rows > cols);
+  const double* data = cost.getData();
+  long rowStride = cost.getRowStride();
+  long colStride = cost.getColumnStride();
+  if (transposed) {
+    std::swap(rowStride, colStride);
+  }
+  int numRows = transposed ? cols : rows;
+  int numColumns = transposed ? rows : cols;
+
+  auto relax = [&](int i, auto& visit) {
+    const double* row = data + i*rowStride;
+    if (colStride == 1) {
+      for (int j = 0; j < numColumns; j++) {
+        if (row[j] <= limit) {
+          visit(j, row[j]);
+        }
+      }
+    } else {
+      for (int j = 0; j < numColumns; j++) {
+        double value = row[j*colStride];
+        if (value <= limit) {
+          visit(j, value);
+        }
+      }
+    }
+  };
+  run(numRows, numColumns, gate, transposed, relax);
+  return totalCost;
+}
+
+/*
+* Assigns the rows of the sparse costs to its columns and returns the sum of
+* the assigned costs. Pairs that are not in the sparse costs are infeasible.
+*
+* cost - The candidate pairs
+* gate - Largest cost of a feasible pair, and the cost of leaving a row
+*        unassigned. Without a gate every row or every column is assigned
+*/
+double LinearAssignment::solve(const SparseCost& cost, double gate) {
+  checkGate(gate);
+  rows = cost.getRows();
+  cols = cost.getColumns();
+  double limit = costLimit(gate);
+  bool transposed = !std::isfinite(gate) && (rows > cols);
+  int numRows = transposed ? cols : rows;
+  int numColumns = transposed ? rows : cols;
+
+  // Sort the feasible entries by row, counting the entries of row r in
+  // rowStart[r + 2] and then filling row r from rowStart[r + 1]
+  rowStart.assign(numRows + 2, 0);
+  long count = 0;
+  for (long e = 0; e < cost.getCount(); e++) {
+    if (cost.getCost(e) <= limit) {
+      int row = transposed ? cost.getColumn(e) : cost.getRow(e);
+      rowStart[row + 2]++;
+      count++;
+    }
+  }
+  for (int r = 2; r < numRows + 2; r++) {
+    rowStart[r] += rowStart[r - 1];
+  }
+  sparseColumns.resize(count);
+  sparseCosts.resize(count);
+  for (long e = 0; e < cost.getCount(); e++) {
+    if (cost.getCost(e) <= limit) {
+      int row = transposed ? cost.getColumn(e) : cost.getRow(e);
+      long position = rowStart[row + 1]++;
+      sparseColumns[position] = transposed ? cost.getRow(e) : cost.getColumn(e);
+      sparseCosts[position] = cost.getCost(e);
+    }
+  }
+
+  auto relax = [&](int i, auto& visit) {
+    for (long e = rowStart[i]; e < rowStart[i + 1]; e++) {
+      visit(sparseColumns[e], sparseCosts[e]);
+    }
+  };
+  run(numRows, numColumns, gate, transposed, relax);
+  return totalCost;
+}
+
+/******************************************************************************
+* RESULTS                                                                     *
+******************************************************************************/
+
+/*
+* Returns the column assigned to every row, or -1 for unassigned rows.
+*/
+const std::vector<int>& LinearAssignment::getRowAssignment() const {
+  return rowAssignment;
+}
+
+/*
+* Returns the row assigned to every column, or -1 for unassigned columns.
+*/
+const std::vector<int>& LinearAssignment::getColumnAssignment() const {
+  return columnAssignment;
+}
+
+int LinearAssignment::getAssignedCount() const {
+  int count = 0;
+  for (int column : rowAssignment) {
+    count += (column != -1);
+  }
+  return count;
+}
+
+/*
+* Returns the sum of the assigned costs of the last solve, which does not
+* include the gate of unassigned rows.
+*/
+double LinearAssignment::getTotalCost() const {
+  return totalCost;
+}
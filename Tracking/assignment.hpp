@@ -0,0 +1,110 @@
+/******************************************************************************
+*                          Linear assignment                                  *
+*                                                                             *
+* Solves the rectangular linear assignment problem of associating tracks     *
+* (rows) with detections (columns) at the lowest total cost, with the         *
+* shortest augmenting path method of Jonker and Volgenant. Each row is added  *
+* with one Dijkstra search over the columns using reduced costs, which takes  *
+* O(rows^2 * columns) in the worst case and far less for typical costs.      *
+*                                                                             *
+* The costs are read straight from a Matrix or MatrixView, or from a          *
+* SparseCost that only holds the candidate pairs. Costs above the gate, as    *
+* well as infinite and NaN costs, are infeasible pairs that are never         *
+* assigned. Without a gate every row is assigned when there are at least as   *
+* many columns as rows, and every column otherwise. With a finite gate, a     *
+* row may also stay unassigned at a cost of gate, so the solver minimizes     *
+* the sum of the assigned costs plus gate for every unassigned row, and a     *
+* solution always exists.                                                     *
+*                                                                             *
+* A LinearAssignment keeps its work buffers between calls to solve, so       *
+* associating a new frame of the same size does not allocate:                *
+*                                                                             *
+*   LinearAssignment association;                                             *
+*   double total = association.solve(distances, gate);                        *
+*   const std::vector<int>& detection = association.getRowAssignment();       *
+*                                                                             *
+******************************************************************************/
+#ifndef ASSIGNMENT_HPP
+#define ASSIGNMENT_HPP
+
+#include <limits>
+#include <vector>
+
+#include "matrix.hpp"
+
+/*
+* The candidate pairs of an assignment problem, added in any order as
+* (row, column, cost) entries. reset keeps the storage of the entries, so a
+* SparseCost can be refilled every frame without allocating.
+*/
+class SparseCost {
+  private:
+    int rows;
+    int cols;
+    std::vector<int> entryRows;
+    std::vector<int> entryColumns;
+    std::vector<double> entryCosts;
+
+  public:
+    SparseCost();
+    SparseCost(int num_rows, int num_columns);
+
+    void reset(int num_rows, int num_columns);
+    void reserve(long entries);
+    void add(int row, int column, double cost);
+
+    int getRows() const;
+    int getColumns() const;
+    long getCount() const;
+    int getRow(long entry) const;
+    int getColumn(long entry) const;
+    double getCost(long entry) const;
+};
+
+class LinearAssignment {
+  private:
+    int rows;
+    int cols;
+    double totalCost;
+    std::vector<int> rowAssignment;
+    std::vector<int> columnAssignment;
+
+    // Work buffers of the search, indexed by internal row or column
+    std::vector<double> rowDual;
+    std::vector<double> columnDual;
+    std::vector<double> shortest;
+    std::vector<double> pathCost;
+    std::vector<double> rowCost;
+    std::vector<int> path;
+    std::vector<int> rowForColumn;
+    std::vector<int> columnForRow;
+    std::vector<unsigned char> columnState;
+    std::vector<int> scannedRows;
+    std::vector<int> touched;
+    std::vector<int> frontier;
+
+    // Candidate pairs of a SparseCost in compressed row order
+    std::vector<long> rowStart;
+    std::vector<int> sparseColumns;
+    std::vector<double> sparseCosts;
+
+    template <typename Relax>
+    void run(int numRows, int numColumns, double gate, bool transposed,
+             Relax relax);
+
+  public:
+    LinearAssignment();
+
+    double solve(const MatrixView& cost,
+                 double gate=std::numeric_limits<double>::infinity());
+    double solve(const SparseCost& cost,
+                 double gate=std::numeric_limits<double>::infinity());
+
+    // Results of the last solve. Unassigned rows and columns are -1
+    const std::vector<int>& getRowAssignment() const;
+    const std::vector<int>& getColumnAssignment() const;
+    int getAssignedCount() const;
+    double getTotalCost() const;
+};
+
+#endif
@@ -0,0 +1,827 @@
+/******************************************************************************
+*                          Matrix of any element type                         *
+*                                                                             *
+* BasicMatrix<T> holds a matrix of any arithmetic element type, stored in     *
+* row major order in an aligned array from allocator.hpp, just like Matrix.   *
+* It lets data stay in a narrow type until the math needs floating point:     *
+* a uint8_t frame buffer is 8 times smaller than the same frame in doubles,   *
+* and a float image fits twice as many elements in every vector register.     *
+*                                                                             *
+* Elementwise arithmetic on floats uses the vectorized float kernels.         *
+* Arithmetic between two integer matrices follows the rules of the built-in   *
+* types, so a sum of uint8_t matrices wraps around; use convert<float>()      *
+* first when the range matters. Arithmetic with a number is computed in       *
+* double and rounded and saturated to the element type, like convert<U>(),    *
+* so a uint8_t matrix times 0.5 is halved and plus 300 is 255 everywhere.     *
+* Products are computed with a plain loop and every operator returns a new    *
+* matrix, since the blocked products, views and lazy expressions are only     *
+* implemented for Matrix, which is the specialization for double defined in   *
+* matrix.hpp.                                                                 *
+*                                                                             *
+* convert<U>(scale, shift) creates a copy with a different element type using *
+* the vectorized conversions of convert.hpp, for example                      *
+* frame.convert<float>(1.0 / 255) to map pixels to [0, 1] and                 *
+* image.convert<uint8_t>(255) to map them back with rounding and saturation.  *
+*                                                                             *
+* borrow(), adopt() and release() wrap the array of a decoded frame or shared *
+* memory segment without copying it, in the same way as for Matrix.           *
+*                                                                             *
+* This header is included at the end of matrix.hpp and should not be          *
+* included on its own.                                                        *
+*                                                                             *
+******************************************************************************/
+#ifndef BASIC_MATRIX_HPP
+#define BASIC_MATRIX_HPP
+
+#include <limits>
+#include <type_traits>
+
+#include "convert.hpp"
+#include "kernels.hpp"
+
+/*
+* Elementwise loops used by the operators of BasicMatrix. The loops for 
+* floats are replaced by the vectorized kernels below, and the others are
+* left to the vectorizer, which is enabled for them at every optimization
+* level since small integer types gain the most from it.
+*/
+#define VECTORIZED_LOOP __attribute__((optimize("tree-vectorize")))
+
+/*
+* Loops with a number, computed in double and rounded and saturated to the
+* element type, so that multiplying a uint8_t matrix by 0.5 halves it and
+* adding 300 gives 255.
+*/
+template <typename Type>
+struct ScalarLoops {
+  VECTORIZED_LOOP
+  static void addScalar(Type* out, const Type* a, double value, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = saturateCast<Type>((double)a[i] + value);
+    }
+  }
+  VECTORIZED_LOOP
+  static void multiplyScalar(Type* out, const Type* a, double value, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = saturateCast<Type>((double)a[i] * value);
+    }
+  }
+  VECTORIZED_LOOP
+  static void divideScalar(Type* out, const Type* a, double value, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = saturateCast<Type>((double)a[i] / value);
+    }
+  }
+  VECTORIZED_LOOP
+  static void subtractFromScalar(Type* out, const Type* a, double value,
+                                 long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = saturateCast<Type>(value - (double)a[i]);
+    }
+  }
+  VECTORIZED_LOOP
+  static void divideScalarBy(Type* out, const Type* a, double value, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = saturateCast<Type>(value / (double)a[i]);
+    }
+  }
+};
+
+template <typename Type>
+struct ElementwiseLoops : ScalarLoops<Type> {
+  VECTORIZED_LOOP
+  static void add(Type* out, const Type* a, const Type* b, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = a[i] + b[i];
+    }
+  }
+  VECTORIZED_LOOP
+  static void subtract(Type* out, const Type* a, const Type* b, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = a[i] - b[i];
+    }
+  }
+  VECTORIZED_LOOP
+  static void multiply(Type* out, const Type* a, const Type* b, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = a[i] * b[i];
+    }
+  }
+  VECTORIZED_LOOP
+  static void divide(Type* out, const Type* a, const Type* b, long n) {
+    for (long i = 0; i < n; i++) {
+      out[i] = a[i] / b[i];
+    }
+  }
+};
+
+/*
+* A sum, difference, product or quotient of two floats computed in double and
+* rounded to float equals the one computed in float, so numbers that are
+* exactly floats go to the float kernels and only the others are computed in
+* double.
+*/
+template <>
+struct ElementwiseLoops<float> : ScalarLoops<float> {
+  static void add(float* out, const float* a, const float* b, long n) {
+    floatKernels().add(out, a, b, n);
+  }
+  static void subtract(float* out, const float* a, const float* b, long n) {
+    floatKernels().subtract(out, a, b, n);
+  }
+  static void multiply(float* out, const float* a, const float* b, long n) {
+    floatKernels().multiply(out, a, b, n);
+  }
+  static void divide(float* out, const float* a, const float* b, long n) {
+    floatKernels().divide(out, a, b, n);
+  }
+  static void addScalar(float* out, const float* a, double value, long n) {
+    if ((double)(float)value == value) {
+      floatKernels().addScalar(out, a, (float)value, n);
+    } else {
+      ScalarLoops<float>::addScalar(out, a, value, n);
+    }
+  }
+  static void multiplyScalar(float* out, const float* a, double value,
+                             long n) {
+    if ((double)(float)value == value) {
+      floatKernels().multiplyScalar(out, a, (float)value, n);
+    } else {
+      ScalarLoops<float>::multiplyScalar(out, a, value, n);
+    }
+  }
+  static void divideScalar(float* out, const float* a, double value, long n) {
+    if ((double)(float)value == value) {
+      floatKernels().divideScalar(out, a, (float)value, n);
+    } else {
+      ScalarLoops<float>::divideScalar(out, a, value, n);
+    }
+  }
+  static void subtractFromScalar(float* out, const float* a, double value,
+                                 long n) {
+    // Negating is exact, so -a + value rounds like value - a
+    if ((double)(float)value == value) {
+      floatKernels().multiplyScalar(out, a, -1.0f, n);
+      floatKernels().addScalar(out, out, (float)value, n);
+    } else {
+      ScalarLoops<float>::subtractFromScalar(out, a, value, n);
+    }
+  }
+};
+
+template <typename Type>
+class BasicMatrix {
+  static_assert(std::is_arithmetic<Type>::value,
+                "BasicMatrix elements must be of an arithmetic type");
+
+  private:
+    int rows;
+    int cols;
+    Type* matrix;
+    BufferDeleter<Type> deleter;
+    void* context;
+
+    BasicMatrix(Type* data, int num_rows, int num_columns,
+                BufferDeleter<Type> buffer_deleter, void* buffer_context);
+    void releaseArray();
+    void checkSize(const BasicMatrix& mat, const char* symbol) const;
+    struct index findExtreme(bool maximum) const;
+
+  public:
+    typedef Type Scalar;
+
+    // Constructors and destructor
+    BasicMatrix(int num_rows, int num_columns);
+    BasicMatrix(int num_rows, int num_columns, const Type data[]);
+    BasicMatrix(const BasicMatrix& mat);
+    BasicMatrix(BasicMatrix&& mat) noexcept;
+    ~BasicMatrix();
+
+    // Static methods for instatiating a specific type of matrix
+    static BasicMatrix zeros(int num_rows, int num_columns);
+    static BasicMatrix identity(int size);
+    static BasicMatrix multiply(const BasicMatrix& left,
+                                const BasicMatrix& right);
+    static BasicMatrix multiplyElementwise(const BasicMatrix& left,
+                                           const BasicMatrix& right);
+    static BasicMatrix borrow(Type* data, int num_rows, int num_columns);
+    static BasicMatrix adopt(Type* data, int num_rows, int num_columns,
+                             BufferDeleter<Type> buffer_deleter,
+                             void* buffer_context=nullptr);
+
+    // Getter functions
+    int getRows() const { return rows; }
+    int getColumns() const { return cols; }
+    Type* getData() { return matrix; }
+    const Type* getData() const { return matrix; }
+    bool isBorrowed() const { return deleter == keepBuffer<Type>; }
+
+    void print(int decimals=5) const;
+    BasicMatrix copy() const { return BasicMatrix(*this); }
+    void swap(BasicMatrix& mat) noexcept;
+    Type* release();
+    BasicMatrix T() const;
+    struct index minIndex() const;
+    struct index maxIndex() const;
+    Type min() const;
+    Type max() const;
+    template <typename U>
+    BasicMatrix<U> convert(double scale=1, double shift=0) const;
+
+    // Operators. operator[] returns a pointer to the start of a row and does
+    // not check the indices
+    Type& operator()(int row, int column);
+    const Type& operator()(int row, int column) const;
+    Type* operator[](int row) { return matrix + (long)row*cols; }
+    const Type* operator[](int row) const { return matrix + (long)row*cols; }
+    BasicMatrix& operator=(const BasicMatrix& mat);
+    BasicMatrix& operator=(BasicMatrix&& mat) noexcept;
+    BasicMatrix& operator*=(double num);
+    BasicMatrix& operator*=(const BasicMatrix& mat);
+    BasicMatrix& operator+=(double num);
+    BasicMatrix& operator+=(const BasicMatrix& mat);
+    BasicMatrix& operator-=(double num);
+    BasicMatrix& operator-=(const BasicMatrix& mat);
+    BasicMatrix& operator/=(double num);
+    BasicMatrix& operator/=(const BasicMatrix& mat);
+};
+
+/******************************************************************************
+* CONSTRUCTORS AND DESTRUCTOR                                                 *
+******************************************************************************/
+
+/*
+* Creates a matrix of the given size whose elements are not initialized.
+*/
+template <typename Type>
+BasicMatrix<Type>::BasicMatrix(int num_rows, int num_columns) :
+  rows(num_rows),
+  cols(num_columns),
+  matrix((Type*)allocateMatrixBytes((std::size_t)num_rows * num_columns *
+                                    sizeof(Type))),
+  deleter(nullptr),
+  context(nullptr)
+{}
+
+/*
+* Creates a matrix filled with the given data in row major order.
+*/
+template <typename Type>
+BasicMatrix<Type>::BasicMatrix(int num_rows, int num_columns, 
+                               const Type data[]) :
+  BasicMatrix(num_rows, num_columns)
+{
+  std::copy(data, data + (long)rows*cols, matrix);
+}
+
+template <typename Type>
+BasicMatrix<Type>::BasicMatrix(const BasicMatrix& mat) :
+  BasicMatrix(mat.rows, mat.cols)
+{
+  std::copy(mat.matrix, mat.matrix + (long)rows*cols, matrix);
+}
+
+template <typename Type>
+BasicMatrix<Type>::BasicMatrix(BasicMatrix&& mat) noexcept :
+  rows(mat.rows),
+  cols(mat.cols),
+  matrix(mat.matrix),
+  deleter(mat.deleter),
+  context(mat.context)
+{
+  mat.rows = 0;
+  mat.cols = 0;
+  mat.matrix = nullptr;
+  mat.deleter = nullptr;
+  mat.context = nullptr;
+}
+
+/*
+* Creates a matrix over an existing array, which is released with the given
+* deleter instead of releaseMatrixBytes.
+*/
+template <typename Type>
+BasicMatrix<Type>::BasicMatrix(Type* data, int num_rows, int num_columns,
+                               BufferDeleter<Type> buffer_deleter,
+                               void* buffer_context) :
+  rows(num_rows),
+  cols(num_columns),
+  matrix(data),
+  deleter(buffer_deleter),
+  context(buffer_context)
+{}
+
+template <typename Type>
+BasicMatrix<Type>::~BasicMatrix() {
+  releaseArray();
+}
+
+/******************************************************************************
+* STATIC METHODS                                                              *
+******************************************************************************/
+
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::zeros(int num_rows, int num_columns) {
+  BasicMatrix mat(num_rows, num_columns);
+  std::fill(mat.matrix, mat.matrix + (long)num_rows*num_columns, Type(0));
+  return mat;
+}
+
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::identity(int size) {
+  BasicMatrix mat = zeros(size, size);
+  for (int i = 0; i < size; i++) {
+    mat.matrix[(long)i*size + i] = 1;
+  }
+  return mat;
+}
+
+/*
+* Applies matrix multiplication to the two matrices, accumulating in the
+* element type. Checks are done to ensure that the dimensions allign.
+*/
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::multiply(const BasicMatrix& left,
+                                              const BasicMatrix& right) {
+  if (left.cols != right.rows) {
+    std::cout << "Unable to multiply matrices with incompatible dimensions: ("
+              << left.rows << ", " << left.cols << ") x (" << right.rows
+              << ", " << right.cols << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  BasicMatrix result = zeros(left.rows, right.cols);
+  for (int i = 0; i < left.rows; i++) {
+    Type* out = result.matrix + (long)i*result.cols;
+    for (int k = 0; k < left.cols; k++) {
+      Type value = left.matrix[(long)i*left.cols + k];
+      const Type* in = right.matrix + (long)k*right.cols;
+      for (int j = 0; j < right.cols; j++) {
+        out[j] += value * in[j];
+      }
+    }
+  }
+  return result;
+}
+
+/*
+* Performs element-wise multiplication of two matrices of the same size.
+*/
+template <typename Type>
+BasicMatrix<Type> 
+BasicMatrix<Type>::multiplyElementwise(const BasicMatrix& left,
+                                       const BasicMatrix& right) {
+  left.checkSize(right, "*");
+  BasicMatrix result(left.rows, left.cols);
+  ElementwiseLoops<Type>::multiply(result.matrix, left.matrix, right.matrix,
+                                   (long)left.rows*left.cols);
+  return result;
+}
+
+/*
+* Creates a matrix using the given array of the caller in row major order,
+* without copying it. The array is never released by the matrix and must
+* outlive it.
+*/
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::borrow(Type* data, int num_rows,
+                                            int num_columns) {
+  return BasicMatrix(data, num_rows, num_columns, keepBuffer<Type>, nullptr);
+}
+
+/*
+* Creates a matrix that takes ownership of the given array in row major order,
+* without copying it. The matrix calls deleter(data, context) once it no
+* longer uses the array, unless release() hands the array back first.
+*/
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::adopt(Type* data, int num_rows,
+                                           int num_columns,
+                                           BufferDeleter<Type> buffer_deleter,
+                                           void* buffer_context) {
+  if (buffer_deleter == nullptr) {
+    std::cout << "Unable to adopt an array without a deleter\n";
+    throw std::invalid_argument("Invalid buffer deleter.");
+  }
+  return BasicMatrix(data, num_rows, num_columns, buffer_deleter,
+                     buffer_context);
+}
+
+/******************************************************************************
+* PUBLIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Prints out the values of the matrix to the console. Integer elements are
+* printed as numbers, also when they are of a character type.
+*/
+template <typename Type>
+void BasicMatrix<Type>::print(int decimals) const {
+  std::cout << std::fixed;
+  std::cout << std::setprecision(decimals);
+  std::cout << "([";
+  for (int i = 0; i < rows; i++){
+    for (int j = 0; j < cols; j++) {
+      std::cout << +matrix[(long)i*cols + j];
+      if (j != (cols - 1)) {
+        std::cout << ", ";
+      }
+    }
+    if (i != (rows - 1)) {
+      std::cout << "],\n  ";
+    } else {
+      std::cout << "]";
+    }
+  }
+  std::cout << "], (" << rows << ", " << cols << "))\n";
+}
+
+template <typename Type>
+void BasicMatrix<Type>::swap(BasicMatrix& mat) noexcept {
+  std::swap(rows, mat.rows);
+  std::swap(cols, mat.cols);
+  std::swap(matrix, mat.matrix);
+  std::swap(deleter, mat.deleter);
+  std::swap(context, mat.context);
+}
+
+/*
+* Gives up the array without releasing it and returns it, leaving the matrix
+* empty with a size of (0, 0). An adopted or borrowed array goes back to the
+* caller without calling its deleter, and any other array must be released
+* with releaseMatrixBytes.
+*/
+template <typename Type>
+Type* BasicMatrix<Type>::release() {
+  Type* data = matrix;
+  rows = 0;
+  cols = 0;
+  matrix = nullptr;
+  deleter = nullptr;
+  context = nullptr;
+  return data;
+}
+
+/*
+* Returns the transpose of the matrix.
+*/
+template <typename Type>
+BasicMatrix<Type> BasicMatrix<Type>::T() const {
+  BasicMatrix result(cols, rows);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      result.matrix[(long)j*rows + i] = matrix[(long)i*cols + j];
+    }
+  }
+  return result;
+}
+
+/*
+* Finds the index (row, column) of the minimum value in the matrix, ignoring
+* NaN elements as Matrix::minIndex does. If multiple items have the same
+* value, the first instance in row major order is returned, and (-1, -1) is
+* returned if every element is NaN. Throws if the matrix is empty.
+*/
+template <typename Type>
+struct index BasicMatrix<Type>::minIndex() const {
+  return findExtreme(false);
+}
+
+/*
+* Finds the index (row, column) of the maximum value in the matrix, in the
+* same way as minIndex.
+*/
+template <typename Type>
+struct index BasicMatrix<Type>::maxIndex() const {
+  return findExtreme(true);
+}
+
+/*
+* Finds and returns the minimum value in the matrix, ignoring NaN elements.
+* Returns NaN if every element is NaN, and throws if the matrix is empty.
+*/
+template <typename Type>
+Type BasicMatrix<Type>::min() const {
+  struct index arrIndex = minIndex();
+  if (arrIndex.r < 0) {
+    return std::numeric_limits<Type>::quiet_NaN();
+  }
+  return matrix[(long)arrIndex.r*cols + arrIndex.c];
+}
+
+/*
+* Finds and returns the maximum value in the matrix, in the same way as min.
+*/
+template <typename Type>
+Type BasicMatrix<Type>::max() const {
+  struct index arrIndex = maxIndex();
+  if (arrIndex.r < 0) {
+    return std::numeric_limits<Type>::quiet_NaN();
+  }
+  return matrix[(long)arrIndex.r*cols + arrIndex.c];
+}
+
+/*
+* Creates a copy of the matrix with elements of type U, computing
+* value * scale + shift for every element. Conversions to integer types round
+* to the nearest value and saturate.
+*/
+template <typename Type>
+template <typename U>
+BasicMatrix<U> BasicMatrix<Type>::convert(double scale, double shift) const {
+  BasicMatrix<U> result(rows, cols);
+  convertElements(matrix, result.getData(), (long)rows*cols, scale, shift);
+  return result;
+}
+
+/*
+* Creates a copy of the matrix with elements of type U. See
+* BasicMatrix<Type>::convert.
+*/
+template <typename U>
+BasicMatrix<U> Matrix::convert(double scale, double shift) const {
+  BasicMatrix<U> result(rows, cols);
+  convertElements(matrix, result.getData(), (long)rows*cols, scale, shift);
+  return result;
+}
+
+/******************************************************************************
+* PRIVATE METHODS                                                             *
+******************************************************************************/
+
+/*
+* Releases the array in the way it was obtained.
+*/
+template <typename Type>
+void BasicMatrix<Type>::releaseArray() {
+  if (deleter == nullptr) {
+    releaseMatrixBytes(matrix);
+  } else {
+    deleter(matrix, context);
+    deleter = nullptr;
+    context = nullptr;
+  }
+}
+
+/*
+* Returns the index of the first minimum, or maximum, element in row major
+* order. NaN elements are skipped, since they compare false with everything
+* and would otherwise win whenever they come first. Throws if the matrix is
+* empty.
+*/
+template <typename Type>
+struct index BasicMatrix<Type>::findExtreme(bool maximum) const {
+  long count = (long)rows * cols;
+  if (count == 0) {
+    std::cout << "Invalid range (0:" << rows - 1 << ", 0:" << cols - 1
+              << ") for matrix with size (" << rows << "," << cols << ")\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  long arrIndex = -1;
+  for (long i = 0; i < count; i++) {
+    if (matrix[i] != matrix[i]) {
+      continue;
+    }
+    if ((arrIndex < 0) || (maximum ? (matrix[i] > matrix[arrIndex])
+                                   : (matrix[i] < matrix[arrIndex]))) {
+      arrIndex = i;
+    }
+  }
+  struct index returnIndex;
+  returnIndex.r = (arrIndex < 0) ? -1 : (int)(arrIndex/cols);
+  returnIndex.c = (arrIndex < 0) ? -1 : (int)(arrIndex%cols);
+  return returnIndex;
+}
+
+/*
+* Throws if the given matrix does not have the same size as this one.
+*/
+template <typename Type>
+void BasicMatrix<Type>::checkSize(const BasicMatrix& mat,
+                                  const char* symbol) const {
+  if ((rows != mat.rows) || (cols != mat.cols)) {
+    std::cout << "Unable to apply elementwise operation to matrices with "
+              << "differing dimensions: (" << rows << ", " << cols << ") "
+              << symbol << " (" << mat.rows << ", " << mat.cols << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/******************************************************************************
+* PUBLIC OPERATOR METHODS                                                     *
+******************************************************************************/
+
+/*
+* Allows indexing using (row, column) into the matrix, including negative
+* indices counted from the end. Index must exist within the size of the
+* matrix.
+*/
+template <typename Type>
+Type& BasicMatrix<Type>::operator()(int row, int column) {
+  if (((-rows > row) || (row >= rows)) ||
+      ((-cols > column) || (column >= cols))) {
+    std::string index = "(" + std::to_string(row) + "," +
+                        std::to_string(column) + ")";
+    std::string size = "(" + std::to_string(rows) + "," +
+                        std::to_string(cols) + ")";
+    std::cout << "Invalid index " << index << " for matrix with size "
+              << size << "\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  if (row < 0) {
+    row += rows;
+  }
+  if (column < 0) {
+    column += cols;
+  }
+  return matrix[(long)row*cols + column];
+}
+
+template <typename Type>
+const Type& BasicMatrix<Type>::operator()(int row, int column) const {
+  return const_cast<BasicMatrix&>(*this)(row, column);
+}
+
+/*
+* Copies the given matrix, reusing the existing array if it holds the same
+* number of elements.
+*/
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator=(const BasicMatrix& mat) {
+  if (this == &mat) {
+    return *this;
+  }
+  if ((long)rows*cols != (long)mat.rows*mat.cols) {
+    HeapScope heap;
+    BasicMatrix temp(mat);
+    swap(temp);
+    return *this;
+  }
+  rows = mat.rows;
+  cols = mat.cols;
+  std::copy(mat.matrix, mat.matrix + (long)rows*cols, matrix);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator=(BasicMatrix&& mat) noexcept {
+  swap(mat);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator*=(double num) {
+  ElementwiseLoops<Type>::multiplyScalar(matrix, matrix, num, (long)rows*cols);
+  return *this;
+}
+
+/*
+* Replaces the matrix with its matrix product with the given matrix.
+*/
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator*=(const BasicMatrix& mat) {
+  BasicMatrix result = multiply(*this, mat);
+  swap(result);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator+=(double num) {
+  ElementwiseLoops<Type>::addScalar(matrix, matrix, num, (long)rows*cols);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator+=(const BasicMatrix& mat) {
+  checkSize(mat, "+");
+  ElementwiseLoops<Type>::add(matrix, matrix, mat.matrix, (long)rows*cols);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator-=(double num) {
+  ElementwiseLoops<Type>::addScalar(matrix, matrix, -num, (long)rows*cols);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator-=(const BasicMatrix& mat) {
+  checkSize(mat, "-");
+  ElementwiseLoops<Type>::subtract(matrix, matrix, mat.matrix, (long)rows*cols);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator/=(double num) {
+  ElementwiseLoops<Type>::divideScalar(matrix, matrix, num, (long)rows*cols);
+  return *this;
+}
+
+template <typename Type>
+BasicMatrix<Type>& BasicMatrix<Type>::operator/=(const BasicMatrix& mat) {
+  checkSize(mat, "/");
+  ElementwiseLoops<Type>::divide(matrix, matrix, mat.matrix, (long)rows*cols);
+  return *this;
+}
+
+/******************************************************************************
+* OPERATOR FUNCTIONS FOR ACTING ON MATRICES OF ANY ELEMENT TYPE               *
+******************************************************************************/
+
+// The operators on matrices of doubles are the lazy expressions of 
+// expression.hpp, so these only apply to the other element types. The
+// operand taken by value is updated and moved out, so a temporary operand
+// is reused instead of copied
+template <typename Type>
+using BasicResult = 
+  typename std::enable_if<!std::is_same<Type, double>::value, 
+                          BasicMatrix<Type>>::type;
+
+template <typename Type>
+void swap(BasicMatrix<Type>& left, BasicMatrix<Type>& right) noexcept {
+  left.swap(right);
+}
+
+template <typename Type>
+BasicResult<Type> operator*(const BasicMatrix<Type>& left,
+                         const BasicMatrix<Type>& right) {
+  return BasicMatrix<Type>::multiply(left, right);
+}
+
+template <typename Type>
+BasicResult<Type> operator+(BasicMatrix<Type> left,
+                            const BasicMatrix<Type>& right) {
+  left += right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator-(BasicMatrix<Type> left,
+                            const BasicMatrix<Type>& right) {
+  left -= right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator/(BasicMatrix<Type> left,
+                            const BasicMatrix<Type>& right) {
+  left /= right;
+  return left;
+}
+
+// Operators with a number, which is not converted to the element type: the
+// result is computed in double and rounded and saturated to it
+template <typename Type>
+BasicResult<Type> operator+(BasicMatrix<Type> left, double right) {
+  left += right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator+(double left, BasicMatrix<Type> right) {
+  right += left;
+  return right;
+}
+
+template <typename Type>
+BasicResult<Type> operator-(BasicMatrix<Type> left, double right) {
+  left -= right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator-(double left, BasicMatrix<Type> right) {
+  Type* data = right.getData();
+  ElementwiseLoops<Type>::subtractFromScalar(data, data, left,
+                                             (long)right.getRows() *
+                                             right.getColumns());
+  return right;
+}
+
+template <typename Type>
+BasicResult<Type> operator*(BasicMatrix<Type> left, double right) {
+  left *= right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator*(double left, BasicMatrix<Type> right) {
+  right *= left;
+  return right;
+}
+
+template <typename Type>
+BasicResult<Type> operator/(BasicMatrix<Type> left, double right) {
+  left /= right;
+  return left;
+}
+
+template <typename Type>
+BasicResult<Type> operator/(double left, BasicMatrix<Type> right) {
+  Type* data = right.getData();
+  ElementwiseLoops<Type>::divideScalarBy(data, data, left,
+                                         (long)right.getRows() *
+                                         right.getColumns());
+  return right;
+}
+
+#endif
@@ -0,0 +1,1423 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "matrix.hpp"
+#include "kernels.hpp"
+#include "fixed_matrix.hpp"
+#include "parallel.hpp"
+#include "decomposition.hpp"
+#include "kalman.hpp"
+#include "kalman_batch.hpp"
+#include "assignment.hpp"
+#include "spatial_grid.hpp"
+#include "sparse_matrix.hpp"
+#include "reduce.hpp"
+#include "image.hpp"
+#include "filter.hpp"
+#include "integral.hpp"
+#include "morphology.hpp"
+#include "fft.hpp"
+#include "correlation.hpp"
+#include "pyramid.hpp"
+
+/*
+* Runs the given function until at least minSeconds have passed and returns 
+* the average time of a single call in seconds. The first call warms up the 
+* caches, and is used as the result if it alone takes longer than minSeconds.
+*/
+template <typename Function>
+double timeIt(Function function, double minSeconds=0.2) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  double elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start).count();
+  if (elapsed >= minSeconds) {
+    return elapsed;
+  }
+  long calls = 0;
+  start = std::chrono::steady_clock::now();
+  do {
+    function();
+    calls++;
+    elapsed = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < minSeconds);
+  return elapsed / calls;
+}
+
+/*
+* Fills a matrix of the given size with random values in [-1, 1].
+*/
+Matrix randomMatrix(int rows, int columns) {
+  Matrix mat(rows, columns);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < columns; j++) {
+      mat[i][j] = 2.0 * std::rand() / RAND_MAX - 1.0;
+    }
+  }
+  return mat;
+}
+
+/*
+* The original i-j-k multiplication loop through the bounds-checked [][] 
+* operator, kept as the reference for the multiplication benchmark.
+*/
+Matrix naiveMultiply(Matrix& left, Matrix& right) {
+  Matrix result(left.getRows(), right.getColumns());
+  double total = 0;
+  for (int r = 0; r < left.getRows(); r++) {
+    for (int c = 0; c < right.getColumns(); c++) {
+      for (int i = 0; i < left.getColumns(); i++) {
+        total += left[r][i] * right[i][c];
+      }
+      result[r][c] = total;
+      total = 0;
+    }
+  }
+  return result;
+}
+
+/*
+* Compares Matrix::multiply with the naive loop for square and tall-skinny 
+* products, reporting the time per product and the achieved GFLOP/s.
+*/
+void benchMultiply() {
+  std::cout << "\nMatrix multiplication (m x k) * (k x n):\n";
+  std::cout << std::setw(22) << "shape" << std::setw(14) << "naive ms" 
+            << std::setw(14) << "naive GF/s" << std::setw(14) << "gemm ms"
+            << std::setw(14) << "gemm GF/s" << std::setw(10) << "speedup"
+            << std::setw(12) << "max diff" << "\n";
+
+  int shapes[][3] = {
+    {4, 4, 4}, {8, 8, 8}, {16, 16, 16}, {32, 32, 32}, {64, 64, 64},
+    {128, 128, 128}, {256, 256, 256}, {512, 512, 512}, {1024, 1024, 1024},
+    {2048, 2048, 2048},
+    {1024, 8, 8}, {4096, 16, 16}, {65536, 8, 8}, {2048, 64, 2048}, 
+    {8, 2048, 2048}, {2048, 2048, 8}
+  };
+  for (auto& shape : shapes) {
+    int m = shape[0], k = shape[1], n = shape[2];
+    Matrix left = randomMatrix(m, k);
+    Matrix right = randomMatrix(k, n);
+    double flops = 2.0 * m * n * k;
+
+    Matrix expected(m, n);
+    Matrix actual(m, n);
+    double naive = timeIt([&]() { expected = naiveMultiply(left, right); });
+    double blocked = timeIt([&]() { actual = Matrix::multiply(left, right); });
+
+    double diff = 0;
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        diff = std::max(diff, std::fabs(expected[i][j] - actual[i][j]));
+      }
+    }
+
+    std::string name = std::to_string(m) + "x" + std::to_string(k) + "*" + 
+                       std::to_string(k) + "x" + std::to_string(n);
+    std::cout << std::setw(22) << name << std::fixed << std::setprecision(3)
+              << std::setw(14) << naive * 1e3 
+              << std::setw(14) << flops / naive * 1e-9
+              << std::setw(14) << blocked * 1e3
+              << std::setw(14) << flops / blocked * 1e-9
+              << std::setw(10) << std::setprecision(1) << naive / blocked 
+              << std::setw(12) << std::scientific << std::setprecision(1) 
+              << diff << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Measures the throughput of the elementwise operators for every instruction 
+* set supported by the CPU, on a matrix that fits in L1 and on a full HD 
+* frame. Throughput counts the bytes read and written by each operation.
+*/
+void benchElementwise() {
+  std::cout << "\nElementwise operators (GB/s):\n";
+  int sizes[][2] = {{64, 64}, {1080, 1920}};
+  KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, 
+                      KernelIsa::AVX512};
+  for (auto& size : sizes) {
+    Matrix left = randomMatrix(size[0], size[1]);
+    Matrix right = randomMatrix(size[0], size[1]);
+    Matrix ones = Matrix::zeros(size[0], size[1]) + 1.0;
+    Matrix out(size[0], size[1]);
+    double elements = (double)size[0] * size[1];
+    double binary = 3 * elements * sizeof(double);
+    double unary = 2 * elements * sizeof(double);
+
+    std::cout << size[0] << "x" << size[1] << ":\n";
+    std::cout << std::setw(10) << "isa" << std::setw(10) << "+=" 
+              << std::setw(10) << "-=" << std::setw(10) << "*=num" 
+              << std::setw(10) << "/=num" << std::setw(10) << "/=" 
+              << std::setw(10) << "elem *" << std::setw(10) << "num /" << "\n";
+    for (KernelIsa isa : isas) {
+      if (!setKernelIsa(isa)) {
+        continue;
+      }
+      double times[] = {
+        timeIt([&]() { out += right; }),
+        timeIt([&]() { out -= right; }),
+        timeIt([&]() { out *= 1.0; }),
+        timeIt([&]() { out /= 1.0; }),
+        timeIt([&]() { out /= ones; }),
+        timeIt([&]() { out = Matrix::multiplyElementwise(left, right); }),
+        timeIt([&]() { out = 1.0 / std::move(out); })
+      };
+      double bytes[] = {binary, binary, unary, unary, binary, binary, unary};
+      std::cout << std::setw(10) << isaName(isa) << std::fixed 
+                << std::setprecision(2);
+      for (int i = 0; i < 7; i++) {
+        std::cout << std::setw(10) << bytes[i] / times[i] * 1e-9;
+      }
+      std::cout << std::defaultfloat << std::endl;
+    }
+  }
+  setKernelIsa(kernels().isa);
+}
+
+/*
+* Compares a chained elementwise expression, which is fused into one pass, 
+* with the same calculation done one operator at a time.
+*/
+void benchExpression() {
+  std::cout << "\nFused expression out = 2.5 + a*2 - b/c (ms):\n";
+  std::cout << std::setw(12) << "size" << std::setw(12) << "stepwise" 
+            << std::setw(12) << "fused" << std::setw(10) << "speedup\n";
+  int sizes[] = {8, 64, 512, 2048};
+  for (int size : sizes) {
+    Matrix a = randomMatrix(size, size);
+    Matrix b = randomMatrix(size, size);
+    Matrix c = randomMatrix(size, size);
+    Matrix out(size, size);
+    double stepwise = timeIt([&]() {
+      Matrix scaled = a.copy();
+      scaled *= 2;
+      Matrix divided = b.copy();
+      divided /= c;
+      scaled += 2.5;
+      scaled -= divided;
+      out = scaled;
+    });
+    double fused = timeIt([&]() { out = 2.5 + a*2 - b/c; });
+    std::cout << std::setw(12) << size << std::fixed << std::setprecision(4)
+              << std::setw(12) << stepwise * 1e3 << std::setw(12) 
+              << fused * 1e3 << std::setw(10) << std::setprecision(1) 
+              << stepwise / fused << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Runs a constant velocity covariance prediction P = F*P*F' + Q and state 
+* prediction x = F*x for a state of size N with both Matrix and FixedMatrix.
+*/
+template <int N>
+void benchFixedPredict() {
+  FixedMatrix<N, N> fixedF = FixedMatrix<N, N>::identity();
+  for (int i = 0; i < N/2; i++) {
+    fixedF(i, i + N/2) = 0.1;
+  }
+  FixedMatrix<N, N> fixedP = FixedMatrix<N, N>::identity();
+  FixedMatrix<N, N> fixedQ = FixedMatrix<N, N>::identity() * 0.01;
+  FixedMatrix<N, 1> fixedX;
+  Matrix F = fixedF.toMatrix();
+  Matrix P = fixedP.toMatrix();
+  Matrix Q = fixedQ.toMatrix();
+  Matrix x = fixedX.toMatrix();
+  Matrix FT = F.T();
+  FixedMatrix<N, N> fixedFT = fixedF.T();
+
+  double dynamic = timeIt([&]() {
+    x = F * x;
+    P = F * P * FT + Q;
+    P *= 0.5;
+  });
+  double fixed = timeIt([&]() {
+    fixedX = fixedF * fixedX;
+    fixedP = fixedF * fixedP * fixedFT + fixedQ;
+    fixedP *= 0.5;
+  });
+  std::cout << std::setw(8) << N << std::fixed << std::setprecision(1)
+            << std::setw(14) << dynamic * 1e9 << std::setw(14) << fixed * 1e9
+            << std::setw(10) << dynamic / fixed << std::defaultfloat 
+            << std::endl;
+}
+
+/*
+* Compares the dynamically sized Matrix with FixedMatrix on the prediction 
+* step of small Kalman filters.
+*/
+void benchFixed() {
+  std::cout << "\nKalman prediction, Matrix vs FixedMatrix (ns per step):\n";
+  std::cout << std::setw(8) << "state" << std::setw(14) << "Matrix"
+            << std::setw(14) << "FixedMatrix" << std::setw(10) << "speedup\n";
+  benchFixedPredict<4>();
+  benchFixedPredict<6>();
+  benchFixedPredict<8>();
+}
+
+/*
+* Compares reading a column for a dot product through getColumn, which copies
+* the column, with a column view.
+*/
+void benchView() {
+  std::cout << "\nDot product of a row and a column (ns):\n";
+  std::cout << std::setw(12) << "size" << std::setw(14) << "getColumn" 
+            << std::setw(14) << "view" << std::setw(10) << "speedup\n";
+  int sizes[] = {8, 64, 512, 2048};
+  for (int size : sizes) {
+    Matrix mat = randomMatrix(size, size);
+    double result = 0;
+    double copied = timeIt([&]() {
+      Matrix row = mat.getRow(size / 2);
+      Matrix column = mat.getColumn(size / 2);
+      result += Matrix::multiply(row, column)(0, 0);
+    });
+    double viewed = timeIt([&]() {
+      result += dot(mat.view().row(size / 2), mat.view().column(size / 2));
+    });
+    std::cout << std::setw(12) << size << std::fixed << std::setprecision(1)
+              << std::setw(14) << copied * 1e9 << std::setw(14) 
+              << viewed * 1e9 << std::setw(10) << copied / viewed 
+              << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Compares a 1080x1920 frame stored as doubles, floats and uint8_t, and the
+* conversions between them, for every instruction set.
+*/
+void benchTypes() {
+  const int rows = 1080;
+  const int cols = 1920;
+  Matrix frame = randomMatrix(rows, cols) * 100.0 + 100.0;
+  Matrix doubleOut = frame;
+  BasicMatrix<float> floats = frame.convert<float>();
+  BasicMatrix<float> floatOut = floats;
+  BasicMatrix<std::uint8_t> bytes = frame.convert<std::uint8_t>();
+  BasicMatrix<std::uint8_t> byteOut = bytes;
+  std::cout << "\nElement types for a " << rows << "x" << cols 
+            << " frame (MB: double " << rows * cols * 8 / 1e6 << ", float " 
+            << rows * cols * 4 / 1e6 << ", uint8_t " << rows * cols / 1e6 
+            << "), ms per operation:\n";
+  std::cout << std::setw(10) << "isa" << std::setw(10) << "double +=" 
+            << std::setw(10) << "float +=" << std::setw(10) << "uint8 +=" 
+            << std::setw(10) << "u8->f32" << std::setw(10) << "f32->u8" 
+            << std::setw(10) << "u8->f64" << std::setw(10) << "f64->f32" 
+            << "\n";
+  KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, 
+                      KernelIsa::AVX512};
+  KernelIsa best = kernels().isa;
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    double times[] = {
+      timeIt([&]() { doubleOut += frame; }),
+      timeIt([&]() { floatOut += floats; }),
+      timeIt([&]() { byteOut += bytes; }),
+      timeIt([&]() { floatOut = bytes.convert<float>(1.0 / 255); }),
+      timeIt([&]() { byteOut = floats.convert<std::uint8_t>(); }),
+      timeIt([&]() { doubleOut = bytes.convert<double>(1.0 / 255); }),
+      timeIt([&]() { floatOut = frame.convert<float>(); })
+    };
+    std::cout << std::setw(10) << isaName(isa) << std::fixed 
+              << std::setprecision(3);
+    for (double time : times) {
+      std::cout << std::setw(10) << time * 1e3;
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+  setKernelIsa(best);
+}
+
+/*
+* Measures how large operations scale from one thread to one thread per 
+* hardware thread. Each row gives the time in ms and the speedup over a 
+* single thread.
+*/
+void benchThreads() {
+  int hardware = std::max(1, (int)std::thread::hardware_concurrency());
+  std::vector<int> counts;
+  for (int threads = 1; threads < hardware; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(hardware);
+
+  Matrix productLeft = randomMatrix(1024, 1024);
+  Matrix productRight = randomMatrix(1024, 1024);
+  Matrix left = randomMatrix(2048, 2048);
+  Matrix right = randomMatrix(2048, 2048);
+  Matrix out(2048, 2048);
+  std::cout << "\nThread scaling (ms, speedup over 1 thread):\n";
+  std::cout << std::setw(8) << "threads" << std::setw(20) << "multiply 1024" 
+            << std::setw(20) << "A + B 2048" << std::setw(20) 
+            << "maxIndex 2048" << std::setw(20) << "transpose 2048" << "\n";
+  double single[4];
+  for (int threads : counts) {
+    setMatrixThreads(threads);
+    double times[] = {
+      timeIt([&]() { out = productLeft * productRight; }),
+      timeIt([&]() { out = left + right; }),
+      timeIt([&]() { volatile int r = left.maxIndex().r; (void)r; }),
+      timeIt([&]() { out = left.T(); })
+    };
+    std::cout << std::setw(8) << threads << std::fixed;
+    for (int i = 0; i < 4; i++) {
+      if (threads == 1) {
+        single[i] = times[i];
+      }
+      std::cout << std::setw(12) << std::setprecision(2) << times[i] * 1e3 
+                << " (" << std::setprecision(1) << std::setw(4) 
+                << single[i] / times[i] << "x)";
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+  setMatrixThreads(0);
+}
+
+/*
+* The original out-of-place transpose, which copies the matrix and then walks
+* it element by element, kept as the reference for the transpose benchmark.
+*/
+Matrix naiveTranspose(const Matrix& mat) {
+  int rows = mat.getRows();
+  int cols = mat.getColumns();
+  Matrix copied = mat.copy();
+  Matrix result(cols, rows);
+  const double* in = copied.getData();
+  double* out = result.getData();
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      out[j*rows + i] = in[i*cols + j];
+    }
+  }
+  return result;
+}
+
+/*
+* Compares the naive transpose with the blocked out-of-place transpose and
+* the in-place transpose, for square matrices and video frames.
+*/
+void benchTranspose() {
+  std::cout << "\nTranspose (ms, GB/s read and written by T()):\n";
+  std::cout << std::setw(12) << "shape" << std::setw(12) << "naive ms" 
+            << std::setw(12) << "T() ms" << std::setw(10) << "GB/s" 
+            << std::setw(10) << "speedup" << std::setw(14) << "in-place ms" 
+            << "\n";
+  int shapes[][2] = {
+    {64, 64}, {256, 256}, {512, 512}, {1024, 1024}, {2048, 2048}, 
+    {1080, 1920}, {1920, 1080}, {480, 640}, {1000, 3000}
+  };
+  for (auto& shape : shapes) {
+    Matrix mat = randomMatrix(shape[0], shape[1]);
+    Matrix out(shape[1], shape[0]);
+    double naive = timeIt([&]() { out = naiveTranspose(mat); });
+    double blocked = timeIt([&]() { out = mat.T(); });
+    double inPlace = timeIt([&]() { mat.transpose(); });
+    double bytes = 2.0 * sizeof(double) * shape[0] * shape[1];
+
+    std::string name = std::to_string(shape[0]) + "x" + 
+                       std::to_string(shape[1]);
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(3)
+              << std::setw(12) << naive * 1e3 << std::setw(12) 
+              << blocked * 1e3 << std::setprecision(2) << std::setw(10) 
+              << bytes / blocked * 1e-9 << std::setw(9) << naive / blocked 
+              << "x" << std::setprecision(3) << std::setw(14) 
+              << inPlace * 1e3 << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Inverts a matrix by Gauss-Jordan elimination with partial pivoting on the 
+* augmented matrix [A | I], kept as the reference for the solver benchmark.
+*/
+Matrix gaussJordanInverse(const Matrix& mat) {
+  int n = mat.getRows();
+  Matrix augmented = Matrix::zeros(n, 2*n);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      augmented[i][j] = mat(i, j);
+    }
+    augmented[i][n + i] = 1;
+  }
+  for (int k = 0; k < n; k++) {
+    int pivot = k;
+    for (int i = k + 1; i < n; i++) {
+      if (std::fabs(augmented[i][k]) > std::fabs(augmented[pivot][k])) {
+        pivot = i;
+      }
+    }
+    for (int j = 0; j < 2*n; j++) {
+      std::swap(augmented[k][j], augmented[pivot][j]);
+    }
+    double diagonal = augmented[k][k];
+    for (int j = 0; j < 2*n; j++) {
+      augmented[k][j] /= diagonal;
+    }
+    for (int i = 0; i < n; i++) {
+      double factor = augmented[i][k];
+      if ((i == k) || (factor == 0)) {
+        continue;
+      }
+      for (int j = 0; j < 2*n; j++) {
+        augmented[i][j] -= factor * augmented[k][j];
+      }
+    }
+  }
+  return augmented.block(0, -1, n, -1).copy();
+}
+
+/*
+* Returns the largest absolute element of A*X - B.
+*/
+double residual(const Matrix& mat, const Matrix& solution, const Matrix& rhs) {
+  Matrix difference = mat * solution - rhs;
+  return std::max(difference.max(), -difference.min());
+}
+
+/*
+* Compares solving A*X = B for four right-hand sides by multiplying with a 
+* Gauss-Jordan inverse against the LU and Cholesky decompositions, for 
+* symmetric positive definite matrices such as innovation covariances.
+*/
+void benchSolve() {
+  std::cout << "\nSolving A*X = B with 4 right-hand sides (us, residual):\n";
+  std::cout << std::setw(6) << "n" << std::setw(24) << "Gauss-Jordan inverse" 
+            << std::setw(24) << "LU" << std::setw(24) << "Cholesky" 
+            << std::setw(10) << "speedup" << "\n";
+  int sizes[] = {2, 4, 8, 16, 32, 64, 128, 256, 512};
+  for (int n : sizes) {
+    Matrix base = randomMatrix(n, n);
+    Matrix mat = base * base.T() + Matrix::identity(n) * n;
+    Matrix rhs = randomMatrix(n, 4);
+    Matrix inverseSolution(n, 4);
+    Matrix luSolution(n, 4);
+    Matrix choleskySolution(n, 4);
+    LUDecomposition lu;
+    CholeskyDecomposition cholesky;
+
+    double inverse = timeIt([&]() { 
+      inverseSolution = gaussJordanInverse(mat) * rhs; 
+    });
+    double luTime = timeIt([&]() { 
+      lu.compute(mat); 
+      luSolution = rhs;
+      lu.solveInPlace(luSolution); 
+    });
+    double choleskyTime = timeIt([&]() { 
+      cholesky.compute(mat); 
+      choleskySolution = rhs;
+      cholesky.solveInPlace(choleskySolution); 
+    });
+
+    std::cout << std::setw(6) << n << std::fixed << std::setprecision(2)
+              << std::setw(14) << inverse * 1e6 << std::scientific 
+              << std::setprecision(1) << std::setw(10) 
+              << residual(mat, inverseSolution, rhs) << std::fixed 
+              << std::setprecision(2) << std::setw(14) << luTime * 1e6 
+              << std::scientific << std::setprecision(1) << std::setw(10) 
+              << residual(mat, luSolution, rhs) << std::fixed 
+              << std::setprecision(2) << std::setw(14) << choleskyTime * 1e6 
+              << std::scientific << std::setprecision(1) << std::setw(10) 
+              << residual(mat, choleskySolution, rhs) << std::fixed
+              << std::setw(9) << inverse / choleskyTime << "x" 
+              << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Creates a filter for a constant velocity (order 1) or constant acceleration
+* (order 2) model in two dimensions that measures positions.
+*/
+KalmanFilter motionFilter(int order, double dt, bool joseph) {
+  int axis = order + 1;
+  Matrix F = Matrix::zeros(2*axis, 2*axis);
+  Matrix H = Matrix::zeros(2, 2*axis);
+  for (int a = 0; a < 2; a++) {
+    for (int i = 0; i < axis; i++) {
+      double term = 1;
+      for (int j = i; j < axis; j++) {
+        F(a*axis + i, a*axis + j) = term;
+        term *= dt / (j - i + 1);
+      }
+    }
+    H(a, a*axis) = 1;
+  }
+  KalmanFilter filter(2*axis, 2);
+  filter.setTransition(F);
+  filter.setProcessNoise(Matrix::identity(2*axis) * 0.01);
+  filter.setMeasurementMatrix(H);
+  filter.setMeasurementNoise(Matrix::identity(2) * 0.25);
+  filter.setJosephForm(joseph);
+  return filter;
+}
+
+/*
+* Reports the time of one predict and update of the Kalman filter for the 
+* constant velocity and constant acceleration models, next to the same steps
+* written as matrix expressions with an inverse.
+*/
+void benchKalman() {
+  std::cout << "\nKalman predict + update (ns per step):\n";
+  std::cout << std::setw(22) << "model" << std::setw(14) << "expressions" 
+            << std::setw(14) << "filter" << std::setw(14) << "Joseph" 
+            << std::setw(10) << "speedup" << "\n";
+  const char* names[] = {"constant velocity 4D", "constant accel 6D"};
+  for (int order = 1; order <= 2; order++) {
+    KalmanFilter filter = motionFilter(order, 0.1, false);
+    KalmanFilter josephFilter = motionFilter(order, 0.1, true);
+    int n = filter.getStateSize();
+    Matrix F = filter.getTransition();
+    Matrix H = filter.getMeasurementMatrix();
+    Matrix Q = filter.getProcessNoise();
+    Matrix R = filter.getMeasurementNoise();
+    Matrix x = Matrix::zeros(n, 1);
+    Matrix P = Matrix::identity(n);
+    Matrix z = Matrix::zeros(2, 1);
+    const int steps = 1000;
+
+    double expressions = timeIt([&]() {
+      for (int i = 0; i < steps; i++) {
+        z(0, 0) = i * 0.1;
+        x = F * x;
+        P = F * P * F.T() + Q;
+        Matrix S = H * P * H.T() + R;
+        Matrix K = P * H.T() * S.inverse();
+        x += K * (z - H * x);
+        P = (Matrix::identity(n) - K * H) * P;
+      }
+    }) / steps;
+    double standard = timeIt([&]() {
+      for (int i = 0; i < steps; i++) {
+        z(0, 0) = i * 0.1;
+        filter.predict();
+        filter.update(z);
+      }
+    }) / steps;
+    double joseph = timeIt([&]() {
+      for (int i = 0; i < steps; i++) {
+        z(0, 0) = i * 0.1;
+        josephFilter.predict();
+        josephFilter.update(z);
+      }
+    }) / steps;
+    std::cout << std::setw(22) << names[order - 1] << std::fixed 
+              << std::setprecision(0) << std::setw(14) << expressions * 1e9 
+              << std::setw(14) << standard * 1e9 << std::setw(14) 
+              << joseph * 1e9 << std::setprecision(1) << std::setw(9) 
+              << expressions / standard << "x" << std::defaultfloat 
+              << std::endl;
+  }
+}
+
+/*
+* Reports the throughput of predict and update for many constant velocity 
+* tracks, in tracks per second on one thread, for the batched filter with 
+* every instruction set and for one KalmanFilter per track.
+*/
+void benchBatch() {
+  std::cout << "\nBatched Kalman predict + update, constant velocity 4D "
+            << "(million tracks/s per core):\n";
+  KalmanFilter model = motionFilter(1, 0.1, false);
+  KernelIsa original = kernels().isa;
+  KernelIsa isas[] = {KernelIsa::Scalar, KernelIsa::SSE2, KernelIsa::AVX2, 
+                      KernelIsa::AVX512};
+  std::cout << std::setw(8) << "tracks" << std::setw(12) << "separate";
+  for (KernelIsa isa : isas) {
+    if (setKernelIsa(isa)) {
+      std::cout << std::setw(10) << isaName(isa);
+    }
+  }
+  std::cout << std::setw(10) << "speedup" << "\n";
+  setMatrixThreads(1);
+  for (long tracks : {10L, 100L, 1000L, 10000L, 100000L}) {
+    Matrix positions(2, tracks);
+    for (long t = 0; t < tracks; t++) {
+      positions(0, t) = t * 0.5;
+      positions(1, t) = -t * 0.25;
+    }
+
+    // One filter and one measurement per track, updated in turn
+    std::vector<KalmanFilter> filters(tracks, model);
+    std::vector<Matrix> measurements(tracks, Matrix::zeros(2, 1));
+    for (long t = 0; t < tracks; t++) {
+      measurements[t](0, 0) = positions(0, t);
+      measurements[t](1, 0) = positions(1, t);
+    }
+    double separate = timeIt([&]() {
+      for (long t = 0; t < tracks; t++) {
+        filters[t].predict();
+        filters[t].update(measurements[t]);
+      }
+    });
+    std::cout << std::setw(8) << tracks << std::fixed << std::setprecision(2)
+              << std::setw(12) << tracks / separate * 1e-6;
+
+    double best = 0;
+    for (KernelIsa isa : isas) {
+      if (!setKernelIsa(isa)) {
+        continue;
+      }
+      KalmanBatch batch(4, 2);
+      batch.setTransition(model.getTransition());
+      batch.setProcessNoise(model.getProcessNoise());
+      batch.setMeasurementMatrix(model.getMeasurementMatrix());
+      batch.setMeasurementNoise(model.getMeasurementNoise());
+      batch.reserve(tracks);
+      for (long t = 0; t < tracks; t++) {
+        batch.addTrack(model.getState(), model.getCovariance());
+      }
+      double time = timeIt([&]() {
+        batch.predict();
+        batch.update(positions);
+      });
+      best = std::max(best, tracks / time);
+      std::cout << std::setw(10) << tracks / time * 1e-6;
+    }
+    std::cout << std::setprecision(1) << std::setw(9) 
+              << best * separate / tracks << "x" << std::defaultfloat 
+              << std::endl;
+  }
+  setKernelIsa(original);
+  setMatrixThreads(0);
+}
+
+/*
+* Reports the time to associate n tracks with n detections scattered around
+* them, with squared distances as costs. The dense problem has no gate, and
+* the gated problem is solved from the dense matrix and from sparse costs
+* that only hold the pairs inside the gate.
+*/
+void benchAssignment() {
+  std::cout << "\nLinear assignment of n tracks to n detections (ms):\n";
+  std::cout << std::setw(6) << "n" << std::setw(12) << "dense" 
+            << std::setw(12) << "gated" << std::setw(12) << "sparse" 
+            << std::setw(12) << "pairs/row" << "\n";
+  LinearAssignment association;
+  SparseCost candidates;
+  const double gate = 25;
+  for (int n : {100, 500, 1000, 2000, 5000}) {
+    double side = 10 * std::sqrt((double)n);
+    Matrix tracks = (randomMatrix(n, 2) + 1) * (side / 2);
+    Matrix detections = tracks + randomMatrix(n, 2) * 3;
+    Matrix costs(n, n);
+    candidates.reset(n, n);
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++) {
+        double dx = tracks(i, 0) - detections(j, 0);
+        double dy = tracks(i, 1) - detections(j, 1);
+        costs(i, j) = dx*dx + dy*dy;
+        if (costs(i, j) <= gate) {
+          candidates.add(i, j, costs(i, j));
+        }
+      }
+    }
+    double dense = timeIt([&]() { association.solve(costs); });
+    double gated = timeIt([&]() { association.solve(costs, gate); });
+    double sparse = timeIt([&]() { association.solve(candidates, gate); });
+    std::cout << std::setw(6) << n << std::fixed << std::setprecision(3) 
+              << std::setw(12) << dense * 1e3 << std::setw(12) 
+              << gated * 1e3 << std::setw(12) << sparse * 1e3 
+              << std::setprecision(1) << std::setw(12) 
+              << (double)candidates.getCount() / n << std::defaultfloat 
+              << std::endl;
+  }
+}
+
+/*
+* Reports the time of gating n tracks against n detections with the spatial
+* grid, and of the association of the gated pairs, next to filling the dense
+* matrix of squared distances for the sizes where it fits in memory.
+*/
+void benchGating() {
+  std::cout << "\nGating and association of n tracks and n detections (ms):"
+            << "\n";
+  std::cout << std::setw(8) << "n" << std::setw(12) << "dense fill" 
+            << std::setw(12) << "grid" << std::setw(12) << "assignment" 
+            << std::setw(12) << "pairs/row" << "\n";
+  SpatialGrid grid;
+  SparseCost candidates;
+  LinearAssignment association;
+  const double gate = 5;
+  for (int n : {1000, 5000, 20000, 100000}) {
+    double side = 10 * std::sqrt((double)n);
+    Matrix tracks = (randomMatrix(n, 2) + 1) * (side / 2);
+    Matrix detections = tracks + randomMatrix(n, 2) * 3;
+
+    double dense = 0;
+    if (n <= 5000) {
+      Matrix costs(n, n);
+      const double* track = tracks.getData();
+      const double* detection = detections.getData();
+      dense = timeIt([&]() {
+        for (int i = 0; i < n; i++) {
+          double* row = costs.getData() + (long)i*n;
+          for (int j = 0; j < n; j++) {
+            double dx = track[2*i] - detection[2*j];
+            double dy = track[2*i + 1] - detection[2*j + 1];
+            row[j] = dx*dx + dy*dy;
+          }
+        }
+      });
+    }
+    double gridTime = timeIt([&]() {
+      grid.build(tracks, gate);
+      grid.findPairs(detections, gate, candidates);
+    });
+    double solve = timeIt([&]() { 
+      association.solve(candidates, gate*gate); 
+    });
+    std::cout << std::setw(8) << n << std::fixed << std::setprecision(3);
+    if (dense > 0) {
+      std::cout << std::setw(12) << dense * 1e3;
+    } else {
+      std::cout << std::setw(12) << "-";
+    }
+    std::cout << std::setw(12) << gridTime * 1e3 << std::setw(12) 
+              << solve * 1e3 << std::setprecision(1) << std::setw(12) 
+              << (double)candidates.getCount() / n << std::defaultfloat 
+              << std::endl;
+  }
+}
+
+/*
+* Compares products of a sparse matrix in CSR and CSC format with a vector 
+* and with a dense matrix of 16 columns against the same dense products, for
+* several densities.
+*/
+void benchSparse() {
+  const int size = 4000;
+  std::cout << "\nSparse (" << size << " x " << size 
+            << ") products (ms):\n";
+  std::cout << std::setw(9) << "density" << std::setw(11) << "dense Ax" 
+            << std::setw(10) << "CSR Ax" << std::setw(10) << "CSC Ax" 
+            << std::setw(11) << "dense AB" << std::setw(10) << "CSR AB" 
+            << std::setw(10) << "CSC AB" << "\n";
+  Matrix vector = randomMatrix(size, 1);
+  Matrix factor = randomMatrix(size, 16);
+  for (double density : {0.001, 0.01, 0.05}) {
+    Matrix dense = Matrix::zeros(size, size);
+    long nonZeros = (long)(density * size * size);
+    for (long k = 0; k < nonZeros; k++) {
+      dense(std::rand() % size, std::rand() % size) = 1.0 + k % 7;
+    }
+    SparseMatrix csr = SparseMatrix::fromDense(dense);
+    SparseMatrix csc = SparseMatrix::fromDense(dense, SparseFormat::CSC);
+    double times[] = {
+      timeIt([&]() { Matrix result = dense * vector; }),
+      timeIt([&]() { Matrix result = csr * vector; }),
+      timeIt([&]() { Matrix result = csc * vector; }),
+      timeIt([&]() { Matrix result = dense * factor; }),
+      timeIt([&]() { Matrix result = csr * factor; }),
+      timeIt([&]() { Matrix result = csc * factor; })
+    };
+    std::cout << std::setw(8) << density * 100 << "%" << std::fixed 
+              << std::setprecision(3);
+    for (int t = 0; t < 6; t++) {
+      std::cout << std::setw((t % 3 == 0) ? 11 : 10) << times[t] * 1e3;
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Compares the fused reduction of a matrix with finding its minimum, maximum,
+* their positions and its sum separately, and reports the time of the 
+* reductions of a block and of every row and column.
+*/
+void benchReduce() {
+  const int size = 2000;
+  std::cout << "\nReductions of a (" << size << " x " << size 
+            << ") matrix (ms):\n";
+  Matrix mat = randomMatrix(size, size);
+  double sink = 0;
+  double separate = timeIt([&]() {
+    struct index low = mat.minIndex();
+    struct index high = mat.maxIndex();
+    double total = 0;
+    const double* data = mat.getData();
+    for (long i = 0; i < (long)size * size; i++) {
+      total += data[i];
+    }
+    sink += mat.min() + mat.max() + low.r + high.c + total;
+  });
+  double fused = timeIt([&]() { sink += reduce(mat).sum; });
+  double range = timeIt([&]() { 
+    sink += mat.minRange(100, 1899, 100, 1899); 
+  });
+  double rows = timeIt([&]() { sink += reduce(mat, 1)[0].sum; });
+  double columns = timeIt([&]() { sink += reduce(mat, 0)[0].sum; });
+  std::cout << std::fixed << std::setprecision(3) 
+            << "  separate min/max/indices/sum: " << separate * 1e3 << "\n"
+            << "  fused reduce:                 " << fused * 1e3 << " (" 
+            << std::setprecision(1) << separate / fused << "x)\n" 
+            << std::setprecision(3)
+            << "  minRange of a block:          " << range * 1e3 << "\n"
+            << "  per row:                      " << rows * 1e3 << "\n"
+            << "  per column:                   " << columns * 1e3 
+            << std::defaultfloat << (sink == 0 ? " " : "") << std::endl;
+}
+
+/*
+* Compares centering and scaling the columns of a matrix with a loop through
+* the row proxies, with a tiled matrix of means and with broadcasting.
+*/
+void benchBroadcast() {
+  const int size = 2000;
+  std::cout << "\nCentering the columns of a (" << size << " x " << size 
+            << ") matrix (ms):\n";
+  Matrix mat = randomMatrix(size, size);
+  Matrix result(size, size);
+  Matrix means = mean(mat, 0);
+  Matrix scales = max(mat, 1);
+  double loop = timeIt([&]() {
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        result[i][j] = mat[i][j] - means[0][j];
+      }
+    }
+  });
+  double tiled = timeIt([&]() {
+    Matrix tiles(size, size);
+    for (int i = 0; i < size; i++) {
+      tiles.block(i, i) = means;
+    }
+    result = mat - tiles;
+  });
+  double rows = timeIt([&]() { result = mat - means; });
+  double columns = timeIt([&]() { result = mat / scales; });
+  double fused = timeIt([&]() { result = (mat - means) / scales + 1.0; });
+  double axis = timeIt([&]() { means = mean(mat, 0); });
+  std::cout << std::fixed << std::setprecision(3) 
+            << "  loop through rows:      " << loop * 1e3 << "\n"
+            << "  tiled means:            " << tiled * 1e3 << "\n"
+            << "  broadcast row:          " << rows * 1e3 << " (" 
+            << std::setprecision(1) << loop / rows << "x)\n" 
+            << std::setprecision(3)
+            << "  broadcast column:       " << columns * 1e3 << "\n"
+            << "  (mat - row) / col + 1:  " << fused * 1e3 << "\n"
+            << "  column means:           " << axis * 1e3 
+            << std::defaultfloat << std::endl;
+}
+
+/*
+* Compares appending detections one row at a time by copying into a new
+* matrix, as concatenation used to, with pushRow() into spare capacity, and
+* stacking many blocks at once with appending them one after another.
+*/
+void benchAppend() {
+  const int count = 5000;
+  std::cout << "\nAppending " << count << " rows of 4 elements (ms):\n";
+  Matrix detections = randomMatrix(count, 4);
+  double sink = 0;
+  double copied = timeIt([&]() {
+    Matrix grown(0, 4);
+    for (int i = 0; i < count; i++) {
+      Matrix next(grown.getRows() + 1, 4);
+      if (i > 0) {
+        next.block(0, i - 1) = grown;
+      }
+      next.block(i, i) = detections.block(i, i);
+      grown = std::move(next);
+    }
+    sink += grown(count - 1, 3);
+  });
+  double pushed = timeIt([&]() {
+    Matrix grown(0, 4);
+    for (int i = 0; i < count; i++) {
+      grown.pushRow(detections.view().row(i));
+    }
+    sink += grown(count - 1, 3);
+  });
+  double reserved = timeIt([&]() {
+    Matrix grown(0, 4);
+    grown.reserve(count, 4);
+    for (int i = 0; i < count; i++) {
+      grown.pushRow(detections.view().row(i));
+    }
+    sink += grown(count - 1, 3);
+  });
+  std::vector<MatrixView> parts;
+  for (int i = 0; i < count; i += 50) {
+    parts.push_back(detections.block(i, i + 49));
+  }
+  double appended = timeIt([&]() {
+    Matrix grown(0, 4);
+    for (const MatrixView& part : parts) {
+      grown.concatenate(Matrix(part), 1);
+    }
+    sink += grown(count - 1, 3);
+  });
+  double stacked = timeIt([&]() { sink += Matrix::stack(parts)(0, 0); });
+  std::cout << std::fixed << std::setprecision(3) 
+            << "  copy per row:           " << copied * 1e3 << "\n"
+            << "  pushRow:                " << pushed * 1e3 << " (" 
+            << std::setprecision(1) << copied / pushed << "x)\n" 
+            << std::setprecision(3)
+            << "  reserve and pushRow:    " << reserved * 1e3 << "\n"
+            << "  concatenate 100 blocks: " << appended * 1e3 << "\n"
+            << "  stack 100 blocks:       " << stacked * 1e3 
+            << std::defaultfloat << (sink == 0 ? " " : "") << std::endl;
+}
+
+/*
+* Compares handing a frame that is already in memory to a matrix by copying
+* it with the data constructor, and by borrowing or adopting its array.
+*/
+void benchBuffers() {
+  const int height = 1080;
+  const int width = 1920;
+  std::cout << "\nWrapping a (" << height << " x " << width 
+            << ") frame (ms):\n";
+  Matrix source = randomMatrix(height, width);
+  double* frame = source.getData();
+  double sink = 0;
+  double copied = timeIt([&]() {
+    Matrix mat(height, width, frame);
+    sink += mat(height - 1, width - 1);
+  });
+  double borrowed = timeIt([&]() {
+    Matrix mat = Matrix::borrow(frame, height, width);
+    sink += mat(height - 1, width - 1);
+  });
+  double adopted = timeIt([&]() {
+    Matrix mat = Matrix::adopt(frame, height, width, 
+                               [](double*, void*) {});
+    sink += mat(height - 1, width - 1);
+    mat.release();
+  });
+  std::cout << std::fixed << std::setprecision(4) 
+            << "  copy:    " << copied * 1e3 << "\n"
+            << "  borrow:  " << borrowed * 1e3 << "\n"
+            << "  adopt:   " << adopted * 1e3 
+            << std::defaultfloat << (sink == 0 ? " " : "") << std::endl;
+}
+
+/*
+* Measures Gaussian blurs and Sobel gradients of 4K frames, against a direct
+* 2-D filter with a kernel of the same size that is not separable.
+*/
+void benchFilter() {
+  const int width = 3840;
+  const int height = 2160;
+  std::cout << "\nFiltering (" << width << " x " << height 
+            << ") frames (ms):\n";
+  for (int channels : {1, 3}) {
+    Image frame(width, height, channels);
+    for (int y = 0; y < height; y++) {
+      float* row = frame.row(y);
+      for (long x = 0; x < (long)width * channels; x++) {
+        row[x] = (float)((x * 7 + y * 13) % 256);
+      }
+    }
+    Image blurred;
+    Image dx;
+    Image dy;
+    std::vector<float> gaussian = gaussianKernel(2.0);
+    int taps = (int)gaussian.size();
+    Matrix kernel(taps, taps);
+    for (int i = 0; i < taps; i++) {
+      for (int j = 0; j < taps; j++) {
+        kernel(i, j) = gaussian[i] * gaussian[j];
+      }
+    }
+    kernel(0, 0) += 1e-3;
+    double blur = timeIt([&]() { gaussianBlur(frame, blurred, 2.0); });
+    double gradients = timeIt([&]() { sobel(frame, dx, dy); });
+    double direct = timeIt([&]() { filter2D(frame, blurred, kernel); });
+    std::cout << std::fixed << std::setprecision(1) 
+              << "  " << channels << " channel" << (channels > 1 ? "s" : " ")
+              << " Gaussian (sigma 2, " << taps << " taps): " << blur * 1e3 
+              << " (" << 1 / blur << " fps)\n"
+              << "             Sobel dx and dy:             "
+              << gradients * 1e3 << " (" << 1 / gradients << " fps)\n"
+              << "             direct " << taps << " x " << taps 
+              << " filter:       " << direct * 1e3 << " (" 
+              << direct / blur << "x slower)" << std::defaultfloat 
+              << std::endl;
+  }
+}
+
+/*
+* Measures building the integral images of a 4K frame, and the statistics of
+* feature windows and box filters from them against rescanning the pixels.
+*/
+void benchIntegral() {
+  const int width = 3840;
+  const int height = 2160;
+  const int window = 31;
+  std::vector<std::uint8_t> pixels((long)width * height);
+  for (long i = 0; i < (long)pixels.size(); i++) {
+    pixels[i] = (std::uint8_t)((i * 7 + i / width * 13) % 256);
+  }
+  Image frame = Image::fromPixels(pixels.data(), width, height, 1, width);
+  IntegralImage integral;
+  double sums = timeIt([&]() { integral.compute(frame); });
+  double both = timeIt([&]() { integral.compute(frame, true); });
+  double bytes = timeIt([&]() { 
+    integral.compute(pixels.data(), width, height, 1, width, true);
+  });
+  std::cout << "\nIntegral images of a (" << width << " x " << height 
+            << ") frame (ms):\n" << std::fixed << std::setprecision(2) 
+            << "  sums:                " << sums * 1e3 << "\n"
+            << "  sums and squares:    " << both * 1e3 << "\n"
+            << "  8 bit, with squares: " << bytes * 1e3 << "\n";
+
+  // Mean and variance of a window at every 8th pixel
+  Matrix plane = frame.toMatrix();
+  double sink = 0;
+  auto windows = [&](auto statistics) {
+    for (int y = 0; y + window <= height; y += 8) {
+      for (int x = 0; x + window <= width; x += 8) {
+        sink += statistics(y, x);
+      }
+    }
+  };
+  double scanned = timeIt([&]() { 
+    windows([&](int y, int x) {
+      Statistics stats = reduce(plane.block(y, y + window - 1, x, 
+                                            x + window - 1));
+      return stats.mean + stats.variance;
+    });
+  });
+  double queried = timeIt([&]() { 
+    windows([&](int y, int x) {
+      return integral.mean(y, y + window - 1, x, x + window - 1) + 
+             integral.variance(y, y + window - 1, x, x + window - 1);
+    });
+  });
+  std::cout << "Mean and variance of " << window << " x " << window 
+            << " windows every 8 pixels (ms):\n"
+            << "  rescanned: " << scanned * 1e3 << "\n"
+            << "  integral:  " << queried * 1e3 << " (" 
+            << scanned / queried << "x faster)\n";
+
+  // Box filter of the same size
+  Image boxed;
+  std::vector<float> box(window, 1.0f / window);
+  double separable = timeIt([&]() { 
+    filterSeparable(frame, boxed, box, box); 
+  });
+  double fromIntegral = timeIt([&]() { 
+    boxFilter(integral, boxed, window / 2, window / 2); 
+  });
+  std::cout << window << " x " << window << " box filter (ms):\n"
+            << "  separable filter:    " << separable * 1e3 << "\n"
+            << "  from integral image: " << fromIntegral * 1e3 
+            << std::defaultfloat << (sink == 0 ? " " : "") << std::endl;
+}
+
+/*
+* Measures non-maximum suppression of a detection heatmap with sliding
+* maximum filters against calling maxRange for every window, and the
+* dilation of a 4K frame.
+*/
+void benchMorphology() {
+  const int size = 1024;
+  Matrix heatmap(size, size);
+  for (int i = 0; i < size; i++) {
+    for (int j = 0; j < size; j++) {
+      heatmap(i, j) = std::sin(0.05*i) * std::cos(0.07*j) + 
+                      0.001*((i * 31 + j * 17) % 97);
+    }
+  }
+  std::cout << "\nMaximum filter of a (" << size << " x " << size 
+            << ") heatmap (ms):\n";
+  Matrix highs(size, size);
+  Matrix isPeak(size, size);
+  for (int radius : {2, 7, 15}) {
+    double ranges = timeIt([&]() {
+      for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+          highs(i, j) = heatmap.maxRange(std::max(0, i - radius), 
+                                         std::min(size - 1, i + radius),
+                                         std::max(0, j - radius),
+                                         std::min(size - 1, j + radius));
+        }
+      }
+    }, 0.05);
+    double sliding = timeIt([&]() { 
+      maxFilter(heatmap, highs, radius, radius, &isPeak); 
+    });
+    int window = 2 * radius + 1;
+    std::cout << std::fixed << std::setprecision(2) 
+              << "  " << std::setw(2) << window << " x " << std::setw(2) 
+              << window << "  maxRange: " << std::setw(8) << ranges * 1e3 
+              << "  sliding with mask: " << std::setw(6) << sliding * 1e3 
+              << " (" << ranges / sliding << "x faster)" 
+              << std::defaultfloat << std::endl;
+  }
+
+  const int width = 3840;
+  const int height = 2160;
+  Image frame(width, height, 1);
+  for (int y = 0; y < height; y++) {
+    float* row = frame.row(y);
+    for (int x = 0; x < width; x++) {
+      row[x] = (float)((x * 7 + y * 13) % 256);
+    }
+  }
+  Image dilated;
+  std::cout << "Dilation of a (" << width << " x " << height 
+            << ") frame (ms):\n";
+  for (int radius : {1, 7, 25}) {
+    double seconds = timeIt([&]() { 
+      dilate(frame, dilated, radius, radius); 
+    });
+    int window = 2 * radius + 1;
+    std::cout << std::fixed << std::setprecision(2) 
+              << "  " << std::setw(2) << window << " x " << std::setw(2) 
+              << window << ": " << seconds * 1e3 << std::defaultfloat 
+              << std::endl;
+  }
+}
+
+/*
+* Measures real transforms of frames, and template matching by sliding the
+* template with multiplyElementwise() against both correlation methods.
+*/
+void benchCorrelation() {
+  std::cout << "\nReal FFT, forward and inverse (ms):\n";
+  for (int size : {1024, 2160}) {
+    int cols = (size == 1024) ? 1024 : 3840;
+    Matrix frame = randomMatrix(size, cols);
+    Matrix spectrum(0, 0);
+    Matrix restored(0, 0);
+    double forward = timeIt([&]() { rfft2(frame, spectrum); });
+    double inverse = timeIt([&]() { irfft2(spectrum, restored, cols); });
+    std::cout << std::fixed << std::setprecision(2) << "  (" 
+              << std::setw(4) << size << " x " << std::setw(4) << cols 
+              << ")  rfft2: " << std::setw(7) << forward * 1e3 
+              << "  irfft2: " << std::setw(7) << inverse * 1e3 
+              << std::defaultfloat << std::endl;
+  }
+
+  const int rows = 240;
+  const int cols = 320;
+  Matrix frame = randomMatrix(rows, cols);
+  std::cout << "Template matching in a (" << rows << " x " << cols 
+            << ") frame (ms):\n";
+  for (int size : {8, 16, 32, 64}) {
+    Matrix templ = frame.block(100, 100 + size - 1, 50, 50 + size - 1).copy();
+    Matrix scores(rows - size + 1, cols - size + 1);
+    double sliding = timeIt([&]() {
+      for (int i = 0; i < scores.getRows(); i++) {
+        for (int j = 0; j < scores.getColumns(); j++) {
+          Matrix window = frame.block(i, i + size - 1, j, j + size - 1);
+          scores(i, j) = reduce(Matrix::multiplyElementwise(window, 
+                                                            templ)).sum;
+        }
+      }
+      scores.maxIndex();
+    }, 0.05);
+    double spatial = timeIt([&]() {
+      correlate(frame, templ, scores, CorrelationMethod::Spatial);
+      scores.maxIndex();
+    });
+    double frequency = timeIt([&]() {
+      correlate(frame, templ, scores, CorrelationMethod::Frequency);
+      scores.maxIndex();
+    });
+    double normalized = timeIt([&]() { findTemplate(frame, templ); });
+    bool spatialChosen = (correlationMethod(rows, cols, size, size) == 
+                          CorrelationMethod::Spatial);
+    std::cout << std::fixed << std::setprecision(2) 
+              << "  " << std::setw(2) << size << " x " << std::setw(2) 
+              << size << "  sliding: " << std::setw(8) << sliding * 1e3 
+              << "  spatial: " << std::setw(6) << spatial * 1e3 
+              << "  frequency: " << std::setw(5) << frequency * 1e3 
+              << "  automatic: " << (spatialChosen ? "spatial  " 
+                                                   : "frequency")
+              << "  normalized: " << std::setw(5) << normalized * 1e3 
+              << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Measures 4 level pyramids of 1080p frames, built by blurring every level
+* and copying every second pixel into new images, against ImagePyramid.
+*/
+void benchPyramid() {
+  const int width = 1920;
+  const int height = 1080;
+  const int levels = 4;
+  std::cout << "\nPyramid of " << levels << " levels of (" << width << " x "
+            << height << ") frames (ms):\n";
+  std::vector<float> binomial = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16,
+                                 1.0f / 16};
+  for (int channels : {1, 3}) {
+    Image frame(width, height, channels);
+    for (int y = 0; y < height; y++) {
+      float* row = frame.row(y);
+      for (long x = 0; x < (long)width * channels; x++) {
+        row[x] = (float)((x * 7 + y * 13) % 256);
+      }
+    }
+    double separate = timeIt([&]() {
+      std::vector<Image> pyramid = {frame};
+      for (int k = 1; k < levels; k++) {
+        Image blurred = filterSeparable(pyramid.back(), binomial, binomial);
+        Image next((blurred.getWidth() + 1) / 2, (blurred.getHeight() + 1) / 2,
+                   channels);
+        for (int y = 0; y < next.getHeight(); y++) {
+          for (int x = 0; x < next.getWidth(); x++) {
+            for (int c = 0; c < channels; c++) {
+              next(y, x, c) = blurred(2*y, 2*x, c);
+            }
+          }
+        }
+        pyramid.push_back(std::move(next));
+      }
+    });
+    ImagePyramid pyramid(levels);
+    setMatrixThreads(1);
+    double single = timeIt([&]() { pyramid.build(frame); });
+    setMatrixThreads(0);
+    double threaded = timeIt([&]() { pyramid.build(frame); });
+    ImagePyramid lazyPyramid(levels, true);
+    double lazy = timeIt([&]() {
+      lazyPyramid.build(frame);
+      lazyPyramid.level(1);
+    });
+    std::cout << std::fixed << std::setprecision(2) 
+              << "  " << channels << " channel" << (channels > 1 ? "s" : " ")
+              << "  blur and copy: " << std::setw(6) << separate * 1e3 
+              << "  pyramid: " << std::setw(5) << single * 1e3 
+              << "  threads: " << std::setw(5) << threaded * 1e3 
+              << "  lazy, level 1 only: " << std::setw(5) << lazy * 1e3 
+              << std::defaultfloat << std::endl;
+  }
+}
+
+/*
+* Runs one frame of a simple tracker, predicting and updating the covariance
+* of many objects with short-lived temporaries.
+*/
+void trackerFrame(Matrix& F, Matrix& H, Matrix& R, Matrix& P, int objects) {
+  for (int i = 0; i < objects; i++) {
+    Matrix predicted = F * P * F.T() + 0.01;
+    Matrix S = H * predicted * H.T() + R;
+    Matrix gain = predicted * H.T();
+    gain /= S(0, 0);
+    Matrix updated = predicted - gain * H * predicted;
+  }
+}
+
+/*
+* Compares the global heap, the size class pools and an arena for the
+* temporaries of a tracker frame.
+*/
+void benchAllocator() {
+  std::cout << "\nTracker frame of 500 objects (us per frame):\n";
+  Matrix F = Matrix::identity(6);
+  Matrix H = Matrix::zeros(2, 6);
+  H(0, 0) = 1;
+  H(1, 1) = 1;
+  Matrix R = Matrix::identity(2);
+  Matrix P = Matrix::identity(6);
+  MatrixArena arena(1 << 23);
+
+  double heap = timeIt([&]() { trackerFrame(F, H, R, P, 500); });
+  setMatrixPooling(true);
+  double pooled = timeIt([&]() { trackerFrame(F, H, R, P, 500); });
+  setMatrixPooling(false);
+  releaseMatrixPools();
+  double arenaTime = timeIt([&]() {
+    ArenaScope scope(arena);
+    trackerFrame(F, H, R, P, 500);
+  });
+  AllocatorStatistics statistics = arena.getStatistics();
+  std::cout << std::fixed << std::setprecision(1) 
+            << "  heap:  " << heap * 1e6 << "\n"
+            << "  pools: " << pooled * 1e6 << "\n"
+            << "  arena: " << arenaTime * 1e6 << std::defaultfloat 
+            << " (high-water mark " << statistics.highWaterMark 
+            << " bytes, " << statistics.heapFallbacks << " fallbacks)" 
+            << std::endl;
+}
+
+/*
+* Runs every benchmark, or only the one named by the first argument.
+*/
+int main(int argc, char** argv) {
+  std::string only = (argc > 1) ? argv[1] : "";
+  if (only.empty() || only == "gemm") {
+    benchMultiply();
+  }
+  if (only.empty() || only == "elementwise") {
+    benchElementwise();
+  }
+  if (only.empty() || only == "expression") {
+    benchExpression();
+  }
+  if (only.empty() || only == "fixed") {
+    benchFixed();
+  }
+  if (only.empty() || only == "view") {
+    benchView();
+  }
+  if (only.empty() || only == "types") {
+    benchTypes();
+  }
+  if (only.empty() || only == "threads") {
+    benchThreads();
+  }
+  if (only.empty() || only == "transpose") {
+    benchTranspose();
+  }
+  if (only.empty() || only == "solve") {
+    benchSolve();
+  }
+  if (only.empty() || only == "kalman") {
+    benchKalman();
+  }
+  if (only.empty() || only == "batch") {
+    benchBatch();
+  }
+  if (only.empty() || only == "assignment") {
+    benchAssignment();
+  }
+  if (only.empty() || only == "gating") {
+    benchGating();
+  }
+  if (only.empty() || only == "sparse") {
+    benchSparse();
+  }
+  if (only.empty() || only == "reduce") {
+    benchReduce();
+  }
+  if (only.empty() || only == "broadcast") {
+    benchBroadcast();
+  }
+  if (only.empty() || only == "append") {
+    benchAppend();
+  }
+  if (only.empty() || only == "buffers") {
+    benchBuffers();
+  }
+  if (only.empty() || only == "filter") {
+    benchFilter();
+  }
+  if (only.empty() || only == "integral") {
+    benchIntegral();
+  }
+  if (only.empty() || only == "morphology") {
+    benchMorphology();
+  }
+  if (only.empty() || only == "correlation") {
+    benchCorrelation();
+  }
+  if (only.empty() || only == "pyramid") {
+    benchPyramid();
+  }
+  if (only.empty() || only == "allocator") {
+    benchAllocator();
+  }
+}
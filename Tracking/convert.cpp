@@ -0,0 +1,361 @@
+/******************************************************************************
+*                         Element type conversion                             *
+*                                                                             *
+* Each vectorized conversion has a scalar reference loop and SSE2 and AVX2    *
+* kernels. The kernels clamp in floating point before converting to integers *
+* and use the default rounding mode of the conversion instructions, which     *
+* matches the nearest-even rounding of the scalar loop. Machines with AVX512  *
+* use the AVX2 kernels, since the conversions are limited by memory traffic.  *
+*                                                                             *
+******************************************************************************/
+#include "convert.hpp"
+#include "kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONVERT_X86
+#endif
+
+using std::uint8_t;
+
+struct ConversionKernels {
+  void (*u8ToFloat)(const uint8_t* in, float* out, long n, float scale,
+                    float shift);
+  void (*floatToU8)(const float* in, uint8_t* out, long n, float scale,
+                    float shift);
+  void (*u8ToDouble)(const uint8_t* in, double* out, long n, double scale,
+                     double shift);
+  void (*doubleToU8)(const double* in, uint8_t* out, long n, double scale,
+                     double shift);
+  void (*floatToDouble)(const float* in, double* out, long n, double scale,
+                        double shift);
+  void (*doubleToFloat)(const double* in, float* out, long n, double scale,
+                        double shift);
+};
+
+/******************************************************************************
+* SCALAR KERNELS                                                              *
+******************************************************************************/
+
+/*
+* Converts n elements computing in the type Compute. Also used for the tails
+* of the vectorized kernels.
+*/
+template <typename Compute, typename From, typename To>
+__attribute__((optimize("no-tree-vectorize")))
+static void convertLoop(const From* in, To* out, long n, Compute scale,
+                        Compute shift) {
+  for (long i = 0; i < n; i++) {
+    out[i] = saturateCast<To>((Compute)in[i] * scale + shift);
+  }
+}
+
+static const ConversionKernels scalarConversions = {
+  convertLoop<float, uint8_t, float>,
+  convertLoop<float, float, uint8_t>,
+  convertLoop<double, uint8_t, double>,
+  convertLoop<double, double, uint8_t>,
+  convertLoop<double, float, double>,
+  convertLoop<double, double, float>
+};
+
+#ifdef CONVERT_X86
+
+/******************************************************************************
+* SSE2 KERNELS                                                                *
+******************************************************************************/
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+
+SSE2_TARGET static void u8ToFloatSSE2(const uint8_t* in, float* out, long n,
+                                      float scale, float shift) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 t = _mm_set1_ps(shift);
+  long i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    __m128i words[4] = {_mm_unpacklo_epi16(low, zero),
+                        _mm_unpackhi_epi16(low, zero),
+                        _mm_unpacklo_epi16(high, zero),
+                        _mm_unpackhi_epi16(high, zero)};
+    for (int k = 0; k < 4; k++) {
+      __m128 value = _mm_cvtepi32_ps(words[k]);
+      _mm_storeu_ps(out + i + 4*k, _mm_add_ps(_mm_mul_ps(value, s), t));
+    }
+  }
+  convertLoop<float>(in + i, out + i, n - i, scale, shift);
+}
+
+SSE2_TARGET static void floatToU8SSE2(const float* in, uint8_t* out, long n,
+                                      float scale, float shift) {
+  const __m128 s = _mm_set1_ps(scale);
+  const __m128 t = _mm_set1_ps(shift);
+  const __m128 lowest = _mm_setzero_ps();
+  const __m128 highest = _mm_set1_ps(255.0f);
+  long i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i words[4];
+    for (int k = 0; k < 4; k++) {
+      __m128 value = _mm_loadu_ps(in + i + 4*k);
+      value = _mm_add_ps(_mm_mul_ps(value, s), t);
+      value = _mm_min_ps(_mm_max_ps(value, lowest), highest);
+      words[k] = _mm_cvtps_epi32(value);
+    }
+    __m128i low = _mm_packs_epi32(words[0], words[1]);
+    __m128i high = _mm_packs_epi32(words[2], words[3]);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(low, high));
+  }
+  convertLoop<float>(in + i, out + i, n - i, scale, shift);
+}
+
+SSE2_TARGET static void u8ToDoubleSSE2(const uint8_t* in, double* out,
+                                       long n, double scale, double shift) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128d s = _mm_set1_pd(scale);
+  const __m128d t = _mm_set1_pd(shift);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i bytes = _mm_loadl_epi64((const __m128i*)(in + i));
+    __m128i shorts = _mm_unpacklo_epi8(bytes, zero);
+    __m128i words[2] = {_mm_unpacklo_epi16(shorts, zero),
+                        _mm_unpackhi_epi16(shorts, zero)};
+    for (int k = 0; k < 2; k++) {
+      __m128d low = _mm_cvtepi32_pd(words[k]);
+      __m128d high = _mm_cvtepi32_pd(_mm_srli_si128(words[k], 8));
+      _mm_storeu_pd(out + i + 4*k, _mm_add_pd(_mm_mul_pd(low, s), t));
+      _mm_storeu_pd(out + i + 4*k + 2, _mm_add_pd(_mm_mul_pd(high, s), t));
+    }
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+SSE2_TARGET static void doubleToU8SSE2(const double* in, uint8_t* out,
+                                       long n, double scale, double shift) {
+  const __m128d s = _mm_set1_pd(scale);
+  const __m128d t = _mm_set1_pd(shift);
+  const __m128d lowest = _mm_setzero_pd();
+  const __m128d highest = _mm_set1_pd(255.0);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i words[4];
+    for (int k = 0; k < 4; k++) {
+      __m128d value = _mm_loadu_pd(in + i + 2*k);
+      value = _mm_add_pd(_mm_mul_pd(value, s), t);
+      value = _mm_min_pd(_mm_max_pd(value, lowest), highest);
+      words[k] = _mm_cvtpd_epi32(value);
+    }
+    __m128i low = _mm_unpacklo_epi64(words[0], words[1]);
+    __m128i high = _mm_unpacklo_epi64(words[2], words[3]);
+    __m128i shorts = _mm_packs_epi32(low, high);
+    _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(shorts, shorts));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+SSE2_TARGET static void floatToDoubleSSE2(const float* in, double* out,
+                                          long n, double scale,
+                                          double shift) {
+  const __m128d s = _mm_set1_pd(scale);
+  const __m128d t = _mm_set1_pd(shift);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 value = _mm_loadu_ps(in + i);
+    __m128d low = _mm_cvtps_pd(value);
+    __m128d high = _mm_cvtps_pd(_mm_movehl_ps(value, value));
+    _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(low, s), t));
+    _mm_storeu_pd(out + i + 2, _mm_add_pd(_mm_mul_pd(high, s), t));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+SSE2_TARGET static void doubleToFloatSSE2(const double* in, float* out,
+                                          long n, double scale,
+                                          double shift) {
+  const __m128d s = _mm_set1_pd(scale);
+  const __m128d t = _mm_set1_pd(shift);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128d low = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(in + i), s), t);
+    __m128d high = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(in + i + 2), s), t);
+    _mm_storeu_ps(out + i, _mm_movelh_ps(_mm_cvtpd_ps(low),
+                                         _mm_cvtpd_ps(high)));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+static const ConversionKernels sse2Conversions = {
+  u8ToFloatSSE2, floatToU8SSE2, u8ToDoubleSSE2, doubleToU8SSE2,
+  floatToDoubleSSE2, doubleToFloatSSE2
+};
+
+/******************************************************************************
+* AVX2 KERNELS                                                                *
+******************************************************************************/
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET static void u8ToFloatAVX2(const uint8_t* in, float* out, long n,
+                                      float scale, float shift) {
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 t = _mm256_set1_ps(shift);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i bytes = _mm_loadl_epi64((const __m128i*)(in + i));
+    __m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(value, s), t));
+  }
+  convertLoop<float>(in + i, out + i, n - i, scale, shift);
+}
+
+AVX2_TARGET static void floatToU8AVX2(const float* in, uint8_t* out, long n,
+                                      float scale, float shift) {
+  const __m256 s = _mm256_set1_ps(scale);
+  const __m256 t = _mm256_set1_ps(shift);
+  const __m256 lowest = _mm256_setzero_ps();
+  const __m256 highest = _mm256_set1_ps(255.0f);
+  long i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i words[2];
+    for (int k = 0; k < 2; k++) {
+      __m256 value = _mm256_loadu_ps(in + i + 8*k);
+      value = _mm256_add_ps(_mm256_mul_ps(value, s), t);
+      value = _mm256_min_ps(_mm256_max_ps(value, lowest), highest);
+      words[k] = _mm256_cvtps_epi32(value);
+    }
+
+    // Packing works within 128 bit lanes, so the 64 bit quarters are put
+    // back in order before the final pack
+    __m256i shorts = _mm256_packs_epi32(words[0], words[1]);
+    shorts = _mm256_permute4x64_epi64(shorts, 0xD8);
+    __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(shorts),
+                                     _mm256_extracti128_si256(shorts, 1));
+    _mm_storeu_si128((__m128i*)(out + i), bytes);
+  }
+  convertLoop<float>(in + i, out + i, n - i, scale, shift);
+}
+
+AVX2_TARGET static void u8ToDoubleAVX2(const uint8_t* in, double* out,
+                                       long n, double scale, double shift) {
+  const __m256d s = _mm256_set1_pd(scale);
+  const __m256d t = _mm256_set1_pd(shift);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i bytes = _mm_loadl_epi64((const __m128i*)(in + i));
+    __m256i words = _mm256_cvtepu8_epi32(bytes);
+    __m256d low = _mm256_cvtepi32_pd(_mm256_castsi256_si128(words));
+    __m256d high = _mm256_cvtepi32_pd(_mm256_extracti128_si256(words, 1));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(low, s), t));
+    _mm256_storeu_pd(out + i + 4, _mm256_add_pd(_mm256_mul_pd(high, s), t));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+AVX2_TARGET static void doubleToU8AVX2(const double* in, uint8_t* out,
+                                       long n, double scale, double shift) {
+  const __m256d s = _mm256_set1_pd(scale);
+  const __m256d t = _mm256_set1_pd(shift);
+  const __m256d lowest = _mm256_setzero_pd();
+  const __m256d highest = _mm256_set1_pd(255.0);
+  long i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i words[2];
+    for (int k = 0; k < 2; k++) {
+      __m256d value = _mm256_loadu_pd(in + i + 4*k);
+      value = _mm256_add_pd(_mm256_mul_pd(value, s), t);
+      value = _mm256_min_pd(_mm256_max_pd(value, lowest), highest);
+      words[k] = _mm256_cvtpd_epi32(value);
+    }
+    __m128i shorts = _mm_packs_epi32(words[0], words[1]);
+    _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(shorts, shorts));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+AVX2_TARGET static void floatToDoubleAVX2(const float* in, double* out,
+                                          long n, double scale,
+                                          double shift) {
+  const __m256d s = _mm256_set1_pd(scale);
+  const __m256d t = _mm256_set1_pd(shift);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d value = _mm256_cvtps_pd(_mm_loadu_ps(in + i));
+    _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(value, s), t));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+AVX2_TARGET static void doubleToFloatAVX2(const double* in, float* out,
+                                          long n, double scale,
+                                          double shift) {
+  const __m256d s = _mm256_set1_pd(scale);
+  const __m256d t = _mm256_set1_pd(shift);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d value = _mm256_loadu_pd(in + i);
+    value = _mm256_add_pd(_mm256_mul_pd(value, s), t);
+    _mm_storeu_ps(out + i, _mm256_cvtpd_ps(value));
+  }
+  convertLoop<double>(in + i, out + i, n - i, scale, shift);
+}
+
+static const ConversionKernels avx2Conversions = {
+  u8ToFloatAVX2, floatToU8AVX2, u8ToDoubleAVX2, doubleToU8AVX2,
+  floatToDoubleAVX2, doubleToFloatAVX2
+};
+
+#endif
+
+/******************************************************************************
+* DISPATCH                                                                    *
+******************************************************************************/
+
+/*
+* Returns the conversions for the instruction set of the active elementwise
+* kernels, so that setKernelIsa also applies to conversions.
+*/
+static const ConversionKernels& conversions() {
+  switch (kernels().isa) {
+#ifdef CONVERT_X86
+    case KernelIsa::SSE2:
+      return sse2Conversions;
+    case KernelIsa::AVX2:
+    case KernelIsa::AVX512:
+      return avx2Conversions;
+#endif
+    default:
+      return scalarConversions;
+  }
+}
+
+void convertElements(const uint8_t* in, float* out, long n, double scale,
+                     double shift) {
+  conversions().u8ToFloat(in, out, n, (float)scale, (float)shift);
+}
+
+void convertElements(const float* in, uint8_t* out, long n, double scale,
+                     double shift) {
+  conversions().floatToU8(in, out, n, (float)scale, (float)shift);
+}
+
+void convertElements(const uint8_t* in, double* out, long n, double scale,
+                     double shift) {
+  conversions().u8ToDouble(in, out, n, scale, shift);
+}
+
+void convertElements(const double* in, uint8_t* out, long n, double scale,
+                     double shift) {
+  conversions().doubleToU8(in, out, n, scale, shift);
+}
+
+void convertElements(const float* in, double* out, long n, double scale,
+                     double shift) {
+  conversions().floatToDouble(in, out, n, scale, shift);
+}
+
+void convertElements(const double* in, float* out, long n, double scale,
+                     double shift) {
+  conversions().doubleToFloat(in, out, n, scale, shift);
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+*                         Element type conversion                             *
+*                                                                             *
+* Converts arrays between element types, such as 8 bit pixels and floating    *
+* point values. Every conversion computes out[i] = in[i] * scale + shift.     *
+* Conversions to an integer type round to the nearest value (ties to even),   *
+* saturate at the limits of the type and turn NaN into zero, so that          *
+* converting a float image back to uint8_t never wraps around.                *
+*                                                                             *
+* The pairs used for pixel data (uint8_t with float or double, and float     *
+* with double) have vectorized kernels, selected for the same instruction    *
+* set as the elementwise kernels. Conversions between uint8_t and float are   *
+* computed in float, and every other conversion in double. Every instruction  *
+* set gives the same results as the scalar loop. Other pairs of types use a   *
+* generic scalar loop.                                                        *
+*                                                                             *
+******************************************************************************/
+#ifndef CONVERT_HPP
+#define CONVERT_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+/*
+* Converts a single value computed in floating point to the type To, with
+* rounding and saturation if To is an integer type.
+*/
+template <typename To, typename Compute>
+inline To saturateCast(Compute value) {
+  if (std::is_integral<To>::value) {
+    if (value != value) {
+      return 0;
+    }
+    if (value <= (Compute)std::numeric_limits<To>::lowest()) {
+      return std::numeric_limits<To>::lowest();
+    }
+    if (value >= (Compute)std::numeric_limits<To>::max()) {
+      return std::numeric_limits<To>::max();
+    }
+    return (To)std::nearbyint(value);
+  }
+  return (To)value;
+}
+
+// Vectorized conversions
+void convertElements(const std::uint8_t* in, float* out, long n,
+                     double scale=1, double shift=0);
+void convertElements(const float* in, std::uint8_t* out, long n,
+                     double scale=1, double shift=0);
+void convertElements(const std::uint8_t* in, double* out, long n,
+                     double scale=1, double shift=0);
+void convertElements(const double* in, std::uint8_t* out, long n,
+                     double scale=1, double shift=0);
+void convertElements(const float* in, double* out, long n,
+                     double scale=1, double shift=0);
+void convertElements(const double* in, float* out, long n,
+                     double scale=1, double shift=0);
+
+/*
+* Converts between any other pair of arithmetic types, computing in double.
+*/
+template <typename From, typename To>
+void convertElements(const From* in, To* out, long n, double scale=1,
+                     double shift=0) {
+  for (long i = 0; i < n; i++) {
+    out[i] = saturateCast<To>((double)in[i] * scale + shift);
+  }
+}
+
+#endif
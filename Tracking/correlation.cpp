@@ -0,0 +1,310 @@
+/******************************************************************************
+*                     Correlation and template matching                       *
+*                                                                             *
+* The spatial correlation adds each kernel element times a row of the input   *
+* to a row of the output, a vectorized loop along the row, so it costs one    *
+* multiply-add per kernel element and output element. The output rows are     *
+* split between the matrix threads.                                           *
+*                                                                             *
+* The frequency correlation zero pads the input to the next length of the     *
+* FFT in each direction, transforms it and the kernel, multiplies the         *
+* spectrum of the input by the conjugate of the spectrum of the kernel, and   *
+* transforms the product back. The correlation is circular, but the padding   *
+* is at least as large as the input, so no output that is kept wraps around.  *
+* Its cost depends on the padded size only.                                   *
+*                                                                             *
+* correlationMethod() compares the number of multiply-adds of the spatial     *
+* correlation with n log2(n) for the n elements of the padded input, each     *
+* weighted by their measured cost.                                            *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "correlation.hpp"
+#include "fft.hpp"
+#include "integral.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Nanoseconds per multiply-add of the spatial correlation and per n log2(n)
+// of the frequency correlation on one core, measured with bench. Only their
+// ratio matters
+static const double SPATIAL_COST = 0.12;
+static const double FREQUENCY_COST = 1.4;
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Adds value times in to out.
+*/
+static ALWAYS_INLINE void axpyBody(double* out, const double* in, double value,
+                                   long n) {
+  for (long i = 0; i < n; i++) {
+    out[i] += value * in[i];
+  }
+}
+
+typedef void (*AxpyKernel)(double* out, const double* in, double value,
+                           long n);
+
+// Defines the kernel for one instruction set
+#define CORRELATION_KERNELS(ISA, TARGET)                                      \
+  TARGET static void axpy_##ISA(double* out, const double* in, double value,  \
+                                long n) {                                     \
+    axpyBody(out, in, value, n);                                              \
+  }
+
+INSTANTIATE_KERNELS(CORRELATION_KERNELS)
+
+/*
+* Returns the kernel for the instruction set of the elementwise kernels.
+*/
+static AxpyKernel axpyKernel() {
+  SELECT_KERNELS(axpy)
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Checks that the kernel fits in the input.
+*/
+static void checkKernel(const MatrixView& in, const MatrixView& kernel) {
+  if ((kernel.getRows() < 1) || (kernel.getColumns() < 1) ||
+      (kernel.getRows() > in.getRows()) ||
+      (kernel.getColumns() > in.getColumns())) {
+    std::cout << "Unable to correlate a matrix of size (" << in.getRows()
+              << ", " << in.getColumns() << ") with a kernel of size ("
+              << kernel.getRows() << ", " << kernel.getColumns() << ")\n";
+    throw std::invalid_argument("Invalid filter kernel.");
+  }
+}
+
+static void correlateSpatial(const MatrixView& in, const MatrixView& kernel,
+                             Matrix& out) {
+  // The rows of the input are read as contiguous arrays
+  Matrix compact(0, 0);
+  const double* data = in.getData();
+  long rowStride = in.getRowStride();
+  if (in.getColumnStride() != 1) {
+    compact = in.copy();
+    data = compact.getData();
+    rowStride = compact.getColumns();
+  }
+  int kernelRows = kernel.getRows();
+  int kernelCols = kernel.getColumns();
+  long outCols = out.getColumns();
+  AxpyKernel axpy = axpyKernel();
+  long work = outCols * kernelRows * kernelCols;
+  long grain = std::max(1L, PARALLEL_GRAIN / std::max(1L, work));
+  parallelFor(out.getRows(), grain, [&](long begin, long end) {
+    for (long i = begin; i < end; i++) {
+      double* row = out.getData() + i*outCols;
+      std::fill(row, row + outCols, 0.0);
+      for (int a = 0; a < kernelRows; a++) {
+        const double* source = data + (i + a)*rowStride;
+        for (int b = 0; b < kernelCols; b++) {
+          axpy(row, source + b, kernel(a, b), outCols);
+        }
+      }
+    }
+  });
+}
+
+static void correlateFrequency(const MatrixView& in, const MatrixView& kernel,
+                               Matrix& out) {
+  int rows = fftSize(in.getRows());
+  int cols = fftSize(in.getColumns());
+  Matrix spectrum = rfft2(in, rows, cols);
+  Matrix kernelSpectrum = rfft2(kernel, rows, cols);
+  multiplySpectra(spectrum, kernelSpectrum, spectrum, true);
+  Matrix full = irfft2(spectrum, cols);
+  long outCols = out.getColumns();
+  for (long i = 0; i < out.getRows(); i++) {
+    std::memcpy(out.getData() + i*outCols, full.getData() + i*cols,
+                outCols * sizeof(double));
+  }
+}
+
+/******************************************************************************
+* CORRELATION                                                                 *
+******************************************************************************/
+
+/*
+* Estimates the cost of both methods.
+*/
+CorrelationMethod correlationMethod(int rows, int cols, int kernelRows,
+                                    int kernelCols) {
+  double outputs = (double)(rows - kernelRows + 1) * (cols - kernelCols + 1);
+  double spatial = SPATIAL_COST * outputs * kernelRows * kernelCols;
+  double padded = (double)fftSize(rows) * fftSize(cols);
+  double frequency = FREQUENCY_COST * padded * std::log2(padded + 1);
+  return (spatial > frequency) ? CorrelationMethod::Frequency
+                               : CorrelationMethod::Spatial;
+}
+
+/*
+* Computes the correlation with the chosen method, through a temporary when
+* the output overlaps the input or the kernel.
+*/
+void correlate(const MatrixView& in, const MatrixView& kernel, Matrix& out,
+               CorrelationMethod method) {
+  checkKernel(in, kernel);
+  if (sharesElements(in, out) || sharesElements(kernel, out)) {
+    Matrix result(0, 0);
+    correlate(in, kernel, result, method);
+    out = std::move(result);
+    return;
+  }
+  int outRows = in.getRows() - kernel.getRows() + 1;
+  int outCols = in.getColumns() - kernel.getColumns() + 1;
+  if ((out.getRows() != outRows) || (out.getColumns() != outCols)) {
+    HeapScope heap;
+    out = Matrix(outRows, outCols);
+  }
+  if (method == CorrelationMethod::Automatic) {
+    method = correlationMethod(in.getRows(), in.getColumns(),
+                               kernel.getRows(), kernel.getColumns());
+  }
+  if (method == CorrelationMethod::Spatial) {
+    correlateSpatial(in, kernel, out);
+  } else {
+    correlateFrequency(in, kernel, out);
+  }
+}
+
+Matrix correlate(const MatrixView& in, const MatrixView& kernel,
+                 CorrelationMethod method) {
+  Matrix out(0, 0);
+  correlate(in, kernel, out, method);
+  return out;
+}
+
+/******************************************************************************
+* TEMPLATE MATCHING                                                           *
+******************************************************************************/
+
+/*
+* Correlates the input with the template, or with the template minus its
+* mean for normalized correlations, and turns the correlation into scores
+* using the sums of the windows from an integral image.
+*/
+void matchTemplate(const MatrixView& in, const MatrixView& templ, Matrix& out,
+                   MatchMethod method, CorrelationMethod correlation) {
+  checkKernel(in, templ);
+  if (method == MatchMethod::CrossCorrelation) {
+    correlate(in, templ, out, correlation);
+    return;
+  }
+  if (sharesElements(in, out) || sharesElements(templ, out)) {
+    Matrix result(0, 0);
+    matchTemplate(in, templ, result, method, correlation);
+    out = std::move(result);
+    return;
+  }
+
+  int templRows = templ.getRows();
+  int templCols = templ.getColumns();
+  double count = (double)templRows * templCols;
+  double templSum = 0;
+  double templSquares = 0;
+  for (int a = 0; a < templRows; a++) {
+    for (int b = 0; b < templCols; b++) {
+      templSum += templ(a, b);
+      templSquares += templ(a, b) * templ(a, b);
+    }
+  }
+  bool normalized = (method == MatchMethod::NormalizedCorrelation);
+  if (normalized) {
+    Matrix centered = templ.copy();
+    double mean = templSum / count;
+    for (int a = 0; a < templRows; a++) {
+      for (int b = 0; b < templCols; b++) {
+        centered(a, b) -= mean;
+      }
+    }
+    correlate(in, centered, out, correlation);
+    double squares = templSquares;
+    templSquares = 0;
+    for (int a = 0; a < templRows; a++) {
+      for (int b = 0; b < templCols; b++) {
+        templSquares += centered(a, b) * centered(a, b);
+      }
+    }
+
+    // So is the variance of templates of constant elements
+    if (templSquares <= 1e-12 * squares) {
+      templSquares = 0;
+    }
+  } else {
+    correlate(in, templ, out, correlation);
+  }
+
+  IntegralImage integral(in, true);
+  const double* sums = integral.getSums().getData();
+  const double* squares = integral.getSquares().getData();
+  long stride = integral.getSums().getColumns();
+  long outCols = out.getColumns();
+  long grain = std::max(1L, PARALLEL_GRAIN / std::max(1L, outCols));
+  parallelFor(out.getRows(), grain, [&](long begin, long end) {
+    for (long i = begin; i < end; i++) {
+      double* row = out.getData() + i*outCols;
+      const double* top = sums + i*stride;
+      const double* bottom = sums + (i + templRows)*stride;
+      const double* topSquares = squares + i*stride;
+      const double* bottomSquares = squares + (i + templRows)*stride;
+      for (long j = 0; j < outCols; j++) {
+        double windowSquares = bottomSquares[j + templCols] -
+                               topSquares[j + templCols] -
+                               bottomSquares[j] + topSquares[j];
+        if (!normalized) {
+          double difference = windowSquares - 2 * row[j] + templSquares;
+          row[j] = std::max(0.0, difference);
+          continue;
+        }
+
+        // The variance of windows of constant elements is rounding error
+        double windowSum = bottom[j + templCols] - top[j + templCols] -
+                           bottom[j] + top[j];
+        double variance = windowSquares - windowSum * windowSum / count;
+        double scale = variance * templSquares;
+        if ((variance <= 1e-12 * windowSquares) || (scale <= 0)) {
+          row[j] = 0;
+        } else {
+          row[j] = std::min(1.0, std::max(-1.0, row[j] / std::sqrt(scale)));
+        }
+      }
+    }
+  });
+}
+
+Matrix matchTemplate(const MatrixView& in, const MatrixView& templ,
+                     MatchMethod method, CorrelationMethod correlation) {
+  Matrix out(0, 0);
+  matchTemplate(in, templ, out, method, correlation);
+  return out;
+}
+
+/*
+* Scores every window and returns the smallest difference or the largest
+* correlation.
+*/
+TemplateMatch findTemplate(const MatrixView& in, const MatrixView& templ,
+                           MatchMethod method, CorrelationMethod correlation) {
+  Matrix scores = matchTemplate(in, templ, method, correlation);
+  TemplateMatch match;
+  if (method == MatchMethod::SquaredDifference) {
+    match.position = scores.minIndex();
+  } else {
+    match.position = scores.maxIndex();
+  }
+  match.score = scores(match.position.r, match.position.c);
+  return match;
+}
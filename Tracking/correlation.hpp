@@ -0,0 +1,80 @@
+/******************************************************************************
+*                     Correlation and template matching                       *
+*                                                                             *
+* correlate() slides a kernel over a matrix and sums the products of the      *
+* overlapping elements, for every position where the kernel lies entirely     *
+* inside the matrix:                                                          *
+*                                                                             *
+*   out(i, j) = sum over (a, b) of kernel(a, b) * in(i + a, j + b)            *
+*                                                                             *
+* so the output has (rows - kernelRows + 1) x (cols - kernelCols + 1)         *
+* elements. The sums are computed directly in the spatial domain, or as a     *
+* product of spectra in the frequency domain, which costs the same for every  *
+* kernel size. By default, correlationMethod() picks whichever is estimated   *
+* to be faster for the sizes, which is the frequency domain for all but small *
+* kernels. Both give the same results up to rounding.                         *
+*                                                                             *
+* matchTemplate() scores every position of a template in a matrix, and        *
+* findTemplate() returns the best one:                                        *
+*                                                                             *
+*   TemplateMatch match = findTemplate(frame, target);                        *
+*   if (match.score > 0.8) {                                                  *
+*     track(match.position.r, match.position.c);                              *
+*   }                                                                         *
+*                                                                             *
+* CrossCorrelation scores are the correlation itself. SquaredDifference       *
+* scores are the sums of squared differences, where the best match is the     *
+* smallest. NormalizedCorrelation scores are the correlation coefficients of  *
+* the template and the window, from -1 to 1, which do not depend on the       *
+* brightness and contrast of the window. They are 0 for windows or templates  *
+* of constant elements. The sums over the windows come from an integral       *
+* image, so every method costs one correlation.                               *
+*                                                                             *
+******************************************************************************/
+#ifndef CORRELATION_HPP
+#define CORRELATION_HPP
+
+#include "matrix.hpp"
+
+enum class CorrelationMethod {
+  Automatic,
+  Spatial,
+  Frequency
+};
+
+enum class MatchMethod {
+  CrossCorrelation,
+  SquaredDifference,
+  NormalizedCorrelation
+};
+
+struct TemplateMatch {
+  struct index position;
+  double score;
+};
+
+// The faster method for a matrix and a kernel of the given sizes
+CorrelationMethod correlationMethod(int rows, int cols, int kernelRows,
+                                    int kernelCols);
+
+void correlate(const MatrixView& in, const MatrixView& kernel, Matrix& out,
+               CorrelationMethod method=CorrelationMethod::Automatic);
+Matrix correlate(const MatrixView& in, const MatrixView& kernel,
+                 CorrelationMethod method=CorrelationMethod::Automatic);
+
+void matchTemplate(const MatrixView& in, const MatrixView& templ, Matrix& out,
+                   MatchMethod method=MatchMethod::NormalizedCorrelation,
+                   CorrelationMethod correlation=CorrelationMethod::Automatic);
+Matrix matchTemplate(
+  const MatrixView& in, const MatrixView& templ,
+  MatchMethod method=MatchMethod::NormalizedCorrelation,
+  CorrelationMethod correlation=CorrelationMethod::Automatic);
+
+// The position of the top left corner of the best window, the first one in
+// row major order when several are equally good
+TemplateMatch findTemplate(
+  const MatrixView& in, const MatrixView& templ,
+  MatchMethod method=MatchMethod::NormalizedCorrelation,
+  CorrelationMethod correlation=CorrelationMethod::Automatic);
+
+#endif
@@ -0,0 +1,684 @@
+/******************************************************************************
+*                          Matrix decompositions                              *
+*                                                                             *
+* The factorizations are right-looking and blocked. Each block of BLOCK       *
+* columns is factored with simple loops, and the rest of the matrix is then  *
+* updated with a single product of the block with the rows or columns it     *
+* eliminates, which is where almost all of the work of a large factorization *
+* is done. The triangular solves are blocked in the same way. Matrices of at *
+* most BLOCK rows, such as the covariances of a tracker, are handled entirely *
+* by the simple loops and never allocate.                                     *
+*                                                                             *
+******************************************************************************/
+#include <cmath>
+#include <utility>
+
+#include "decomposition.hpp"
+#include "gemm.hpp"
+
+// Number of columns factored at a time. Each block of the factorization then
+// updates the rest of the matrix with a product of inner dimension BLOCK
+static const int BLOCK = 64;
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Computes C -= A*diag(scale)*B, where A is (m x k), B is (k x n) and C is a
+* row major (m x n) array. A and B are read through the given strides, like
+* the operands of gemm, and scale may be nullptr. Small products use a simple
+* loop, and larger ones pass a negated copy of A to gemm.
+*/
+static void subtractProduct(int m, int n, int k,
+                            const double* a, int aRowStride, int aColStride,
+                            const double* scale,
+                            const double* b, int bRowStride, int bColStride,
+                            double* c, int cRowStride) {
+  if ((m == 0) || (n == 0) || (k == 0)) {
+    return;
+  }
+  if ((long)m * n * k < GEMM_BLOCKED_THRESHOLD) {
+    for (int i = 0; i < m; i++) {
+      double* cRow = c + (long)i*cRowStride;
+      for (int p = 0; p < k; p++) {
+        double factor = a[(long)i*aRowStride + (long)p*aColStride];
+        if (scale != nullptr) {
+          factor *= scale[p];
+        }
+        const double* bRow = b + (long)p*bRowStride;
+        for (int j = 0; j < n; j++) {
+          cRow[j] -= factor * bRow[(long)j*bColStride];
+        }
+      }
+    }
+    return;
+  }
+  std::vector<double> negated((long)m * k);
+  for (int i = 0; i < m; i++) {
+    for (int p = 0; p < k; p++) {
+      double factor = a[(long)i*aRowStride + (long)p*aColStride];
+      negated[(long)i*k + p] = (scale != nullptr) ? -factor * scale[p]
+                                                  : -factor;
+    }
+  }
+  gemm(m, n, k, negated.data(), k, 1, b, bRowStride, bColStride, c,
+       cRowStride, true);
+}
+
+/*
+* Solves L*X = B in place, where L is the lower triangle of the (n x n) array
+* l, or the transpose of its upper triangle if transposed is set. The diagonal
+* is taken to be one if unit is set. B has r columns.
+*/
+static void solveLower(const double* l, int n, bool unit, bool transposed,
+                       double* b, int r) {
+  int rowStride = transposed ? 1 : n;
+  int colStride = transposed ? n : 1;
+  for (int i0 = 0; i0 < n; i0 += BLOCK) {
+    int i1 = std::min(n, i0 + BLOCK);
+
+    // Remove the contribution of the rows that are already solved
+    subtractProduct(i1 - i0, r, i0, l + (long)i0*rowStride, rowStride,
+                    colStride, nullptr, b, r, 1, b + (long)i0*r, r);
+    for (int i = i0; i < i1; i++) {
+      double* row = b + (long)i*r;
+      for (int p = i0; p < i; p++) {
+        double factor = l[(long)i*rowStride + (long)p*colStride];
+        const double* solved = b + (long)p*r;
+        for (int j = 0; j < r; j++) {
+          row[j] -= factor * solved[j];
+        }
+      }
+      if (!unit) {
+        double diagonal = l[(long)i*rowStride + (long)i*colStride];
+        for (int j = 0; j < r; j++) {
+          row[j] /= diagonal;
+        }
+      }
+    }
+  }
+}
+
+/*
+* Solves U*X = B in place, where U is the upper triangle of the (n x n) array
+* u, or the transpose of its lower triangle if transposed is set. The diagonal
+* is taken to be one if unit is set. B has r columns.
+*/
+static void solveUpper(const double* u, int n, bool unit, bool transposed,
+                       double* b, int r) {
+  int rowStride = transposed ? 1 : n;
+  int colStride = transposed ? n : 1;
+  for (int i1 = n; i1 > 0; i1 -= BLOCK) {
+    int i0 = std::max(0, i1 - BLOCK);
+
+    // Remove the contribution of the rows that are already solved
+    subtractProduct(i1 - i0, r, n - i1,
+                    u + (long)i0*rowStride + (long)i1*colStride, rowStride,
+                    colStride, nullptr, b + (long)i1*r, r, 1,
+                    b + (long)i0*r, r);
+    for (int i = i1 - 1; i >= i0; i--) {
+      double* row = b + (long)i*r;
+      for (int p = i + 1; p < i1; p++) {
+        double factor = u[(long)i*rowStride + (long)p*colStride];
+        const double* solved = b + (long)p*r;
+        for (int j = 0; j < r; j++) {
+          row[j] -= factor * solved[j];
+        }
+      }
+      if (!unit) {
+        double diagonal = u[(long)i*rowStride + (long)i*colStride];
+        for (int j = 0; j < r; j++) {
+          row[j] /= diagonal;
+        }
+      }
+    }
+  }
+}
+
+/*
+* Prints an error and throws if the matrix is not square.
+*/
+static void checkSquare(const Matrix& mat, const char* decomposition) {
+  if (mat.getRows() != mat.getColumns()) {
+    std::cout << "Unable to compute the " << decomposition
+              << " decomposition of a non-square matrix: (" << mat.getRows()
+              << ", " << mat.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix is not square.");
+  }
+}
+
+/*
+* Prints an error and throws if the right-hand side of a system does not have
+* the given number of rows.
+*/
+static void checkRows(const Matrix& rhs, int size) {
+  if (rhs.getRows() != size) {
+    std::cout << "Unable to solve a system of size " << size
+              << " with a right-hand side of size (" << rhs.getRows() << ", "
+              << rhs.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/*
+* Prints an error and throws if the right-hand side of a system solved from
+* the right does not have the given number of columns.
+*/
+static void checkColumns(const Matrix& rhs, int size) {
+  if (rhs.getColumns() != size) {
+    std::cout << "Unable to solve a system of size " << size
+              << " with a right-hand side of size (" << rhs.getRows() << ", "
+              << rhs.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/*
+* Factors the symmetric matrix held in the lower triangle of data as L*L^T,
+* or as L*D*L^T with unit L and D on the diagonal if ldlt is set. The factors
+* overwrite the lower triangle and the upper triangle is set to zero, so only
+* the lower half of the updates to the rest of the matrix are computed. Returns
+* false if a pivot is not positive for L*L^T, or zero for L*D*L^T.
+*/
+static bool factorSymmetric(double* data, int n, bool ldlt) {
+  bool success = true;
+  std::vector<double> pivots;
+  for (int k0 = 0; k0 < n; k0 += BLOCK) {
+    int k1 = std::min(n, k0 + BLOCK);
+
+    // Factor the columns of the block, including the rows below it
+    for (int j = k0; j < k1; j++) {
+      double* rowJ = data + (long)j*n;
+      double pivot = rowJ[j];
+      for (int p = k0; p < j; p++) {
+        pivot -= ldlt ? rowJ[p] * rowJ[p] * data[(long)p*n + p]
+                      : rowJ[p] * rowJ[p];
+      }
+      if (ldlt ? (pivot == 0) : !(pivot > 0)) {
+        success = false;
+        pivot = 0;
+      }
+      rowJ[j] = ldlt ? pivot : std::sqrt(pivot);
+      for (int i = j + 1; i < n; i++) {
+        double* rowI = data + (long)i*n;
+        double value = rowI[j];
+        for (int p = k0; p < j; p++) {
+          value -= ldlt ? rowI[p] * rowJ[p] * data[(long)p*n + p]
+                        : rowI[p] * rowJ[p];
+        }
+        rowI[j] = (rowJ[j] != 0) ? value / rowJ[j] : 0;
+      }
+    }
+
+    // Update the lower triangle of the rest of the matrix with the block,
+    // one block of rows at a time up to its diagonal
+    if (k1 < n) {
+      const double* scale = nullptr;
+      if (ldlt) {
+        pivots.resize(k1 - k0);
+        for (int p = k0; p < k1; p++) {
+          pivots[p - k0] = data[(long)p*n + p];
+        }
+        scale = pivots.data();
+      }
+      const double* panel = data + (long)k1*n + k0;
+      for (int i0 = k1; i0 < n; i0 += BLOCK) {
+        int i1 = std::min(n, i0 + BLOCK);
+        subtractProduct(i1 - i0, i1 - k1, k1 - k0, data + (long)i0*n + k0,
+                        n, 1, scale, panel, 1, n, data + (long)i0*n + k1, n);
+      }
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    std::fill(data + (long)i*n + i + 1, data + (long)(i + 1)*n, 0.0);
+  }
+  return success;
+}
+
+/*
+* Solves A*X = B in place with the factors of A from factorSymmetric, where B
+* has r columns.
+*/
+static void solveSymmetric(const double* factor, int n, bool ldlt, double* b,
+                           int r) {
+  solveLower(factor, n, ldlt, false, b, r);
+  if (ldlt) {
+    for (int i = 0; i < n; i++) {
+      double diagonal = factor[(long)i*n + i];
+      for (int j = 0; j < r; j++) {
+        b[(long)i*r + j] /= diagonal;
+      }
+    }
+  }
+  solveUpper(factor, n, ldlt, true, b, r);
+}
+
+/*
+* Solves A*x = b in place for a single vector b with the factors of A from
+* factorSymmetric, by forward and back substitution without the blocking of
+* solveSymmetric, which costs more than it saves for small systems.
+*/
+static void solveSymmetricVector(const double* factor, int n, bool ldlt,
+                                 double* b) {
+  for (int i = 0; i < n; i++) {
+    const double* row = factor + (long)i*n;
+    double value = b[i];
+    for (int p = 0; p < i; p++) {
+      value -= row[p] * b[p];
+    }
+    b[i] = ldlt ? value : value / row[i];
+  }
+  if (ldlt) {
+    for (int i = 0; i < n; i++) {
+      b[i] /= factor[(long)i*n + i];
+    }
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double value = b[i];
+    for (int p = i + 1; p < n; p++) {
+      value -= factor[(long)p*n + i] * b[p];
+    }
+    b[i] = ldlt ? value : value / factor[(long)i*n + i];
+  }
+}
+
+/******************************************************************************
+* LU DECOMPOSITION                                                            *
+******************************************************************************/
+
+/*
+* Creates an empty decomposition, to be filled by compute.
+*/
+LUDecomposition::LUDecomposition() :
+  factors(0, 0),
+  swaps(0),
+  singular(true)
+{}
+
+/*
+* Creates the decomposition of the given square matrix.
+*/
+LUDecomposition::LUDecomposition(const Matrix& mat) : LUDecomposition() {
+  compute(mat);
+}
+
+/*
+* Factors the given square matrix as P*A = L*U, with the row of largest
+* magnitude chosen as the pivot of every column. L has ones on its diagonal
+* and is stored below the diagonal of the factors, with U on and above it.
+* The storage of a previous decomposition of the same size is reused.
+*/
+void LUDecomposition::compute(const Matrix& mat) {
+  checkSquare(mat, "LU");
+  int n = mat.getRows();
+  factors = mat;
+  pivots.resize(n);
+  swaps = 0;
+  singular = false;
+  double* data = factors.getData();
+
+  for (int k0 = 0; k0 < n; k0 += BLOCK) {
+    int k1 = std::min(n, k0 + BLOCK);
+
+    // Factor the columns of the block, swapping whole rows for the pivots
+    for (int k = k0; k < k1; k++) {
+      int pivot = k;
+      for (int i = k + 1; i < n; i++) {
+        if (std::fabs(data[(long)i*n + k]) > 
+            std::fabs(data[(long)pivot*n + k])) {
+          pivot = i;
+        }
+      }
+      pivots[k] = pivot;
+      if (pivot != k) {
+        std::swap_ranges(data + (long)k*n, data + (long)(k + 1)*n,
+                         data + (long)pivot*n);
+        swaps++;
+      }
+      double* rowK = data + (long)k*n;
+      if (rowK[k] == 0) {
+        singular = true;
+        continue;
+      }
+      for (int i = k + 1; i < n; i++) {
+        double* rowI = data + (long)i*n;
+        rowI[k] /= rowK[k];
+        for (int j = k + 1; j < k1; j++) {
+          rowI[j] -= rowI[k] * rowK[j];
+        }
+      }
+    }
+
+    // Compute the rows of U to the right of the block, then update the rest
+    // of the matrix with the product of the block columns of L and those rows
+    if (k1 < n) {
+      for (int k = k0; k < k1; k++) {
+        const double* rowK = data + (long)k*n;
+        for (int i = k + 1; i < k1; i++) {
+          double* rowI = data + (long)i*n;
+          for (int j = k1; j < n; j++) {
+            rowI[j] -= rowI[k] * rowK[j];
+          }
+        }
+      }
+      subtractProduct(n - k1, n - k1, k1 - k0, data + (long)k1*n + k0, n, 1,
+                      nullptr, data + (long)k0*n + k1, n, 1,
+                      data + (long)k1*n + k1, n);
+    }
+  }
+}
+
+/*
+* Returns true if a pivot was exactly zero, in which case the system has no
+* unique solution.
+*/
+bool LUDecomposition::isSingular() const {
+  return singular;
+}
+
+int LUDecomposition::getSize() const {
+  return factors.getRows();
+}
+
+/*
+* Returns L and U stored in a single matrix, with the unit diagonal of L left
+* out.
+*/
+const Matrix& LUDecomposition::getFactors() const {
+  return factors;
+}
+
+/*
+* Returns the row that was swapped with row k when factoring column k.
+*/
+const std::vector<int>& LUDecomposition::getPivots() const {
+  return pivots;
+}
+
+/*
+* Returns the determinant of the factored matrix.
+*/
+double LUDecomposition::determinant() const {
+  double result = (swaps % 2 == 0) ? 1 : -1;
+  for (int i = 0; i < factors.getRows(); i++) {
+    result *= factors(i, i);
+  }
+  return result;
+}
+
+/*
+* Returns the solution X of A*X = B.
+*/
+Matrix LUDecomposition::solve(const Matrix& rhs) const {
+  Matrix result = rhs.copy();
+  solveInPlace(result);
+  return result;
+}
+
+/*
+* Replaces B with the solution X of A*X = B.
+*/
+void LUDecomposition::solveInPlace(Matrix& rhs) const {
+  int n = factors.getRows();
+  checkRows(rhs, n);
+  if (singular) {
+    std::cout << "Unable to solve a system with a singular matrix\n";
+    throw std::invalid_argument("Matrix is singular.");
+  }
+  int r = rhs.getColumns();
+  double* b = rhs.getData();
+  for (int k = 0; k < n; k++) {
+    if (pivots[k] != k) {
+      std::swap_ranges(b + (long)k*r, b + (long)(k + 1)*r,
+                       b + (long)pivots[k]*r);
+    }
+  }
+  solveLower(factors.getData(), n, true, false, b, r);
+  solveUpper(factors.getData(), n, false, false, b, r);
+}
+
+/*
+* Returns the inverse of the factored matrix. Solving with the decomposition
+* is faster and more accurate than multiplying by the inverse, so this is only
+* meant for when the inverse itself is needed.
+*/
+Matrix LUDecomposition::inverse() const {
+  Matrix result = Matrix::identity(factors.getRows());
+  solveInPlace(result);
+  return result;
+}
+
+/******************************************************************************
+* CHOLESKY DECOMPOSITION                                                      *
+******************************************************************************/
+
+/*
+* Creates an empty decomposition, to be filled by compute.
+*/
+CholeskyDecomposition::CholeskyDecomposition() :
+  factor(0, 0),
+  positiveDefinite(false)
+{}
+
+/*
+* Creates the decomposition of the given symmetric matrix.
+*/
+CholeskyDecomposition::CholeskyDecomposition(const Matrix& mat) :
+  CholeskyDecomposition()
+{
+  compute(mat);
+}
+
+/*
+* Factors the given symmetric matrix as A = L*L^T, reading only its lower
+* triangle. The storage of a previous decomposition of the same size is
+* reused.
+*/
+void CholeskyDecomposition::compute(const Matrix& mat) {
+  checkSquare(mat, "Cholesky");
+  factor = mat;
+  positiveDefinite = factorSymmetric(factor.getData(), factor.getRows(),
+                                     false);
+}
+
+/*
+* Returns false if the matrix was not positive definite, in which case the
+* decomposition can not be used.
+*/
+bool CholeskyDecomposition::isPositiveDefinite() const {
+  return positiveDefinite;
+}
+
+int CholeskyDecomposition::getSize() const {
+  return factor.getRows();
+}
+
+/*
+* Returns the lower triangular factor L.
+*/
+const Matrix& CholeskyDecomposition::getL() const {
+  return factor;
+}
+
+/*
+* Returns the determinant of the factored matrix.
+*/
+double CholeskyDecomposition::determinant() const {
+  double result = 1;
+  for (int i = 0; i < factor.getRows(); i++) {
+    result *= factor(i, i) * factor(i, i);
+  }
+  return result;
+}
+
+/*
+* Returns the solution X of A*X = B.
+*/
+Matrix CholeskyDecomposition::solve(const Matrix& rhs) const {
+  Matrix result = rhs.copy();
+  solveInPlace(result);
+  return result;
+}
+
+/*
+* Replaces B with the solution X of A*X = B.
+*/
+void CholeskyDecomposition::solveInPlace(Matrix& rhs) const {
+  int n = factor.getRows();
+  checkRows(rhs, n);
+  if (!positiveDefinite) {
+    std::cout << "Unable to solve a system with a matrix that is not "
+              << "positive definite\n";
+    throw std::invalid_argument("Matrix is not positive definite.");
+  }
+  solveSymmetric(factor.getData(), n, false, rhs.getData(),
+                 rhs.getColumns());
+}
+
+/*
+* Returns the solution X of X*A = B.
+*/
+Matrix CholeskyDecomposition::solveRight(const Matrix& rhs) const {
+  Matrix result = rhs.copy();
+  solveRightInPlace(result);
+  return result;
+}
+
+/*
+* Replaces B with the solution X of X*A = B. Since A is symmetric, every row
+* x of X is the solution of A*x^T = b^T for the same row b of B, which is
+* solved where it is stored.
+*/
+void CholeskyDecomposition::solveRightInPlace(Matrix& rhs) const {
+  int n = factor.getRows();
+  checkColumns(rhs, n);
+  if (!positiveDefinite) {
+    std::cout << "Unable to solve a system with a matrix that is not "
+              << "positive definite\n";
+    throw std::invalid_argument("Matrix is not positive definite.");
+  }
+  for (int i = 0; i < rhs.getRows(); i++) {
+    double* row = rhs.getData() + (long)i*n;
+    if (n <= BLOCK) {
+      solveSymmetricVector(factor.getData(), n, false, row);
+    } else {
+      solveSymmetric(factor.getData(), n, false, row, 1);
+    }
+  }
+}
+
+/******************************************************************************
+* LDLT DECOMPOSITION                                                          *
+******************************************************************************/
+
+/*
+* Creates an empty decomposition, to be filled by compute.
+*/
+LDLTDecomposition::LDLTDecomposition() :
+  factor(0, 0),
+  singular(true)
+{}
+
+/*
+* Creates the decomposition of the given symmetric matrix.
+*/
+LDLTDecomposition::LDLTDecomposition(const Matrix& mat) : LDLTDecomposition() {
+  compute(mat);
+}
+
+/*
+* Factors the given symmetric matrix as A = L*D*L^T, reading only its lower
+* triangle. The storage of a previous decomposition of the same size is
+* reused.
+*/
+void LDLTDecomposition::compute(const Matrix& mat) {
+  checkSquare(mat, "LDLT");
+  factor = mat;
+  singular = !factorSymmetric(factor.getData(), factor.getRows(), true);
+}
+
+/*
+* Returns true if a pivot was exactly zero, in which case the decomposition
+* can not be used.
+*/
+bool LDLTDecomposition::isSingular() const {
+  return singular;
+}
+
+int LDLTDecomposition::getSize() const {
+  return factor.getRows();
+}
+
+/*
+* Returns L below the diagonal, with its unit diagonal left out, and D on the
+* diagonal.
+*/
+const Matrix& LDLTDecomposition::getFactors() const {
+  return factor;
+}
+
+/*
+* Returns the determinant of the factored matrix.
+*/
+double LDLTDecomposition::determinant() const {
+  double result = 1;
+  for (int i = 0; i < factor.getRows(); i++) {
+    result *= factor(i, i);
+  }
+  return result;
+}
+
+/*
+* Returns the solution X of A*X = B.
+*/
+Matrix LDLTDecomposition::solve(const Matrix& rhs) const {
+  Matrix result = rhs.copy();
+  solveInPlace(result);
+  return result;
+}
+
+/*
+* Replaces B with the solution X of A*X = B.
+*/
+void LDLTDecomposition::solveInPlace(Matrix& rhs) const {
+  int n = factor.getRows();
+  checkRows(rhs, n);
+  if (singular) {
+    std::cout << "Unable to solve a system with a singular matrix\n";
+    throw std::invalid_argument("Matrix is singular.");
+  }
+  solveSymmetric(factor.getData(), n, true, rhs.getData(),
+                 rhs.getColumns());
+}
+
+/*
+* Returns the solution X of X*A = B.
+*/
+Matrix LDLTDecomposition::solveRight(const Matrix& rhs) const {
+  Matrix result = rhs.copy();
+  solveRightInPlace(result);
+  return result;
+}
+
+/*
+* Replaces B with the solution X of X*A = B. Since A is symmetric, every row
+* x of X is the solution of A*x^T = b^T for the same row b of B, which is
+* solved where it is stored.
+*/
+void LDLTDecomposition::solveRightInPlace(Matrix& rhs) const {
+  int n = factor.getRows();
+  checkColumns(rhs, n);
+  if (singular) {
+    std::cout << "Unable to solve a system with a singular matrix\n";
+    throw std::invalid_argument("Matrix is singular.");
+  }
+  for (int i = 0; i < rhs.getRows(); i++) {
+    double* row = rhs.getData() + (long)i*n;
+    if (n <= BLOCK) {
+      solveSymmetricVector(factor.getData(), n, true, row);
+    } else {
+      solveSymmetric(factor.getData(), n, true, row, 1);
+    }
+  }
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+*                          Matrix decompositions                              *
+*                                                                             *
+* Factorizations of square matrices for solving linear systems without       *
+* forming an inverse:                                                         *
+*                                                                             *
+* - LUDecomposition factors any square matrix as P*A = L*U with partial       *
+*   pivoting.                                                                 *
+* - CholeskyDecomposition factors a symmetric positive definite matrix, such *
+*   as a covariance, as A = L*L^T.                                            *
+* - LDLTDecomposition factors a symmetric matrix as A = L*D*L^T without       *
+*   square roots, and also handles matrices that are only semidefinite or     *
+*   indefinite, as long as no pivot is zero.                                  *
+*                                                                             *
+* The symmetric decompositions only read the lower triangle of the matrix.   *
+* Large matrices are factored in blocks of columns, and most of the work is   *
+* done by the blocked products in gemm.cpp.                                   *
+*                                                                             *
+* A decomposition keeps its storage between calls to compute, so one object  *
+* can factor a new matrix of the same size every frame without allocating.    *
+* solve returns the solution X of A*X = B for one or many right-hand sides,  *
+* and solveRight returns the solution X of X*A = B, such as the Kalman gain   *
+* K = P*H^T*S^-1 for S = H*P*H^T + R:                                         *
+*                                                                             *
+*   CholeskyDecomposition innovation(S);                                      *
+*   Matrix K = innovation.solveRight(P * H.T());                              *
+*                                                                             *
+******************************************************************************/
+#ifndef DECOMPOSITION_HPP
+#define DECOMPOSITION_HPP
+
+#include <vector>
+
+#include "matrix.hpp"
+
+class LUDecomposition {
+  private:
+    Matrix factors;
+    std::vector<int> pivots;
+    int swaps;
+    bool singular;
+
+  public:
+    LUDecomposition();
+    explicit LUDecomposition(const Matrix& mat);
+
+    void compute(const Matrix& mat);
+    bool isSingular() const;
+    int getSize() const;
+    const Matrix& getFactors() const;
+    const std::vector<int>& getPivots() const;
+    double determinant() const;
+
+    Matrix solve(const Matrix& rhs) const;
+    void solveInPlace(Matrix& rhs) const;
+    Matrix inverse() const;
+};
+
+class CholeskyDecomposition {
+  private:
+    Matrix factor;
+    bool positiveDefinite;
+
+  public:
+    CholeskyDecomposition();
+    explicit CholeskyDecomposition(const Matrix& mat);
+
+    void compute(const Matrix& mat);
+    bool isPositiveDefinite() const;
+    int getSize() const;
+    const Matrix& getL() const;
+    double determinant() const;
+
+    Matrix solve(const Matrix& rhs) const;
+    void solveInPlace(Matrix& rhs) const;
+    Matrix solveRight(const Matrix& rhs) const;
+    void solveRightInPlace(Matrix& rhs) const;
+};
+
+class LDLTDecomposition {
+  private:
+    Matrix factor;
+    bool singular;
+
+  public:
+    LDLTDecomposition();
+    explicit LDLTDecomposition(const Matrix& mat);
+
+    void compute(const Matrix& mat);
+    bool isSingular() const;
+    int getSize() const;
+    const Matrix& getFactors() const;
+    double determinant() const;
+
+    Matrix solve(const Matrix& rhs) const;
+    void solveInPlace(Matrix& rhs) const;
+    Matrix solveRight(const Matrix& rhs) const;
+    void solveRightInPlace(Matrix& rhs) const;
+};
+
+#endif
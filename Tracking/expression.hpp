@@ -0,0 +1,915 @@
+/******************************************************************************
+*                          Matrix expressions                                 *
+*                                                                             *
+* Lazy evaluation of elementwise matrix arithmetic. The +, -, * and /         *
+* operators do not compute anything on their own. Instead they build a tree   *
+* of expression objects whose type describes the whole calculation. The tree *
+* is evaluated in a single loop when it is assigned to a Matrix, so a chain   *
+* such as "2.5 + mat * 2 - other" reads every input once, writes the output   *
+* once and needs no intermediate matrices.                                    *
+*                                                                             *
+* Matrix products are not elementwise, so the operands of a product are       *
+* evaluated into matrices first and the product itself is returned as a new   *
+* Matrix, which then takes part in the rest of the expression. Matrices and   *
+* views are multiplied directly, without copying them.                        *
+*                                                                             *
+* Operands of different sizes are broadcast like in NumPy: a row of size      *
+* (1, n) is combined with every row of an (m, n) operand, a column of size    *
+* (m, 1) with every column, and a (1, 1) matrix with every element. Repeated  *
+* operands are read in place instead of being copied to the full size, so    *
+* "features - mean(features, 0)" centers every column in a single pass.       *
+*                                                                             *
+* Views take part in expressions like matrices. If the destination of an      *
+* assignment overlaps an operand with a different layout, for example when    *
+* assigning the transpose of a matrix to itself, the expression is first      *
+* evaluated into a temporary matrix.                                          *
+*                                                                             *
+* Expressions hold references to the matrices they read, so they should be   *
+* assigned to a Matrix in the statement that creates them rather than stored  *
+* with "auto". Temporary matrices, such as the result of a product, are moved *
+* into the expression and their array is reused for the result if possible.  *
+*                                                                             *
+* This header is included at the end of matrix.hpp and should not be         *
+* included on its own.                                                        *
+*                                                                             *
+******************************************************************************/
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+
+#include <type_traits>
+#include <utility>
+
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+/******************************************************************************
+* OPERATIONS                                                                  *
+******************************************************************************/
+
+// Every operation knows how to combine two values, how to describe itself in
+// error messages and which elementwise kernels implement it for whole arrays
+
+struct AddOperation {
+  static constexpr const char* verb = "add";
+  static constexpr const char* symbol = "+";
+  static double apply(double left, double right) { return left + right; }
+};
+
+struct SubtractOperation {
+  static constexpr const char* verb = "subtract";
+  static constexpr const char* symbol = "-";
+  static double apply(double left, double right) { return left - right; }
+};
+
+struct MultiplyOperation {
+  static constexpr const char* verb = "multiply";
+  static constexpr const char* symbol = "*";
+  static double apply(double left, double right) { return left * right; }
+};
+
+struct DivideOperation {
+  static constexpr const char* verb = "divide";
+  static constexpr const char* symbol = "/";
+  static double apply(double left, double right) { return left / right; }
+};
+
+/******************************************************************************
+* EXPRESSION NODES                                                            *
+******************************************************************************/
+
+/*
+* Base class of every expression. Derived classes provide getRows(),
+* getColumns(), the element at (row, column) through at(), the element at a
+* row major index through operator[] if all leaves are contiguous and none is
+* broadcast, aliases(), which tells whether a leaf overlaps the given
+* destination with a different layout, broadcasts(), which tells whether an
+* operand is repeated to the size of another, and reusable(), which returns a
+* temporary matrix owned by the expression whose array may be used to store
+* the result, or nullptr if there is none. Leaves holding elements in memory
+* also give the address of a row through rowData() and the distance between
+* its elements through getColumnStep().
+*/
+template <typename Derived>
+class MatrixExpression {
+  public:
+    const Derived& derived() const {
+      return static_cast<const Derived&>(*this);
+    }
+    Derived& derived() {
+      return static_cast<Derived&>(*this);
+    }
+};
+
+/*
+* Returns true if the strided block at data overlaps the destination block at
+* out, unless both describe exactly the same elements in the same order.
+*/
+inline bool blocksAlias(const double* data, int rows, int cols, int rs,
+                        int cs, const double* out, int outRows, int outCols,
+                        int outRs, int outCs) {
+  if ((rows <= 0) || (cols <= 0) || (outRows <= 0) || (outCols <= 0)) {
+    return false;
+  }
+  if ((data == out) && (rows == outRows) && (cols == outCols) &&
+      ((rows == 1) || (rs == outRs)) && ((cols == 1) || (cs == outCs))) {
+    return false;
+  }
+  const double* last = data + (long)(rows - 1)*rs + (long)(cols - 1)*cs;
+  const double* outLast = out + (long)(outRows - 1)*outRs +
+                          (long)(outCols - 1)*outCs;
+  return (data <= outLast) && (out <= last);
+}
+
+/*
+* Leaf referring to a matrix that outlives the expression.
+*/
+class MatrixLeaf : public MatrixExpression<MatrixLeaf> {
+  private:
+    const double* data;
+    int rows;
+    int cols;
+
+  public:
+    MatrixLeaf(const Matrix& mat) :
+      data(mat.getData()),
+      rows(mat.getRows()),
+      cols(mat.getColumns()) {};
+
+    int getRows() const { return rows; }
+    int getColumns() const { return cols; }
+    const double* getData() const { return data; }
+    double operator[](long i) const { return data[i]; }
+    double at(int row, int column) const { return data[row*cols + column]; }
+    const double* rowData(int row) const { return data + (long)row*cols; }
+    long getColumnStep() const { return 1; }
+    bool aliases(const double* out, int outRows, int outCols, int outRs,
+                 int outCs) const {
+      return blocksAlias(data, rows, cols, cols, 1, out, outRows, outCols,
+                         outRs, outCs);
+    }
+    bool broadcasts() const { return false; }
+    Matrix* reusable() const { return nullptr; }
+};
+
+/*
+* Leaf owning a temporary matrix that was moved into the expression. Its array
+* can hold the result, unless it is borrowed from the caller.
+*/
+class TemporaryLeaf : public MatrixExpression<TemporaryLeaf> {
+  private:
+    mutable Matrix mat;
+
+  public:
+    TemporaryLeaf(Matrix&& temporary) :
+      mat(std::move(temporary)) {};
+
+    int getRows() const { return mat.getRows(); }
+    int getColumns() const { return mat.getColumns(); }
+    const double* getData() const { return mat.getData(); }
+    double operator[](long i) const { return mat.getData()[i]; }
+    double at(int row, int column) const {
+      return mat.getData()[row*mat.getColumns() + column];
+    }
+    const double* rowData(int row) const {
+      return mat.getData() + (long)row*mat.getColumns();
+    }
+    long getColumnStep() const { return 1; }
+    bool aliases(const double*, int, int, int, int) const { return false; }
+    bool broadcasts() const { return false; }
+    Matrix* reusable() const {
+      return mat.isBorrowed() ? nullptr : &mat;
+    }
+};
+
+/*
+* Leaf for a number, which takes the shape of the other operand. Its size is
+* reported as (-1, -1).
+*/
+class ScalarLeaf : public MatrixExpression<ScalarLeaf> {
+  private:
+    double value;
+
+  public:
+    ScalarLeaf(double num) :
+      value(num) {};
+
+    int getRows() const { return -1; }
+    int getColumns() const { return -1; }
+    double getValue() const { return value; }
+    double operator[](long) const { return value; }
+    double at(int, int) const { return value; }
+    bool aliases(const double*, int, int, int, int) const { return false; }
+    bool broadcasts() const { return false; }
+    Matrix* reusable() const { return nullptr; }
+};
+
+/*
+* Leaf referring to the elements of a view, which may be strided.
+*/
+class ViewLeaf : public MatrixExpression<ViewLeaf> {
+  private:
+    const double* data;
+    int rows;
+    int cols;
+    int rowStride;
+    int colStride;
+
+  public:
+    ViewLeaf(const MatrixView& view) :
+      data(view.getData()),
+      rows(view.getRows()),
+      cols(view.getColumns()),
+      rowStride(view.getRowStride()),
+      colStride(view.getColumnStride()) {};
+
+    int getRows() const { return rows; }
+    int getColumns() const { return cols; }
+    double at(int row, int column) const {
+      return data[(long)row*rowStride + (long)column*colStride];
+    }
+    const double* rowData(int row) const {
+      return data + (long)row*rowStride;
+    }
+    long getColumnStep() const { return colStride; }
+    bool aliases(const double* out, int outRows, int outCols, int outRs,
+                 int outCs) const {
+      return blocksAlias(data, rows, cols, rowStride, colStride, out, outRows,
+                         outCols, outRs, outCs);
+    }
+    bool broadcasts() const { return false; }
+    Matrix* reusable() const { return nullptr; }
+};
+
+/*
+* Refers to another expression without copying it. Used by the compound
+* assignment operators.
+*/
+template <typename E>
+class ExpressionReference : public MatrixExpression<ExpressionReference<E>> {
+  private:
+    const E& expr;
+
+  public:
+    ExpressionReference(const E& expression) :
+      expr(expression) {};
+
+    int getRows() const { return expr.getRows(); }
+    int getColumns() const { return expr.getColumns(); }
+    double operator[](long i) const { return expr[i]; }
+    double at(int row, int column) const { return expr.at(row, column); }
+    bool aliases(const double* out, int outRows, int outCols, int outRs,
+                 int outCs) const {
+      return expr.aliases(out, outRows, outCols, outRs, outCs);
+    }
+    bool broadcasts() const { return expr.broadcasts(); }
+    Matrix* reusable() const { return nullptr; }
+};
+
+/*
+* Applies an operation to the corresponding elements of two expressions. The
+* dimensions are checked when the node is created and follow the NumPy
+* broadcasting rules: they have to be equal, or one of them has to be 1, in
+* which case that row or column is repeated along the dimension of the other
+* operand. Repeated operands are read at row or column 0 instead of being
+* copied.
+*/
+template <typename Left, typename Right, typename Operation>
+class BinaryExpression :
+  public MatrixExpression<BinaryExpression<Left, Right, Operation>> {
+  private:
+    Left left;
+    Right right;
+    int rows;
+    int cols;
+    bool leftRows;
+    bool leftColumns;
+    bool rightRows;
+    bool rightColumns;
+
+  public:
+    typedef Left LeftType;
+    typedef Right RightType;
+    typedef Operation OperationType;
+
+    BinaryExpression(Left&& left_operand, Right&& right_operand) :
+      left(std::move(left_operand)),
+      right(std::move(right_operand)),
+      rows((left.getRows() >= 0) ? left.getRows() : right.getRows()),
+      cols((left.getRows() >= 0) ? left.getColumns() : right.getColumns()),
+      leftRows(false),
+      leftColumns(false),
+      rightRows(false),
+      rightColumns(false)
+    {
+      if ((left.getRows() < 0) || (right.getRows() < 0)) {
+        return;
+      }
+      int lr = left.getRows();
+      int lc = left.getColumns();
+      int rr = right.getRows();
+      int rc = right.getColumns();
+      if (((lr != rr) && (lr != 1) && (rr != 1)) ||
+          ((lc != rc) && (lc != 1) && (rc != 1))) {
+        std::cout << "Unable to " << Operation::verb
+                  << " matrices with differing dimensions: ("
+                  << lr << ", " << lc << ") " << Operation::symbol << " ("
+                  << rr << ", " << rc << ")\n";
+        throw std::invalid_argument("Matrix dimension do not match.");
+      }
+      rows = (lr == 1) ? rr : lr;
+      cols = (lc == 1) ? rc : lc;
+      leftRows = (lr != rows);
+      leftColumns = (lc != cols);
+      rightRows = (rr != rows);
+      rightColumns = (rc != cols);
+    }
+
+    int getRows() const { return rows; }
+    int getColumns() const { return cols; }
+    double operator[](long i) const {
+      return Operation::apply(left[i], right[i]);
+    }
+    double at(int row, int column) const {
+      return Operation::apply(
+        left.at(leftRows ? 0 : row, leftColumns ? 0 : column),
+        right.at(rightRows ? 0 : row, rightColumns ? 0 : column));
+    }
+    bool aliases(const double* out, int outRows, int outCols, int outRs,
+                 int outCs) const {
+      return left.aliases(out, outRows, outCols, outRs, outCs) ||
+             right.aliases(out, outRows, outCols, outRs, outCs);
+    }
+    // True if an operand anywhere in the expression is broadcast, in which
+    // case the elements cannot be read with a single row major index
+    bool broadcasts() const {
+      return leftRows || leftColumns || rightRows || rightColumns ||
+             left.broadcasts() || right.broadcasts();
+    }
+    // Only a temporary with the dimensions of the result can hold it
+    Matrix* reusable() const {
+      Matrix* mat = (leftRows || leftColumns) ? nullptr : left.reusable();
+      if ((mat == nullptr) && !rightRows && !rightColumns) {
+        mat = right.reusable();
+      }
+      return mat;
+    }
+    bool broadcastsLeft(bool alongRows) const {
+      return alongRows ? leftRows : leftColumns;
+    }
+    bool broadcastsRight(bool alongRows) const {
+      return alongRows ? rightRows : rightColumns;
+    }
+    const Left& getLeft() const { return left; }
+    const Right& getRight() const { return right; }
+};
+
+/******************************************************************************
+* TYPE TRAITS                                                                 *
+******************************************************************************/
+
+template <typename T>
+struct isMatrixExpression :
+  std::is_base_of<MatrixExpression<T>, T> {};
+
+// True for matrices, views and expressions, which can be operands of an 
+// expression
+template <typename T>
+struct isMatrixOperand :
+  std::integral_constant<bool, std::is_same<T, Matrix>::value ||
+                               std::is_same<T, MatrixView>::value ||
+                               isMatrixExpression<T>::value> {};
+
+// True for matrices and views, which hold their elements in memory
+template <typename T>
+struct isStoredOperand :
+  std::integral_constant<bool, std::is_same<T, Matrix>::value ||
+                               std::is_same<T, MatrixView>::value> {};
+
+// True for expressions whose leaves are all contiguous, so that they can be
+// evaluated with a single row major index
+template <typename T>
+struct isFlat : std::true_type {};
+template <>
+struct isFlat<ViewLeaf> : std::false_type {};
+template <typename E>
+struct isFlat<ExpressionReference<E>> : isFlat<E> {};
+template <typename L, typename R, typename O>
+struct isFlat<BinaryExpression<L, R, O>> :
+  std::integral_constant<bool, isFlat<L>::value && isFlat<R>::value> {};
+
+// True for leaves whose elements are stored in a contiguous array
+template <typename T>
+struct isArrayLeaf :
+  std::integral_constant<bool, std::is_same<T, MatrixLeaf>::value ||
+                               std::is_same<T, TemporaryLeaf>::value> {};
+
+// True for leaves whose rows are stored in memory
+template <typename T>
+struct isRowLeaf :
+  std::integral_constant<bool, isArrayLeaf<T>::value ||
+                               std::is_same<T, ViewLeaf>::value> {};
+
+// True for operations directly on leaves, which are evaluated row by row with
+// the elementwise kernels when an operand is broadcast
+template <typename T>
+struct isLeafOperation : std::false_type {};
+template <typename L, typename R, typename O>
+struct isLeafOperation<BinaryExpression<L, R, O>> :
+  std::integral_constant<bool,
+    (isRowLeaf<L>::value || std::is_same<L, ScalarLeaf>::value) &&
+    (isRowLeaf<R>::value || std::is_same<R, ScalarLeaf>::value)> {};
+
+// Enables an operator if one side is a matrix operand and the other side is
+// a matrix operand or a number
+template <typename L, typename R>
+using enableIfExpressionOperands = typename std::enable_if<
+  (isMatrixOperand<typename std::decay<L>::type>::value &&
+   (isMatrixOperand<typename std::decay<R>::type>::value ||
+    std::is_arithmetic<typename std::decay<R>::type>::value)) ||
+  (std::is_arithmetic<typename std::decay<L>::type>::value &&
+   isMatrixOperand<typename std::decay<R>::type>::value)>::type;
+
+/******************************************************************************
+* BUILDING EXPRESSIONS                                                        *
+******************************************************************************/
+
+// Converts an operand into the node that represents it in an expression
+inline MatrixLeaf toExpression(const Matrix& mat) {
+  return MatrixLeaf(mat);
+}
+inline MatrixLeaf toExpression(Matrix& mat) {
+  return MatrixLeaf(mat);
+}
+inline TemporaryLeaf toExpression(Matrix&& mat) {
+  return TemporaryLeaf(std::move(mat));
+}
+inline ViewLeaf toExpression(const MatrixView& view) {
+  return ViewLeaf(view);
+}
+inline ScalarLeaf toExpression(double num) {
+  return ScalarLeaf(num);
+}
+template <typename E>
+E toExpression(const MatrixExpression<E>& expr) {
+  return expr.derived();
+}
+template <typename E>
+E toExpression(MatrixExpression<E>&& expr) {
+  return std::move(expr.derived());
+}
+
+template <typename Operation, typename L, typename R>
+auto makeExpression(L&& left, R&& right) {
+  auto leftNode = toExpression(std::forward<L>(left));
+  auto rightNode = toExpression(std::forward<R>(right));
+  return BinaryExpression<decltype(leftNode), decltype(rightNode), Operation>(
+           std::move(leftNode), std::move(rightNode));
+}
+
+// Turns a product operand into a matrix or view, without copying existing 
+// matrices or views
+inline const Matrix& materialize(const Matrix& mat) {
+  return mat;
+}
+inline const MatrixView& materialize(const MatrixView& view) {
+  return view;
+}
+template <typename E>
+Matrix materialize(const MatrixExpression<E>& expr) {
+  return Matrix(expr);
+}
+template <typename E>
+Matrix materialize(MatrixExpression<E>&& expr) {
+  return Matrix(std::move(expr));
+}
+
+/******************************************************************************
+* EVALUATION                                                                  *
+******************************************************************************/
+
+/*
+* Writes the elements begin to end (exclusive) of a flat expression into out.
+* An operation directly on arrays or on an array and a number is handed to 
+* the vectorized elementwise kernels, everything else is evaluated in one 
+* fused loop.
+*/
+template <typename E>
+void evaluateRange(double* out, const E& expr, long begin, long end) {
+  long n = end - begin;
+  if constexpr (isArrayLeaf<E>::value) {
+    if (out != expr.getData()) {
+      std::copy(expr.getData() + begin, expr.getData() + end, out + begin);
+    }
+  } else if constexpr (std::is_same<E, ScalarLeaf>::value) {
+    std::fill(out + begin, out + end, expr.getValue());
+  } else {
+    typedef typename E::LeftType L;
+    typedef typename E::RightType R;
+    typedef typename E::OperationType O;
+    const ElementwiseKernels& k = kernels();
+    if constexpr (isArrayLeaf<L>::value && isArrayLeaf<R>::value) {
+      const double* a = expr.getLeft().getData() + begin;
+      const double* b = expr.getRight().getData() + begin;
+      if constexpr (std::is_same<O, AddOperation>::value) {
+        return k.add(out + begin, a, b, n);
+      } else if constexpr (std::is_same<O, SubtractOperation>::value) {
+        return k.subtract(out + begin, a, b, n);
+      } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+        return k.multiply(out + begin, a, b, n);
+      } else {
+        return k.divide(out + begin, a, b, n);
+      }
+    } else if constexpr (isArrayLeaf<L>::value &&
+                         std::is_same<R, ScalarLeaf>::value) {
+      const double* a = expr.getLeft().getData() + begin;
+      double value = expr.getRight().getValue();
+      if constexpr (std::is_same<O, AddOperation>::value) {
+        return k.addScalar(out + begin, a, value, n);
+      } else if constexpr (std::is_same<O, SubtractOperation>::value) {
+        return k.addScalar(out + begin, a, -value, n);
+      } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+        return k.multiplyScalar(out + begin, a, value, n);
+      } else {
+        return k.divideScalar(out + begin, a, value, n);
+      }
+    } else if constexpr (std::is_same<L, ScalarLeaf>::value &&
+                         isArrayLeaf<R>::value &&
+                         !std::is_same<O, SubtractOperation>::value) {
+      double value = expr.getLeft().getValue();
+      const double* a = expr.getRight().getData() + begin;
+      if constexpr (std::is_same<O, AddOperation>::value) {
+        return k.addScalar(out + begin, a, value, n);
+      } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+        return k.multiplyScalar(out + begin, a, value, n);
+      } else {
+        return k.scalarDivide(out + begin, value, a, n);
+      }
+    }
+    for (long i = begin; i < end; i++) {
+      out[i] = expr[i];
+    }
+  }
+}
+
+/*
+* Gives the elements of a leaf in one row of the result, either as a
+* contiguous array or as a single value that is repeated along the row.
+* Returns false for rows whose elements are strided.
+*/
+template <typename Leaf>
+bool rowOperand(const Leaf& leaf, bool repeatRows, bool repeatColumns,
+                int row, const double*& array, double& value) {
+  array = nullptr;
+  if constexpr (std::is_same<Leaf, ScalarLeaf>::value) {
+    value = leaf.getValue();
+    return true;
+  } else {
+    const double* data = leaf.rowData(repeatRows ? 0 : row);
+    if (repeatColumns) {
+      value = data[0];
+    } else if (leaf.getColumnStep() == 1) {
+      array = data;
+    } else {
+      return false;
+    }
+    return true;
+  }
+}
+
+/*
+* Writes one row of an expression with cols columns into out. An operation on
+* two leaves that each give a contiguous row or a repeated value, such as a
+* matrix minus a row of means, is handed to the elementwise kernels, 
+* everything else is evaluated in one fused loop.
+*/
+template <typename E>
+void evaluateRow(double* out, const E& expr, int row, int cols) {
+  if constexpr (isLeafOperation<E>::value) {
+    typedef typename E::OperationType O;
+    const double* a;
+    const double* b;
+    double aValue = 0;
+    double bValue = 0;
+    if (rowOperand(expr.getLeft(), expr.broadcastsLeft(true),
+                   expr.broadcastsLeft(false), row, a, aValue) &&
+        rowOperand(expr.getRight(), expr.broadcastsRight(true),
+                   expr.broadcastsRight(false), row, b, bValue)) {
+      const ElementwiseKernels& k = kernels();
+      if ((a != nullptr) && (b != nullptr)) {
+        if constexpr (std::is_same<O, AddOperation>::value) {
+          return k.add(out, a, b, cols);
+        } else if constexpr (std::is_same<O, SubtractOperation>::value) {
+          return k.subtract(out, a, b, cols);
+        } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+          return k.multiply(out, a, b, cols);
+        } else {
+          return k.divide(out, a, b, cols);
+        }
+      } else if (a != nullptr) {
+        if constexpr (std::is_same<O, AddOperation>::value) {
+          return k.addScalar(out, a, bValue, cols);
+        } else if constexpr (std::is_same<O, SubtractOperation>::value) {
+          return k.addScalar(out, a, -bValue, cols);
+        } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+          return k.multiplyScalar(out, a, bValue, cols);
+        } else {
+          return k.divideScalar(out, a, bValue, cols);
+        }
+      } else if (b == nullptr) {
+        return std::fill(out, out + cols, O::apply(aValue, bValue));
+      } else if constexpr (std::is_same<O, AddOperation>::value) {
+        return k.addScalar(out, b, aValue, cols);
+      } else if constexpr (std::is_same<O, MultiplyOperation>::value) {
+        return k.multiplyScalar(out, b, aValue, cols);
+      } else if constexpr (std::is_same<O, DivideOperation>::value) {
+        return k.scalarDivide(out, aValue, b, cols);
+      }
+    }
+  }
+  for (int c = 0; c < cols; c++) {
+    out[c] = expr.at(row, c);
+  }
+}
+
+/*
+* Writes the rows of the expression into out, where consecutive rows start
+* rowStride elements apart. Large expressions are split into ranges of rows
+* that are evaluated in parallel.
+*/
+template <typename E>
+void evaluateRows(double* out, long rowStride, int rows, int cols,
+                  const E& expr) {
+  long grain = std::max(1L, PARALLEL_GRAIN / std::max(cols, 1));
+  parallelFor(rows, grain, [&](long first, long last) {
+    for (int r = (int)first; r < (int)last; r++) {
+      evaluateRow(out + r*rowStride, expr, r, cols);
+    }
+  });
+}
+
+/*
+* Writes the elements of the expression into out, which has room for every
+* element and may be the array of one of the matrices in the expression. 
+* Large expressions are split into ranges that are evaluated in parallel.
+* Expressions with strided or broadcast operands are evaluated row by row.
+*/
+template <typename E>
+void evaluateExpression(double* out, const E& expr) {
+  long n = (long)expr.getRows() * expr.getColumns();
+  if constexpr (isFlat<E>::value) {
+    if (!expr.broadcasts()) {
+      parallelFor(n, PARALLEL_GRAIN, [&](long begin, long end) {
+        evaluateRange(out, expr, begin, end);
+      });
+      return;
+    }
+  }
+  evaluateRows(out, expr.getColumns(), expr.getRows(), expr.getColumns(),
+               expr);
+}
+
+/*
+* Writes the elements of the expression into a strided destination block. If
+* an operand overlaps the destination with a different layout, the expression
+* is evaluated into a temporary matrix first. A number on its own fills the
+* block.
+*/
+template <typename E>
+void assignExpression(double* out, int rows, int cols, int rowStride,
+                      int colStride, const E& expr) {
+  if ((expr.getRows() >= 0) &&
+      ((expr.getRows() != rows) || (expr.getColumns() != cols))) {
+    std::cout << "Unable to assign matrix of size (" << expr.getRows() << ", "
+              << expr.getColumns() << ") to block of size (" << rows << ", "
+              << cols << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  if (expr.aliases(out, rows, cols, rowStride, colStride)) {
+    Matrix temporary(expr);
+    assignExpression(out, rows, cols, rowStride, colStride,
+                     MatrixLeaf(temporary));
+  } else if ((colStride == 1) && ((rowStride == cols) || (rows == 1)) &&
+             (expr.getRows() >= 0)) {
+    evaluateExpression(out, expr);
+  } else if (colStride == 1) {
+    evaluateRows(out, rowStride, rows, cols, expr);
+  } else {
+    long grain = std::max(1L, PARALLEL_GRAIN / std::max(cols, 1));
+    parallelFor(rows, grain, [&](long first, long last) {
+      for (int r = (int)first; r < (int)last; r++) {
+        double* outRow = out + (long)r*rowStride;
+        for (int c = 0; c < cols; c++) {
+          outRow[(long)c*colStride] = expr.at(r, c);
+        }
+      }
+    });
+  }
+}
+
+/******************************************************************************
+* MATRIX MEMBERS TAKING EXPRESSIONS                                           *
+******************************************************************************/
+
+/*
+* Creates a matrix holding the result of the given expression.
+*/
+template <typename E>
+Matrix::BasicMatrix(const MatrixExpression<E>& expr) :
+  rows(expr.derived().getRows()),
+  cols(expr.derived().getColumns()),
+  capacity((long)rows * cols),
+  matrix(allocateMatrix(rows * cols)),
+  deleter(nullptr),
+  context(nullptr)
+{
+  evaluateExpression(matrix, expr.derived());
+}
+
+/*
+* Creates a matrix holding the result of the given temporary expression. If
+* the expression owns a temporary matrix of the right size, its array is
+* taken over instead of allocating a new one.
+*/
+template <typename E>
+Matrix::BasicMatrix(MatrixExpression<E>&& expr) :
+  rows(0),
+  cols(0),
+  capacity(0),
+  matrix(nullptr),
+  deleter(nullptr),
+  context(nullptr)
+{
+  const E& e = expr.derived();
+  Matrix* temporary = e.reusable();
+  if (temporary != nullptr) {
+    evaluateExpression(temporary->matrix, e);
+    swap(*temporary);
+  } else {
+    rows = e.getRows();
+    cols = e.getColumns();
+    capacity = (long)rows * cols;
+    matrix = allocateMatrix(rows * cols);
+    evaluateExpression(matrix, e);
+  }
+}
+
+/*
+* Replaces the values of the matrix with the result of the expression. The
+* existing array is reused if it has room for the result, even if the matrix
+* appears in the expression, since every element only depends on the elements
+* at the same position. If the matrix is broadcast to a larger result, the
+* result is evaluated into a new array instead.
+*/
+template <typename E>
+Matrix& Matrix::operator=(const MatrixExpression<E>& expr) {
+  const E& e = expr.derived();
+  if (((long)e.getRows()*e.getColumns() <= capacity) &&
+      !e.aliases(matrix, e.getRows(), e.getColumns(), e.getColumns(), 1)) {
+    evaluateExpression(matrix, e);
+    rows = e.getRows();
+    cols = e.getColumns();
+  } else {
+    HeapScope heap;
+    Matrix result(expr);
+    swap(result);
+  }
+  return *this;
+}
+
+/*
+* Replaces the values of the matrix with the result of the temporary 
+* expression. If the array of the matrix is too small, the array of a 
+* temporary matrix in the expression is taken over if possible, unless it
+* came from an arena that the matrix may outlive.
+*/
+template <typename E>
+Matrix& Matrix::operator=(MatrixExpression<E>&& expr) {
+  const E& e = expr.derived();
+  if (((long)e.getRows()*e.getColumns() <= capacity) &&
+      !e.aliases(matrix, e.getRows(), e.getColumns(), e.getColumns(), 1)) {
+    evaluateExpression(matrix, e);
+    rows = e.getRows();
+    cols = e.getColumns();
+  } else {
+    HeapScope heap;
+    Matrix* temporary = e.reusable();
+    if ((temporary != nullptr) && (temporary->deleter == nullptr) &&
+        isArenaArray(temporary->matrix)) {
+      Matrix result(expr);
+      swap(result);
+    } else {
+      Matrix result(std::move(expr));
+      swap(result);
+    }
+  }
+  return *this;
+}
+
+/*
+* Compound assignment with an expression, evaluated in place in one pass.
+*/
+template <typename E>
+Matrix& Matrix::operator+=(const MatrixExpression<E>& expr) {
+  assignExpression(matrix, rows, cols, cols, 1,
+    BinaryExpression<MatrixLeaf, ExpressionReference<E>, AddOperation>(
+      MatrixLeaf(*this), ExpressionReference<E>(expr.derived())));
+  return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator-=(const MatrixExpression<E>& expr) {
+  assignExpression(matrix, rows, cols, cols, 1,
+    BinaryExpression<MatrixLeaf, ExpressionReference<E>, SubtractOperation>(
+      MatrixLeaf(*this), ExpressionReference<E>(expr.derived())));
+  return *this;
+}
+
+template <typename E>
+Matrix& Matrix::operator/=(const MatrixExpression<E>& expr) {
+  assignExpression(matrix, rows, cols, cols, 1,
+    BinaryExpression<MatrixLeaf, ExpressionReference<E>, DivideOperation>(
+      MatrixLeaf(*this), ExpressionReference<E>(expr.derived())));
+  return *this;
+}
+
+/******************************************************************************
+* VIEW MEMBERS TAKING EXPRESSIONS                                             *
+******************************************************************************/
+
+/*
+* Writes the result of the expression into the elements of the view.
+*/
+template <typename E>
+MatrixView& MatrixView::operator=(const MatrixExpression<E>& expr) {
+  checkWritable();
+  assignExpression(data, rows, cols, rowStride, colStride, expr.derived());
+  return *this;
+}
+
+/*
+* Compound assignment with an expression, evaluated in place in one pass.
+*/
+template <typename E>
+MatrixView& MatrixView::operator+=(const MatrixExpression<E>& expr) {
+  return (*this = ViewLeaf(*this) + ExpressionReference<E>(expr.derived()));
+}
+
+template <typename E>
+MatrixView& MatrixView::operator-=(const MatrixExpression<E>& expr) {
+  return (*this = ViewLeaf(*this) - ExpressionReference<E>(expr.derived()));
+}
+
+template <typename E>
+MatrixView& MatrixView::operator/=(const MatrixExpression<E>& expr) {
+  return (*this = ViewLeaf(*this) / ExpressionReference<E>(expr.derived()));
+}
+
+/******************************************************************************
+* OPERATORS                                                                   *
+******************************************************************************/
+
+/*
+* Adds matrices, expressions and numbers elementwise
+*/
+template <typename L, typename R, typename = enableIfExpressionOperands<L, R>>
+auto operator+(L&& left, R&& right) {
+  return makeExpression<AddOperation>(std::forward<L>(left),
+                                      std::forward<R>(right));
+}
+
+/*
+* Subtracts matrices, expressions and numbers elementwise
+*/
+template <typename L, typename R, typename = enableIfExpressionOperands<L, R>>
+auto operator-(L&& left, R&& right) {
+  return makeExpression<SubtractOperation>(std::forward<L>(left),
+                                           std::forward<R>(right));
+}
+
+/*
+* Multiplies two matrices or expressions with matrix multiplication, which is
+* evaluated immediately, or scales a matrix or expression by a number, which
+* is evaluated lazily
+*/
+template <typename L, typename R, typename = enableIfExpressionOperands<L, R>>
+auto operator*(L&& left, R&& right) {
+  if constexpr (std::is_arithmetic<typename std::decay<L>::type>::value ||
+                std::is_arithmetic<typename std::decay<R>::type>::value) {
+    return makeExpression<MultiplyOperation>(std::forward<L>(left),
+                                             std::forward<R>(right));
+  } else {
+    return Matrix::multiply(MatrixView(materialize(std::forward<L>(left))),
+                            MatrixView(materialize(std::forward<R>(right))));
+  }
+}
+
+/*
+* Divides matrices, expressions and numbers elementwise
+*/
+template <typename L, typename R, typename = enableIfExpressionOperands<L, R>>
+auto operator/(L&& left, R&& right) {
+  return makeExpression<DivideOperation>(std::forward<L>(left),
+                                         std::forward<R>(right));
+}
+
+#endif
@@ -0,0 +1,888 @@
+/******************************************************************************
+*                         Fast Fourier transforms                             *
+*                                                                             *
+* The transforms are Stockham autosort FFTs: every pass of radix p reads one  *
+* array and writes the other, in an order that leaves the result in natural   *
+* order without a bit reversal. Radices 8, 4, 2, 3 and 5 have their own       *
+* butterflies, and any other prime factor is summed directly.                 *
+*                                                                             *
+* Every transform works on a batch of sequences whose values are interleaved, *
+* value k of sequence j at position k * batch + j, with the real and the      *
+* imaginary parts in two separate planes. The innermost loop of each pass     *
+* then runs over the sequences of the batch, with the same twiddle factor for *
+* all of them, and is vectorized. The columns of a matrix are copied in       *
+* groups into such a batch, and the rows of a matrix are transposed into one. *
+* The batches are small enough to stay in the cache, as the passes are        *
+* limited by its bandwidth rather than by the arithmetic, and they are split  *
+* between the matrix threads.                                                 *
+*                                                                             *
+* A real row of even length 2n is transformed as n complex values, with the   *
+* even elements as real parts and the odd elements as imaginary parts. The    *
+* transforms of the even and odd elements are then separated using the        *
+* symmetry of real transforms, and combined into the spectrum of the row.     *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "fft.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Bytes of the batch of sequences transformed together. Both arrays of a
+// batch stay in the second level cache, and the passes over them run at the
+// bandwidth of the cache, so smaller batches are faster
+static const long FFT_BATCH_BYTES = 1L << 16;
+
+// Limits of the number of sequences in a batch
+static const long FFT_MIN_BATCH = 4;
+static const long FFT_MAX_BATCH = 64;
+
+// Values multiplied at a time by multiplySpectra()
+static const long FFT_MULTIPLY_CHUNK = 256;
+
+static const double FFT_PI = 3.14159265358979323846;
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Multiplies (re, im) by the twiddle factor (wr, wi) and stores the product.
+*/
+static ALWAYS_INLINE void storeTwiddled(double* outRe, double* outIm,
+                                        double re, double im, double wr,
+                                        double wi) {
+  *outRe = re * wr - im * wi;
+  *outIm = re * wi + im * wr;
+}
+
+/*
+* Pass of radix 2. The real part of value q of the sequences is x[q] and its
+* imaginary part x[plane + q], and the subsequence i of m values has the
+* twiddle factors of twiddles[2 * i]. Every output of a pass is written once,
+* so the loops over the sequences have no dependencies between iterations,
+* which the compiler cannot prove for the many output rows.
+*/
+static ALWAYS_INLINE void pass2(const double* __restrict x,
+                                double* __restrict y, long m, long s,
+                                long plane, const double* twiddles,
+                                double sign) {
+  for (long i = 0; i < m; i++) {
+    double wr = twiddles[2*i];
+    double wi = sign * twiddles[2*i + 1];
+    const double* x0 = x + s*i;
+    const double* x1 = x + s*(i + m);
+    double* y0 = y + s*(2*i);
+    double* y1 = y + s*(2*i + 1);
+    #pragma GCC ivdep
+    for (long q = 0; q < s; q++) {
+      double ar = x0[q];
+      double ai = x0[plane + q];
+      double br = x1[q];
+      double bi = x1[plane + q];
+      y0[q] = ar + br;
+      y0[plane + q] = ai + bi;
+      storeTwiddled(y1 + q, y1 + plane + q, ar - br, ai - bi, wr, wi);
+    }
+  }
+}
+
+/*
+* Pass of radix 3.
+*/
+static ALWAYS_INLINE void pass3(const double* __restrict x,
+                                double* __restrict y, long m, long s,
+                                long plane, const double* twiddles,
+                                double sign) {
+  const double root = sign * 0.86602540378443864676;
+  for (long i = 0; i < m; i++) {
+    const double* w = twiddles + 4*i;
+    double w1r = w[0];
+    double w1i = sign * w[1];
+    double w2r = w[2];
+    double w2i = sign * w[3];
+    const double* x0 = x + s*i;
+    const double* x1 = x + s*(i + m);
+    const double* x2 = x + s*(i + 2*m);
+    double* y0 = y + s*(3*i);
+    double* y1 = y + s*(3*i + 1);
+    double* y2 = y + s*(3*i + 2);
+    #pragma GCC ivdep
+    for (long q = 0; q < s; q++) {
+      double a0r = x0[q];
+      double a0i = x0[plane + q];
+      double tr = x1[q] + x2[q];
+      double ti = x1[plane + q] + x2[plane + q];
+      double ur = a0r - 0.5 * tr;
+      double ui = a0i - 0.5 * ti;
+      double vr = -root * (x1[plane + q] - x2[plane + q]);
+      double vi = root * (x1[q] - x2[q]);
+      y0[q] = a0r + tr;
+      y0[plane + q] = a0i + ti;
+      storeTwiddled(y1 + q, y1 + plane + q, ur + vr, ui + vi, w1r, w1i);
+      storeTwiddled(y2 + q, y2 + plane + q, ur - vr, ui - vi, w2r, w2i);
+    }
+  }
+}
+
+/*
+* Pass of radix 4.
+*/
+static ALWAYS_INLINE void pass4(const double* __restrict x,
+                                double* __restrict y, long m, long s,
+                                long plane, const double* twiddles,
+                                double sign) {
+  for (long i = 0; i < m; i++) {
+    const double* w = twiddles + 6*i;
+    double w1r = w[0];
+    double w1i = sign * w[1];
+    double w2r = w[2];
+    double w2i = sign * w[3];
+    double w3r = w[4];
+    double w3i = sign * w[5];
+    const double* x0 = x + s*i;
+    const double* x1 = x + s*(i + m);
+    const double* x2 = x + s*(i + 2*m);
+    const double* x3 = x + s*(i + 3*m);
+    double* y0 = y + s*(4*i);
+    double* y1 = y + s*(4*i + 1);
+    double* y2 = y + s*(4*i + 2);
+    double* y3 = y + s*(4*i + 3);
+    #pragma GCC ivdep
+    for (long q = 0; q < s; q++) {
+      double t0r = x0[q] + x2[q];
+      double t0i = x0[plane + q] + x2[plane + q];
+      double t1r = x0[q] - x2[q];
+      double t1i = x0[plane + q] - x2[plane + q];
+      double t2r = x1[q] + x3[q];
+      double t2i = x1[plane + q] + x3[plane + q];
+      double rr = -sign * (x1[plane + q] - x3[plane + q]);
+      double ri = sign * (x1[q] - x3[q]);
+      y0[q] = t0r + t2r;
+      y0[plane + q] = t0i + t2i;
+      storeTwiddled(y1 + q, y1 + plane + q, t1r + rr, t1i + ri, w1r, w1i);
+      storeTwiddled(y2 + q, y2 + plane + q, t0r - t2r, t0i - t2i, w2r, w2i);
+      storeTwiddled(y3 + q, y3 + plane + q, t1r - rr, t1i - ri, w3r, w3i);
+    }
+  }
+}
+
+/*
+* Pass of radix 5.
+*/
+static ALWAYS_INLINE void pass5(const double* __restrict x,
+                                double* __restrict y, long m, long s,
+                                long plane, const double* twiddles,
+                                double sign) {
+  const double c1 = 0.30901699437494742410;
+  const double c2 = -0.80901699437494742410;
+  const double s1 = sign * 0.95105651629515357212;
+  const double s2 = sign * 0.58778525229247312917;
+  for (long i = 0; i < m; i++) {
+    const double* w = twiddles + 8*i;
+    double w1r = w[0];
+    double w1i = sign * w[1];
+    double w2r = w[2];
+    double w2i = sign * w[3];
+    double w3r = w[4];
+    double w3i = sign * w[5];
+    double w4r = w[6];
+    double w4i = sign * w[7];
+    const double* x0 = x + s*i;
+    const double* x1 = x + s*(i + m);
+    const double* x2 = x + s*(i + 2*m);
+    const double* x3 = x + s*(i + 3*m);
+    const double* x4 = x + s*(i + 4*m);
+    double* y0 = y + s*(5*i);
+    double* y1 = y + s*(5*i + 1);
+    double* y2 = y + s*(5*i + 2);
+    double* y3 = y + s*(5*i + 3);
+    double* y4 = y + s*(5*i + 4);
+    #pragma GCC ivdep
+    for (long q = 0; q < s; q++) {
+      double a0r = x0[q];
+      double a0i = x0[plane + q];
+      double t1r = x1[q] + x4[q];
+      double t1i = x1[plane + q] + x4[plane + q];
+      double t2r = x2[q] + x3[q];
+      double t2i = x2[plane + q] + x3[plane + q];
+      double d1r = x1[q] - x4[q];
+      double d1i = x1[plane + q] - x4[plane + q];
+      double d2r = x2[q] - x3[q];
+      double d2i = x2[plane + q] - x3[plane + q];
+      double r1r = a0r + c1 * t1r + c2 * t2r;
+      double r1i = a0i + c1 * t1i + c2 * t2i;
+      double r2r = a0r + c2 * t1r + c1 * t2r;
+      double r2i = a0i + c2 * t1i + c1 * t2i;
+
+      // i * (s1 * d1 + s2 * d2) and i * (s2 * d1 - s1 * d2)
+      double i1r = -(s1 * d1i + s2 * d2i);
+      double i1i = s1 * d1r + s2 * d2r;
+      double i2r = -(s2 * d1i - s1 * d2i);
+      double i2i = s2 * d1r - s1 * d2r;
+      y0[q] = a0r + t1r + t2r;
+      y0[plane + q] = a0i + t1i + t2i;
+      storeTwiddled(y1 + q, y1 + plane + q, r1r + i1r, r1i + i1i, w1r, w1i);
+      storeTwiddled(y2 + q, y2 + plane + q, r2r + i2r, r2i + i2i, w2r, w2i);
+      storeTwiddled(y3 + q, y3 + plane + q, r2r - i2r, r2i - i2i, w3r, w3i);
+      storeTwiddled(y4 + q, y4 + plane + q, r1r - i1r, r1i - i1i, w4r, w4i);
+    }
+  }
+}
+
+/*
+* Transform of the 4 values b0 to b3 at position q, into f0 to f3.
+*/
+static ALWAYS_INLINE void butterfly4(const double* b0, const double* b1,
+                                     const double* b2, const double* b3,
+                                     long q, long plane, double sign,
+                                     double& f0r, double& f0i, double& f1r,
+                                     double& f1i, double& f2r, double& f2i,
+                                     double& f3r, double& f3i) {
+  double t0r = b0[q] + b2[q];
+  double t0i = b0[plane + q] + b2[plane + q];
+  double t1r = b0[q] - b2[q];
+  double t1i = b0[plane + q] - b2[plane + q];
+  double t2r = b1[q] + b3[q];
+  double t2i = b1[plane + q] + b3[plane + q];
+  double rr = -sign * (b1[plane + q] - b3[plane + q]);
+  double ri = sign * (b1[q] - b3[q]);
+  f0r = t0r + t2r;
+  f0i = t0i + t2i;
+  f1r = t1r + rr;
+  f1i = t1i + ri;
+  f2r = t0r - t2r;
+  f2i = t0i - t2i;
+  f3r = t1r - rr;
+  f3i = t1i - ri;
+}
+
+/*
+* Pass of radix 8, as two transforms of 4 values, of the even and the odd
+* inputs, combined with the roots of unity of 8.
+*/
+static ALWAYS_INLINE void pass8(const double* __restrict x,
+                                double* __restrict y, long m, long s,
+                                long plane, const double* twiddles,
+                                double sign) {
+  const double c = 0.70710678118654752440;
+  for (long i = 0; i < m; i++) {
+    const double* w = twiddles + 14*i;
+    const double* x0 = x + s*i;
+    double* y0 = y + s*(8*i);
+    long ms = m*s;
+    #pragma GCC ivdep
+    for (long q = 0; q < s; q++) {
+      double e0r, e0i, e1r, e1i, e2r, e2i, e3r, e3i;
+      double o0r, o0i, o1r, o1i, o2r, o2i, o3r, o3i;
+      butterfly4(x0, x0 + 2*ms, x0 + 4*ms, x0 + 6*ms, q, plane, sign,
+                 e0r, e0i, e1r, e1i, e2r, e2i, e3r, e3i);
+      butterfly4(x0 + ms, x0 + 3*ms, x0 + 5*ms, x0 + 7*ms, q, plane, sign,
+                 o0r, o0i, o1r, o1i, o2r, o2i, o3r, o3i);
+
+      // The odd transform times the roots of unity of 8
+      double r1r = c * (o1r - sign * o1i);
+      double r1i = c * (o1i + sign * o1r);
+      double r2r = -sign * o2i;
+      double r2i = sign * o2r;
+      double r3r = -c * (o3r + sign * o3i);
+      double r3i = c * (sign * o3r - o3i);
+      y0[q] = e0r + o0r;
+      y0[plane + q] = e0i + o0i;
+      double* out = y0 + q;
+      storeTwiddled(out + s, out + plane + s, e1r + r1r, e1i + r1i, w[0],
+                    sign * w[1]);
+      storeTwiddled(out + 2*s, out + plane + 2*s, e2r + r2r, e2i + r2i, w[2],
+                    sign * w[3]);
+      storeTwiddled(out + 3*s, out + plane + 3*s, e3r + r3r, e3i + r3i, w[4],
+                    sign * w[5]);
+      storeTwiddled(out + 4*s, out + plane + 4*s, e0r - o0r, e0i - o0i, w[6],
+                    sign * w[7]);
+      storeTwiddled(out + 5*s, out + plane + 5*s, e1r - r1r, e1i - r1i, w[8],
+                    sign * w[9]);
+      storeTwiddled(out + 6*s, out + plane + 6*s, e2r - r2r, e2i - r2i,
+                    w[10], sign * w[11]);
+      storeTwiddled(out + 7*s, out + plane + 7*s, e3r - r3r, e3i - r3i,
+                    w[12], sign * w[13]);
+    }
+  }
+}
+
+/*
+* Pass of any other radix p, summing the p values directly. roots holds
+* (cos, sin) of 2 pi j / p for every j below p.
+*/
+static ALWAYS_INLINE void passGeneric(const double* __restrict x,
+                                      double* __restrict y, long m, long s,
+                                      long plane, int p,
+                                      const double* twiddles,
+                                      const double* roots, double sign) {
+  for (long i = 0; i < m; i++) {
+    for (int k = 0; k < p; k++) {
+      double* outRe = y + s*(p*i + k);
+      double* outIm = outRe + plane;
+      std::fill(outRe, outRe + s, 0.0);
+      std::fill(outIm, outIm + s, 0.0);
+      for (int r = 0; r < p; r++) {
+        const double* in = x + s*(i + r*m);
+        long j = ((long)r * k) % p;
+        double rootr = roots[2*j];
+        double rooti = sign * roots[2*j + 1];
+        #pragma GCC ivdep
+        for (long q = 0; q < s; q++) {
+          outRe[q] += in[q] * rootr - in[plane + q] * rooti;
+          outIm[q] += in[q] * rooti + in[plane + q] * rootr;
+        }
+      }
+      if (k > 0) {
+        double wr = twiddles[2*((p - 1)*i + k - 1)];
+        double wi = sign * twiddles[2*((p - 1)*i + k - 1) + 1];
+        #pragma GCC ivdep
+        for (long q = 0; q < s; q++) {
+          storeTwiddled(outRe + q, outIm + q, outRe[q], outIm[q], wr, wi);
+        }
+      }
+    }
+  }
+}
+
+/*
+* Runs one pass of radix p over s interleaved sequences, whose current
+* subsequences have p * m values. sign is -1 for forward transforms and 1
+* for inverse transforms.
+*/
+static ALWAYS_INLINE void passBody(const double* __restrict x,
+                                   double* __restrict y, long m, long s,
+                                   long plane, int p, const double* twiddles,
+                                   double sign) {
+  switch (p) {
+    case 2:
+      pass2(x, y, m, s, plane, twiddles, sign);
+      break;
+    case 3:
+      pass3(x, y, m, s, plane, twiddles, sign);
+      break;
+    case 4:
+      pass4(x, y, m, s, plane, twiddles, sign);
+      break;
+    case 5:
+      pass5(x, y, m, s, plane, twiddles, sign);
+      break;
+    case 8:
+      pass8(x, y, m, s, plane, twiddles, sign);
+      break;
+    default:
+      passGeneric(x, y, m, s, plane, p, twiddles, twiddles + 2*m*(p - 1),
+                  sign);
+      break;
+  }
+}
+
+/*
+* Sets out to left times right, or times the conjugate of right when sign is
+* -1, for n complex values stored as in std::complex. The real and imaginary
+* parts go through separate arrays: GCC turns a product of interleaved
+* complex values into fused multiply-adds even when contraction is off,
+* which would change the results of the AVX512 kernels.
+*/
+static ALWAYS_INLINE void multiplyBody(double* out, const double* left,
+                                       const double* right, long n,
+                                       double sign) {
+  double real[FFT_MULTIPLY_CHUNK];
+  double imag[FFT_MULTIPLY_CHUNK];
+  for (long first = 0; first < n; first += FFT_MULTIPLY_CHUNK) {
+    long count = std::min(FFT_MULTIPLY_CHUNK, n - first);
+    const double* l = left + 2*first;
+    const double* r = right + 2*first;
+    for (long k = 0; k < count; k++) {
+      double ri = sign * r[2*k + 1];
+      real[k] = l[2*k] * r[2*k] - l[2*k + 1] * ri;
+      imag[k] = l[2*k] * ri + l[2*k + 1] * r[2*k];
+    }
+    double* o = out + 2*first;
+    for (long k = 0; k < count; k++) {
+      o[2*k] = real[k];
+      o[2*k + 1] = imag[k];
+    }
+  }
+}
+
+typedef void (*PassKernel)(const double* x, double* y, long m, long s,
+                           long plane, int p, const double* twiddles,
+                           double sign);
+typedef void (*MultiplyKernel)(double* out, const double* left,
+                               const double* right, long n, double sign);
+
+struct FFTKernels {
+  PassKernel pass;
+  MultiplyKernel multiply;
+};
+
+// Defines the kernels for one instruction set
+#define FFT_KERNELS(ISA, TARGET)                                              \
+  TARGET static void pass_##ISA(const double* __restrict x,                   \
+                                double* __restrict y, long m, long s,         \
+                                long plane, int p, const double* twiddles,    \
+                                double sign) {                                \
+    passBody(x, y, m, s, plane, p, twiddles, sign);                           \
+  }                                                                           \
+  TARGET static void multiply_##ISA(double* out, const double* left,          \
+                                    const double* right, long n,              \
+                                    double sign) {                            \
+    multiplyBody(out, left, right, n, sign);                                  \
+  }                                                                           \
+  static const FFTKernels fftKernels_##ISA = {pass_##ISA, multiply_##ISA};
+
+INSTANTIATE_KERNELS(FFT_KERNELS)
+
+/*
+* Returns the kernels for the instruction set of the elementwise kernels.
+*/
+static const FFTKernels& fftKernels() {
+  SELECT_KERNELS(fftKernels)
+}
+
+/******************************************************************************
+* PLANS                                                                       *
+******************************************************************************/
+
+/*
+* Returns true if the radix has its own butterfly, and false if it is summed
+* directly.
+*/
+static bool hasButterfly(int p) {
+  return (p == 2) || (p == 3) || (p == 4) || (p == 5) || (p == 8);
+}
+
+/*
+* Creates the plan of a transform of n values. The radices are 8 as often as
+* possible, then 4, 2, 3, 5 and the other prime factors. Each pass stores the
+* twiddle factors (cos, sin) of 2 pi i k / length for its subsequences i and
+* its outputs k from 1 to p - 1, followed by the roots of unity of p for the
+* radices without their own butterflies.
+*/
+FFTPlan::FFTPlan(int n) :
+  size(n)
+{
+  if (n < 1) {
+    std::cout << "Invalid transform length " << n << "\n";
+    throw std::invalid_argument("Invalid transform size.");
+  }
+  int rest = n;
+  for (int radix : {8, 4, 2, 3, 5}) {
+    while (rest % radix == 0) {
+      radices.push_back(radix);
+      rest /= radix;
+    }
+  }
+  for (int factor = 7; rest > 1; factor += 2) {
+    if ((long)factor * factor > rest) {
+      factor = rest;
+    }
+    while (rest % factor == 0) {
+      radices.push_back(factor);
+      rest /= factor;
+    }
+  }
+
+  long length = n;
+  for (int p : radices) {
+    long m = length / p;
+    for (long i = 0; i < m; i++) {
+      for (int k = 1; k < p; k++) {
+        double angle = 2 * FFT_PI * (double)(i * k) / length;
+        twiddles.push_back(std::cos(angle));
+        twiddles.push_back(std::sin(angle));
+      }
+    }
+    if (!hasButterfly(p)) {
+      for (int j = 0; j < p; j++) {
+        double angle = 2 * FFT_PI * j / p;
+        twiddles.push_back(std::cos(angle));
+        twiddles.push_back(std::sin(angle));
+      }
+    }
+    length = m;
+  }
+
+  realTwiddles.resize(2 * ((long)n + 1));
+  for (long k = 0; k <= n; k++) {
+    double angle = FFT_PI * (double)k / n;
+    realTwiddles[2*k] = std::cos(angle);
+    realTwiddles[2*k + 1] = -std::sin(angle);
+  }
+}
+
+int FFTPlan::getSize() const {
+  return size;
+}
+
+const std::vector<int>& FFTPlan::getRadices() const {
+  return radices;
+}
+
+/*
+* Runs every pass, alternating between the two arrays.
+*/
+double* FFTPlan::execute(double* data, double* work, long batch,
+                         bool inverse) const {
+  PassKernel pass = fftKernels().pass;
+  double sign = inverse ? 1 : -1;
+  const double* stageTwiddles = twiddles.data();
+  long length = size;
+  long s = batch;
+  long plane = size * batch;
+  for (int p : radices) {
+    long m = length / p;
+    pass(data, work, m, s, plane, p, stageTwiddles, sign);
+    stageTwiddles += 2*m*(p - 1) + (hasButterfly(p) ? 0 : 2*p);
+    std::swap(data, work);
+    length = m;
+    s *= p;
+  }
+  return data;
+}
+
+const double* FFTPlan::getRealTwiddles() const {
+  return realTwiddles.data();
+}
+
+/*
+* Returns the smallest even length of at least n, or 1 for n up to 1, whose
+* prime factors are 2, 3 and 5.
+*/
+int fftSize(int n) {
+  if (n <= 1) {
+    return 1;
+  }
+  for (int size = n + (n % 2);; size += 2) {
+    int rest = size;
+    for (int factor : {2, 3, 5}) {
+      while (rest % factor == 0) {
+        rest /= factor;
+      }
+    }
+    if (rest == 1) {
+      return size;
+    }
+  }
+}
+
+static std::mutex planMutex;
+
+static std::map<int, std::unique_ptr<FFTPlan>>& planCache() {
+  static std::map<int, std::unique_ptr<FFTPlan>> plans;
+  return plans;
+}
+
+/*
+* Returns the cached plan of length n, creating it the first time.
+*/
+const FFTPlan& fftPlan(int n) {
+  std::lock_guard<std::mutex> lock(planMutex);
+  std::unique_ptr<FFTPlan>& plan = planCache()[n];
+  if (plan == nullptr) {
+    plan.reset(new FFTPlan(n));
+  }
+  return *plan;
+}
+
+void clearFFTPlans() {
+  std::lock_guard<std::mutex> lock(planMutex);
+  planCache().clear();
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns the number of sequences of length n that are transformed together,
+* a multiple of FFT_MIN_BATCH so that the passes run whole vectors.
+*/
+static long batchSize(long n) {
+  long batch = std::min(FFT_MAX_BATCH, FFT_BATCH_BYTES / (16 * n));
+  return std::max(FFT_MIN_BATCH, batch - batch % FFT_MIN_BATCH);
+}
+
+/*
+* Returns the number of batches of sequences of length n that are given to
+* the same thread.
+*/
+static long batchGrain(long n, long batch) {
+  return std::max(1L, PARALLEL_GRAIN / (n * batch));
+}
+
+/*
+* Transforms the columns of a matrix of complex values with rows rows and
+* columns columns, whose rows start rowStride doubles apart, from in to out,
+* which may be the same.
+*/
+static void transformColumns(const double* in, double* out, long rowStride,
+                             int rows, long columns, bool inverse) {
+  const FFTPlan& plan = fftPlan(rows);
+  long batch = batchSize(rows);
+  long groups = (columns + batch - 1) / batch;
+  parallelFor(groups, batchGrain(rows, batch), [&](long begin, long end) {
+    std::vector<double> buffers(4 * rows * batch);
+    for (long group = begin; group < end; group++) {
+      long first = group * batch;
+      long count = std::min(batch, columns - first);
+      long plane = rows * count;
+      double* values = buffers.data();
+      for (long r = 0; r < rows; r++) {
+        const double* row = in + r*rowStride + 2*first;
+        for (long j = 0; j < count; j++) {
+          values[r*count + j] = row[2*j];
+          values[plane + r*count + j] = row[2*j + 1];
+        }
+      }
+      const double* result = plan.execute(values, values + 2*plane, count,
+                                          inverse);
+      for (long r = 0; r < rows; r++) {
+        double* row = out + r*rowStride + 2*first;
+        for (long j = 0; j < count; j++) {
+          row[2*j] = result[r*count + j];
+          row[2*j + 1] = result[plane + r*count + j];
+        }
+      }
+    }
+  });
+}
+
+/******************************************************************************
+* TRANSFORMS                                                                  *
+******************************************************************************/
+
+/*
+* Transforms n complex values in place, scaling the inverse by 1 / n.
+*/
+void fft(std::complex<double>* data, int n, bool inverse) {
+  const FFTPlan& plan = fftPlan(n);
+  std::vector<double> buffers(4 * (long)n);
+  double* values = buffers.data();
+  for (long k = 0; k < n; k++) {
+    values[k] = data[k].real();
+    values[n + k] = data[k].imag();
+  }
+  const double* result = plan.execute(values, values + 2*n, 1, inverse);
+  double scale = inverse ? 1.0 / n : 1.0;
+  for (long k = 0; k < n; k++) {
+    data[k] = std::complex<double>(result[k] * scale,
+                                   result[n + k] * scale);
+  }
+}
+
+/*
+* Transforms the rows of the input first, rows of even length as half as
+* many complex values, and then the columns of the spectrum. The rows of
+* the padding are zero and are not transformed.
+*/
+void rfft2(const MatrixView& in, Matrix& spectrum, int rows, int cols) {
+  rows = (rows == 0) ? in.getRows() : rows;
+  cols = (cols == 0) ? in.getColumns() : cols;
+  if ((rows < in.getRows()) || (cols < in.getColumns()) || (rows < 1) ||
+      (cols < 1)) {
+    std::cout << "Invalid transform size (" << rows << ", " << cols
+              << ") for a matrix of size (" << in.getRows() << ", "
+              << in.getColumns() << ")\n";
+    throw std::invalid_argument("Invalid transform size.");
+  }
+  if (sharesElements(in, spectrum)) {
+    Matrix result(0, 0);
+    rfft2(in, result, rows, cols);
+    spectrum = std::move(result);
+    return;
+  }
+  long bins = cols / 2 + 1;
+  if ((spectrum.getRows() != rows) || (spectrum.getColumns() != 2*bins)) {
+    HeapScope heap;
+    spectrum = Matrix(rows, (int)(2*bins));
+  }
+  double* out = spectrum.getData();
+  std::fill(out + (long)in.getRows()*2*bins, out + (long)rows*2*bins, 0.0);
+
+  const double* data = in.getData();
+  long rowStride = in.getRowStride();
+  long colStride = in.getColumnStride();
+  long inCols = in.getColumns();
+  bool packed = (cols % 2 == 0);
+  long n = packed ? cols / 2 : cols;
+  const FFTPlan& plan = fftPlan((int)n);
+  const double* realTwiddles = plan.getRealTwiddles();
+  long batch = batchSize(n);
+  long groups = (in.getRows() + batch - 1) / batch;
+  parallelFor(groups, batchGrain(n, batch), [&](long begin, long end) {
+    std::vector<double> buffers(4 * n * batch);
+    for (long group = begin; group < end; group++) {
+      long first = group * batch;
+      long count = std::min(batch, (long)in.getRows() - first);
+      long plane = n * count;
+      double* values = buffers.data();
+      for (long j = 0; j < count; j++) {
+        const double* row = data + (first + j)*rowStride;
+        for (long k = 0; k < n; k++) {
+          long re = packed ? 2*k : k;
+          double* value = values + k*count + j;
+          value[0] = (re < inCols) ? row[re*colStride] : 0;
+          value[plane] = (packed && (re + 1 < inCols))
+                         ? row[(re + 1)*colStride] : 0;
+        }
+      }
+      const double* z = plan.execute(values, values + 2*plane, count, false);
+      for (long j = 0; j < count; j++) {
+        double* spectrumRow = out + (first + j)*2*bins;
+        if (!packed) {
+          for (long k = 0; k < bins; k++) {
+            spectrumRow[2*k] = z[k*count + j];
+            spectrumRow[2*k + 1] = z[plane + k*count + j];
+          }
+          continue;
+        }
+
+        // Even part E = (Z[k] + conj(Z[n - k])) / 2 and odd part
+        // O = (Z[k] - conj(Z[n - k])) / 2i, combined as E + W^k O
+        for (long k = 0; k <= n; k++) {
+          const double* zk = z + ((k < n) ? k : 0)*count + j;
+          const double* zc = z + ((k > 0) ? n - k : 0)*count + j;
+          double er = 0.5 * (zk[0] + zc[0]);
+          double ei = 0.5 * (zk[plane] - zc[plane]);
+          double orr = 0.5 * (zk[plane] + zc[plane]);
+          double oi = -0.5 * (zk[0] - zc[0]);
+          double wr = realTwiddles[2*k];
+          double wi = realTwiddles[2*k + 1];
+          spectrumRow[2*k] = er + (orr * wr - oi * wi);
+          spectrumRow[2*k + 1] = ei + (orr * wi + oi * wr);
+        }
+      }
+    }
+  });
+  transformColumns(out, out, 2*bins, rows, bins, false);
+}
+
+Matrix rfft2(const MatrixView& in, int rows, int cols) {
+  Matrix spectrum(0, 0);
+  rfft2(in, spectrum, rows, cols);
+  return spectrum;
+}
+
+/*
+* Transforms the columns of the spectrum back into a temporary first, and
+* then the rows, undoing the steps of rfft2() in reverse order.
+*/
+void irfft2(const Matrix& spectrum, Matrix& out, int cols) {
+  long bins = cols / 2 + 1;
+  int rows = spectrum.getRows();
+  if ((cols < 1) || (spectrum.getColumns() != 2*bins)) {
+    std::cout << "Invalid spectrum with " << spectrum.getColumns()
+              << " columns for " << cols << " real columns\n";
+    throw std::invalid_argument("Invalid transform size.");
+  }
+  Matrix columns(rows, (int)(2*bins));
+  transformColumns(spectrum.getData(), columns.getData(), 2*bins, rows, bins,
+                   true);
+  if ((out.getRows() != rows) || (out.getColumns() != cols)) {
+    HeapScope heap;
+    out = Matrix(rows, cols);
+  }
+
+  const double* data = columns.getData();
+  double* result = out.getData();
+  bool packed = (cols % 2 == 0);
+  long n = packed ? cols / 2 : cols;
+  double scale = 1.0 / ((double)rows * n);
+  const FFTPlan& plan = fftPlan((int)n);
+  const double* realTwiddles = plan.getRealTwiddles();
+  long batch = batchSize(n);
+  long groups = (rows + batch - 1) / batch;
+  parallelFor(groups, batchGrain(n, batch), [&](long begin, long end) {
+    std::vector<double> buffers(4 * n * batch);
+    for (long group = begin; group < end; group++) {
+      long first = group * batch;
+      long count = std::min(batch, (long)rows - first);
+      long plane = n * count;
+      double* values = buffers.data();
+      for (long j = 0; j < count; j++) {
+        const double* x = data + (first + j)*2*bins;
+        for (long k = 0; k < n; k++) {
+          double* value = values + k*count + j;
+          if (!packed) {
+            // The values above cols / 2 are the conjugates of those below
+            long source = (k < bins) ? k : n - k;
+            value[0] = x[2*source];
+            value[plane] = (k < bins) ? x[2*source + 1] : -x[2*source + 1];
+            continue;
+          }
+
+          // Z[k] = E + iO with E = (X[k] + conj(X[n - k])) / 2 and
+          // O = (X[k] - conj(X[n - k])) conj(W^k) / 2
+          const double* xk = x + 2*k;
+          const double* xc = x + 2*(n - k);
+          double er = 0.5 * (xk[0] + xc[0]);
+          double ei = 0.5 * (xk[1] - xc[1]);
+          double dr = 0.5 * (xk[0] - xc[0]);
+          double di = 0.5 * (xk[1] + xc[1]);
+          double wr = realTwiddles[2*k];
+          double wi = -realTwiddles[2*k + 1];
+          double orr = dr * wr - di * wi;
+          double oi = dr * wi + di * wr;
+          value[0] = er - oi;
+          value[plane] = ei + orr;
+        }
+      }
+      const double* z = plan.execute(values, values + 2*plane, count, true);
+      for (long j = 0; j < count; j++) {
+        double* row = result + (first + j)*cols;
+        for (long k = 0; k < n; k++) {
+          const double* value = z + k*count + j;
+          if (packed) {
+            row[2*k] = value[0] * scale;
+            row[2*k + 1] = value[plane] * scale;
+          } else {
+            row[k] = value[0] * scale;
+          }
+        }
+      }
+    }
+  });
+}
+
+Matrix irfft2(const Matrix& spectrum, int cols) {
+  Matrix out(0, 0);
+  irfft2(spectrum, out, cols);
+  return out;
+}
+
+/*
+* Multiplies the values of two spectra of the same size.
+*/
+void multiplySpectra(const Matrix& left, const Matrix& right, Matrix& out,
+                     bool conjugate) {
+  if ((left.getRows() != right.getRows()) ||
+      (left.getColumns() != right.getColumns()) ||
+      (left.getColumns() % 2 != 0)) {
+    std::cout << "Unable to multiply spectra of sizes (" << left.getRows()
+              << ", " << left.getColumns() << ") and (" << right.getRows()
+              << ", " << right.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  if ((out.getRows() != left.getRows()) ||
+      (out.getColumns() != left.getColumns())) {
+    HeapScope heap;
+    out = Matrix(left.getRows(), left.getColumns());
+  }
+  MultiplyKernel multiply = fftKernels().multiply;
+  long n = (long)left.getRows() * left.getColumns() / 2;
+  double sign = conjugate ? -1 : 1;
+  parallelFor(n, PARALLEL_GRAIN, [&](long begin, long end) {
+    multiply(out.getData() + 2*begin, left.getData() + 2*begin,
+             right.getData() + 2*begin, end - begin, sign);
+  });
+}
@@ -0,0 +1,86 @@
+/******************************************************************************
+*                         Fast Fourier transforms                             *
+*                                                                             *
+* Complex transforms of any length, and real transforms of matrices in two    *
+* dimensions. Lengths whose prime factors are 2, 3 and 5 are fastest, and     *
+* fftSize() returns the next such length, which is the size to zero pad to.   *
+* Other prime factors are transformed directly, in time proportional to the   *
+* factor.                                                                     *
+*                                                                             *
+* The twiddle factors of every length are computed once, in an FFTPlan that   *
+* is cached by fftPlan() and shared by all threads. clearFFTPlans() frees the *
+* cache and must not be called while transforms are running.                  *
+*                                                                             *
+* The spectrum of a real matrix is conjugate symmetric, so rfft2() only keeps *
+* the columns 0 to cols / 2 of it. A spectrum is a Matrix of doubles with the *
+* real and imaginary parts of each value next to each other, the layout of an *
+* array of std::complex<double>, so a spectrum of rows x (cols / 2 + 1)       *
+* values has 2 * (cols / 2 + 1) columns. Products of spectra correlate or     *
+* convolve the matrices:                                                      *
+*                                                                             *
+*   rfft2(patch, patchSpectrum);                                              *
+*   multiplySpectra(patchSpectrum, filterSpectrum, response, true);           *
+*   irfft2(response, correlation, patch.getColumns());                        *
+*                                                                             *
+* Inverse transforms are scaled by 1 / n, so that they undo the forward       *
+* transforms, as in NumPy.                                                    *
+*                                                                             *
+******************************************************************************/
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <complex>
+#include <vector>
+
+#include "matrix.hpp"
+
+class FFTPlan {
+  private:
+    int size;
+    std::vector<int> radices;
+    std::vector<double> twiddles;
+    std::vector<double> realTwiddles;
+
+  public:
+    explicit FFTPlan(int n);
+
+    int getSize() const;
+    const std::vector<int>& getRadices() const;
+
+    // Transforms batch sequences of getSize() complex values that are
+    // interleaved, so that the real part of value k of sequence j is
+    // data[k * batch + j] and its imaginary part is getSize() * batch
+    // doubles later, using work as a second array of the same size. Returns
+    // data or work, whichever holds the result
+    double* execute(double* data, double* work, long batch,
+                    bool inverse) const;
+
+    // exp(-2 pi i k / (2 * getSize())) for k from 0 to getSize(), used to
+    // split the transform of a real sequence of twice the length
+    const double* getRealTwiddles() const;
+};
+
+// Returns the smallest length of at least n whose prime factors are 2, 3 and
+// 5. Lengths above 1 are even, as the real transforms prefer
+int fftSize(int n);
+const FFTPlan& fftPlan(int n);
+void clearFFTPlans();
+
+// Transforms n complex values in place
+void fft(std::complex<double>* data, int n, bool inverse=false);
+
+// Transforms a real matrix, zero padded to rows x cols when they are given,
+// into its rows x (cols / 2 + 1) spectrum
+void rfft2(const MatrixView& in, Matrix& spectrum, int rows=0, int cols=0);
+Matrix rfft2(const MatrixView& in, int rows=0, int cols=0);
+
+// Transforms a spectrum from rfft2() back into a real matrix of cols columns
+void irfft2(const Matrix& spectrum, Matrix& out, int cols);
+Matrix irfft2(const Matrix& spectrum, int cols);
+
+// Multiplies two spectra value by value, with the conjugate of right when
+// conjugate is true, which correlates instead of convolving
+void multiplySpectra(const Matrix& left, const Matrix& right, Matrix& out,
+                     bool conjugate=false);
+
+#endif
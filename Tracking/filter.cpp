@@ -0,0 +1,608 @@
+/******************************************************************************
+*                              Image filters                                  *
+*                                                                             *
+* Both passes of a separable filter, and every row of a 2-D filter, compute   *
+* out[i] = sum over t of weights[t] * sources[t][i] for a list of source      *
+* rows. The vertical pass takes its sources from the input rows above and     *
+* below the output row and writes a line that extends past the tile on both   *
+* sides by the radius of the row kernel. Columns of the line outside the      *
+* image are filtered at the column the border mode gives them. The            *
+* horizontal pass takes its sources from that line, shifted by one pixel per  *
+* tap. Since the channels are interleaved, a shift of one pixel is a shift of *
+* one element per channel, and the same loop filters every channel at once.   *
+*                                                                             *
+* Separable filters process the image in tiles of FILTER_TILE values per      *
+* row, so that the parts of the input rows used by the vertical pass stay in  *
+* the first level cache while the tile moves down the image. Filters that     *
+* read the same input, like the two Sobel gradients, share the walk over the  *
+* tiles. Each parallel chunk of rows has its own line.                        *
+*                                                                             *
+******************************************************************************/
+#include <cmath>
+
+#include "filter.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Values of an output row that are summed together over all taps
+static const long FILTER_BLOCK = 1024;
+
+// Values of a row in a tile of columns of a separable filter
+static const long FILTER_TILE = 512;
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Sets out[i] = weight * in[i].
+*/
+static ALWAYS_INLINE void scaleLine(float* __restrict out,
+                                    const float* __restrict in, float weight,
+                                    long n) {
+  for (long i = 0; i < n; i++) {
+    out[i] = weight * in[i];
+  }
+}
+
+/*
+* Adds weight * in[i] to out[i].
+*/
+static ALWAYS_INLINE void addScaledLine(float* __restrict out,
+                                        const float* __restrict in,
+                                        float weight, long n) {
+  for (long i = 0; i < n; i++) {
+    out[i] += weight * in[i];
+  }
+}
+
+/*
+* Adds the four products weights[k] * in[k][i] to out[i], one after the
+* other, so the sum is rounded as if they were added by four calls of
+* addScaledLine, with a quarter of the loads and stores of out.
+*/
+static ALWAYS_INLINE void addScaledLines4(float* __restrict out,
+                                          const float* __restrict in0,
+                                          const float* __restrict in1,
+                                          const float* __restrict in2,
+                                          const float* __restrict in3,
+                                          const float* weights, long n) {
+  float w0 = weights[0];
+  float w1 = weights[1];
+  float w2 = weights[2];
+  float w3 = weights[3];
+  for (long i = 0; i < n; i++) {
+    out[i] = (((out[i] + w0 * in0[i]) + w1 * in1[i]) + w2 * in2[i]) +
+             w3 * in3[i];
+  }
+}
+
+/*
+* Sets out[i] to the sum of weights[t] * sources[t][i], adding the taps in
+* order. None of the sources may overlap the output.
+*/
+static ALWAYS_INLINE void weightedSumBody(float* out,
+                                          const float* const* sources,
+                                          const float* weights, int taps,
+                                          long n) {
+  for (long begin = 0; begin < n; begin += FILTER_BLOCK) {
+    long count = std::min(FILTER_BLOCK, n - begin);
+    float* block = out + begin;
+    scaleLine(block, sources[0] + begin, weights[0], count);
+    int t = 1;
+    for (; t + 4 <= taps; t += 4) {
+      addScaledLines4(block, sources[t] + begin, sources[t + 1] + begin,
+                      sources[t + 2] + begin, sources[t + 3] + begin,
+                      weights + t, count);
+    }
+    for (; t < taps; t++) {
+      addScaledLine(block, sources[t] + begin, weights[t], count);
+    }
+  }
+}
+
+typedef void (*WeightedSumKernel)(float* out, const float* const* sources,
+                                  const float* weights, int taps, long n);
+
+// Defines the kernel for one instruction set
+#define FILTER_KERNELS(ISA, TARGET)                                           \
+  TARGET static void weightedSum_##ISA(float* out,                            \
+                                       const float* const* sources,           \
+                                       const float* weights, int taps,        \
+                                       long n) {                              \
+    weightedSumBody(out, sources, weights, taps, n);                          \
+  }
+
+INSTANTIATE_KERNELS(FILTER_KERNELS)
+
+/*
+* Returns the kernel for the instruction set of the elementwise kernels.
+*/
+static WeightedSumKernel weightedSumKernel() {
+  SELECT_KERNELS(weightedSum)
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+// One separable filter applied by separableRows
+struct SeparablePass {
+  Image* out;
+  const std::vector<float>* rowKernel;
+  const std::vector<float>* columnKernel;
+  float padValue;
+};
+
+/*
+* Returns the pass filtering into out. A column of constant pixels filters to
+* the border value times the sum of the column kernel, which is the value of
+* the columns of the line outside the image.
+*/
+static SeparablePass separablePass(Image& out,
+                                   const std::vector<float>& rowKernel,
+                                   const std::vector<float>& columnKernel,
+                                   float borderValue) {
+  double columnSum = 0;
+  for (float weight : columnKernel) {
+    columnSum += weight;
+  }
+  return {&out, &rowKernel, &columnKernel, (float)(borderValue * columnSum)};
+}
+
+/*
+* Returns the position inside [0, n) that the border mode gives position i,
+* or -1 if the pixel has the constant border value.
+*/
+long borderIndex(long i, long n, BorderMode border) {
+  if ((i >= 0) && (i < n)) {
+    return i;
+  }
+  switch (border) {
+    case BorderMode::Replicate:
+      return (i < 0) ? 0 : n - 1;
+    case BorderMode::Reflect: {
+      if (n == 1) {
+        return 0;
+      }
+      long period = 2*(n - 1);
+      i %= period;
+      if (i < 0) {
+        i += period;
+      }
+      return (i < n) ? i : period - i;
+    }
+    case BorderMode::Wrap:
+      i %= n;
+      return (i < 0) ? i + n : i;
+    default:
+      return -1;
+  }
+}
+
+/*
+* Fills the left and right pixels at the ends of a padded line, whose pixels
+* from left to left + width - 1 are already set, according to the border
+* mode. Constant pixels are set to value.
+*/
+static void padLine(float* line, int width, int channels, int left,
+                    int right, BorderMode border, float value) {
+  float* first = line + (long)left*channels;
+  for (long p = -left; p < width + right; p++) {
+    if ((p >= 0) && (p < width)) {
+      p = width - 1;
+      continue;
+    }
+    float* pixel = first + p*channels;
+    long source = borderIndex(p, width, border);
+    for (int c = 0; c < channels; c++) {
+      pixel[c] = (source < 0) ? value : first[source*channels + c];
+    }
+  }
+}
+
+/*
+* Checks the kernel sizes and prepares the output, returning false if there
+* is nothing to filter.
+*/
+static bool prepareFilter(const Image& in, Image& out, long kernelRows,
+                          long kernelColumns) {
+  if ((kernelRows < 1) || (kernelColumns < 1)) {
+    std::cout << "Unable to filter with a kernel of size (" << kernelRows
+              << ", " << kernelColumns << ")\n";
+    throw std::invalid_argument("Invalid filter kernel.");
+  }
+  out.setSize(in.getWidth(), in.getHeight(), in.getChannels());
+  return (in.getWidth() > 0) && (in.getHeight() > 0);
+}
+
+/*
+* Returns the number of output rows filtered together by a thread, so that a
+* chunk does at least PARALLEL_GRAIN multiplications.
+*/
+static long filterGrain(const Image& in, long taps) {
+  long work = std::max(1L, (long)in.getWidth() * in.getChannels() * taps);
+  return std::max(1L, PARALLEL_GRAIN / work);
+}
+
+/*
+* Filters the rows of one or more separable filters of the same input, each
+* into an output that does not share pixels with the input. The image is
+* processed in tiles of columns, so that the parts of the input rows used by
+* the vertical passes stay in the first level cache while the output rows
+* move down the tile. The columns just outside a tile are computed as well,
+* for the horizontal pass.
+*/
+static void separableRows(const Image& in,
+                          const std::vector<SeparablePass>& passes,
+                          BorderMode border, float borderValue) {
+  int width = in.getWidth();
+  int height = in.getHeight();
+  int channels = in.getChannels();
+  long tileWidth = std::max(1L, FILTER_TILE / channels);
+
+  // The input rows are shared by all passes, so the tallest column kernel
+  // decides which rows are needed
+  int above = 0;
+  int below = 0;
+  long taps = 0;
+  int maxTaps = 0;
+  for (const SeparablePass& pass : passes) {
+    int columnTaps = (int)pass.columnKernel->size();
+    int rowTaps = (int)pass.rowKernel->size();
+    above = std::max(above, columnTaps / 2);
+    below = std::max(below, columnTaps - 1 - columnTaps / 2);
+    taps += rowTaps + columnTaps;
+    maxTaps = std::max(maxTaps, std::max(rowTaps, columnTaps));
+  }
+
+  WeightedSumKernel weightedSum = weightedSumKernel();
+  parallelFor(height, filterGrain(in, taps), [&](long begin, long end) {
+    std::vector<float> line;
+    std::vector<float> constantRow;
+    if (border == BorderMode::Constant) {
+      constantRow.assign((long)width * channels, borderValue);
+    }
+    std::vector<const float*> rows(above + 1 + below);
+    std::vector<const float*> sources(maxTaps);
+    for (long x0 = 0; x0 < width; x0 += tileWidth) {
+      long x1 = std::min((long)width, x0 + tileWidth);
+      for (long y = begin; y < end; y++) {
+        for (int t = -above; t <= below; t++) {
+          long source = borderIndex(y + t, height, border);
+          rows[t + above] = (source < 0) ? constantRow.data()
+                                         : in.row((int)source);
+        }
+        for (const SeparablePass& pass : passes) {
+          const std::vector<float>& rowKernel = *pass.rowKernel;
+          const std::vector<float>& columnKernel = *pass.columnKernel;
+          int rowTaps = (int)rowKernel.size();
+          int columnTaps = (int)columnKernel.size();
+          int left = rowTaps / 2;
+          int right = rowTaps - 1 - left;
+          const float* const* columnRows = rows.data() + above -
+                                           columnTaps / 2;
+          line.resize((tileWidth + rowTaps - 1) * channels);
+
+          // Columns of the line, of which first to last - 1 are in the image
+          long lineStart = x0 - left;
+          long first = std::max(0L, lineStart);
+          long last = std::min((long)width, x1 + right);
+          for (int t = 0; t < columnTaps; t++) {
+            sources[t] = columnRows[t] + first*channels;
+          }
+          weightedSum(line.data() + (first - lineStart)*channels,
+                      sources.data(), columnKernel.data(), columnTaps,
+                      (last - first)*channels);
+
+          // Columns outside the image are filtered at the column the border
+          // mode gives them, and constant columns have the pad value
+          for (long x = lineStart; x < x1 + right; x++) {
+            if ((x >= 0) && (x < width)) {
+              x = std::max(x, last - 1);
+              continue;
+            }
+            float* pixel = line.data() + (x - lineStart)*channels;
+            long source = borderIndex(x, width, border);
+            if (source < 0) {
+              std::fill(pixel, pixel + channels, pass.padValue);
+              continue;
+            }
+            for (int t = 0; t < columnTaps; t++) {
+              sources[t] = columnRows[t] + source*channels;
+            }
+            weightedSum(pixel, sources.data(), columnKernel.data(),
+                        columnTaps, channels);
+          }
+
+          for (int t = 0; t < rowTaps; t++) {
+            sources[t] = line.data() + (long)t*channels;
+          }
+          weightedSum(pass.out->row((int)y) + x0*channels, sources.data(),
+                      rowKernel.data(), rowTaps, (x1 - x0)*channels);
+        }
+      }
+    }
+  });
+}
+
+/*
+* Filters the image into the output with one separable filter.
+*/
+static void separableRows(const Image& in, Image& out,
+                          const std::vector<float>& rowKernel,
+                          const std::vector<float>& columnKernel,
+                          BorderMode border, float borderValue) {
+  std::vector<SeparablePass> passes = {
+    separablePass(out, rowKernel, columnKernel, borderValue)
+  };
+  separableRows(in, passes, border, borderValue);
+}
+
+/*
+* Filters the rows of a 2-D filter into an output that does not share pixels
+* with the input. Each output row pads the input rows it needs and sums the
+* nonzero taps.
+*/
+static void directRows(const Image& in, Image& out, const MatrixView& kernel,
+                       BorderMode border, float borderValue) {
+  int width = in.getWidth();
+  int height = in.getHeight();
+  int channels = in.getChannels();
+  int kernelRows = kernel.getRows();
+  int kernelColumns = kernel.getColumns();
+  int left = kernelColumns / 2;
+  int above = kernelRows / 2;
+  long lineLength = (long)(width + kernelColumns - 1) * channels;
+  long elements = (long)width * channels;
+
+  // Nonzero taps, as the kernel row and the offset into its padded line
+  std::vector<float> weights;
+  std::vector<int> tapRows;
+  std::vector<long> tapOffsets;
+  for (int i = 0; i < kernelRows; i++) {
+    for (int j = 0; j < kernelColumns; j++) {
+      double weight = kernel.getData()[(long)i*kernel.getRowStride() +
+                                       (long)j*kernel.getColumnStride()];
+      if (weight != 0) {
+        weights.push_back((float)weight);
+        tapRows.push_back(i);
+        tapOffsets.push_back((long)j*channels);
+      }
+    }
+  }
+  if (weights.empty()) {
+    out.fill(0);
+    return;
+  }
+
+  WeightedSumKernel weightedSum = weightedSumKernel();
+  int taps = (int)weights.size();
+  parallelFor(height, filterGrain(in, taps), [&](long begin, long end) {
+    std::vector<float> lines(lineLength * kernelRows);
+    std::vector<const float*> sources(taps);
+    for (long y = begin; y < end; y++) {
+      for (int i = 0; i < kernelRows; i++) {
+        float* line = lines.data() + i*lineLength;
+        float* center = line + (long)left*channels;
+        long source = borderIndex(y + i - above, height, border);
+        if (source < 0) {
+          std::fill(line, line + lineLength, borderValue);
+          continue;
+        }
+        const float* row = in.row((int)source);
+        std::copy(row, row + elements, center);
+        padLine(line, width, channels, left, kernelColumns - 1 - left,
+                border, borderValue);
+      }
+      for (int t = 0; t < taps; t++) {
+        sources[t] = lines.data() + tapRows[t]*lineLength + tapOffsets[t];
+      }
+      weightedSum(out.row((int)y), sources.data(), weights.data(), taps,
+                  elements);
+    }
+  });
+}
+
+/*
+* Splits the kernel into a column kernel and a row kernel whose outer product
+* it is, up to the rounding of floats. Returns false if the kernel is not
+* separable.
+*/
+static bool separateKernel(const MatrixView& kernel,
+                           std::vector<float>& rowKernel,
+                           std::vector<float>& columnKernel) {
+  int rows = kernel.getRows();
+  int columns = kernel.getColumns();
+  auto at = [&](int i, int j) {
+    return kernel.getData()[(long)i*kernel.getRowStride() +
+                            (long)j*kernel.getColumnStride()];
+  };
+
+  // The largest element gives the row and column that are scaled copies of
+  // all others
+  int pivotRow = 0;
+  int pivotColumn = 0;
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < columns; j++) {
+      if (std::fabs(at(i, j)) > std::fabs(at(pivotRow, pivotColumn))) {
+        pivotRow = i;
+        pivotColumn = j;
+      }
+    }
+  }
+  double pivot = at(pivotRow, pivotColumn);
+  if (pivot == 0) {
+    return false;
+  }
+  double tolerance = 1e-6 * std::fabs(pivot);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < columns; j++) {
+      double product = at(i, pivotColumn) * at(pivotRow, j) / pivot;
+      if (std::fabs(at(i, j) - product) > tolerance) {
+        return false;
+      }
+    }
+  }
+  rowKernel.resize(columns);
+  columnKernel.resize(rows);
+  for (int j = 0; j < columns; j++) {
+    rowKernel[j] = (float)at(pivotRow, j);
+  }
+  for (int i = 0; i < rows; i++) {
+    columnKernel[i] = (float)(at(i, pivotColumn) / pivot);
+  }
+  return true;
+}
+
+/******************************************************************************
+* FILTERS                                                                     *
+******************************************************************************/
+
+/*
+* Filters the image with a separable kernel: every column is correlated with
+* the column kernel, and every row of that result with the row kernel.
+*
+* in - The image to filter
+* out - Receives the filtered image, with the size of the input
+* rowKernel - Weights along x, with the anchor at rowKernel.size() / 2
+* columnKernel - Weights along y, with the anchor at columnKernel.size() / 2
+* border - How pixels outside the image are found
+* borderValue - The value of pixels outside the image for BorderMode::Constant
+*/
+void filterSeparable(const Image& in, Image& out,
+                     const std::vector<float>& rowKernel,
+                     const std::vector<float>& columnKernel,
+                     BorderMode border, float borderValue) {
+  if (sharesPixels(in, out)) {
+    Image result;
+    filterSeparable(in, result, rowKernel, columnKernel, border,
+                    borderValue);
+    out = result;
+    return;
+  }
+  if (prepareFilter(in, out, columnKernel.size(), rowKernel.size())) {
+    separableRows(in, out, rowKernel, columnKernel, border, borderValue);
+  }
+}
+
+Image filterSeparable(const Image& in, const std::vector<float>& rowKernel,
+                      const std::vector<float>& columnKernel,
+                      BorderMode border, float borderValue) {
+  Image out;
+  filterSeparable(in, out, rowKernel, columnKernel, border, borderValue);
+  return out;
+}
+
+/*
+* Filters the image with a 2-D kernel. Separable kernels are applied in two
+* passes, and other kernels directly, skipping their zero elements.
+*
+* in - The image to filter
+* out - Receives the filtered image, with the size of the input
+* kernel - The weights, with the anchor at the center element
+* border - How pixels outside the image are found
+* borderValue - The value of pixels outside the image for BorderMode::Constant
+*/
+void filter2D(const Image& in, Image& out, const MatrixView& kernel,
+              BorderMode border, float borderValue) {
+  if (sharesPixels(in, out)) {
+    Image result;
+    filter2D(in, result, kernel, border, borderValue);
+    out = result;
+    return;
+  }
+  if (!prepareFilter(in, out, kernel.getRows(), kernel.getColumns())) {
+    return;
+  }
+  std::vector<float> rowKernel;
+  std::vector<float> columnKernel;
+  if ((kernel.getRows() > 1) && (kernel.getColumns() > 1) &&
+      separateKernel(kernel, rowKernel, columnKernel)) {
+    separableRows(in, out, rowKernel, columnKernel, border, borderValue);
+  } else {
+    directRows(in, out, kernel, border, borderValue);
+  }
+}
+
+Image filter2D(const Image& in, const MatrixView& kernel, BorderMode border,
+               float borderValue) {
+  Image out;
+  filter2D(in, out, kernel, border, borderValue);
+  return out;
+}
+
+/*
+* Returns the weights exp(-x^2 / (2 sigma^2)) for x from -radius to radius,
+* divided by their sum.
+*/
+std::vector<float> gaussianKernel(double sigma, int radius) {
+  if (!(sigma > 0) || (radius < 0)) {
+    std::cout << "Unable to create a Gaussian kernel with sigma " << sigma
+              << " and radius " << radius << "\n";
+    throw std::invalid_argument("Invalid filter kernel.");
+  }
+  if (radius == 0) {
+    radius = std::max(1, (int)std::ceil(3 * sigma));
+  }
+  std::vector<double> weights(2*radius + 1);
+  double sum = 0;
+  for (int x = -radius; x <= radius; x++) {
+    weights[x + radius] = std::exp(-(double)x*x / (2 * sigma * sigma));
+    sum += weights[x + radius];
+  }
+  std::vector<float> kernel(weights.size());
+  for (std::size_t i = 0; i < weights.size(); i++) {
+    kernel[i] = (float)(weights[i] / sum);
+  }
+  return kernel;
+}
+
+/*
+* Blurs the image with a Gaussian of the given standard deviation, truncated
+* at three standard deviations.
+*/
+void gaussianBlur(const Image& in, Image& out, double sigma,
+                  BorderMode border) {
+  std::vector<float> kernel = gaussianKernel(sigma);
+  filterSeparable(in, out, kernel, kernel, border);
+}
+
+Image gaussianBlur(const Image& in, double sigma, BorderMode border) {
+  Image out;
+  gaussianBlur(in, out, sigma, border);
+  return out;
+}
+
+/*
+* Computes the Sobel gradients of the image, smoothing with (1, 2, 1) across
+* the direction of the derivative (-1, 0, 1). Both gradients are computed in
+* the same pass over the image.
+*
+* in - The image to differentiate
+* dx - Receives the gradient along x, positive where values grow to the right
+* dy - Receives the gradient along y, positive where values grow downwards
+* border - How pixels outside the image are found
+*/
+void sobel(const Image& in, Image& dx, Image& dy, BorderMode border) {
+  const std::vector<float> derivative = {-1, 0, 1};
+  const std::vector<float> smoothing = {1, 2, 1};
+  if (sharesPixels(in, dx) || sharesPixels(in, dy) || (&dx == &dy)) {
+    Image resultX;
+    Image resultY;
+    sobel(in, resultX, resultY, border);
+    dx = resultX;
+    dy = resultY;
+    return;
+  }
+  prepareFilter(in, dx, 3, 3);
+  if (prepareFilter(in, dy, 3, 3)) {
+    std::vector<SeparablePass> passes = {
+      separablePass(dx, derivative, smoothing, 0),
+      separablePass(dy, smoothing, derivative, 0)
+    };
+    separableRows(in, passes, border, 0);
+  }
+}
@@ -0,0 +1,79 @@
+/******************************************************************************
+*                              Image filters                                  *
+*                                                                             *
+* Correlates images with a kernel, as the filters of image libraries do: the  *
+* kernel is not flipped, so output pixel (y, x) is the sum of                 *
+* kernel(i, j) * in(y + i - anchorY, x + j - anchorX), with the anchor at the *
+* center element (size / 2) of each dimension. For symmetric kernels this is  *
+* the same as a convolution. Every channel is filtered separately.            *
+*                                                                             *
+* A separable kernel, the outer product of a column kernel and a row kernel,  *
+* is applied in two 1-D passes, which costs rows + columns multiplications    *
+* per value instead of rows * columns. filter2D() detects separable kernels   *
+* and takes this path by itself. Gaussian blurs and Sobel gradients are       *
+* always separable:                                                           *
+*                                                                             *
+*   gaussianBlur(frame, blurred, 2.0);                                        *
+*   sobel(blurred, dx, dy);                                                   *
+*                                                                             *
+* Pixels outside the image are given by the border mode. The output image is  *
+* resized to the size of the input with setSize(), so an output that is       *
+* reused across frames keeps its array. The input and output may be the same  *
+* image, in which case the result goes through a temporary image.             *
+*                                                                             *
+* The inner loops are vectorized for the instruction set of the elementwise   *
+* kernels, and sum the taps in the same order for every instruction set, so   *
+* the results are identical. The rows of large images are split between the   *
+* matrix threads.                                                             *
+*                                                                             *
+******************************************************************************/
+#ifndef FILTER_HPP
+#define FILTER_HPP
+
+#include <vector>
+
+#include "image.hpp"
+
+enum class BorderMode {
+  Constant,   // Every pixel outside the image has the border value
+  Replicate,  // The nearest edge pixel is repeated: aaa|abcd|ddd
+  Reflect,    // Mirrored without repeating the edge pixel: dcb|abcd|cba
+  Wrap        // The image repeats periodically: bcd|abcd|abc
+};
+
+// Position inside [0, n) that the border mode gives position i, or -1 if the
+// pixel has the constant border value
+long borderIndex(long i, long n, BorderMode border);
+
+// Filters with a separable kernel, correlating every column with
+// columnKernel and then every row with rowKernel
+void filterSeparable(const Image& in, Image& out,
+                     const std::vector<float>& rowKernel,
+                     const std::vector<float>& columnKernel,
+                     BorderMode border=BorderMode::Reflect,
+                     float borderValue=0);
+Image filterSeparable(const Image& in, const std::vector<float>& rowKernel,
+                      const std::vector<float>& columnKernel,
+                      BorderMode border=BorderMode::Reflect,
+                      float borderValue=0);
+
+// Filters with any 2-D kernel, using the separable path when the kernel is
+// an outer product
+void filter2D(const Image& in, Image& out, const MatrixView& kernel,
+              BorderMode border=BorderMode::Reflect, float borderValue=0);
+Image filter2D(const Image& in, const MatrixView& kernel,
+               BorderMode border=BorderMode::Reflect, float borderValue=0);
+
+// Gaussian kernel of the given standard deviation, normalized to a sum of 1.
+// A radius of 0 selects ceil(3 * sigma)
+std::vector<float> gaussianKernel(double sigma, int radius=0);
+void gaussianBlur(const Image& in, Image& out, double sigma,
+                  BorderMode border=BorderMode::Reflect);
+Image gaussianBlur(const Image& in, double sigma,
+                   BorderMode border=BorderMode::Reflect);
+
+// 3 x 3 Sobel gradients along x (to the right) and y (down)
+void sobel(const Image& in, Image& dx, Image& dy,
+           BorderMode border=BorderMode::Reflect);
+
+#endif
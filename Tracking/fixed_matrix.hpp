@@ -0,0 +1,287 @@
+/******************************************************************************
+*                            Fixed size matrix                                *
+*                                                                             *
+* Matrix whose dimensions are template parameters. The elements are stored    *
+* inline, so a FixedMatrix never allocates, and every loop runs over a        *
+* compile-time bound that the compiler unrolls. Dimension mismatches in       *
+* products, sums and assignments are compile errors rather than exceptions.   *
+* Meant for small state vectors and covariances, such as those of a Kalman    *
+* filter. Use toMatrix() and the Matrix constructor to convert to and from   *
+* the dynamically sized Matrix class.                                         *
+*                                                                             *
+******************************************************************************/
+#ifndef FIXED_MATRIX_HPP
+#define FIXED_MATRIX_HPP
+
+#include <initializer_list>
+
+#include "matrix.hpp"
+
+template <int R, int C, typename Type=double>
+class FixedMatrix {
+  static_assert((R > 0) && (C > 0), "FixedMatrix dimensions must be positive");
+
+  private:
+    Type matrix[R * C];
+
+  public:
+    typedef Type Scalar;
+    static constexpr int rows = R;
+    static constexpr int cols = C;
+
+    /*
+    * Creates a matrix with every element set to zero.
+    */
+    FixedMatrix() {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] = 0;
+      }
+    }
+
+    /*
+    * Creates a matrix from a list of exactly R*C values in row major order.
+    */
+    FixedMatrix(std::initializer_list<Type> values) {
+      if (values.size() != (std::size_t)(R*C)) {
+        std::cout << "Unable to create a matrix of fixed size (" << R << ", "
+                  << C << ") from " << values.size() << " values\n";
+        throw std::invalid_argument("Data size does not match the dimension");
+      }
+      std::copy(values.begin(), values.end(), matrix);
+    }
+
+    /*
+    * Creates a fixed size copy of a Matrix, which must have R rows and C
+    * columns.
+    */
+    explicit FixedMatrix(const Matrix& mat) {
+      if ((mat.getRows() != R) || (mat.getColumns() != C)) {
+        std::cout << "Unable to convert matrix of size (" << mat.getRows()
+                  << ", " << mat.getColumns() << ") to fixed size (" << R
+                  << ", " << C << ")\n";
+        throw std::invalid_argument("Matrix dimension do not match.");
+      }
+      const double* data = mat.getData();
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] = (Type)data[i];
+      }
+    }
+
+    static FixedMatrix zeros() {
+      return FixedMatrix();
+    }
+
+    static FixedMatrix identity() {
+      static_assert(R == C, "Identity matrix must be square");
+      FixedMatrix mat;
+      for (int i = 0; i < R; i++) {
+        mat(i, i) = 1;
+      }
+      return mat;
+    }
+
+    int getRows() const { return R; }
+    int getColumns() const { return C; }
+    Type* getData() { return matrix; }
+    const Type* getData() const { return matrix; }
+
+    /*
+    * Copies the values into a new dynamically sized Matrix.
+    */
+    Matrix toMatrix() const {
+      Matrix mat(R, C);
+      double* data = mat.getData();
+      for (int i = 0; i < R*C; i++) {
+        data[i] = (double)matrix[i];
+      }
+      return mat;
+    }
+
+    /*
+    * Returns the transpose of the matrix.
+    */
+    FixedMatrix<C, R, Type> T() const {
+      FixedMatrix<C, R, Type> result;
+      for (int i = 0; i < R; i++) {
+        for (int j = 0; j < C; j++) {
+          result(j, i) = matrix[i*C + j];
+        }
+      }
+      return result;
+    }
+
+    // Element access. Indices are not checked
+    Type& operator()(int row, int column) { return matrix[row*C + column]; }
+    const Type& operator()(int row, int column) const {
+      return matrix[row*C + column];
+    }
+    Type* operator[](int row) { return matrix + row*C; }
+    const Type* operator[](int row) const { return matrix + row*C; }
+
+    // Elementwise operators
+    FixedMatrix& operator+=(const FixedMatrix& mat) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] += mat.matrix[i];
+      }
+      return *this;
+    }
+    FixedMatrix& operator-=(const FixedMatrix& mat) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] -= mat.matrix[i];
+      }
+      return *this;
+    }
+    FixedMatrix& operator/=(const FixedMatrix& mat) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] /= mat.matrix[i];
+      }
+      return *this;
+    }
+    FixedMatrix& operator+=(Type num) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] += num;
+      }
+      return *this;
+    }
+    FixedMatrix& operator-=(Type num) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] -= num;
+      }
+      return *this;
+    }
+    FixedMatrix& operator*=(Type num) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] *= num;
+      }
+      return *this;
+    }
+    FixedMatrix& operator/=(Type num) {
+      for (int i = 0; i < R*C; i++) {
+        matrix[i] /= num;
+      }
+      return *this;
+    }
+
+    // Matrix multiplication with a square matrix keeps the shape
+    FixedMatrix& operator*=(const FixedMatrix<C, C, Type>& mat) {
+      return (*this = *this * mat);
+    }
+};
+
+/******************************************************************************
+* OPERATOR FUNCTIONS FOR ACTING ON FIXED SIZE MATRICES                        *
+******************************************************************************/
+
+/*
+* Matrix multiplication. The inner dimensions must agree at compile time.
+*/
+template <int R, int K, int C, typename T>
+FixedMatrix<R, C, T> operator*(const FixedMatrix<R, K, T>& left,
+                               const FixedMatrix<K, C, T>& right) {
+  FixedMatrix<R, C, T> result;
+  #pragma GCC unroll 16
+  for (int i = 0; i < R; i++) {
+    #pragma GCC unroll 16
+    for (int k = 0; k < K; k++) {
+      T value = left(i, k);
+      #pragma GCC unroll 16
+      for (int j = 0; j < C; j++) {
+        result(i, j) += value * right(k, j);
+      }
+    }
+  }
+  return result;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator+(FixedMatrix<R, C, T> left,
+                               const FixedMatrix<R, C, T>& right) {
+  return left += right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator-(FixedMatrix<R, C, T> left,
+                               const FixedMatrix<R, C, T>& right) {
+  return left -= right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator/(FixedMatrix<R, C, T> left,
+                               const FixedMatrix<R, C, T>& right) {
+  return left /= right;
+}
+
+// Operators with a number. The number is converted to the element type of
+// the matrix, so "mat * 2" works for a matrix of doubles
+template <int R, int C, typename T>
+using FixedScalar = typename FixedMatrix<R, C, T>::Scalar;
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator+(FixedMatrix<R, C, T> left,
+                               FixedScalar<R, C, T> right) {
+  return left += right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator+(FixedScalar<R, C, T> left,
+                               FixedMatrix<R, C, T> right) {
+  return right += left;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator-(FixedMatrix<R, C, T> left,
+                               FixedScalar<R, C, T> right) {
+  return left -= right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator-(FixedScalar<R, C, T> left,
+                               const FixedMatrix<R, C, T>& right) {
+  FixedMatrix<R, C, T> result;
+  for (int i = 0; i < R*C; i++) {
+    result.getData()[i] = left - right.getData()[i];
+  }
+  return result;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator*(FixedMatrix<R, C, T> left,
+                               FixedScalar<R, C, T> right) {
+  return left *= right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator*(FixedScalar<R, C, T> left,
+                               FixedMatrix<R, C, T> right) {
+  return right *= left;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator/(FixedMatrix<R, C, T> left,
+                               FixedScalar<R, C, T> right) {
+  return left /= right;
+}
+
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> operator/(FixedScalar<R, C, T> left,
+                               const FixedMatrix<R, C, T>& right) {
+  FixedMatrix<R, C, T> result;
+  for (int i = 0; i < R*C; i++) {
+    result.getData()[i] = left / right.getData()[i];
+  }
+  return result;
+}
+
+/*
+* Performs element-wise multiplication of two matrices of the same size.
+*/
+template <int R, int C, typename T>
+FixedMatrix<R, C, T> multiplyElementwise(FixedMatrix<R, C, T> left,
+                                         const FixedMatrix<R, C, T>& right) {
+  for (int i = 0; i < R*C; i++) {
+    left.getData()[i] *= right.getData()[i];
+  }
+  return left;
+}
+
+#endif
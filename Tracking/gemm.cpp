@@ -0,0 +1,249 @@
+/******************************************************************************
+*                           Matrix multiplication                             *
+*                                                                             *
+* Packed, cache-blocked general matrix multiplication. The computation is     *
+* split into blocks of NC columns of B, KC rows of B and MC rows of A. Each   *
+* block of A and B is packed into a contiguous buffer in the order in which   *
+* the micro-kernel reads it, so that a KC x NR sliver of B stays in L1 while  *
+* a MC x KC block of A stays in L2. The micro-kernel keeps an MR x NR tile of *
+* C in registers for the whole KC loop. Large products are split into blocks *
+* of rows of C that run in parallel, each with its own packing buffers.       *
+*                                                                             *
+* The micro-kernel is compiled once for every instruction set and chosen like *
+* the elementwise kernels, so the tile is held in as many vector registers    *
+* as the instruction set needs: eight for AVX2 and four for AVX-512. Products *
+* are not contracted into fused multiply-adds, so that every instruction set  *
+* rounds the same way and gives identical products.                           *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <vector>
+
+#include "gemm.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Register tile size of the micro-kernel
+static const int MR = 4;
+static const int NR = 8;
+
+// Cache block sizes. MC x KC doubles of A target L2, KC x NR doubles of B 
+// target L1 and KC x NC doubles of B target L3
+static const int MC = 96;
+static const int KC = 256;
+static const int NC = 4096;
+
+/******************************************************************************
+* PACKING                                                                     *
+******************************************************************************/
+
+/*
+* Packs an (mc x kc) block of A into panels of MR rows. Each panel is stored 
+* column by column, so the micro-kernel reads MR consecutive values per step. 
+* Rows past the edge of the matrix are padded with zeros.
+*/
+static void packA(int mc, int kc, const double* a, int rs, int cs, 
+                  double* packed) {
+  for (int i = 0; i < mc; i += MR) {
+    int rows = std::min(MR, mc - i);
+    for (int p = 0; p < kc; p++) {
+      for (int r = 0; r < rows; r++) {
+        packed[r] = a[(i + r)*rs + p*cs];
+      }
+      for (int r = rows; r < MR; r++) {
+        packed[r] = 0;
+      }
+      packed += MR;
+    }
+  }
+}
+
+/*
+* Packs a (kc x nc) block of B into panels of NR columns. Each panel is stored
+* row by row, so the micro-kernel reads NR consecutive values per step. 
+* Columns past the edge of the matrix are padded with zeros.
+*/
+static void packB(int kc, int nc, const double* b, int rs, int cs, 
+                  double* packed) {
+  for (int j = 0; j < nc; j += NR) {
+    int cols = std::min(NR, nc - j);
+    for (int p = 0; p < kc; p++) {
+      const double* src = b + p*rs + j*cs;
+      if (cs == 1) {
+        for (int c = 0; c < cols; c++) {
+          packed[c] = src[c];
+        }
+      } else {
+        for (int c = 0; c < cols; c++) {
+          packed[c] = src[c*cs];
+        }
+      }
+      for (int c = cols; c < NR; c++) {
+        packed[c] = 0;
+      }
+      packed += NR;
+    }
+  }
+}
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Multiplies an MR panel of packed A with an NR panel of packed B and adds the
+* (mr x nr) result to C. The tile is accumulated in a local array which the 
+* compiler keeps in vector registers.
+*/
+static ALWAYS_INLINE void microKernelBody(int kc, const double* __restrict a,
+                                          const double* __restrict b,
+                                          double* __restrict c, int ldc,
+                                          int mr, int nr) {
+  double acc[MR][NR] = {};
+  for (int p = 0; p < kc; p++) {
+    for (int i = 0; i < MR; i++) {
+      double ai = a[i];
+      for (int j = 0; j < NR; j++) {
+        acc[i][j] += ai * b[j];
+      }
+    }
+    a += MR;
+    b += NR;
+  }
+  for (int i = 0; i < mr; i++) {
+    for (int j = 0; j < nr; j++) {
+      c[i*ldc + j] += acc[i][j];
+    }
+  }
+}
+
+typedef void (*MicroKernel)(int kc, const double* a, const double* b,
+                            double* c, int ldc, int mr, int nr);
+
+// Defines the micro-kernel for one instruction set
+#define GEMM_KERNELS(ISA, TARGET)                                             \
+  TARGET static void microKernel_##ISA(int kc, const double* a,               \
+                                       const double* b, double* c, int ldc,   \
+                                       int mr, int nr) {                      \
+    microKernelBody(kc, a, b, c, ldc, mr, nr);                                \
+  }
+
+INSTANTIATE_KERNELS(GEMM_KERNELS)
+
+/*
+* Returns the micro-kernel for the instruction set of the elementwise kernels.
+*/
+static MicroKernel microKernel() {
+  SELECT_KERNELS(microKernel)
+}
+
+/*
+* Multiplication for small operands. The loops are ordered so that the inner 
+* loop walks along a row of B and a row of C.
+*/
+static void smallGemm(int m, int n, int k, 
+                      const double* a, int ars, int acs,
+                      const double* b, int brs, int bcs,
+                      double* c, int ldc) {
+  for (int i = 0; i < m; i++) {
+    double* cRow = c + i*ldc;
+    for (int p = 0; p < k; p++) {
+      double ai = a[i*ars + p*acs];
+      const double* bRow = b + p*brs;
+      for (int j = 0; j < n; j++) {
+        cRow[j] += ai * bRow[j*bcs];
+      }
+    }
+  }
+}
+
+/*
+* Multiplies with the packed, cache-blocked kernel, adding the product to C.
+*/
+static void blockedGemm(int m, int n, int k, 
+                        const double* a, int aRowStride, int aColStride,
+                        const double* b, int bRowStride, int bColStride,
+                        double* c, int cRowStride) {
+  // The packing buffers are kept per thread and reused between calls
+  thread_local std::vector<double> packedA;
+  thread_local std::vector<double> packedB;
+  packedA.resize((size_t)MC * KC);
+  packedB.resize((size_t)KC * (NC + NR));
+  MicroKernel kernel = microKernel();
+
+  for (int jc = 0; jc < n; jc += NC) {
+    int nc = std::min(NC, n - jc);
+    for (int pc = 0; pc < k; pc += KC) {
+      int kc = std::min(KC, k - pc);
+      packB(kc, nc, b + pc*bRowStride + jc*bColStride, bRowStride, bColStride,
+            packedB.data());
+
+      for (int ic = 0; ic < m; ic += MC) {
+        int mc = std::min(MC, m - ic);
+        packA(mc, kc, a + ic*aRowStride + pc*aColStride, aRowStride, 
+              aColStride, packedA.data());
+
+        // Sweep the register tiles over the packed blocks
+        for (int jr = 0; jr < nc; jr += NR) {
+          int nr = std::min(NR, nc - jr);
+          for (int ir = 0; ir < mc; ir += MR) {
+            int mr = std::min(MR, mc - ir);
+            kernel(kc, packedA.data() + ir*kc, packedB.data() + jr*kc,
+                   c + (ic + ir)*cRowStride + jc + jr, cRowStride, mr, nr);
+          }
+        }
+      }
+    }
+  }
+}
+
+/******************************************************************************
+* PUBLIC FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Computes C = A x B, or C += A x B if accumulate is set. A is (m x k), B is 
+* (k x n) and C is (m x n) and stored in row major order with the given row 
+* stride. Element (i, j) of A is read from a[i*aRowStride + j*aColStride], 
+* and similarly for B, so a transposed operand is passed by swapping its 
+* strides. C must not overlap with A or B.
+*/
+void gemm(int m, int n, int k, 
+          const double* a, int aRowStride, int aColStride,
+          const double* b, int bRowStride, int bColStride,
+          double* c, int cRowStride, bool accumulate) {
+  if (!accumulate) {
+    for (int i = 0; i < m; i++) {
+      std::fill(c + i*cRowStride, c + i*cRowStride + n, 0.0);
+    }
+  }
+  if ((m == 0) || (n == 0) || (k == 0)) {
+    return;
+  }
+
+  if ((long)m*n*k < GEMM_BLOCKED_THRESHOLD) {
+    smallGemm(m, n, k, a, aRowStride, aColStride, b, bRowStride, bColStride,
+              c, cRowStride);
+    return;
+  }
+
+  // Large products are split into blocks of rows of C, which run in parallel
+  // and each pack their own copy of B
+  int rowBlocks = (m + MC - 1) / MC;
+  int chunks = ((long)m*n*k < GEMM_PARALLEL_THRESHOLD) ? 1 : 
+               parallelChunks(rowBlocks, 1);
+  if (chunks <= 1) {
+    blockedGemm(m, n, k, a, aRowStride, aColStride, b, bRowStride, 
+                bColStride, c, cRowStride);
+    return;
+  }
+  runParallel(chunks, [&](int chunk) {
+    int first = (int)((long)rowBlocks * chunk / chunks) * MC;
+    int last = std::min(m, (int)((long)rowBlocks * (chunk + 1) / chunks) * MC);
+    blockedGemm(last - first, n, k, a + (long)first*aRowStride, aRowStride, 
+                aColStride, b, bRowStride, bColStride, 
+                c + (long)first*cRowStride, cRowStride);
+  });
+}
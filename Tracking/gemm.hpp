@@ -0,0 +1,26 @@
+/******************************************************************************
+*                           Matrix multiplication                             *
+*                                                                             *
+* Packed, cache-blocked general matrix multiplication (GEMM) used by the      *
+* Matrix class. Operands are described by a pointer and a row and column      *
+* stride, so that transposed or strided data can be multiplied without first  *
+* being copied into a new matrix.                                             *
+*                                                                             *
+******************************************************************************/
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+// Products with fewer multiply-adds than this use a simple loop, since packing
+// the operands would cost more than it saves
+const long GEMM_BLOCKED_THRESHOLD = 32*32*32;
+
+// Products with at least this many multiply-adds are split into blocks of rows
+// that run in parallel
+const long GEMM_PARALLEL_THRESHOLD = 128*128*128;
+
+void gemm(int m, int n, int k, 
+          const double* a, int aRowStride, int aColStride,
+          const double* b, int bRowStride, int bColStride,
+          double* c, int cRowStride, bool accumulate=false);
+
+#endif
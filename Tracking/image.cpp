@@ -0,0 +1,511 @@
+/******************************************************************************
+*                                  Image                                      *
+*                                                                             *
+* The rows of an image that owns its array are padded to a whole number of    *
+* IMAGE_ROW_ALIGNMENT bytes. Since the array itself is aligned, every row     *
+* then starts on a cache line, and the vectorized loops of the filters never  *
+* split a row start across two lines. Conversions from and to 8 bit pixels    *
+* are done row by row, with the rows split between the matrix threads.        *
+*                                                                             *
+******************************************************************************/
+#include "image.hpp"
+#include "convert.hpp"
+#include "parallel.hpp"
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns the stride of an image that owns its array: the elements of a row,
+* rounded up to a whole number of IMAGE_ROW_ALIGNMENT bytes.
+*/
+static long alignedStride(int width, int channels) {
+  const long floats = IMAGE_ROW_ALIGNMENT / (long)sizeof(float);
+  long elements = (long)width * channels;
+  return (elements + floats - 1) / floats * floats;
+}
+
+/*
+* Throws if the given dimensions do not describe an image.
+*/
+static void checkDimensions(int width, int height, int channels) {
+  if ((width < 0) || (height < 0) || (channels < 1)) {
+    std::cout << "Invalid image size (" << width << ", " << height << ") with "
+              << channels << " channels\n";
+    throw std::invalid_argument("Invalid image size.");
+  }
+}
+
+/*
+* Returns the number of floats from the first value of the first row to just
+* past the last value of the last row, which is all of a wrapped array that
+* the image may touch.
+*/
+static long wrappedExtent(int width, int height, int channels, long stride) {
+  if (height == 0) {
+    return 0;
+  }
+  return (long)(height - 1) * stride + (long)width * channels;
+}
+
+/*
+* Returns the number of rows that are converted together, so that a chunk of
+* rows holds at least PARALLEL_GRAIN elements.
+*/
+static long rowGrain(int width, int channels) {
+  long elements = std::max(1L, (long)width * channels);
+  return std::max(1L, PARALLEL_GRAIN / elements);
+}
+
+/******************************************************************************
+* CONSTRUCTORS AND DESTRUCTOR                                                 *
+******************************************************************************/
+
+/*
+* Creates an image without pixels.
+*/
+Image::Image() :
+  width(0),
+  height(0),
+  channels(1),
+  stride(0),
+  capacity(0),
+  pixels(nullptr),
+  deleter(nullptr),
+  context(nullptr)
+{}
+
+/*
+* Creates an image of the given size, whose pixels are not initialized.
+*
+* image_width - The number of pixels in a row
+* image_height - The number of rows
+* image_channels - The number of values of each pixel
+*/
+Image::Image(int image_width, int image_height, int image_channels) :
+  width(image_width),
+  height(image_height),
+  channels(image_channels),
+  stride(0),
+  capacity(0),
+  pixels(nullptr),
+  deleter(nullptr),
+  context(nullptr)
+{
+  checkDimensions(width, height, channels);
+  stride = alignedStride(width, channels);
+  capacity = (long)height * stride;
+  pixels = (float*)allocateMatrixBytes(capacity * sizeof(float));
+}
+
+/*
+* Copy constructor. The copy owns its array and has the aligned stride, even
+* if the given image wraps an external array.
+*/
+Image::Image(const Image& image) :
+  Image(image.width, image.height, image.channels)
+{
+  for (int y = 0; y < height; y++) {
+    std::copy(image.row(y), image.row(y) + (long)width*channels, row(y));
+  }
+}
+
+/*
+* Move constructor. Takes over the array of the given image, which is left
+* without pixels.
+*/
+Image::Image(Image&& image) noexcept :
+  Image()
+{
+  swap(image);
+}
+
+/*
+* Creates an image over an existing array, which is released with the given
+* deleter instead of releaseMatrixBytes.
+*/
+Image::Image(float* data, int image_width, int image_height,
+             int image_channels, long row_stride,
+             BufferDeleter<float> buffer_deleter, void* buffer_context) :
+  width(image_width),
+  height(image_height),
+  channels(image_channels),
+  stride(row_stride),
+  capacity(wrappedExtent(image_width, image_height, image_channels,
+                         row_stride)),
+  pixels(data),
+  deleter(buffer_deleter),
+  context(buffer_context)
+{
+  checkDimensions(width, height, channels);
+  if (stride < (long)width * channels) {
+    std::cout << "Unable to wrap an image with " << (long)width * channels
+              << " values per row and a row stride of " << stride << "\n";
+    throw std::invalid_argument("Invalid image stride.");
+  }
+}
+
+Image::~Image() {
+  releaseArray();
+}
+
+/******************************************************************************
+* STATIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Creates an image using the given array of the caller, without copying it.
+* The array is never released by the image and must outlive it.
+*
+* data - The first value of the first row
+* image_width - The number of pixels in a row
+* image_height - The number of rows
+* image_channels - The number of interleaved values of each pixel
+* row_stride - The number of floats from the start of one row to the next
+*/
+Image Image::borrow(float* data, int image_width, int image_height,
+                    int image_channels, long row_stride) {
+  return Image(data, image_width, image_height, image_channels, row_stride,
+               keepBuffer<float>, nullptr);
+}
+
+/*
+* Creates an image that takes ownership of the given array, without copying
+* it. The image calls deleter(data, context) once it no longer uses the
+* array, unless release() hands the array back first.
+*
+* data - The first value of the first row
+* image_width - The number of pixels in a row
+* image_height - The number of rows
+* image_channels - The number of interleaved values of each pixel
+* row_stride - The number of floats from the start of one row to the next
+* buffer_deleter - The function releasing the array
+* buffer_context - Passed to the deleter
+*/
+Image Image::adopt(float* data, int image_width, int image_height,
+                   int image_channels, long row_stride,
+                   BufferDeleter<float> buffer_deleter,
+                   void* buffer_context) {
+  if (buffer_deleter == nullptr) {
+    std::cout << "Unable to adopt an array without a deleter\n";
+    throw std::invalid_argument("Invalid buffer deleter.");
+  }
+  return Image(data, image_width, image_height, image_channels, row_stride,
+               buffer_deleter, buffer_context);
+}
+
+/*
+* Creates an image from 8 bit pixels, multiplying every value by scale.
+*
+* data - The first value of the first row
+* image_width - The number of pixels in a row
+* image_height - The number of rows
+* image_channels - The number of interleaved values of each pixel
+* row_stride - The number of bytes from the start of one row to the next
+* scale - Factor applied to every value, such as 1 / 255.0 to map [0, 255] to
+*         [0, 1]
+*/
+Image Image::fromPixels(const std::uint8_t* data, int image_width,
+                        int image_height, int image_channels,
+                        long row_stride, double scale) {
+  Image image(image_width, image_height, image_channels);
+  long elements = (long)image_width * image_channels;
+  parallelFor(image_height, rowGrain(image_width, image_channels),
+              [&](long begin, long end) {
+    for (long y = begin; y < end; y++) {
+      convertElements(data + y*row_stride, image.row((int)y), elements,
+                      scale);
+    }
+  });
+  return image;
+}
+
+/*
+* Creates a single channel image from a matrix or view, with one pixel per
+* element.
+*/
+Image Image::fromMatrix(const MatrixView& mat) {
+  Image image(mat.getColumns(), mat.getRows(), 1);
+  const double* data = mat.getData();
+  for (int y = 0; y < image.height; y++) {
+    const double* in = data + (long)y*mat.getRowStride();
+    float* out = image.row(y);
+    if (mat.getColumnStride() == 1) {
+      convertElements(in, out, image.width);
+    } else {
+      for (int x = 0; x < image.width; x++) {
+        out[x] = (float)in[(long)x*mat.getColumnStride()];
+      }
+    }
+  }
+  return image;
+}
+
+/******************************************************************************
+* PRIVATE METHODS                                                             *
+******************************************************************************/
+
+/*
+* Releases the array in the way it was obtained.
+*/
+void Image::releaseArray() {
+  if (deleter == nullptr) {
+    releaseMatrixBytes(pixels);
+  } else {
+    deleter(pixels, context);
+    deleter = nullptr;
+    context = nullptr;
+  }
+}
+
+/******************************************************************************
+* PUBLIC METHODS                                                              *
+******************************************************************************/
+
+int Image::getWidth() const {
+  return width;
+}
+
+int Image::getHeight() const {
+  return height;
+}
+
+int Image::getChannels() const {
+  return channels;
+}
+
+/*
+* Returns the number of floats from the start of one row to the start of the
+* next.
+*/
+long Image::getStride() const {
+  return stride;
+}
+
+/*
+* Returns the number of floats the array has room for.
+*/
+long Image::getCapacity() const {
+  return capacity;
+}
+
+/*
+* Returns true if the image uses an array borrowed from the caller.
+*/
+bool Image::isBorrowed() const {
+  return deleter == keepBuffer<float>;
+}
+
+float* Image::getData() {
+  return pixels;
+}
+
+const float* Image::getData() const {
+  return pixels;
+}
+
+/*
+* Returns the first value of row y, without checking y.
+*/
+float* Image::row(int y) {
+  return pixels + (long)y*stride;
+}
+
+const float* Image::row(int y) const {
+  return pixels + (long)y*stride;
+}
+
+/*
+* Gives the image the given size. The array is reused if it is large enough,
+* and otherwise replaced by a new one, so the pixels are not kept. The new
+* rows have the aligned stride unless the size does not change. A borrowed or
+* adopted array is never laid out again, since its rows may be part of a
+* larger frame: an image that wraps one gets a new array of its own instead,
+* and an adopted array is handed to its deleter.
+*
+* image_width - The number of pixels in a row
+* image_height - The number of rows
+* image_channels - The number of values of each pixel
+*/
+void Image::setSize(int image_width, int image_height, int image_channels) {
+  if ((image_width == width) && (image_height == height) &&
+      (image_channels == channels)) {
+    return;
+  }
+  checkDimensions(image_width, image_height, image_channels);
+  long newStride = alignedStride(image_width, image_channels);
+  long count = (long)image_height * newStride;
+  if ((count > capacity) || (deleter != nullptr)) {
+    HeapScope heap;
+    float* temp = (float*)allocateMatrixBytes(count * sizeof(float));
+    releaseArray();
+    pixels = temp;
+    capacity = count;
+  }
+  width = image_width;
+  height = image_height;
+  channels = image_channels;
+  stride = newStride;
+}
+
+/*
+* Sets every value of every pixel to the given value.
+*/
+void Image::fill(float value) {
+  for (int y = 0; y < height; y++) {
+    std::fill(row(y), row(y) + (long)width*channels, value);
+  }
+}
+
+/*
+* Writes the image as 8 bit pixels, multiplying every value by scale and
+* rounding and saturating the result.
+*
+* data - Receives the first value of the first row
+* row_stride - The number of bytes from the start of one row to the next
+* scale - Factor applied to every value, such as 255 to map [0, 1] to
+*         [0, 255]
+*/
+void Image::toPixels(std::uint8_t* data, long row_stride, double scale) const {
+  long elements = (long)width * channels;
+  parallelFor(height, rowGrain(width, channels), [&](long begin, long end) {
+    for (long y = begin; y < end; y++) {
+      convertElements(row((int)y), data + y*row_stride, elements, scale);
+    }
+  });
+}
+
+/*
+* Returns one channel of the image as a (height x width) matrix.
+*/
+Matrix Image::toMatrix(int channel) const {
+  if ((channel < 0) || (channel >= channels)) {
+    std::cout << "Invalid channel " << channel << " for an image with "
+              << channels << " channels\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  Matrix mat(height, width);
+  double* out = mat.getData();
+  for (int y = 0; y < height; y++) {
+    const float* in = row(y) + channel;
+    if (channels == 1) {
+      convertElements(in, out + (long)y*width, width);
+    } else {
+      for (int x = 0; x < width; x++) {
+        out[(long)y*width + x] = in[(long)x*channels];
+      }
+    }
+  }
+  return mat;
+}
+
+/*
+* Exchanges the contents of this image with the given image, without copying
+* any pixels.
+*/
+void Image::swap(Image& image) noexcept {
+  std::swap(width, image.width);
+  std::swap(height, image.height);
+  std::swap(channels, image.channels);
+  std::swap(stride, image.stride);
+  std::swap(capacity, image.capacity);
+  std::swap(pixels, image.pixels);
+  std::swap(deleter, image.deleter);
+  std::swap(context, image.context);
+}
+
+/*
+* Gives up the array without releasing it and returns it, leaving the image
+* without pixels. An adopted or borrowed array goes back to the caller without
+* calling its deleter, and any other array must be released with
+* releaseMatrixBytes.
+*/
+float* Image::release() {
+  float* data = pixels;
+  width = 0;
+  height = 0;
+  channels = 1;
+  stride = 0;
+  capacity = 0;
+  pixels = nullptr;
+  deleter = nullptr;
+  context = nullptr;
+  return data;
+}
+
+/******************************************************************************
+* PUBLIC OPERATOR METHODS                                                     *
+******************************************************************************/
+
+/*
+* Returns the given channel of the pixel in row y and column x.
+*/
+float& Image::operator()(int y, int x, int channel) {
+  if ((y < 0) || (y >= height) || (x < 0) || (x >= width) || (channel < 0) ||
+      (channel >= channels)) {
+    std::cout << "Invalid pixel (" << y << ", " << x << ", " << channel
+              << ") for an image of size (" << height << ", " << width
+              << ", " << channels << ")\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  return pixels[(long)y*stride + (long)x*channels + channel];
+}
+
+const float& Image::operator()(int y, int x, int channel) const {
+  return const_cast<Image&>(*this)(y, x, channel);
+}
+
+/*
+* Replaces the pixels with a copy of the given image, reusing the array if it
+* is large enough.
+*/
+Image& Image::operator=(const Image& image) {
+  if (this == &image) {
+    return *this;
+  }
+  setSize(image.width, image.height, image.channels);
+  for (int y = 0; y < height; y++) {
+    std::copy(image.row(y), image.row(y) + (long)width*channels, row(y));
+  }
+  return *this;
+}
+
+/*
+* Takes over the array of the given image, which releases the previous array
+* of this image.
+*/
+Image& Image::operator=(Image&& image) noexcept {
+  swap(image);
+  return *this;
+}
+
+/******************************************************************************
+* OPERATOR FUNCTIONS                                                          *
+******************************************************************************/
+
+void swap(Image& left, Image& right) noexcept {
+  left.swap(right);
+}
+
+/******************************************************************************
+* FUNCTIONS ACTING ON IMAGES                                                  *
+******************************************************************************/
+
+/*
+* Returns true if the pixels of two images may overlap, comparing the range
+* of memory from the first to the last value of each, so that a filter whose
+* output shares pixels with its input computes into a temporary image first.
+* Images without pixels never overlap, even if they still hold an array.
+*/
+bool sharesPixels(const Image& left, const Image& right) {
+  if ((left.getWidth() == 0) || (left.getHeight() == 0) ||
+      (right.getWidth() == 0) || (right.getHeight() == 0)) {
+    return false;
+  }
+  const float* leftEnd = left.row(left.getHeight() - 1) +
+                         (long)left.getWidth() * left.getChannels();
+  const float* rightEnd = right.row(right.getHeight() - 1) +
+                          (long)right.getWidth() * right.getChannels();
+  return (left.getData() < rightEnd) && (right.getData() < leftEnd);
+}
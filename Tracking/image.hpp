@@ -0,0 +1,103 @@
+/******************************************************************************
+*                                  Image                                      *
+*                                                                             *
+* An image of float pixels with one or more interleaved channels, so that the *
+* channels of a pixel are next to each other, as in a decoded RGB frame. The  *
+* array comes from the same allocator as the arrays of a Matrix. Every row    *
+* starts at a multiple of IMAGE_ROW_ALIGNMENT bytes, and getStride() gives    *
+* the number of floats from the start of one row to the start of the next,    *
+* which may include padding after the last pixel.                             *
+*                                                                             *
+* Images are usually made from 8 bit frames with fromPixels(), which converts *
+* with the vectorized conversions of convert.hpp, and turned back into frames *
+* with toPixels(). Arrays of floats that already hold an image, with any row  *
+* stride, are wrapped without copying by borrow() and adopt(), which follow   *
+* the same rules as for Matrix:                                               *
+*                                                                             *
+*   Image frame = Image::fromPixels(decoded, width, height, 3, 3 * width,     *
+*                                   1 / 255.0);                               *
+*   Image blurred = gaussianBlur(frame, 2.0);                                 *
+*                                                                             *
+* setSize() reuses the array whenever it is large enough, so images that are  *
+* refilled every frame only allocate once. A wrapped array is only reused at  *
+* its own size, so a filter can write into a region of a larger frame, but    *
+* an output of another size gets an array of its own.                         *
+*                                                                             *
+******************************************************************************/
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <cstdint>
+
+#include "matrix.hpp"
+
+// Alignment in bytes of the start of every row of an image that owns its array
+const long IMAGE_ROW_ALIGNMENT = 64;
+
+class Image {
+  private:
+    int width;
+    int height;
+    int channels;
+    long stride;
+    long capacity;
+    float* pixels;
+    BufferDeleter<float> deleter;
+    void* context;
+
+    Image(float* data, int image_width, int image_height, int image_channels,
+          long row_stride, BufferDeleter<float> buffer_deleter,
+          void* buffer_context);
+    void releaseArray();
+
+  public:
+    // Constructors and destructor. The pixels of a new image are not
+    // initialized
+    Image();
+    Image(int image_width, int image_height, int image_channels=1);
+    Image(const Image& image);
+    Image(Image&& image) noexcept;
+    ~Image();
+
+    // Static methods for creating images from existing data
+    static Image borrow(float* data, int image_width, int image_height,
+                        int image_channels, long row_stride);
+    static Image adopt(float* data, int image_width, int image_height,
+                       int image_channels, long row_stride,
+                       BufferDeleter<float> buffer_deleter,
+                       void* buffer_context=nullptr);
+    static Image fromPixels(const std::uint8_t* data, int image_width,
+                            int image_height, int image_channels,
+                            long row_stride, double scale=1);
+    static Image fromMatrix(const MatrixView& mat);
+
+    // Getter functions
+    int getWidth() const;
+    int getHeight() const;
+    int getChannels() const;
+    long getStride() const;
+    long getCapacity() const;
+    bool isBorrowed() const;
+    float* getData();
+    const float* getData() const;
+    float* row(int y);
+    const float* row(int y) const;
+
+    void setSize(int image_width, int image_height, int image_channels=1);
+    void fill(float value);
+    void toPixels(std::uint8_t* data, long row_stride, double scale=1) const;
+    Matrix toMatrix(int channel=0) const;
+    void swap(Image& image) noexcept;
+    float* release();
+
+    // Operators
+    float& operator()(int y, int x, int channel=0);
+    const float& operator()(int y, int x, int channel=0) const;
+    Image& operator=(const Image& image);
+    Image& operator=(Image&& image) noexcept;
+};
+
+void swap(Image& left, Image& right) noexcept;
+bool sharesPixels(const Image& left, const Image& right);
+
+#endif
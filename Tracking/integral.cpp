@@ -0,0 +1,508 @@
+/******************************************************************************
+*                            Integral images                                  *
+*                                                                             *
+* The tables are built in strips of INTEGRAL_STRIP rows, and the strips are   *
+* split between the matrix threads. A first pass only reads the pixels and    *
+* adds up the columns of every strip. Summed from top to bottom, these totals *
+* give the tables just above every strip. The second pass then sums each row  *
+* of a strip from left to right and adds the row above to it with the         *
+* vectorized add kernel, starting from the table above the strip. The tables  *
+* are written once, instead of being corrected after the strips are done.     *
+* Since the strips do not depend on the number of threads, and the add        *
+* kernels give the same result for every instruction set, the tables are      *
+* identical however they were computed.                                       *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+
+#include "integral.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+// Rows of the table that are summed in the same parallel task
+static const int INTEGRAL_STRIP = 32;
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Writes the running sums of one row of pixels, and of their squares when
+* squares is not null, to a row of the tables. Element (x, channel) of the
+* row is in[x*step + channel]. The sums are kept in the accumulator type,
+* which is a 64 bit integer for integer pixels, so that the sums are exact.
+*/
+template <typename Accumulator, typename T>
+static void sumRow(const T* in, long step, int width, int channels,
+                   double* sums, double* squares) {
+  for (int c = 0; c < channels; c++) {
+    Accumulator total = 0;
+    sums[c] = 0;
+    if (squares == nullptr) {
+      for (long x = 0; x < width; x++) {
+        total += (Accumulator)in[x*step + c];
+        sums[(x + 1)*channels + c] = (double)total;
+      }
+      continue;
+    }
+    Accumulator totalSquares = 0;
+    squares[c] = 0;
+    for (long x = 0; x < width; x++) {
+      Accumulator value = (Accumulator)in[x*step + c];
+      total += value;
+      totalSquares += value * value;
+      sums[(x + 1)*channels + c] = (double)total;
+      squares[(x + 1)*channels + c] = (double)totalSquares;
+    }
+  }
+}
+
+/*
+* Adds the pixels of rows first to last - 1 of every column, and of their
+* squares when squares is not null, and writes the running sums of these
+* totals along the row to totals and squareTotals. The column totals are
+* kept in the same rows, one element after the running sums they turn into,
+* so no memory is allocated. They are doubles also for 8 bit pixels, which
+* is exact since a strip adds at most INTEGRAL_STRIP squares of 255.
+*/
+template <typename Accumulator, typename T, typename RowFunction>
+static void sumStrip(const RowFunction& row, long step, int width,
+                     int channels, long first, long last, double* totals,
+                     double* squareTotals) {
+  long n = (long)width * channels;
+  double* columns = totals + channels;
+  double* squareColumns = nullptr;
+  std::fill(columns, columns + n, 0.0);
+  if (squareTotals != nullptr) {
+    squareColumns = squareTotals + channels;
+    std::fill(squareColumns, squareColumns + n, 0.0);
+  }
+  for (long y = first; y < last; y++) {
+    const T* in = (const T*)row(y);
+    if (step != channels) {
+      for (long x = 0; x < width; x++) {
+        for (int c = 0; c < channels; c++) {
+          Accumulator value = (Accumulator)in[x*step + c];
+          columns[x*channels + c] += (double)value;
+          if (squareColumns != nullptr) {
+            squareColumns[x*channels + c] += (double)(value * value);
+          }
+        }
+      }
+    } else if (squareColumns == nullptr) {
+      for (long i = 0; i < n; i++) {
+        columns[i] += (double)in[i];
+      }
+    } else {
+      for (long i = 0; i < n; i++) {
+        Accumulator value = (Accumulator)in[i];
+        columns[i] += (double)value;
+        squareColumns[i] += (double)(value * value);
+      }
+    }
+  }
+
+  // Each total is read just before its running sum is written over it
+  sumRow<Accumulator>(columns, channels, width, channels, totals, nullptr);
+  if (squareColumns != nullptr) {
+    sumRow<Accumulator>(squareColumns, channels, width, channels,
+                        squareTotals, nullptr);
+  }
+}
+
+/*
+* Builds the tables from the rows given by row(y), with the elements of a row
+* step apart. squares is null when only the sums are built. carries holds the
+* tables at the top of every strip.
+*/
+template <typename Accumulator, typename T, typename RowFunction>
+static void integrate(const RowFunction& row, long step, int width,
+                      int height, int channels, Matrix& sums,
+                      Matrix* squares, Matrix& carries) {
+  const ElementwiseKernels& ops = kernels();
+  long length = (long)(width + 1) * channels;
+  long strips = (height + INTEGRAL_STRIP - 1) / INTEGRAL_STRIP;
+  int carryRows = (int)(strips + 1) * (squares == nullptr ? 1 : 2);
+  if ((carries.getRows() != carryRows) || (carries.getColumns() != length)) {
+    HeapScope heap;
+    carries = Matrix(carryRows, (int)length);
+  }
+  auto carryRow = [&](bool squared, long strip) -> double* {
+    return carries.getData() + (squared * (strips + 1) + strip)*length;
+  };
+  std::fill(sums.getData(), sums.getData() + length, 0.0);
+  std::fill(carryRow(false, 0), carryRow(false, 0) + length, 0.0);
+  if (squares != nullptr) {
+    std::fill(squares->getData(), squares->getData() + length, 0.0);
+    std::fill(carryRow(true, 0), carryRow(true, 0) + length, 0.0);
+  }
+  long grain = std::max(1L, PARALLEL_GRAIN / (INTEGRAL_STRIP * length));
+
+  // The totals of every strip, which only read the pixels, are summed from
+  // top to bottom into the tables at the top of the next strip
+  parallelFor(strips, grain, [&](long begin, long end) {
+    for (long strip = begin; strip < end; strip++) {
+      long first = strip * INTEGRAL_STRIP;
+      long last = std::min((long)height, first + INTEGRAL_STRIP);
+      sumStrip<Accumulator, T>(row, step, width, channels, first, last,
+                               carryRow(false, strip + 1),
+                               squares == nullptr ? nullptr
+                                                  : carryRow(true, strip + 1));
+    }
+  });
+  for (long strip = 1; strip < strips; strip++) {
+    for (bool squared : {false, true}) {
+      if (!squared || (squares != nullptr)) {
+        double* carry = carryRow(squared, strip + 1);
+        ops.add(carry, carry, carryRow(squared, strip), length);
+      }
+    }
+  }
+
+  // Every row of a strip is then summed along the row and added to the row
+  // above, starting from the table at the top of the strip
+  parallelFor(strips, grain, [&](long begin, long end) {
+    for (long strip = begin; strip < end; strip++) {
+      long first = strip * INTEGRAL_STRIP;
+      long last = std::min((long)height, first + INTEGRAL_STRIP);
+      for (long y = first; y < last; y++) {
+        double* sumsRow = sums.getData() + (y + 1)*length;
+        double* squaresRow = (squares == nullptr) ? nullptr
+                             : squares->getData() + (y + 1)*length;
+        sumRow<Accumulator>((const T*)row(y), step, width, channels,
+                            sumsRow, squaresRow);
+        ops.add(sumsRow, sumsRow, (y == first) ? carryRow(false, strip)
+                                               : sumsRow - length, length);
+        if (squaresRow != nullptr) {
+          ops.add(squaresRow, squaresRow,
+                  (y == first) ? carryRow(true, strip) : squaresRow - length,
+                  length);
+        }
+      }
+    }
+  });
+}
+
+/*
+* Throws if the rectangle is not inside an image of the given size, after
+* resolving negative bounds in the same way as minRange.
+*/
+static void checkRectangle(int& minRow, int& maxRow, int& minCol,
+                           int& maxCol, int channel, int height, int width,
+                           int channels) {
+  if (maxRow < 0) {
+    maxRow += height;
+  }
+  if (maxCol < 0) {
+    maxCol += width;
+  }
+  if (minRow < 0) {
+    minRow += height;
+  }
+  if (minCol < 0) {
+    minCol += width;
+  }
+  if (((minRow < 0) || (maxRow >= height) || (minRow > maxRow)) ||
+      ((minCol < 0) || (maxCol >= width) || (minCol > maxCol))) {
+    std::string slice = "(" + std::to_string(minRow) + ":" +
+                        std::to_string(maxRow) + ", " +
+                        std::to_string(minCol) + ":" +
+                        std::to_string(maxCol) + ")";
+    std::string size = "(" + std::to_string(height) + "," +
+                        std::to_string(width) + ")";
+    std::cout << "Invalid range " << slice << " for integral image with size "
+              << size << "\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  if ((channel < 0) || (channel >= channels)) {
+    std::cout << "Invalid channel " << channel << " for integral image with "
+              << channels << " channels\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+}
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+/*
+* Creates an integral image of an empty image.
+*/
+IntegralImage::IntegralImage() :
+  width(0),
+  height(0),
+  channels(1),
+  squared(false),
+  sums(1, 1),
+  squares(0, 0),
+  carries(0, 0)
+{
+  sums(0, 0) = 0;
+}
+
+/*
+* Creates the integral image of an image, with the table of squares when
+* with_squares is true.
+*/
+IntegralImage::IntegralImage(const Image& image, bool with_squares) :
+  IntegralImage()
+{
+  compute(image, with_squares);
+}
+
+/*
+* Creates the single channel integral image of a matrix or view.
+*/
+IntegralImage::IntegralImage(const MatrixView& mat, bool with_squares) :
+  IntegralImage()
+{
+  compute(mat, with_squares);
+}
+
+/******************************************************************************
+* PRIVATE METHODS                                                             *
+******************************************************************************/
+
+/*
+* Sets the size and allocates the tables, keeping them when their size does
+* not change.
+*/
+void IntegralImage::prepare(int image_width, int image_height,
+                            int image_channels, bool with_squares) {
+  if ((image_width < 0) || (image_height < 0) || (image_channels < 1)) {
+    std::cout << "Invalid image size (" << image_width << ", "
+              << image_height << ") with " << image_channels
+              << " channels\n";
+    throw std::invalid_argument("Invalid image size.");
+  }
+  width = image_width;
+  height = image_height;
+  channels = image_channels;
+  squared = with_squares;
+  int rows = height + 1;
+  int cols = (width + 1) * channels;
+  if ((sums.getRows() != rows) || (sums.getColumns() != cols)) {
+    HeapScope heap;
+    sums = Matrix(rows, cols);
+  }
+  if (!squared) {
+    return;
+  }
+  if ((squares.getRows() != rows) || (squares.getColumns() != cols)) {
+    HeapScope heap;
+    squares = Matrix(rows, cols);
+  }
+}
+
+/*
+* Returns the position in the tables of the sum of the pixels above and to
+* the left of (y, x).
+*/
+long IntegralImage::corner(int y, int x, int channel) const {
+  return (long)y * (width + 1) * channels + (long)x * channels + channel;
+}
+
+/*
+* Returns the sum of a rectangle of one of the tables, after checking it.
+*/
+double IntegralImage::rectangle(const Matrix& table, int minRow, int maxRow,
+                                int minCol, int maxCol, int channel) const {
+  checkRectangle(minRow, maxRow, minCol, maxCol, channel, height, width,
+                 channels);
+  const double* data = table.getData();
+  return (data[corner(maxRow + 1, maxCol + 1, channel)] -
+          data[corner(minRow, maxCol + 1, channel)]) -
+         (data[corner(maxRow + 1, minCol, channel)] -
+          data[corner(minRow, minCol, channel)]);
+}
+
+/******************************************************************************
+* PUBLIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Builds the tables of an image, summing the float pixels as doubles.
+*/
+void IntegralImage::compute(const Image& image, bool with_squares) {
+  prepare(image.getWidth(), image.getHeight(), image.getChannels(),
+          with_squares);
+  integrate<double, float>([&](long y) { return image.row((int)y); },
+                           channels, width, height, channels, sums,
+                           squared ? &squares : nullptr, carries);
+}
+
+/*
+* Builds the single channel tables of a matrix or view.
+*/
+void IntegralImage::compute(const MatrixView& mat, bool with_squares) {
+  prepare(mat.getColumns(), mat.getRows(), 1, with_squares);
+  const double* data = mat.getData();
+  long rowStride = mat.getRowStride();
+  integrate<double, double>([&](long y) { return data + y*rowStride; },
+                            mat.getColumnStride(), width, height, 1, sums,
+                            squared ? &squares : nullptr, carries);
+}
+
+/*
+* Builds the tables of an 8 bit frame with interleaved channels, whose rows
+* start row_stride bytes apart. The sums are exact.
+*/
+void IntegralImage::compute(const std::uint8_t* data, int image_width,
+                            int image_height, int image_channels,
+                            long row_stride, bool with_squares) {
+  prepare(image_width, image_height, image_channels, with_squares);
+  if (row_stride < (long)image_width * image_channels) {
+    std::cout << "Row stride " << row_stride << " is shorter than a row of "
+              << image_width << " pixels with " << image_channels
+              << " channels\n";
+    throw std::invalid_argument("Invalid image stride.");
+  }
+  integrate<long, std::uint8_t>([&](long y) { return data + y*row_stride; },
+                                channels, width, height, channels, sums,
+                                squared ? &squares : nullptr, carries);
+}
+
+int IntegralImage::getWidth() const {
+  return width;
+}
+
+int IntegralImage::getHeight() const {
+  return height;
+}
+
+int IntegralImage::getChannels() const {
+  return channels;
+}
+
+/*
+* Returns true if the table of squared pixels was built.
+*/
+bool IntegralImage::hasSquares() const {
+  return squared;
+}
+
+const Matrix& IntegralImage::getSums() const {
+  return sums;
+}
+
+const Matrix& IntegralImage::getSquares() const {
+  return squares;
+}
+
+/*
+* Returns the sum of the pixels of a channel in the rectangle of rows minRow
+* to maxRow and columns minCol to maxCol, inclusive.
+*/
+double IntegralImage::sum(int minRow, int maxRow, int minCol, int maxCol,
+                          int channel) const {
+  return rectangle(sums, minRow, maxRow, minCol, maxCol, channel);
+}
+
+/*
+* Returns the sum of the squared pixels of a channel in the rectangle. Needs
+* the table of squares.
+*/
+double IntegralImage::sumSquares(int minRow, int maxRow, int minCol,
+                                 int maxCol, int channel) const {
+  if (!squared) {
+    std::cout << "The integral image was computed without squares\n";
+    throw std::invalid_argument("Missing squared sums.");
+  }
+  return rectangle(squares, minRow, maxRow, minCol, maxCol, channel);
+}
+
+/*
+* Returns the mean of the pixels of a channel in the rectangle.
+*/
+double IntegralImage::mean(int minRow, int maxRow, int minCol, int maxCol,
+                           int channel) const {
+  checkRectangle(minRow, maxRow, minCol, maxCol, channel, height, width,
+                 channels);
+  double count = (double)(maxRow - minRow + 1) * (maxCol - minCol + 1);
+  return sum(minRow, maxRow, minCol, maxCol, channel) / count;
+}
+
+/*
+* Returns the population variance of the pixels of a channel in the
+* rectangle. Needs the table of squares.
+*/
+double IntegralImage::variance(int minRow, int maxRow, int minCol,
+                               int maxCol, int channel) const {
+  double squaresSum = sumSquares(minRow, maxRow, minCol, maxCol, channel);
+  checkRectangle(minRow, maxRow, minCol, maxCol, channel, height, width,
+                 channels);
+  double count = (double)(maxRow - minRow + 1) * (maxCol - minCol + 1);
+  double average = sum(minRow, maxRow, minCol, maxCol, channel) / count;
+  return std::max(0.0, squaresSum / count - average * average);
+}
+
+/******************************************************************************
+* FILTERS                                                                     *
+******************************************************************************/
+
+/*
+* Computes the mean of the window around every pixel from an integral image.
+* The columns whose window is inside the image in x share one count, and are
+* computed with a single loop over their values.
+*/
+void boxFilter(const IntegralImage& integral, Image& out, int radiusX,
+               int radiusY) {
+  if ((radiusX < 0) || (radiusY < 0)) {
+    std::cout << "Invalid box filter radius (" << radiusX << ", " << radiusY
+              << ")\n";
+    throw std::invalid_argument("Invalid filter kernel.");
+  }
+  int width = integral.getWidth();
+  int height = integral.getHeight();
+  int channels = integral.getChannels();
+  out.setSize(width, height, channels);
+  const double* table = integral.getSums().getData();
+  long length = (long)(width + 1) * channels;
+  long grain = std::max(1L, PARALLEL_GRAIN / std::max(1L, length));
+  parallelFor(height, grain, [&](long begin, long end) {
+    for (long y = begin; y < end; y++) {
+      long top = std::max(0L, y - radiusY);
+      long bottom = std::min((long)height - 1, y + radiusY);
+      const double* above = table + top*length;
+      const double* below = table + (bottom + 1)*length;
+      double rowCount = (double)(bottom - top + 1);
+      float* row = out.row((int)y);
+
+      // Columns whose window is cut by the left or right edge
+      auto edge = [&](long x) {
+        long left = std::max(0L, x - radiusX) * channels;
+        long right = (std::min((long)width - 1, x + radiusX) + 1) * channels;
+        double count = rowCount * (right - left) / channels;
+        for (int c = 0; c < channels; c++) {
+          double total = (below[right + c] - below[left + c]) -
+                         (above[right + c] - above[left + c]);
+          row[x*channels + c] = (float)(total / count);
+        }
+      };
+      long inner = std::min((long)radiusX, (long)width);
+      long innerEnd = std::max(inner, (long)width - radiusX);
+      for (long x = 0; x < inner; x++) {
+        edge(x);
+      }
+      double scale = 1 / (rowCount * (2 * radiusX + 1));
+      long right = (long)(radiusX + 1) * channels;
+      long left = -(long)radiusX * channels;
+      for (long i = inner * channels; i < innerEnd * channels; i++) {
+        double total = (below[i + right] - below[i + left]) -
+                       (above[i + right] - above[i + left]);
+        row[i] = (float)(total * scale);
+      }
+      for (long x = innerEnd; x < width; x++) {
+        edge(x);
+      }
+    }
+  });
+}
+
+/*
+* Computes the mean of the window around every pixel of an image.
+*/
+void boxFilter(const Image& in, Image& out, int radiusX, int radiusY) {
+  IntegralImage integral(in);
+  boxFilter(integral, out, radiusX, radiusY);
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+*                            Integral images                                  *
+*                                                                             *
+* An integral image, or summed-area table, holds at (y, x) the sum of every   *
+* pixel above and to the left of (y, x). Once it is built, the sum of any     *
+* rectangle takes four lookups however large the rectangle is, so the sums,   *
+* means and variances of feature windows, box filters and the normalization   *
+* of cross-correlations never rescan the pixels:                              *
+*                                                                             *
+*   IntegralImage integral(frame, true);                                      *
+*   double mean = integral.mean(y, y + 31, x, x + 31);                        *
+*   double variance = integral.variance(y, y + 31, x, x + 31);                *
+*                                                                             *
+* The rectangles follow the rules of minRange: the bounds are inclusive and   *
+* negative bounds count from the end. Each channel of an image has its own    *
+* sums. The table of squared pixels is only built when it is asked for, and   *
+* is needed by sumSquares() and variance().                                   *
+*                                                                             *
+* The sums are kept as doubles. Each row is summed in a 64 bit integer for 8  *
+* bit frames, so their sums are exact up to 2^53 (about 1.4e11 pixels of 255  *
+* squared), and in doubles for float images and matrices. The variance is     *
+* computed from the two sums and is clamped at zero, so windows of almost     *
+* constant pixels with a large mean lose precision.                           *
+*                                                                             *
+* compute() reuses the tables when the size does not change, so an integral   *
+* image that is rebuilt every frame only allocates once.                      *
+*                                                                             *
+******************************************************************************/
+#ifndef INTEGRAL_HPP
+#define INTEGRAL_HPP
+
+#include <cstdint>
+
+#include "image.hpp"
+
+class IntegralImage {
+  private:
+    int width;
+    int height;
+    int channels;
+    bool squared;
+    Matrix sums;
+    Matrix squares;
+    Matrix carries;
+
+    void prepare(int image_width, int image_height, int image_channels,
+                 bool with_squares);
+    long corner(int y, int x, int channel) const;
+    double rectangle(const Matrix& table, int minRow, int maxRow, int minCol,
+                     int maxCol, int channel) const;
+
+  public:
+    // Constructors
+    IntegralImage();
+    explicit IntegralImage(const Image& image, bool with_squares=false);
+    explicit IntegralImage(const MatrixView& mat, bool with_squares=false);
+
+    // Builds the tables of an image, a matrix or an 8 bit frame whose rows
+    // start row_stride bytes apart
+    void compute(const Image& image, bool with_squares=false);
+    void compute(const MatrixView& mat, bool with_squares=false);
+    void compute(const std::uint8_t* data, int image_width, int image_height,
+                 int image_channels, long row_stride,
+                 bool with_squares=false);
+
+    // Getter functions. The tables have height + 1 rows and
+    // (width + 1) * channels columns, with a first row and column of zeros
+    int getWidth() const;
+    int getHeight() const;
+    int getChannels() const;
+    bool hasSquares() const;
+    const Matrix& getSums() const;
+    const Matrix& getSquares() const;
+
+    // Statistics of a rectangle of pixels in O(1)
+    double sum(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1,
+               int channel=0) const;
+    double sumSquares(int minRow=0, int maxRow=-1, int minCol=0,
+                      int maxCol=-1, int channel=0) const;
+    double mean(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1,
+                int channel=0) const;
+    double variance(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1,
+                    int channel=0) const;
+};
+
+// Mean of the (2 * radiusY + 1) x (2 * radiusX + 1) window around every
+// pixel. Near the edges, the mean is over the part of the window inside the
+// image
+void boxFilter(const IntegralImage& integral, Image& out, int radiusX,
+               int radiusY);
+void boxFilter(const Image& in, Image& out, int radiusX, int radiusY);
+
+#endif
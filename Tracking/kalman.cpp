@@ -0,0 +1,335 @@
+/******************************************************************************
+*                              Kalman filter                                  *
+*                                                                             *
+* The products of the filter steps are written straight into the workspaces  *
+* with gemm, which multiplies small matrices with simple loops that do not    *
+* allocate. Products that result in a symmetric matrix are computed by        *
+* symmetricProduct, which only visits the lower triangle.                     *
+*                                                                             *
+******************************************************************************/
+#include "kalman.hpp"
+#include "gemm.hpp"
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Prints an error and throws if the matrix does not have the given size.
+*/
+static void checkSize(const Matrix& mat, int rows, int cols, const char* name) {
+  if ((mat.getRows() != rows) || (mat.getColumns() != cols)) {
+    std::cout << "Expected the " << name << " of the Kalman filter to have "
+              << "size (" << rows << ", " << cols << "), but got ("
+              << mat.getRows() << ", " << mat.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/*
+* Prints an error and throws if a size of the filter is not positive, and
+* returns it otherwise.
+*/
+static int checkDimension(int size, const char* name) {
+  if (size <= 0) {
+    std::cout << "Unable to create a Kalman filter with a " << name
+              << " of size " << size << "\n";
+    throw std::invalid_argument("Invalid Kalman filter size.");
+  }
+  return size;
+}
+
+/*
+* Computes the symmetric (n x n) matrix out = add + sign*A*B^T, where A is a
+* row major (n x k) array and element (j, p) of B is read from
+* b[j*bRowStride + p*bColStride]. Only the lower triangle is computed and it
+* is then mirrored into the upper triangle. add may be nullptr for zero, or
+* the same array as out.
+*/
+static void symmetricProduct(int n, int k, const double* a, const double* b,
+                             int bRowStride, int bColStride, double sign,
+                             const double* add, double* out) {
+  for (int i = 0; i < n; i++) {
+    const double* aRow = a + i*k;
+    for (int j = 0; j <= i; j++) {
+      const double* bRow = b + j*bRowStride;
+      double total = 0;
+      for (int p = 0; p < k; p++) {
+        total += aRow[p] * bRow[p*bColStride];
+      }
+      double value = sign * total;
+      if (add != nullptr) {
+        value += add[i*n + j];
+      }
+      out[i*n + j] = value;
+      out[j*n + i] = value;
+    }
+  }
+}
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+/*
+* Creates a filter for the given state and measurement sizes. The state and
+* process noise start at zero, the covariance, transition and measurement
+* noise at the identity and the measurement matrix at zero.
+*
+* state_size - The number of elements of the state vector
+* measurement_size - The number of elements of a measurement
+*/
+KalmanFilter::KalmanFilter(int state_size, int measurement_size) :
+  stateSize(checkDimension(state_size, "state")),
+  measurementSize(checkDimension(measurement_size, "measurement")),
+  joseph(false),
+  state(Matrix::zeros(stateSize, 1)),
+  covariance(Matrix::identity(stateSize)),
+  transition(Matrix::identity(stateSize)),
+  processNoise(Matrix::zeros(stateSize, stateSize)),
+  measurement(Matrix::zeros(measurementSize, stateSize)),
+  measurementNoise(Matrix::identity(measurementSize)),
+  predictedState(stateSize, 1),
+  transitionCovariance(stateSize, stateSize),
+  innovation(Matrix::zeros(measurementSize, 1)),
+  crossCovariance(stateSize, measurementSize),
+  innovationCovariance(Matrix::identity(measurementSize)),
+  gain(Matrix::zeros(stateSize, measurementSize)),
+  josephFactor(stateSize, stateSize),
+  josephProduct(stateSize, stateSize),
+  gainNoise(stateSize, measurementSize),
+  decomposition(innovationCovariance)
+{}
+
+/******************************************************************************
+* GETTER FUNCTIONS                                                            *
+******************************************************************************/
+
+int KalmanFilter::getStateSize() const {
+  return stateSize;
+}
+
+int KalmanFilter::getMeasurementSize() const {
+  return measurementSize;
+}
+
+const Matrix& KalmanFilter::getState() const {
+  return state;
+}
+
+const Matrix& KalmanFilter::getCovariance() const {
+  return covariance;
+}
+
+const Matrix& KalmanFilter::getTransition() const {
+  return transition;
+}
+
+const Matrix& KalmanFilter::getProcessNoise() const {
+  return processNoise;
+}
+
+const Matrix& KalmanFilter::getMeasurementMatrix() const {
+  return measurement;
+}
+
+const Matrix& KalmanFilter::getMeasurementNoise() const {
+  return measurementNoise;
+}
+
+/*
+* Returns the innovation z - H*x of the last update.
+*/
+const Matrix& KalmanFilter::getInnovation() const {
+  return innovation;
+}
+
+/*
+* Returns the innovation covariance S = H*P*H^T + R of the last update.
+*/
+const Matrix& KalmanFilter::getInnovationCovariance() const {
+  return innovationCovariance;
+}
+
+/*
+* Returns the gain K of the last update.
+*/
+const Matrix& KalmanFilter::getGain() const {
+  return gain;
+}
+
+bool KalmanFilter::getJosephForm() const {
+  return joseph;
+}
+
+/******************************************************************************
+* SETTER FUNCTIONS                                                            *
+******************************************************************************/
+
+void KalmanFilter::setState(const Matrix& x) {
+  checkSize(x, stateSize, 1, "state");
+  state = x;
+}
+
+void KalmanFilter::setCovariance(const Matrix& P) {
+  checkSize(P, stateSize, stateSize, "covariance");
+  covariance = P;
+}
+
+void KalmanFilter::setTransition(const Matrix& F) {
+  checkSize(F, stateSize, stateSize, "transition matrix");
+  transition = F;
+}
+
+void KalmanFilter::setProcessNoise(const Matrix& Q) {
+  checkSize(Q, stateSize, stateSize, "process noise");
+  processNoise = Q;
+}
+
+void KalmanFilter::setMeasurementMatrix(const Matrix& H) {
+  checkSize(H, measurementSize, stateSize, "measurement matrix");
+  measurement = H;
+}
+
+void KalmanFilter::setMeasurementNoise(const Matrix& R) {
+  checkSize(R, measurementSize, measurementSize, "measurement noise");
+  measurementNoise = R;
+}
+
+/*
+* Selects the Joseph form of the covariance update instead of the standard
+* form P - K*H*P.
+*/
+void KalmanFilter::setJosephForm(bool enabled) {
+  joseph = enabled;
+}
+
+/******************************************************************************
+* FILTER STEPS                                                                *
+******************************************************************************/
+
+/*
+* Replaces the covariance with F*P*F^T + Q for the given transition matrix or
+* Jacobian F.
+*/
+void KalmanFilter::predictCovariance(const Matrix& jacobian) {
+  int n = stateSize;
+  gemm(n, n, n, jacobian.getData(), n, 1, covariance.getData(), n, 1,
+       transitionCovariance.getData(), n);
+  symmetricProduct(n, n, transitionCovariance.getData(), jacobian.getData(),
+                   n, 1, 1, processNoise.getData(), covariance.getData());
+}
+
+/*
+* Predicts the state and covariance of the next time step with the linear
+* model x = F*x and P = F*P*F^T + Q.
+*/
+void KalmanFilter::predict() {
+  gemm(stateSize, 1, stateSize, transition.getData(), stateSize, 1,
+       state.getData(), 1, 1, predictedState.getData(), 1);
+  state = predictedState;
+  predictCovariance(transition);
+}
+
+/*
+* Predicts the state and covariance of the next time step with a nonlinear
+* model. The state is replaced by the predicted state f(x) and the covariance
+* by F*P*F^T + Q, where F is the Jacobian of f at the previous state.
+*
+* predicted - The predicted state f(x), of size (stateSize x 1)
+* jacobian - The Jacobian of f, of size (stateSize x stateSize)
+*/
+void KalmanFilter::predict(const Matrix& predicted, const Matrix& jacobian) {
+  checkSize(predicted, stateSize, 1, "predicted state");
+  checkSize(jacobian, stateSize, stateSize, "transition Jacobian");
+  state = predicted;
+  predictCovariance(jacobian);
+}
+
+/*
+* Corrects the state and covariance with the innovation that has been stored,
+* using the given measurement matrix or Jacobian H.
+*/
+void KalmanFilter::updateWithInnovation(const Matrix& jacobian) {
+  int n = stateSize;
+  int m = measurementSize;
+  const double* H = jacobian.getData();
+  double* P = covariance.getData();
+  double* PHt = crossCovariance.getData();
+  double* K = gain.getData();
+
+  // P*H^T, and S = H*P*H^T + R from its lower triangle
+  gemm(n, m, n, P, n, 1, H, 1, n, PHt, m);
+  symmetricProduct(m, n, H, PHt, 1, m, 1, measurementNoise.getData(),
+                   innovationCovariance.getData());
+
+  // K = P*H^T*S^-1, found by solving K*S = P*H^T
+  decomposition.compute(innovationCovariance);
+  if (!decomposition.isPositiveDefinite()) {
+    std::cout << "Unable to update the Kalman filter, since the innovation "
+              << "covariance is not positive definite\n";
+    throw std::invalid_argument("Matrix is not positive definite.");
+  }
+  gain = crossCovariance;
+  decomposition.solveRightInPlace(gain);
+
+  // x = x + K*y
+  gemm(n, 1, m, K, m, 1, innovation.getData(), 1, 1, state.getData(), 1,
+       true);
+
+  if (joseph) {
+    // P = (I - K*H)*P*(I - K*H)^T + K*R*K^T
+    double* factor = josephFactor.getData();
+    gemm(n, n, m, K, m, 1, H, n, 1, factor, n);
+    for (int i = 0; i < n*n; i++) {
+      factor[i] = -factor[i];
+    }
+    for (int i = 0; i < n; i++) {
+      factor[i*n + i] += 1;
+    }
+    gemm(n, n, n, factor, n, 1, P, n, 1, josephProduct.getData(), n);
+    gemm(n, m, m, K, m, 1, measurementNoise.getData(), m, 1,
+         gainNoise.getData(), m);
+    symmetricProduct(n, n, josephProduct.getData(), factor, n, 1, 1, nullptr,
+                     P);
+    symmetricProduct(n, m, gainNoise.getData(), K, m, 1, 1, P, P);
+  } else {
+    // P = P - K*H*P = P - K*(P*H^T)^T
+    symmetricProduct(n, m, K, PHt, m, 1, -1, P, P);
+  }
+}
+
+/*
+* Corrects the state and covariance with a measurement of the linear model
+* z = H*x.
+*
+* z - The measurement, of size (measurementSize x 1)
+*/
+void KalmanFilter::update(const Matrix& z) {
+  checkSize(z, measurementSize, 1, "measurement");
+  gemm(measurementSize, 1, stateSize, measurement.getData(), stateSize, 1,
+       state.getData(), 1, 1, innovation.getData(), 1);
+  for (int i = 0; i < measurementSize; i++) {
+    innovation.getData()[i] = z.getData()[i] - innovation.getData()[i];
+  }
+  updateWithInnovation(measurement);
+}
+
+/*
+* Corrects the state and covariance with a measurement of a nonlinear model
+* z = h(x).
+*
+* z - The measurement, of size (measurementSize x 1)
+* expected - The expected measurement h(x) at the current state
+* jacobian - The Jacobian of h, of size (measurementSize x stateSize)
+*/
+void KalmanFilter::update(const Matrix& z, const Matrix& expected,
+                          const Matrix& jacobian) {
+  checkSize(z, measurementSize, 1, "measurement");
+  checkSize(expected, measurementSize, 1, "expected measurement");
+  checkSize(jacobian, measurementSize, stateSize, "measurement Jacobian");
+  for (int i = 0; i < measurementSize; i++) {
+    innovation.getData()[i] = z.getData()[i] - expected.getData()[i];
+  }
+  updateWithInnovation(jacobian);
+}
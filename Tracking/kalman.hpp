@@ -0,0 +1,94 @@
+/******************************************************************************
+*                              Kalman filter                                  *
+*                                                                             *
+* Linear Kalman filter with a state of stateSize elements and measurements of *
+* measurementSize elements. Every intermediate product is written into a     *
+* workspace that is allocated when the filter is created, so once the model  *
+* has been set, predict and update do not allocate at all.                    *
+*                                                                             *
+* The covariance P is kept exactly symmetric: products that produce it are    *
+* only computed for the lower triangle, which is then mirrored. The gain is   *
+* found with a Cholesky solve against the innovation covariance S rather     *
+* than with its inverse. setJosephForm switches the covariance update to the *
+* Joseph form, (I - K*H)*P*(I - K*H)^T + K*R*K^T, which costs more but keeps  *
+* P positive semidefinite even when the gain is not optimal or rounding       *
+* errors build up.                                                            *
+*                                                                             *
+* For an extended Kalman filter, the application evaluates the nonlinear     *
+* models itself and passes their values and Jacobians to the overloads of    *
+* predict and update:                                                         *
+*                                                                             *
+*   filter.predict(f(x), jacobianF(x));                                       *
+*   filter.update(z, h(x), jacobianH(x));                                     *
+*                                                                             *
+******************************************************************************/
+#ifndef KALMAN_HPP
+#define KALMAN_HPP
+
+#include "matrix.hpp"
+#include "decomposition.hpp"
+
+class KalmanFilter {
+  private:
+    int stateSize;
+    int measurementSize;
+    bool joseph;
+
+    // Model
+    Matrix state;
+    Matrix covariance;
+    Matrix transition;
+    Matrix processNoise;
+    Matrix measurement;
+    Matrix measurementNoise;
+
+    // Workspaces, with their sizes
+    Matrix predictedState;       // (stateSize x 1)
+    Matrix transitionCovariance; // (stateSize x stateSize)
+    Matrix innovation;           // (measurementSize x 1)
+    Matrix crossCovariance;      // (stateSize x measurementSize)
+    Matrix innovationCovariance; // (measurementSize x measurementSize)
+    Matrix gain;                 // (stateSize x measurementSize)
+    Matrix josephFactor;         // (stateSize x stateSize)
+    Matrix josephProduct;        // (stateSize x stateSize)
+    Matrix gainNoise;            // (stateSize x measurementSize)
+    CholeskyDecomposition decomposition;
+
+    void predictCovariance(const Matrix& jacobian);
+    void updateWithInnovation(const Matrix& jacobian);
+
+  public:
+    KalmanFilter(int state_size, int measurement_size);
+
+    // Getter functions
+    int getStateSize() const;
+    int getMeasurementSize() const;
+    const Matrix& getState() const;
+    const Matrix& getCovariance() const;
+    const Matrix& getTransition() const;
+    const Matrix& getProcessNoise() const;
+    const Matrix& getMeasurementMatrix() const;
+    const Matrix& getMeasurementNoise() const;
+    const Matrix& getInnovation() const;
+    const Matrix& getInnovationCovariance() const;
+    const Matrix& getGain() const;
+    bool getJosephForm() const;
+
+    // Setter functions, which copy into the existing storage
+    void setState(const Matrix& x);
+    void setCovariance(const Matrix& P);
+    void setTransition(const Matrix& F);
+    void setProcessNoise(const Matrix& Q);
+    void setMeasurementMatrix(const Matrix& H);
+    void setMeasurementNoise(const Matrix& R);
+    void setJosephForm(bool enabled);
+
+    // Filter steps
+    void predict();
+    void predict(const Matrix& predicted, const Matrix& jacobian);
+    void update(const Matrix& z);
+    void update(const Matrix& z, const Matrix& expected,
+                const Matrix& jacobian);
+};
+
+#endif
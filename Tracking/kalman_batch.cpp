@@ -0,0 +1,772 @@
+/******************************************************************************
+*                          Batched Kalman filter                              *
+*                                                                             *
+* The storage is a single allocation of getArrays() arrays of capacity        *
+* elements: the stateSize state arrays, then the covariance arrays of the     *
+* lower triangle in row order, then the squared Mahalanobis distances of the *
+* last update.                                                                *
+*                                                                             *
+* The kernels copy a group of KALMAN_BATCH_LANES tracks into arrays on the   *
+* stack whose last dimension is the lane, run the filter step on them and    *
+* copy them back. Every inner loop therefore runs over a constant number of  *
+* lanes with no dependencies between them, which the compiler turns into     *
+* vector instructions. The kernels are compiled once for every instruction   *
+* set and chosen like the elementwise kernels. Each lane performs the same   *
+* operations in the same order in every version, so all of them give         *
+* identical results.                                                          *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cmath>
+
+#include "kalman_batch.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+static const int LANES = KALMAN_BATCH_LANES;
+static const int MAX_STATE = KALMAN_BATCH_MAX_STATE;
+static const int MAX_MEASUREMENT = KALMAN_BATCH_MAX_MEASUREMENT;
+static const int MAX_TRIANGLE = MAX_STATE * (MAX_STATE + 1) / 2;
+static const int MAX_MEASUREMENT_TRIANGLE =
+  MAX_MEASUREMENT * (MAX_MEASUREMENT + 1) / 2;
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// The model and storage shared by all groups of a filter step
+struct BatchModel {
+  int n;
+  int m;
+  const double* F;
+  const double* Q;
+  const double* H;
+  const double* R;
+  double* data;
+  long capacity;
+};
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Returns the index of element (i, j) of a symmetric matrix stored as its
+* lower triangle in row order.
+*/
+static ALWAYS_INLINE int lower(int i, int j) {
+  return (i >= j) ? i*(i + 1)/2 + j : j*(j + 1)/2 + i;
+}
+
+/*
+* Copies the given number of lanes from src into dst and sets the remaining
+* lanes to zero.
+*/
+static ALWAYS_INLINE void loadLanes(double* dst, const double* src,
+                                    int lanes) {
+  if (lanes == LANES) {
+    for (int l = 0; l < LANES; l++) {
+      dst[l] = src[l];
+    }
+  } else {
+    for (int l = 0; l < LANES; l++) {
+      dst[l] = (l < lanes) ? src[l] : 0;
+    }
+  }
+}
+
+/*
+* Copies the given number of lanes from src into dst.
+*/
+static ALWAYS_INLINE void storeLanes(double* dst, const double* src,
+                                     int lanes) {
+  if (lanes == LANES) {
+    for (int l = 0; l < LANES; l++) {
+      dst[l] = src[l];
+    }
+  } else {
+    for (int l = 0; l < lanes; l++) {
+      dst[l] = src[l];
+    }
+  }
+}
+
+/*
+* Predicts the tracks first to first + lanes - 1 with x = F*x and
+* P = F*P*F^T + Q.
+*/
+static ALWAYS_INLINE void predictGroup(const BatchModel& model, long first,
+                                       int lanes) {
+  const int n = model.n;
+  const int triangle = n*(n + 1)/2;
+  double x[MAX_STATE][LANES];
+  double P[MAX_TRIANGLE][LANES];
+  double FP[MAX_STATE][MAX_STATE][LANES];
+  for (int s = 0; s < n; s++) {
+    loadLanes(x[s], model.data + s*model.capacity + first, lanes);
+  }
+  for (int s = 0; s < triangle; s++) {
+    loadLanes(P[s], model.data + (n + s)*model.capacity + first, lanes);
+  }
+
+  // x = F*x
+  double predicted[MAX_STATE][LANES];
+  for (int i = 0; i < n; i++) {
+    for (int l = 0; l < LANES; l++) {
+      predicted[i][l] = 0;
+    }
+    for (int k = 0; k < n; k++) {
+      double f = model.F[i*n + k];
+      if (f == 0) {
+        continue;
+      }
+      for (int l = 0; l < LANES; l++) {
+        predicted[i][l] += f * x[k][l];
+      }
+    }
+  }
+
+  // F*P, then the lower triangle of F*P*F^T + Q
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      for (int l = 0; l < LANES; l++) {
+        FP[i][j][l] = 0;
+      }
+      for (int k = 0; k < n; k++) {
+        double f = model.F[i*n + k];
+        if (f == 0) {
+          continue;
+        }
+        const double* p = P[lower(k, j)];
+        for (int l = 0; l < LANES; l++) {
+          FP[i][j][l] += f * p[l];
+        }
+      }
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      double* p = P[lower(i, j)];
+      for (int l = 0; l < LANES; l++) {
+        p[l] = 0;
+      }
+      for (int k = 0; k < n; k++) {
+        double f = model.F[j*n + k];
+        if (f == 0) {
+          continue;
+        }
+        for (int l = 0; l < LANES; l++) {
+          p[l] += FP[i][k][l] * f;
+        }
+      }
+      double q = model.Q[i*n + j];
+      for (int l = 0; l < LANES; l++) {
+        p[l] += q;
+      }
+    }
+  }
+
+  for (int s = 0; s < n; s++) {
+    storeLanes(model.data + s*model.capacity + first, predicted[s], lanes);
+  }
+  for (int s = 0; s < triangle; s++) {
+    storeLanes(model.data + (n + s)*model.capacity + first, P[s], lanes);
+  }
+}
+
+/*
+* Updates the tracks first to first + lanes - 1 with their measurements.
+* Tracks whose entry in updated is zero are computed with a zero measurement,
+* so that whatever their slot holds cannot reach the other lanes, and keep
+* their previous state, covariance and distance. So do the tracks whose
+* innovation covariance is not positive definite, for which failed is set to
+* one, and to zero for every other track.
+*/
+static ALWAYS_INLINE void updateGroup(const BatchModel& model, long first,
+                                      int lanes, const double* measurements,
+                                      long stride,
+                                      const unsigned char* updated,
+                                      unsigned char* failed) {
+  const int n = model.n;
+  const int m = model.m;
+  const int triangle = n*(n + 1)/2;
+  double x[MAX_STATE][LANES];
+  double P[MAX_TRIANGLE][LANES];
+  double y[MAX_MEASUREMENT][LANES];
+  double PHt[MAX_STATE][MAX_MEASUREMENT][LANES];
+  double S[MAX_MEASUREMENT_TRIANGLE][LANES];
+  double inverseDiagonal[MAX_MEASUREMENT][LANES];
+  double K[MAX_STATE][MAX_MEASUREMENT][LANES];
+  double gate[LANES];
+  double definite[LANES];
+  for (int s = 0; s < n; s++) {
+    loadLanes(x[s], model.data + s*model.capacity + first, lanes);
+  }
+  for (int s = 0; s < triangle; s++) {
+    loadLanes(P[s], model.data + (n + s)*model.capacity + first, lanes);
+  }
+  for (int l = 0; l < LANES; l++) {
+    gate[l] = ((l < lanes) && ((updated == nullptr) || updated[first + l]))
+              ? 1 : 0;
+  }
+  for (int a = 0; a < m; a++) {
+    loadLanes(y[a], measurements + a*stride + first, lanes);
+    for (int l = 0; l < LANES; l++) {
+      y[a][l] = (gate[l] != 0) ? y[a][l] : 0;
+    }
+  }
+
+  // y = z - H*x and P*H^T
+  for (int a = 0; a < m; a++) {
+    for (int k = 0; k < n; k++) {
+      double h = model.H[a*n + k];
+      if (h == 0) {
+        continue;
+      }
+      for (int l = 0; l < LANES; l++) {
+        y[a][l] -= h * x[k][l];
+      }
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    for (int a = 0; a < m; a++) {
+      for (int l = 0; l < LANES; l++) {
+        PHt[i][a][l] = 0;
+      }
+      for (int k = 0; k < n; k++) {
+        double h = model.H[a*n + k];
+        if (h == 0) {
+          continue;
+        }
+        const double* p = P[lower(i, k)];
+        for (int l = 0; l < LANES; l++) {
+          PHt[i][a][l] += p[l] * h;
+        }
+      }
+    }
+  }
+
+  // Lower triangle of S = H*P*H^T + R, replaced by its Cholesky factor. A
+  // lane whose pivot is not positive, or NaN, is not positive definite and
+  // is left out like an unmeasured track
+  for (int l = 0; l < LANES; l++) {
+    definite[l] = 1;
+  }
+  for (int a = 0; a < m; a++) {
+    for (int b = 0; b <= a; b++) {
+      double* s = S[lower(a, b)];
+      double r = model.R[a*m + b];
+      for (int l = 0; l < LANES; l++) {
+        s[l] = r;
+      }
+      for (int k = 0; k < n; k++) {
+        double h = model.H[a*n + k];
+        if (h == 0) {
+          continue;
+        }
+        for (int l = 0; l < LANES; l++) {
+          s[l] += h * PHt[k][b][l];
+        }
+      }
+    }
+  }
+  for (int a = 0; a < m; a++) {
+    for (int b = 0; b <= a; b++) {
+      double* s = S[lower(a, b)];
+      for (int c = 0; c < b; c++) {
+        const double* left = S[lower(a, c)];
+        const double* right = S[lower(b, c)];
+        for (int l = 0; l < LANES; l++) {
+          s[l] -= left[l] * right[l];
+        }
+      }
+      if (a == b) {
+        for (int l = 0; l < LANES; l++) {
+          definite[l] = (s[l] > 0) ? definite[l] : 0;
+          s[l] = std::sqrt(s[l]);
+          inverseDiagonal[a][l] = 1 / s[l];
+        }
+      } else {
+        for (int l = 0; l < LANES; l++) {
+          s[l] *= inverseDiagonal[b][l];
+        }
+      }
+    }
+  }
+
+  for (int l = 0; l < lanes; l++) {
+    failed[first + l] = (gate[l] != 0) && (definite[l] == 0);
+  }
+  for (int l = 0; l < LANES; l++) {
+    gate[l] = (definite[l] != 0) ? gate[l] : 0;
+  }
+
+  // Every row of K solves K_i*S = (P*H^T)_i, by forward and back
+  // substitution with the Cholesky factor
+  for (int i = 0; i < n; i++) {
+    for (int a = 0; a < m; a++) {
+      for (int l = 0; l < LANES; l++) {
+        K[i][a][l] = PHt[i][a][l];
+      }
+      for (int c = 0; c < a; c++) {
+        const double* s = S[lower(a, c)];
+        for (int l = 0; l < LANES; l++) {
+          K[i][a][l] -= s[l] * K[i][c][l];
+        }
+      }
+      for (int l = 0; l < LANES; l++) {
+        K[i][a][l] *= inverseDiagonal[a][l];
+      }
+    }
+    for (int a = m - 1; a >= 0; a--) {
+      for (int c = a + 1; c < m; c++) {
+        const double* s = S[lower(c, a)];
+        for (int l = 0; l < LANES; l++) {
+          K[i][a][l] -= s[l] * K[i][c][l];
+        }
+      }
+      for (int l = 0; l < LANES; l++) {
+        K[i][a][l] *= inverseDiagonal[a][l];
+      }
+    }
+  }
+
+  // Squared Mahalanobis distance y^T*S^-1*y = |L^-1*y|^2
+  double whitened[MAX_MEASUREMENT][LANES];
+  double distance[LANES];
+  double previous[LANES];
+  loadLanes(previous, model.data + (n + triangle)*model.capacity + first,
+            lanes);
+  for (int l = 0; l < LANES; l++) {
+    distance[l] = 0;
+  }
+  for (int a = 0; a < m; a++) {
+    for (int l = 0; l < LANES; l++) {
+      whitened[a][l] = y[a][l];
+    }
+    for (int c = 0; c < a; c++) {
+      const double* s = S[lower(a, c)];
+      for (int l = 0; l < LANES; l++) {
+        whitened[a][l] -= s[l] * whitened[c][l];
+      }
+    }
+    for (int l = 0; l < LANES; l++) {
+      whitened[a][l] *= inverseDiagonal[a][l];
+      distance[l] += whitened[a][l] * whitened[a][l];
+    }
+  }
+  for (int l = 0; l < LANES; l++) {
+    distance[l] = (gate[l] != 0) ? distance[l] : previous[l];
+  }
+
+  // x = x + K*y and the lower triangle of P = P - K*(P*H^T)^T, selected by
+  // the mask so that the tracks left out keep their values bit for bit
+  double corrected[LANES];
+  for (int i = 0; i < n; i++) {
+    for (int l = 0; l < LANES; l++) {
+      corrected[l] = x[i][l];
+    }
+    for (int a = 0; a < m; a++) {
+      for (int l = 0; l < LANES; l++) {
+        corrected[l] += K[i][a][l] * y[a][l];
+      }
+    }
+    for (int l = 0; l < LANES; l++) {
+      x[i][l] = (gate[l] != 0) ? corrected[l] : x[i][l];
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j <= i; j++) {
+      double* p = P[lower(i, j)];
+      for (int l = 0; l < LANES; l++) {
+        corrected[l] = p[l];
+      }
+      for (int a = 0; a < m; a++) {
+        for (int l = 0; l < LANES; l++) {
+          corrected[l] -= K[i][a][l] * PHt[j][a][l];
+        }
+      }
+      for (int l = 0; l < LANES; l++) {
+        p[l] = (gate[l] != 0) ? corrected[l] : p[l];
+      }
+    }
+  }
+
+  for (int s = 0; s < n; s++) {
+    storeLanes(model.data + s*model.capacity + first, x[s], lanes);
+  }
+  for (int s = 0; s < triangle; s++) {
+    storeLanes(model.data + (n + s)*model.capacity + first, P[s], lanes);
+  }
+  storeLanes(model.data + (n + triangle)*model.capacity + first, distance,
+             lanes);
+}
+
+typedef void (*PredictKernel)(const BatchModel& model, long begin, long end);
+typedef void (*UpdateKernel)(const BatchModel& model, long begin, long end,
+                             const double* measurements, long stride,
+                             const unsigned char* updated,
+                             unsigned char* failed);
+
+struct BatchKernels {
+  PredictKernel predict;
+  UpdateKernel update;
+};
+
+// Defines the kernels for the tracks begin to end - 1 for one instruction set
+#define BATCH_KERNELS(ISA, TARGET)                                            \
+  TARGET static void predict_##ISA(const BatchModel& model, long begin,      \
+                                   long end) {                               \
+    for (long first = begin; first < end; first += LANES) {                   \
+      predictGroup(model, first, (int)std::min((long)LANES, end - first));    \
+    }                                                                         \
+  }                                                                           \
+  TARGET static void update_##ISA(const BatchModel& model, long begin,       \
+                                  long end, const double* measurements,      \
+                                  long stride, const unsigned char* updated, \
+                                  unsigned char* failed) {                   \
+    for (long first = begin; first < end; first += LANES) {                   \
+      updateGroup(model, first, (int)std::min((long)LANES, end - first),      \
+                  measurements, stride, updated, failed);                    \
+    }                                                                         \
+  }                                                                           \
+  static const BatchKernels batchKernels_##ISA = {                            \
+    predict_##ISA, update_##ISA                                               \
+  };
+
+INSTANTIATE_KERNELS(BATCH_KERNELS)
+
+/*
+* Returns the kernels for the instruction set of the elementwise kernels.
+*/
+static const BatchKernels& batchKernels() {
+  SELECT_KERNELS(batchKernels)
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Prints an error and throws if the matrix does not have the given size.
+*/
+static void checkSize(const Matrix& mat, int rows, int cols, const char* name) {
+  if ((mat.getRows() != rows) || (mat.getColumns() != cols)) {
+    std::cout << "Expected the " << name << " of the Kalman batch to have "
+              << "size (" << rows << ", " << cols << "), but got ("
+              << mat.getRows() << ", " << mat.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/*
+* Prints an error and throws if the track does not exist.
+*/
+static void checkTrack(long track, long count) {
+  if ((track < 0) || (track >= count)) {
+    std::cout << "Invalid track " << track << " for a batch of " << count
+              << " tracks\n";
+    throw std::invalid_argument("Invalid track index.");
+  }
+}
+
+/*
+* Prints an error and throws if a size of the batch is not supported, and
+* returns it otherwise.
+*/
+static int checkDimension(int size, int maximum, const char* name) {
+  if ((size <= 0) || (size > maximum)) {
+    std::cout << "Unable to create a Kalman batch with a " << name
+              << " of size " << size << ", the largest supported size is "
+              << maximum << "\n";
+    throw std::invalid_argument("Invalid Kalman batch size.");
+  }
+  return size;
+}
+
+/*
+* Returns the number of tracks per chunk for parallel filter steps, rounded
+* to whole groups of lanes.
+*/
+static long trackGrain(int n) {
+  long grain = PARALLEL_GRAIN / ((long)n * n * n);
+  return std::max((long)LANES, grain / LANES * LANES);
+}
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+/*
+* Creates an empty batch for the given state and measurement sizes. The
+* transition and measurement noise start at the identity, and the process
+* noise and measurement matrix at zero.
+*
+* state_size - The number of elements of every state vector
+* measurement_size - The number of elements of every measurement
+*/
+KalmanBatch::KalmanBatch(int state_size, int measurement_size) :
+  stateSize(checkDimension(state_size, MAX_STATE, "state")),
+  measurementSize(checkDimension(measurement_size, MAX_MEASUREMENT,
+                                 "measurement")),
+  count(0),
+  capacity(0),
+  data(nullptr),
+  transition(Matrix::identity(stateSize)),
+  processNoise(Matrix::zeros(stateSize, stateSize)),
+  measurement(Matrix::zeros(measurementSize, stateSize)),
+  measurementNoise(Matrix::identity(measurementSize))
+{}
+
+KalmanBatch::~KalmanBatch() {
+  if (data != nullptr) {
+    releaseMatrix(data);
+  }
+}
+
+/******************************************************************************
+* MODEL                                                                       *
+******************************************************************************/
+
+void KalmanBatch::setTransition(const Matrix& F) {
+  checkSize(F, stateSize, stateSize, "transition matrix");
+  transition = F;
+}
+
+void KalmanBatch::setProcessNoise(const Matrix& Q) {
+  checkSize(Q, stateSize, stateSize, "process noise");
+  processNoise = Q;
+}
+
+void KalmanBatch::setMeasurementMatrix(const Matrix& H) {
+  checkSize(H, measurementSize, stateSize, "measurement matrix");
+  measurement = H;
+}
+
+void KalmanBatch::setMeasurementNoise(const Matrix& R) {
+  checkSize(R, measurementSize, measurementSize, "measurement noise");
+  measurementNoise = R;
+}
+
+/******************************************************************************
+* TRACKS                                                                      *
+******************************************************************************/
+
+/*
+* Returns the number of arrays in the storage: the state, the lower triangle
+* of the covariance and the distance.
+*/
+int KalmanBatch::getArrays() const {
+  return stateSize + stateSize*(stateSize + 1)/2 + 1;
+}
+
+/*
+* Returns the array holding the given element of every track.
+*/
+double* KalmanBatch::array(int index) const {
+  return data + (long)index*capacity;
+}
+
+int KalmanBatch::getStateSize() const {
+  return stateSize;
+}
+
+int KalmanBatch::getMeasurementSize() const {
+  return measurementSize;
+}
+
+long KalmanBatch::getCount() const {
+  return count;
+}
+
+long KalmanBatch::getCapacity() const {
+  return capacity;
+}
+
+/*
+* Makes room for at least the given number of tracks, so that adding them
+* does not reallocate.
+*/
+void KalmanBatch::reserve(long tracks) {
+  if (tracks <= capacity) {
+    return;
+  }
+  long newCapacity = (tracks + LANES - 1) / LANES * LANES;
+  HeapScope heap;
+  double* newData = allocateMatrix(newCapacity * getArrays());
+  for (int a = 0; a < getArrays(); a++) {
+    std::copy(array(a), array(a) + count, newData + a*newCapacity);
+  }
+  if (data != nullptr) {
+    releaseMatrix(data);
+  }
+  data = newData;
+  capacity = newCapacity;
+}
+
+/*
+* Adds a track with the given state and covariance and returns its number.
+* The capacity grows geometrically, so adding tracks one at a time takes
+* amortized constant time.
+*/
+long KalmanBatch::addTrack(const Matrix& x, const Matrix& P) {
+  checkSize(x, stateSize, 1, "state");
+  checkSize(P, stateSize, stateSize, "covariance");
+  if (count == capacity) {
+    reserve(std::max(2*capacity, (long)LANES));
+  }
+  count++;
+  setTrack(count - 1, x, P);
+  return count - 1;
+}
+
+/*
+* Replaces the state and covariance of a track. Only the lower triangle of the
+* covariance is used.
+*/
+void KalmanBatch::setTrack(long track, const Matrix& x, const Matrix& P) {
+  checkTrack(track, count);
+  checkSize(x, stateSize, 1, "state");
+  checkSize(P, stateSize, stateSize, "covariance");
+  for (int s = 0; s < stateSize; s++) {
+    array(s)[track] = x(s, 0);
+  }
+  for (int i = 0; i < stateSize; i++) {
+    for (int j = 0; j <= i; j++) {
+      array(stateSize + i*(i + 1)/2 + j)[track] = P(i, j);
+    }
+  }
+  array(getArrays() - 1)[track] = 0;
+}
+
+/*
+* Removes a track by moving the last track into its place.
+*/
+void KalmanBatch::removeTrack(long track) {
+  checkTrack(track, count);
+  count--;
+  for (int a = 0; a < getArrays(); a++) {
+    array(a)[track] = array(a)[count];
+  }
+}
+
+/*
+* Removes every track, keeping the storage.
+*/
+void KalmanBatch::clear() {
+  count = 0;
+}
+
+/*
+* Returns the state of a track as a (stateSize x 1) matrix.
+*/
+Matrix KalmanBatch::getState(long track) const {
+  checkTrack(track, count);
+  Matrix result(stateSize, 1);
+  for (int s = 0; s < stateSize; s++) {
+    result(s, 0) = array(s)[track];
+  }
+  return result;
+}
+
+/*
+* Returns the covariance of a track as a full (stateSize x stateSize) matrix.
+*/
+Matrix KalmanBatch::getCovariance(long track) const {
+  checkTrack(track, count);
+  Matrix result(stateSize, stateSize);
+  for (int i = 0; i < stateSize; i++) {
+    for (int j = 0; j <= i; j++) {
+      result(i, j) = array(stateSize + i*(i + 1)/2 + j)[track];
+      result(j, i) = result(i, j);
+    }
+  }
+  return result;
+}
+
+/*
+* Returns the array holding the given element of the state of every track.
+*/
+double* KalmanBatch::getStates(int element) {
+  return array(element);
+}
+
+const double* KalmanBatch::getStates(int element) const {
+  return array(element);
+}
+
+/*
+* Returns the squared Mahalanobis distance y^T*S^-1*y of the innovation of
+* every track in the last update that corrected it, which is zero for tracks
+* added since.
+*/
+const double* KalmanBatch::getDistances() const {
+  return array(getArrays() - 1);
+}
+
+/*
+* Returns a mask with a one for every track whose innovation covariance was
+* not positive definite in the last update, and which was therefore left
+* unchanged, and a zero for every other track. The mask uses the track
+* numbers of that update.
+*/
+const unsigned char* KalmanBatch::getFailures() const {
+  return failures.data();
+}
+
+/******************************************************************************
+* FILTER STEPS                                                                *
+******************************************************************************/
+
+/*
+* Predicts the state and covariance of every track for the next time step.
+*/
+void KalmanBatch::predict() {
+  BatchModel model = {stateSize, measurementSize, transition.getData(),
+                      processNoise.getData(), measurement.getData(),
+                      measurementNoise.getData(), data, capacity};
+  PredictKernel kernel = batchKernels().predict;
+  long grain = trackGrain(stateSize);
+  parallelFor((count + grain - 1) / grain, 1, [&](long first, long last) {
+    kernel(model, first*grain, std::min(count, last*grain));
+  });
+}
+
+/*
+* Corrects the state and covariance of every track with its measurement.
+*
+* measurements - Element a of the measurement of track t is read from
+*                measurements[a*stride + t]
+* stride - The distance between the arrays of measurement elements
+* updated - If not nullptr, only tracks t with updated[t] != 0 are corrected.
+*           The others keep their state, covariance and distance, whatever
+*           their measurement slots hold
+*
+* Unlike KalmanFilter::update, a track whose innovation covariance is not
+* positive definite does not throw, since the other tracks are still
+* corrected. It keeps its state, covariance and distance, and is marked in
+* getFailures(). Returns the number of such tracks.
+*/
+long KalmanBatch::update(const double* measurements, long stride,
+                         const unsigned char* updated) {
+  BatchModel model = {stateSize, measurementSize, transition.getData(),
+                      processNoise.getData(), measurement.getData(),
+                      measurementNoise.getData(), data, capacity};
+  UpdateKernel kernel = batchKernels().update;
+  long grain = trackGrain(stateSize);
+  failures.resize(count);
+  unsigned char* failed = failures.data();
+  parallelFor((count + grain - 1) / grain, 1, [&](long first, long last) {
+    kernel(model, first*grain, std::min(count, last*grain), measurements,
+           stride, updated, failed);
+  });
+  return std::count(failures.begin(), failures.end(), 1);
+}
+
+/*
+* Corrects every track with the measurements in the columns of a
+* (measurementSize x getCount()) matrix.
+*/
+long KalmanBatch::update(const Matrix& measurements,
+                         const unsigned char* updated) {
+  checkSize(measurements, measurementSize, (int)count, "measurements");
+  return update(measurements.getData(), count, updated);
+}
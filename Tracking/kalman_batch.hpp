@@ -0,0 +1,95 @@
+/******************************************************************************
+*                          Batched Kalman filter                              *
+*                                                                             *
+* Runs the same linear Kalman filter for many tracks at once. The states and *
+* covariances of all tracks are stored as a structure of arrays: element s   *
+* of every state is kept in one contiguous array, and so is element (i, j)   *
+* of every covariance, of which only the lower triangle is stored. predict   *
+* and update work on groups of KALMAN_BATCH_LANES tracks, and every step of   *
+* the filter is applied to all tracks of a group with the same vector         *
+* instructions, one track per lane, just as the elementwise kernels of the    *
+* Matrix class apply one operation to many elements. Groups run in parallel *
+* on the matrix threads.                                                      *
+*                                                                             *
+* All tracks share the transition, process noise, measurement matrix and    *
+* measurement noise. Zero elements of the transition and measurement        *
+* matrices are skipped, so sparse motion models cost less. Measurements are  *
+* also passed as a structure of arrays, with element a of the measurement of *
+* track t at measurements[a*stride + t], such as a (measurementSize x count) *
+* Matrix. Tracks that were not measured in a frame can be left out of an     *
+* update with a mask. A track whose innovation covariance is not positive     *
+* definite is left out in the same way instead of turning into NaN: update()  *
+* returns the number of such tracks and getFailures() marks which ones.       *
+*                                                                             *
+* Tracks are numbered from 0 to getCount() - 1. Removing a track moves the   *
+* last track into its place, so track numbers are not stable across removals.*
+*                                                                             *
+******************************************************************************/
+#ifndef KALMAN_BATCH_HPP
+#define KALMAN_BATCH_HPP
+
+#include "matrix.hpp"
+
+// Number of tracks processed together by the vectorized kernels
+const int KALMAN_BATCH_LANES = 8;
+
+// Largest supported state and measurement sizes. The kernels keep a group of
+// tracks in fixed size arrays on the stack
+const int KALMAN_BATCH_MAX_STATE = 12;
+const int KALMAN_BATCH_MAX_MEASUREMENT = 6;
+
+class KalmanBatch {
+  private:
+    int stateSize;
+    int measurementSize;
+    long count;
+    long capacity;
+    double* data;
+    std::vector<unsigned char> failures;
+
+    Matrix transition;
+    Matrix processNoise;
+    Matrix measurement;
+    Matrix measurementNoise;
+
+    int getArrays() const;
+    double* array(int index) const;
+
+  public:
+    KalmanBatch(int state_size, int measurement_size);
+    KalmanBatch(const KalmanBatch&) = delete;
+    KalmanBatch& operator=(const KalmanBatch&) = delete;
+    ~KalmanBatch();
+
+    // Model
+    void setTransition(const Matrix& F);
+    void setProcessNoise(const Matrix& Q);
+    void setMeasurementMatrix(const Matrix& H);
+    void setMeasurementNoise(const Matrix& R);
+
+    // Tracks
+    int getStateSize() const;
+    int getMeasurementSize() const;
+    long getCount() const;
+    long getCapacity() const;
+    void reserve(long tracks);
+    long addTrack(const Matrix& x, const Matrix& P);
+    void setTrack(long track, const Matrix& x, const Matrix& P);
+    void removeTrack(long track);
+    void clear();
+    Matrix getState(long track) const;
+    Matrix getCovariance(long track) const;
+    double* getStates(int element);
+    const double* getStates(int element) const;
+    const double* getDistances() const;
+    const unsigned char* getFailures() const;
+
+    // Filter steps
+    void predict();
+    long update(const double* measurements, long stride,
+                const unsigned char* updated=nullptr);
+    long update(const Matrix& measurements,
+                const unsigned char* updated=nullptr);
+};
+
+#endif
@@ -0,0 +1,259 @@
+/******************************************************************************
+*                           Elementwise kernels                               *
+*                                                                             *
+* Each instruction set gets its own copy of the kernels, generated by the     *
+* macros below and compiled with the matching target attribute, so the rest  *
+* of the library can be built for the baseline architecture. The main loop    *
+* processes one vector register per step and the remaining elements are      *
+* handled by a scalar tail loop.                                              *
+*                                                                             *
+******************************************************************************/
+#include <atomic>
+
+#include "kernels.hpp"
+
+#ifdef KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*
+* Defines the kernels for one instruction set and element type. TARGET is the
+* function attribute enabling the instruction set, WIDTH the number of 
+* elements per register and the remaining arguments the intrinsics for a 
+* register type.
+*/
+#define BINARY_KERNEL(ISA, TYPE, NAME, OP, TARGET, WIDTH, LOAD, STORE, VOP)   \
+  TARGET static void NAME##_##ISA##_##TYPE(TYPE* out, const TYPE* a,          \
+                                           const TYPE* b, long n) {          \
+    long i = 0;                                                               \
+    for (; i + WIDTH <= n; i += WIDTH) {                                      \
+      STORE(out + i, VOP(LOAD(a + i), LOAD(b + i)));                          \
+    }                                                                         \
+    for (; i < n; i++) {                                                      \
+      out[i] = a[i] OP b[i];                                                  \
+    }                                                                         \
+  }
+
+#define SCALAR_KERNEL(ISA, TYPE, NAME, OP, TARGET, WIDTH, LOAD, STORE, SET1,  \
+                      VOP)                                                    \
+  TARGET static void NAME##_##ISA##_##TYPE(TYPE* out, const TYPE* a,          \
+                                           TYPE value, long n) {              \
+    long i = 0;                                                               \
+    auto v = SET1(value);                                                     \
+    for (; i + WIDTH <= n; i += WIDTH) {                                      \
+      STORE(out + i, VOP(LOAD(a + i), v));                                    \
+    }                                                                         \
+    for (; i < n; i++) {                                                      \
+      out[i] = a[i] OP value;                                                 \
+    }                                                                         \
+  }
+
+#define DEFINE_KERNELS(ISA, TYPE, TARGET, WIDTH, LOAD, STORE, SET1, ADD, SUB,\
+                       MUL, DIV)                                              \
+  BINARY_KERNEL(ISA, TYPE, add, +, TARGET, WIDTH, LOAD, STORE, ADD)           \
+  BINARY_KERNEL(ISA, TYPE, subtract, -, TARGET, WIDTH, LOAD, STORE, SUB)      \
+  BINARY_KERNEL(ISA, TYPE, multiply, *, TARGET, WIDTH, LOAD, STORE, MUL)      \
+  BINARY_KERNEL(ISA, TYPE, divide, /, TARGET, WIDTH, LOAD, STORE, DIV)        \
+  SCALAR_KERNEL(ISA, TYPE, addScalar, +, TARGET, WIDTH, LOAD, STORE, SET1,    \
+                ADD)                                                          \
+  SCALAR_KERNEL(ISA, TYPE, multiplyScalar, *, TARGET, WIDTH, LOAD, STORE,     \
+                SET1, MUL)                                                    \
+  SCALAR_KERNEL(ISA, TYPE, divideScalar, /, TARGET, WIDTH, LOAD, STORE, SET1, \
+                DIV)                                                          \
+  TARGET static void scalarDivide_##ISA##_##TYPE(TYPE* out, TYPE value,       \
+                                                 const TYPE* a, long n) {    \
+    long i = 0;                                                               \
+    auto v = SET1(value);                                                     \
+    for (; i + WIDTH <= n; i += WIDTH) {                                      \
+      STORE(out + i, DIV(v, LOAD(a + i)));                                    \
+    }                                                                         \
+    for (; i < n; i++) {                                                      \
+      out[i] = value / a[i];                                                  \
+    }                                                                         \
+  }                                                                           \
+  static const BasicElementwiseKernels<TYPE> ISA##_##TYPE##Kernels = {        \
+    KernelIsa::ISA, #ISA,                                                     \
+    add_##ISA##_##TYPE, subtract_##ISA##_##TYPE, multiply_##ISA##_##TYPE,     \
+    divide_##ISA##_##TYPE, addScalar_##ISA##_##TYPE,                          \
+    multiplyScalar_##ISA##_##TYPE, divideScalar_##ISA##_##TYPE,               \
+    scalarDivide_##ISA##_##TYPE                                               \
+  };
+
+/******************************************************************************
+* SCALAR KERNELS                                                              *
+******************************************************************************/
+
+// The scalar fallback uses a "register" of a single double, with the tree 
+// vectorizer disabled so that it really is the scalar reference
+#define SCALAR_TARGET __attribute__((optimize("no-tree-vectorize")))
+#define SCALAR_LOAD(p) (*(p))
+#define SCALAR_STORE(p, v) (*(p) = (v))
+#define SCALAR_SET1(v) (v)
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_SUB(a, b) ((a) - (b))
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_DIV(a, b) ((a) / (b))
+DEFINE_KERNELS(Scalar, double, SCALAR_TARGET, 1, SCALAR_LOAD, SCALAR_STORE, 
+               SCALAR_SET1, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_DIV)
+DEFINE_KERNELS(Scalar, float, SCALAR_TARGET, 1, SCALAR_LOAD, SCALAR_STORE, 
+               SCALAR_SET1, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_DIV)
+
+/******************************************************************************
+* X86 KERNELS                                                                 *
+******************************************************************************/
+
+#ifdef KERNELS_X86
+DEFINE_KERNELS(SSE2, double, __attribute__((target("sse2"))), 2, 
+               _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd, 
+               _mm_sub_pd, _mm_mul_pd, _mm_div_pd)
+DEFINE_KERNELS(AVX2, double, __attribute__((target("avx2"))), 4, 
+               _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, 
+               _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd)
+DEFINE_KERNELS(AVX512, double, __attribute__((target("avx512f"))), 8, 
+               _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd, 
+               _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd)
+
+// A register holds twice as many floats as doubles
+DEFINE_KERNELS(SSE2, float, __attribute__((target("sse2"))), 4, 
+               _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_add_ps, 
+               _mm_sub_ps, _mm_mul_ps, _mm_div_ps)
+DEFINE_KERNELS(AVX2, float, __attribute__((target("avx2"))), 8, 
+               _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, 
+               _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_div_ps)
+DEFINE_KERNELS(AVX512, float, __attribute__((target("avx512f"))), 16, 
+               _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps, 
+               _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps, _mm512_div_ps)
+#endif
+
+/******************************************************************************
+* DISPATCH                                                                    *
+******************************************************************************/
+
+/*
+* Returns the kernels compiled for the given instruction set, or nullptr if 
+* they were not compiled for this architecture.
+*/
+static const ElementwiseKernels* kernelsFor(KernelIsa isa) {
+  switch (isa) {
+    case KernelIsa::Scalar:
+      return &Scalar_doubleKernels;
+#ifdef KERNELS_X86
+    case KernelIsa::SSE2:
+      return &SSE2_doubleKernels;
+    case KernelIsa::AVX2:
+      return &AVX2_doubleKernels;
+    case KernelIsa::AVX512:
+      return &AVX512_doubleKernels;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+/*
+* Returns the float kernels compiled for the given instruction set, which 
+* exist whenever the double kernels do.
+*/
+static const FloatKernels* floatKernelsFor(KernelIsa isa) {
+  switch (isa) {
+#ifdef KERNELS_X86
+    case KernelIsa::SSE2:
+      return &SSE2_floatKernels;
+    case KernelIsa::AVX2:
+      return &AVX2_floatKernels;
+    case KernelIsa::AVX512:
+      return &AVX512_floatKernels;
+#endif
+    default:
+      return &Scalar_floatKernels;
+  }
+}
+
+/*
+* Returns true if the kernels for the given instruction set were compiled in 
+* and the running CPU supports them.
+*/
+bool isaSupported(KernelIsa isa) {
+  if (kernelsFor(isa) == nullptr) {
+    return false;
+  }
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  switch (isa) {
+    case KernelIsa::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case KernelIsa::AVX2:
+      return __builtin_cpu_supports("avx2");
+    case KernelIsa::AVX512:
+      return __builtin_cpu_supports("avx512f");
+    default:
+      break;
+  }
+#endif
+  return true;
+}
+
+/*
+* Returns the printable name of the given instruction set.
+*/
+const char* isaName(KernelIsa isa) {
+  switch (isa) {
+    case KernelIsa::SSE2:
+      return "SSE2";
+    case KernelIsa::AVX2:
+      return "AVX2";
+    case KernelIsa::AVX512:
+      return "AVX512";
+    default:
+      return "Scalar";
+  }
+}
+
+/*
+* Finds the widest instruction set supported by the running CPU.
+*/
+static const ElementwiseKernels* selectKernels() {
+  KernelIsa order[] = {KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE2};
+  for (KernelIsa isa : order) {
+    if (isaSupported(isa)) {
+      return kernelsFor(isa);
+    }
+  }
+  return &Scalar_doubleKernels;
+}
+
+static std::atomic<const ElementwiseKernels*> activeKernels{nullptr};
+
+/*
+* Returns the kernels for the current CPU. The instruction set is detected on
+* the first call.
+*/
+const ElementwiseKernels& kernels() {
+  const ElementwiseKernels* active = 
+    activeKernels.load(std::memory_order_relaxed);
+  if (active == nullptr) {
+    active = selectKernels();
+    activeKernels.store(active, std::memory_order_relaxed);
+  }
+  return *active;
+}
+
+/*
+* Returns the float kernels for the same instruction set as kernels().
+*/
+const FloatKernels& floatKernels() {
+  return *floatKernelsFor(kernels().isa);
+}
+
+/*
+* Forces the kernels for the given instruction set to be used, for both 
+* element types, which is meant for testing and benchmarking. Returns false,
+* and leaves the kernels unchanged, if the instruction set is not supported.
+*/
+bool setKernelIsa(KernelIsa isa) {
+  if (!isaSupported(isa)) {
+    return false;
+  }
+  activeKernels.store(kernelsFor(isa), std::memory_order_relaxed);
+  return true;
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+*                           Elementwise kernels                               *
+*                                                                             *
+* Vectorized loops for the elementwise matrix operations, on doubles and on  *
+* floats. A set of kernels is compiled for every supported instruction set    *
+* and the best one for the running CPU is selected once, the first time the   *
+* kernels are used. Every kernel performs the same single IEEE operation per  *
+* element as the scalar loop, so all instruction sets give bit-identical      *
+* results (0 ULP).                                                            *
+*                                                                             *
+******************************************************************************/
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+enum class KernelIsa {
+  Scalar,
+  SSE2,
+  AVX2,
+  AVX512
+};
+
+template <typename T>
+struct BasicElementwiseKernels {
+  KernelIsa isa;
+  const char* name;
+
+  // out[i] = a[i] (op) b[i]
+  void (*add)(T* out, const T* a, const T* b, long n);
+  void (*subtract)(T* out, const T* a, const T* b, long n);
+  void (*multiply)(T* out, const T* a, const T* b, long n);
+  void (*divide)(T* out, const T* a, const T* b, long n);
+
+  // out[i] = a[i] (op) value
+  void (*addScalar)(T* out, const T* a, T value, long n);
+  void (*multiplyScalar)(T* out, const T* a, T value, long n);
+  void (*divideScalar)(T* out, const T* a, T value, long n);
+
+  // out[i] = value / a[i]
+  void (*scalarDivide)(T* out, T value, const T* a, long n);
+};
+
+typedef BasicElementwiseKernels<double> ElementwiseKernels;
+typedef BasicElementwiseKernels<float> FloatKernels;
+
+const ElementwiseKernels& kernels();
+const FloatKernels& floatKernels();
+bool isaSupported(KernelIsa isa);
+bool setKernelIsa(KernelIsa isa);
+const char* isaName(KernelIsa isa);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#endif
+
+/*
+* Function attributes for the loops compiled once per instruction set. The 
+* scalar version is not vectorized so it stays the reference. Contracting a 
+* product and a sum into a fused multiply-add would round differently, so it 
+* is turned off for every instruction set to keep the results identical.
+*/
+#define KERNEL_TARGET_Scalar                                                  \
+  __attribute__((optimize("no-tree-vectorize", "fp-contract=off")))
+#define KERNEL_TARGET_SSE2                                                    \
+  __attribute__((target("sse2"),                                              \
+                 optimize("tree-vectorize", "fp-contract=off")))
+#define KERNEL_TARGET_AVX2                                                    \
+  __attribute__((target("avx2"),                                              \
+                 optimize("tree-vectorize", "fp-contract=off")))
+#define KERNEL_TARGET_AVX512                                                  \
+  __attribute__((target("avx512f"),                                           \
+                 optimize("tree-vectorize", "fp-contract=off")))
+
+/*
+* Expands DEFINE(ISA, TARGET) once for every instruction set compiled on this 
+* platform. DEFINE names its kernels NAME_##ISA so that SELECT_KERNELS can 
+* find them.
+*/
+#ifdef KERNELS_X86
+#define INSTANTIATE_KERNELS(DEFINE)                                           \
+  DEFINE(Scalar, KERNEL_TARGET_Scalar)                                        \
+  DEFINE(SSE2, KERNEL_TARGET_SSE2)                                            \
+  DEFINE(AVX2, KERNEL_TARGET_AVX2)                                            \
+  DEFINE(AVX512, KERNEL_TARGET_AVX512)
+#else
+#define INSTANTIATE_KERNELS(DEFINE) DEFINE(Scalar, KERNEL_TARGET_Scalar)
+#endif
+
+/*
+* Returns NAME_##ISA for the instruction set of the elementwise kernels.
+*/
+#ifdef KERNELS_X86
+#define SELECT_KERNELS(NAME)                                                  \
+  switch (kernels().isa) {                                                    \
+    case KernelIsa::SSE2:                                                     \
+      return NAME##_SSE2;                                                     \
+    case KernelIsa::AVX2:                                                     \
+      return NAME##_AVX2;                                                     \
+    case KernelIsa::AVX512:                                                   \
+      return NAME##_AVX512;                                                   \
+    default:                                                                  \
+      return NAME##_Scalar;                                                   \
+  }
+#else
+#define SELECT_KERNELS(NAME) return NAME##_Scalar;
+#endif
+
+#endif
@@ -5,6 +5,47 @@
 *                                                                             *
 ******************************************************************************/
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+#include "transpose.hpp"
+#include "decomposition.hpp"
+#include "reduce.hpp"
+
+/******************************************************************************
+* PARALLEL HELPERS                                                            *
+******************************************************************************/
+
+/*
+* Runs an elementwise kernel over n elements, splitting large arrays into 
+* ranges that run in parallel.
+*/
+static void parallelKernel(void (*kernel)(double*, const double*, 
+                                          const double*, long),
+                           double* out, const double* a, const double* b, 
+                           long n) {
+  parallelFor(n, PARALLEL_GRAIN, [&](long begin, long end) {
+    kernel(out + begin, a + begin, b + begin, end - begin);
+  });
+}
+
+static void parallelKernel(void (*kernel)(double*, const double*, double, 
+                                          long),
+                           double* out, const double* a, double value, 
+                           long n) {
+  parallelFor(n, PARALLEL_GRAIN, [&](long begin, long end) {
+    kernel(out + begin, a + begin, value, end - begin);
+  });
+}
+
+static void parallelKernel(void (*kernel)(double*, double, const double*, 
+                                          long),
+                           double* out, double value, const double* a, 
+                           long n) {
+  parallelFor(n, PARALLEL_GRAIN, [&](long begin, long end) {
+    kernel(out + begin, value, a + begin, end - begin);
+  });
+}
 
 /******************************************************************************
 * CONSTRUCTORS AND DESTRUCTOR                                                 *
@@ -17,11 +58,14 @@
 * num_columns - An integer denoting the number of columns that the matrix 
 *               should have
 */
-Matrix::Matrix(int num_rows, int num_columns) :
+Matrix::BasicMatrix(int num_rows, int num_columns) :
   rows(num_rows),
   cols(num_columns),
+  capacity((long)num_rows * num_columns),
   //matrix(double[num_rows * num_columns])
-  matrix(new double[num_rows * num_columns])
+  matrix(allocateMatrix(num_rows * num_columns)),
+  deleter(nullptr),
+  context(nullptr)
 {}
 
 /* 
@@ -33,28 +77,104 @@ Matrix::Matrix(int num_rows, int num_columns) :
 * data - A pointer to a datastructure of the correct type containing the data 
 *        that the matrix should be filled with in row major order
 */
-Matrix::Matrix(int num_rows, int num_columns, double data[]) :
+Matrix::BasicMatrix(int num_rows, int num_columns, const double data[]) :
   rows(num_rows),
   cols(num_columns),
+  capacity((long)num_rows * num_columns),
   //matrix(double[num_rows * num_columns])
-  matrix(new double[num_rows * num_columns])
+  matrix(allocateMatrix(num_rows * num_columns)),
+  deleter(nullptr),
+  context(nullptr)
 {
   /*if ((sizeof(data)/sizeof(double)) != (rows * cols)) {
     throw std::invalid_argument("Data size does not match the dimension"); 
   }*/
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] = data[i*cols + j];
-    }
+  std::copy(data, data + rows*cols, matrix);
+}
+
+/*
+* Copy constructor. Allocates a new array and copies every element of the 
+* given matrix into it, so that the two matrices do not share data.
+*
+* mat - The matrix that should be copied
+*/
+Matrix::BasicMatrix(const Matrix& mat) :
+  rows(mat.rows),
+  cols(mat.cols),
+  capacity((long)mat.rows * mat.cols),
+  matrix(allocateMatrix(mat.rows * mat.cols)),
+  deleter(nullptr),
+  context(nullptr)
+{
+  std::copy(mat.matrix, mat.matrix + rows*cols, matrix);
+}
+
+/*
+* Move constructor. Takes ownership of the array of the given matrix without 
+* copying it. The given matrix is left empty with a size of (0, 0).
+*
+* mat - The matrix whose data should be taken over
+*/
+Matrix::BasicMatrix(Matrix&& mat) noexcept :
+  rows(mat.rows),
+  cols(mat.cols),
+  capacity(mat.capacity),
+  matrix(mat.matrix),
+  deleter(mat.deleter),
+  context(mat.context)
+{
+  mat.rows = 0;
+  mat.cols = 0;
+  mat.capacity = 0;
+  mat.matrix = nullptr;
+  mat.deleter = nullptr;
+  mat.context = nullptr;
+}
+
+/*
+* Creates a matrix holding a copy of the elements of the given view.
+*
+* view - The view whose elements should be copied
+*/
+Matrix::BasicMatrix(const MatrixView& view) :
+  rows(view.getRows()),
+  cols(view.getColumns()),
+  capacity((long)view.getRows() * view.getColumns()),
+  matrix(allocateMatrix(view.getRows() * view.getColumns())),
+  deleter(nullptr),
+  context(nullptr)
+{
+  // A view whose columns are contiguous is the transpose of a row major
+  // array, so it is copied with the blocked transpose
+  if ((view.getRowStride() == 1) && (view.getColumnStride() != 1)) {
+    transposeCopy(view.getData(), cols, rows, view.getColumnStride(), matrix,
+                  cols);
+    return;
   }
+  assignExpression(matrix, rows, cols, cols, 1, ViewLeaf(view));
 }
 
+/*
+* Creates a matrix over an existing array, which is released with the given
+* deleter instead of releaseMatrix.
+*/
+Matrix::BasicMatrix(double* data, int num_rows, int num_columns,
+                    BufferDeleter<double> buffer_deleter,
+                    void* buffer_context) :
+  rows(num_rows),
+  cols(num_columns),
+  capacity((long)num_rows * num_columns),
+  matrix(data),
+  deleter(buffer_deleter),
+  context(buffer_context)
+{}
+
 /*
 * Deconstructor for the Matrix class to remove the array used to represent the 
 * matrix.
 */
 Matrix::~Matrix() {
-  //delete matrix;
+  releaseArray();
 }
 
 /******************************************************************************
@@ -101,7 +221,19 @@ Matrix Matrix::identity(int size) {
 * right - A matrix object representing the matrix on the right side for 
 *         multiplication
 */
-Matrix Matrix::multiply(Matrix left, Matrix right) {
+Matrix Matrix::multiply(const Matrix& left, const Matrix& right) {
+  return multiply(MatrixView(left), MatrixView(right));
+}
+
+/*
+* Applies matrix multiplication to the two views presented, without copying 
+* the viewed elements. Checks are done to ensure that the views have the 
+* correct dimensions.
+* 
+* left - A view of the matrix on the left side for multiplication
+* right - A view of the matrix on the right side for multiplication
+*/
+Matrix Matrix::multiply(const MatrixView& left, const MatrixView& right) {
 
   // Check to see if the dimensions for the matrices allign
   if (left.getColumns() != right.getRows()) {
@@ -111,105 +243,342 @@ Matrix Matrix::multiply(Matrix left, Matrix right) {
     throw std::invalid_argument("Matrix dimension do not match.");
   }
 
-  // Create a new matrix of the correct size and populate
+  // Create a new matrix of the correct size and populate it. Large products 
+  // are dispatched to the blocked kernel by gemm
   Matrix result(left.getRows(), right.getColumns());
-  double total = 0;
-  for (int r = 0; r < left.getRows(); r++) {
-    for (int c = 0; c < right.getColumns(); c++) {
-      for (int i = 0; i < left.getColumns(); i++) {
-        total += left[r][i] * right[i][c];
-      }
-      result[r][c] = total;
-      total = 0;
-    }
-  }
+  gemm(left.getRows(), right.getColumns(), left.getColumns(), 
+       left.getData(), left.getRowStride(), left.getColumnStride(), 
+       right.getData(), right.getRowStride(), right.getColumnStride(), 
+       result.matrix, result.cols);
   return result;
 }
 
 /*
-* Adds the two matrices together. Checks are done to ensure that the matrices 
-* are of the same size.
+* Adds the two matrices together. Matrices of differing sizes are broadcast,
+* so a row or column is added to every row or column of the other matrix.
 * 
 * left - A matrix object representing the left matrix in the addition
 * right - A matrix object representing the right matrix in the addition
 */
-Matrix Matrix::add(Matrix left, Matrix right) {
-  // Check to ensure that the matrices have the same dimensions
+Matrix Matrix::add(const Matrix& left, const Matrix& right) {
   if ((left.getColumns() != right.getColumns()) || 
       (left.getRows() != right.getRows())) {
-    std::cout << "Unable to add matrices with differing dimensions: ("
-              << left.getRows() << ", " << left.getColumns() << ") + ("
-              << right.getRows() << ", " << right.getColumns() << ")\n";
-    throw std::invalid_argument("Matrix dimension do not match.");
+    return Matrix(left + right);
   }
 
   // Create a new matrix of the correct size and populate it
   Matrix result(left.getRows(), left.getColumns());
-  for (int r = 0; r < left.getRows(); r++) {
-    for (int c = 0; c < left.getColumns(); c++) {
-      result[r][c] = left[r][c] + right[r][c];
-    }
-  }
+  parallelKernel(kernels().add, result.matrix, left.matrix, right.matrix,
+                 left.rows*left.cols);
   return result;
 }
 
 /*
-* Subtracts the matrix on the right from the matrix on the left. Checks are 
-* done to ensure that the matrices are of the same size.
+* Subtracts the matrix on the right from the matrix on the left. Matrices of
+* differing sizes are broadcast, so a row or column pairs with every row or
+* column of the other matrix.
 * 
 * left - A matrix object representing the left matrix in the subtraction
 * right - A matrix object representing the right matrix in the subtraction
 */
-Matrix Matrix::subtract(Matrix left, Matrix right) {
-  // Check to ensure that the matrices have the same dimensions
+Matrix Matrix::subtract(const Matrix& left, const Matrix& right) {
   if ((left.getColumns() != right.getColumns()) || 
       (left.getRows() != right.getRows())) {
-    std::cout << "Unable to subtract matrices with differing dimensions: ("
-              << left.getRows() << ", " << left.getColumns() << ") - ("
-              << right.getRows() << ", " << right.getColumns() << ")\n";
-    throw std::invalid_argument("Matrix dimension do not match.");
+    return Matrix(left - right);
   }
 
   // Create a new matrix of the correct size and populate it
   Matrix result(left.getRows(), left.getColumns());
-  for (int r = 0; r < left.getRows(); r++) {
-    for (int c = 0; c < left.getColumns(); c++) {
-      result[r][c] = left[r][c] - right[r][c];
-    }
-  }
+  parallelKernel(kernels().subtract, result.matrix, left.matrix, right.matrix,
+                 left.rows*left.cols);
   return result;
 }
 
 /*
-* Performs element-wise multiplication of two matrices. Check are done to 
-* ensure that the matrices are of the same size.
+* Performs element-wise multiplication of two matrices. Matrices of differing
+* sizes are broadcast, so a row or column multiplies every row or column of
+* the other matrix.
 *
 * left - A matrix object representing the left matrix in the element-wise
 *        multiplication.
 * right - A matrix object representing the right matrix in the element-wise
 *         multiplication
 */
-Matrix Matrix::multiplyElementwise(Matrix left, Matrix right) {
-  // Check to ensure that the matrices have the same dimensions
+Matrix Matrix::multiplyElementwise(const Matrix& left, const Matrix& right) {
   if ((left.getColumns() != right.getColumns()) || 
       (left.getRows() != right.getRows())) {
-    std::cout << "Unable to perform element-wise multiplication on matrices "
-              << "with differing dimensions: (" << left.getRows() << ", " 
-              << left.getColumns() << ") - (" << right.getRows() << ", " 
-              << right.getColumns() << ")\n";
-    throw std::invalid_argument("Matrix dimension do not match.");
+    return Matrix(BinaryExpression<MatrixLeaf, MatrixLeaf, MultiplyOperation>(
+                    MatrixLeaf(left), MatrixLeaf(right)));
   }
 
   // Create a new matrix of the correct size and populate it
   Matrix result(left.getRows(), left.getColumns());
-  for (int r = 0; r < left.getRows(); r++) {
-    for (int c = 0; c < left.getColumns(); c++) {
-      result[r][c] = left[r][c] * right[r][c];
+  parallelKernel(kernels().multiply, result.matrix, left.matrix, right.matrix,
+                 left.rows*left.cols);
+  return result;
+}
+
+/*
+* Stacks the given matrices or views on top of each other into a new matrix, 
+* with a single allocation. Every part must have the same number of columns.
+*
+* parts - The matrices or views, from top to bottom
+*/
+Matrix Matrix::stack(const std::vector<MatrixView>& parts) {
+  long total = 0;
+  for (const MatrixView& part : parts) {
+    if (part.getColumns() != parts[0].getColumns()) {
+      std::cout << "Unable to stack matrices with " 
+                << parts[0].getColumns() << " and " << part.getColumns() 
+                << " columns\n";
+      throw std::invalid_argument("Invalid matrix sizes for concatenation.");
     }
+    total += part.getRows();
+  }
+  Matrix result((int)total, parts.empty() ? 0 : parts[0].getColumns());
+  double* out = result.matrix;
+  for (const MatrixView& part : parts) {
+    assignExpression(out, part.getRows(), result.cols, result.cols, 1,
+                     ViewLeaf(part));
+    out += (long)part.getRows() * result.cols;
   }
   return result;
 }
 
+/*
+* Places the given matrices or views side by side into a new matrix, with a
+* single allocation. Every part must have the same number of rows.
+*
+* parts - The matrices or views, from left to right
+*/
+Matrix Matrix::hstack(const std::vector<MatrixView>& parts) {
+  long total = 0;
+  for (const MatrixView& part : parts) {
+    if (part.getRows() != parts[0].getRows()) {
+      std::cout << "Unable to place matrices with " << parts[0].getRows() 
+                << " and " << part.getRows() << " rows side by side\n";
+      throw std::invalid_argument("Invalid matrix sizes for concatenation.");
+    }
+    total += part.getColumns();
+  }
+  Matrix result(parts.empty() ? 0 : parts[0].getRows(), (int)total);
+  double* out = result.matrix;
+  for (const MatrixView& part : parts) {
+    assignExpression(out, result.rows, part.getColumns(), result.cols, 1,
+                     ViewLeaf(part));
+    out += part.getColumns();
+  }
+  return result;
+}
+
+/*
+* Creates a matrix using the given array of the caller in row major order,
+* without copying it. The array is never released by the matrix and must
+* outlive it. If the matrix later needs a larger array, it copies its
+* elements into an array of its own and stops using the borrowed one.
+*
+* data - The array, holding at least num_rows * num_columns elements
+* num_rows - An integer denoting the number of rows that the matrix should have
+* num_columns - An integer denoting the number of columns that the matrix 
+*               should have
+*/
+Matrix Matrix::borrow(double* data, int num_rows, int num_columns) {
+  return Matrix(data, num_rows, num_columns, keepBuffer<double>, nullptr);
+}
+
+/*
+* Creates a matrix that takes ownership of the given array in row major order,
+* without copying it. The matrix calls deleter(data, context) once it no
+* longer uses the array, which is when it is destroyed or moves to a larger
+* array, unless release() hands the array back first.
+*
+* data - The array, holding at least num_rows * num_columns elements
+* num_rows - An integer denoting the number of rows that the matrix should have
+* num_columns - An integer denoting the number of columns that the matrix 
+*               should have
+* buffer_deleter - The function releasing the array
+* buffer_context - Passed to the deleter, such as the frame or segment that
+*                  the array belongs to
+*/
+Matrix Matrix::adopt(double* data, int num_rows, int num_columns,
+                     BufferDeleter<double> buffer_deleter,
+                     void* buffer_context) {
+  if (buffer_deleter == nullptr) {
+    std::cout << "Unable to adopt an array without a deleter\n";
+    throw std::invalid_argument("Invalid buffer deleter.");
+  }
+  return Matrix(data, num_rows, num_columns, buffer_deleter, buffer_context);
+}
+
+/******************************************************************************
+* PRIVATE METHODS                                                             *
+******************************************************************************/
+
+/*
+* Returns true if any element of the view lies in the given array, so that it
+* has to be copied before the array is changed.
+*/
+static bool viewInArray(const MatrixView& view, const double* data, 
+                        long count) {
+  if ((view.getRows() == 0) || (view.getColumns() == 0) || (count == 0)) {
+    return false;
+  }
+  const double* first = view.getData();
+  const double* last = first + (long)(view.getRows() - 1)*view.getRowStride() +
+                       (long)(view.getColumns() - 1)*view.getColumnStride();
+  return (first < data + count) && (data <= last);
+}
+
+/*
+* Reduces the given range of the matrix, which is inclusive and may use 
+* negative indices counted from the end. Throws if the range is not inside
+* the matrix, which includes every range of an empty matrix.
+*/
+static Statistics reduceRange(const Matrix& mat, int minRow, int maxRow, 
+                              int minCol, int maxCol) {
+  int rows = mat.getRows();
+  int cols = mat.getColumns();
+
+  // Handle negative indexing
+  if (maxRow < 0) {
+    maxRow += rows;
+  }
+  if (maxCol < 0) {
+    maxCol += cols;
+  }
+  if (minRow < 0) {
+    minRow += rows;
+  }
+  if (minCol < 0) {
+    minCol += cols;
+  }
+
+  // Ensure that the range is valid
+  if (((minRow < 0) || (maxRow >= rows) || (minRow > maxRow)) ||
+      ((minCol < 0) || (maxCol >= cols) || (minCol > maxCol))) {
+    std::string slice = "(" + std::to_string(minRow) + ":" + 
+                        std::to_string(maxRow) + ", " +
+                        std::to_string(minCol) + ":" + 
+                        std::to_string(maxCol) + ")";
+    std::string size = "(" + std::to_string(rows) + "," + 
+                        std::to_string(cols) + ")";
+    std::cout << "Invalid range " << slice << " for matrix with size " 
+              << size << "\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+
+  // Find the statistics of the range in one vectorized pass
+  return reduce(mat.block(minRow, maxRow, minCol, maxCol));
+}
+
+/*
+* Releases the array in the way it was obtained. The matrix must stop using
+* it afterwards.
+*/
+void Matrix::releaseArray() {
+  if (deleter == nullptr) {
+    releaseMatrix(matrix);
+  } else {
+    deleter(matrix, context);
+    deleter = nullptr;
+    context = nullptr;
+  }
+}
+
+/*
+* Moves the elements into a new array with room for count elements.
+*/
+void Matrix::reallocate(long count) {
+  HeapScope heap;
+  double* temp = allocateMatrix(count);
+  std::copy(matrix, matrix + (long)rows*cols, temp);
+  releaseArray();
+  matrix = temp;
+  capacity = count;
+}
+
+/*
+* Makes room for at least count elements. The capacity is at least doubled,
+* so that appending one row at a time copies every element a constant number
+* of times on average.
+*/
+void Matrix::grow(long count) {
+  if (count > capacity) {
+    reallocate(std::max(count, 2*capacity));
+  }
+}
+
+/*
+* Appends the rows of the given view to the bottom of the matrix. A matrix
+* without elements takes the width of the view.
+*/
+void Matrix::appendRows(const MatrixView& part) {
+  if (viewInArray(part, matrix, capacity)) {
+    Matrix copied(part);
+    appendRows(copied);
+    return;
+  }
+  if ((long)rows*cols == 0) {
+    rows = 0;
+    cols = part.getColumns();
+  }
+  if (part.getColumns() != cols) {
+    std::cout << "Unable to append rows of size (" << part.getRows() << ", "
+              << part.getColumns() << ") to a matrix of size (" << rows 
+              << ", " << cols << ")\n";
+    throw std::invalid_argument("Invalid matrix sizes for concatenation.");
+  }
+  grow((long)(rows + part.getRows()) * cols);
+  assignExpression(matrix + (long)rows*cols, part.getRows(), cols, cols, 1,
+                   ViewLeaf(part));
+  rows += part.getRows();
+}
+
+/*
+* Appends the columns of the given view to the right of the matrix. If the
+* array has room, the rows are moved apart within it, starting from the last
+* row so that no row is overwritten before it has been moved. A matrix 
+* without elements takes the height of the view.
+*/
+void Matrix::appendColumns(const MatrixView& part) {
+  if (viewInArray(part, matrix, capacity)) {
+    Matrix copied(part);
+    appendColumns(copied);
+    return;
+  }
+  if ((long)rows*cols == 0) {
+    rows = part.getRows();
+    cols = 0;
+  }
+  if (part.getRows() != rows) {
+    std::cout << "Unable to append columns of size (" << part.getRows() 
+              << ", " << part.getColumns() << ") to a matrix of size (" 
+              << rows << ", " << cols << ")\n";
+    throw std::invalid_argument("Invalid matrix sizes for concatenation.");
+  }
+  int newColumns = cols + part.getColumns();
+  long count = (long)rows * newColumns;
+  if (count > capacity) {
+    long newCapacity = std::max(count, 2*capacity);
+    HeapScope heap;
+    double* temp = allocateMatrix(newCapacity);
+    for (long i = 0; i < rows; i++) {
+      std::copy(matrix + i*cols, matrix + (i + 1)*cols, temp + i*newColumns);
+    }
+    releaseArray();
+    matrix = temp;
+    capacity = newCapacity;
+  } else {
+    for (long i = rows - 1; i > 0; i--) {
+      std::copy_backward(matrix + i*cols, matrix + (i + 1)*cols, 
+                         matrix + i*newColumns + cols);
+    }
+  }
+  assignExpression(matrix + cols, rows, part.getColumns(), newColumns, 1,
+                   ViewLeaf(part));
+  cols = newColumns;
+}
+
 /******************************************************************************
 * PUBLIC METHODS                                                              *
 ******************************************************************************/
@@ -217,23 +586,54 @@ Matrix Matrix::multiplyElementwise(Matrix left, Matrix right) {
 /*
 * Returns the number of rows in the matrix.
 */
-int Matrix::getRows() {
+int Matrix::getRows() const {
   return rows;
 }
 
 /*
 * Returns the number of columns in the matrix.
 */
-int Matrix::getColumns() {
+int Matrix::getColumns() const {
   return cols;
 }
 
+/*
+* Returns the number of elements the array of the matrix has room for, which
+* is at least the number of elements in the matrix.
+*/
+long Matrix::getCapacity() const {
+  return capacity;
+}
+
+/*
+* Returns true if the matrix uses an array borrowed from the caller.
+*/
+bool Matrix::isBorrowed() const {
+  return deleter == keepBuffer<double>;
+}
+
+/*
+* Returns a pointer to the array holding the elements of the matrix in row 
+* major order.
+*/
+double* Matrix::getData() {
+  return matrix;
+}
+
+/*
+* Returns a read-only pointer to the array holding the elements of the matrix
+* in row major order.
+*/
+const double* Matrix::getData() const {
+  return matrix;
+}
+
 /*
 * Extracts a single row from the matrix and returns that as a new matrix.
 *
 * row - The integer index of the row that is to be extracted
 */
-Matrix Matrix::getRow(int row) {
+Matrix Matrix::getRow(int row) const {
 
   // Check to ensure that a valid row is requested
   if ((row < 0) || (row >= rows)) {
@@ -245,7 +645,7 @@ Matrix Matrix::getRow(int row) {
   // Create a new matrix for the extracted row and return that
   Matrix newMatrix(1, cols);
   for (int i = 0; i < cols; i++) {
-    newMatrix[0][i] = matrix[row*cols + i];
+    newMatrix.matrix[i] = matrix[row*cols + i];
   }
   return newMatrix;
 }
@@ -255,7 +655,7 @@ Matrix Matrix::getRow(int row) {
 *
 * column - The integer index of the column that is to be extracted
 */
-Matrix Matrix::getColumn(int column) {
+Matrix Matrix::getColumn(int column) const {
 
   // Check to ensure that a valid column is requested
   if ((column < 0) || (column >= cols)) {
@@ -267,17 +667,53 @@ Matrix Matrix::getColumn(int column) {
   // Create a new matrix for the extracted column and return that
   Matrix newMatrix(rows, 1);
   for (int i = 0; i < rows; i++) {
-    newMatrix[i][0] = matrix[i*cols + column];
+    newMatrix.matrix[i] = matrix[i*cols + column];
   }
   return newMatrix;
 }
 
+/*
+* Creates a view of every element of the matrix. Changes made through the view
+* change the matrix.
+*/
+MatrixView Matrix::view() {
+  return MatrixView(*this);
+}
+
+/*
+* Creates a read-only view of every element of the matrix.
+*/
+const MatrixView Matrix::view() const {
+  return MatrixView(*this);
+}
+
+/*
+* Creates a view of a rectangular range of the matrix without copying it. The
+* bounds are inclusive and follow the same rules as minRange.
+*
+* minRow - The lower bound row index of the block
+* maxRow - The upper bound row index of the block
+* minCol - The lower bound column index of the block
+* maxCol - The upper bound column index of the block
+*/
+MatrixView Matrix::block(int minRow, int maxRow, int minCol, int maxCol) {
+  return view().block(minRow, maxRow, minCol, maxCol);
+}
+
+/*
+* Creates a read-only view of a rectangular range of the matrix.
+*/
+const MatrixView Matrix::block(int minRow, int maxRow, int minCol, 
+                               int maxCol) const {
+  return view().block(minRow, maxRow, minCol, maxCol);
+}
+
 /*
 * Prints out the values of the matrix to the console
 *
 * decimals - The precision of the numbers that should be printed. Default 5
 */
-void Matrix::print(int decimals) {
+void Matrix::print(int decimals) const {
   std::cout << std::fixed;
   std::cout << std::setprecision(decimals);
   std::cout << "([";
@@ -300,118 +736,91 @@ void Matrix::print(int decimals) {
 /*
 * Creates a copy of this matrix and passes it back. 
 */
-Matrix Matrix::copy() {
-  Matrix newMatrix(rows, cols);
-  for (int i = 0; i < rows; i++){
-    for (int j = 0; j < cols; j++) {
-      newMatrix[i][j] = matrix[i*cols + j];
-    }
-  }
-  return newMatrix;
+Matrix Matrix::copy() const {
+  return Matrix(*this);
+}
+
+/*
+* Exchanges the contents of this matrix with the given matrix. No data is 
+* copied, only the sizes, capacities, arrays and their deleters are swapped.
+*
+* mat - The matrix whose contents should be exchanged with this matrix
+*/
+void Matrix::swap(Matrix& mat) noexcept {
+  std::swap(rows, mat.rows);
+  std::swap(cols, mat.cols);
+  std::swap(capacity, mat.capacity);
+  std::swap(matrix, mat.matrix);
+  std::swap(deleter, mat.deleter);
+  std::swap(context, mat.context);
 }
 
 /*
 * Find the transpose of the current matrix. This operation is done in place.
 */
 void Matrix::transpose() {
-  int temp;
-  // Check if matrix is square, in which case swap relevant positions
   if (rows == cols) {
-    for (int i = 0; i < rows; i++) {
-      for (int j = i+1; j < cols; j++) {
-        temp = matrix[i*rows + j];
-        matrix[i*cols + j] = matrix[j*cols + i];
-        matrix[j*cols + i] = temp;
-      }
-    }
-
-  // If the matrix is not square, create and populate a new matrix
+    transposeSquare(matrix, rows, cols);
   } else {
-    double tempMat[rows * cols];
-    for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-        tempMat[j*rows + i] = matrix[i*cols + j];
-      }
-    }
-    for (int i = 0; i < (rows*cols); i++) {
-      matrix[i] = tempMat[i];
-    }
-    temp = rows;
-    rows = cols;
-    cols = temp;
-
+    transposeInPlace(matrix, rows, cols);
+    std::swap(rows, cols);
   }
 }
 
+/*
+* Find and return the inverse of the matrix, which must be square and not 
+* singular. Systems of equations should be solved with an LUDecomposition or
+* CholeskyDecomposition instead, which is faster and more accurate than 
+* multiplying by the inverse.
+*/
+Matrix Matrix::inverse() const {
+  LUDecomposition decomposition(*this);
+  return decomposition.inverse();
+}
+
 /*
 * Find and return the transpose of the matrix
 */
-Matrix Matrix::T() {
-  Matrix newMat = copy();
-  newMat.transpose();
+Matrix Matrix::T() const {
+  Matrix newMat(cols, rows);
+  transposeCopy(matrix, rows, cols, cols, newMat.matrix, rows);
   return newMat;
 }
 
 /*
-* Finds the index (row, column) of the minimum value in the matrix. If multiple 
-* items have the same value, the first instance in row major order is returned.
-* Returns an index struct where index.r gives the row index and index.c gives 
-* the column index.
+* Finds the index (row, column) of the minimum value in the matrix, ignoring
+* NaN elements. If multiple items have the same value, the first instance in
+* row major order is returned. Returns an index struct where index.r gives 
+* the row index and index.c gives the column index, or (-1, -1) if every 
+* element is NaN. Throws if the matrix is empty.
 */
-struct index Matrix::minIndex() {
-
-  // Find the minimum value in the array
-  int arrIndex = 0;
-  for (int i = 0; i < (rows*cols); i++) {
-    if (matrix[i] < matrix[arrIndex]) {
-      arrIndex = i;
-    }
-  }
-
-  // Translate the minimum value 
-  struct index returnIndex;
-  returnIndex.r = arrIndex/cols;
-  returnIndex.c = arrIndex%cols;
-  return returnIndex;
+struct index Matrix::minIndex() const {
+  return reduceRange(*this, 0, -1, 0, -1).minIndex;
 }
 
 /*
-* Finds the index (row, column) of the maximum value in the matrix. If multiple 
-* items have the same value, the first instance in row major order is returned.
-* Returns an index struct where index.r gives the row index and index.c gives 
-* the column index.
+* Finds the index (row, column) of the maximum value in the matrix, in the 
+* same way as minIndex.
 */
-struct index Matrix::maxIndex() {
-
-  // Find the maximum value in the array
-  int arrIndex = 0;
-  for (int i = 0; i < (rows*cols); i++) {
-    if (matrix[i] > matrix[arrIndex]) {
-      arrIndex = i;
-    }
-  }
-
-  // Translate the minimum value 
-  struct index returnIndex;
-  returnIndex.r = arrIndex/cols;
-  returnIndex.c = arrIndex%cols;
-  return returnIndex;
+struct index Matrix::maxIndex() const {
+  return reduceRange(*this, 0, -1, 0, -1).maxIndex;
 }
 
 /*
-* Finds and returns the minimum value in the matrix.
+* Finds and returns the minimum value in the matrix, ignoring NaN elements as
+* reduce() does, so that matrices and their views agree. Throws if the matrix
+* is empty.
 */
-double Matrix::min() {
-  struct index arrIndex= minIndex();
-  return matrix[arrIndex.r*cols + arrIndex.c];
+double Matrix::min() const {
+  return minRange();
 }
 
 /*
-* Finds and return the maximum value in the matrix.
+* Finds and return the maximum value in the matrix, ignoring NaN elements.
+* Throws if the matrix is empty.
 */
-double Matrix::max() {
-  struct index arrIndex= maxIndex();
-  return matrix[arrIndex.r*cols + arrIndex.c];
+double Matrix::max() const {
+  return maxRange();
 }
 
 /*
@@ -423,86 +832,14 @@ double Matrix::max() {
 * maxRow - The upper bound row index for the function
 * maxCol - The upper bound column index for the function
 */
-double Matrix::minRange(int minRow, int maxRow, int minCol, int maxCol) {
-  // Handle negative indexing
-  if (maxRow < 0) {
-    maxRow += rows;
-  }
-  if (maxCol < 0) {
-    maxCol += cols;
-  }
-  if (minRow < 0) {
-    minRow += rows;
-  }
-  if (minCol < 0) {
-    minCol += cols;
-  }
-
-  // Ensure that the range is valid
-  if (((minRow < 0) || (maxRow >= rows) || (minRow > maxRow)) ||
-      ((minCol < 0) || (maxCol >= cols) || (minCol > maxCol))) {
-    std::string slice = "(" + std::to_string(minRow) + ":" + 
-                        std::to_string(maxRow) + ", " +
-                        std::to_string(minCol) + ":" + 
-                        std::to_string(maxCol) + ")";
-    std::string size = "(" + std::to_string(rows) + "," + 
-                        std::to_string(cols) + ")";
-    std::cout << "Invalid range " << slice << " for matrix with size " 
-              << size << "\n";
-    throw std::invalid_argument("Invalid index.");
-  }
-
-  // Find the minimum in the range and return it
-  int arrIndex = minRow*cols + minCol;
-  for (int i = minRow; i <= maxRow; i++) {
-    for (int j = minCol; j <= maxCol; j++) {
-      if (matrix[i*cols + j] < matrix[arrIndex]) {
-        arrIndex = i*cols + j;
-      }
-    }
-  }
-  return matrix[arrIndex];
+double Matrix::minRange(int minRow, int maxRow, int minCol, 
+                        int maxCol) const {
+  return reduceRange(*this, minRow, maxRow, minCol, maxCol).min;
 }
 
-double Matrix::maxRange(int minRow, int maxRow, int minCol, int maxCol) {
-  // Handle negative indexing
-  if (maxRow < 0) {
-    maxRow += rows;
-  }
-  if (maxCol < 0) {
-    maxCol += cols;
-  }
-  if (minRow < 0) {
-    minRow += rows;
-  }
-  if (minCol < 0) {
-    minCol += cols;
-  }
-
-  // Ensure that the range is valid
-  if (((minRow < 0) || (maxRow >= rows) || (minRow > maxRow)) ||
-      ((minCol < 0) || (maxCol >= cols) || (minCol > maxCol))) {
-    std::string slice = "(" + std::to_string(minRow) + ":" + 
-                        std::to_string(maxRow) + ", " +
-                        std::to_string(minCol) + ":" + 
-                        std::to_string(maxCol) + ")";
-    std::string size = "(" + std::to_string(rows) + "," + 
-                        std::to_string(cols) + ")";
-    std::cout << "Invalid range " << slice << " for matrix with size " 
-              << size << "\n";
-    throw std::invalid_argument("Invalid index.");
-  }
-
-  // Find the maximum in the range and return it
-  int arrIndex = minRow*cols + minCol;
-  for (int i = minRow; i <= maxRow; i++) {
-    for (int j = minCol; j <= maxCol; j++) {
-      if (matrix[i*cols + j] > matrix[arrIndex]) {
-        arrIndex = i*cols + j;
-      }
-    }
-  }
-  return matrix[arrIndex];
+double Matrix::maxRange(int minRow, int maxRow, int minCol, 
+                        int maxCol) const {
+  return reduceRange(*this, minRow, maxRow, minCol, maxCol).max;
 }
 
 /*
@@ -534,7 +871,7 @@ void Matrix::resize(int rowLength, int columnLength) {
 *        set to 1, mat will be added to the bottom of the current matrix 
 *        extending the columns
 */
-void Matrix::concatenate(Matrix mat, int axis) {
+void Matrix::concatenate(const Matrix& mat, int axis) {
 
   // Check to ensure that the provided axis is valid
   if ((axis < 0) || (axis > 1)) {
@@ -551,46 +888,87 @@ void Matrix::concatenate(Matrix mat, int axis) {
     throw std::invalid_argument("Invalid matrix sizes for concatenation.");
   }
 
-  // Create a new array to store the matrix, change the number of columns and 
-  // fill the array with values from both matrices. Column
+  // Add the columns or rows in the spare capacity of the array, which grows
+  // geometrically when it runs out
   if (axis == 0) {
-    int newColumns = cols + mat.getColumns();
-    double* temp = new double[rows * newColumns];
-    for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-        temp[i*newColumns + j] = matrix[i*cols + j];
-      }
-    }
-    for (int i = 0; i < mat.getRows(); i++) {
-      for (int j = 0; j < mat.getColumns(); j++) {
-        temp[i*newColumns + j + cols] = mat[i][j];
-      }
-    }
-    cols = newColumns;
-    delete matrix;
-    matrix = temp;
-
-  // Create a new array to store the matrix, change the number of rows and fill
-  // the array with values from both matrices
+    appendColumns(mat);
   } else {
-    int newRows = rows + mat.getRows();
-    double* temp = new double[newRows * cols];
-    for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-        temp[i*cols + j] = matrix[i*cols + j];
-      }
-    }
-    for (int i = 0; i < mat.getRows(); i++) {
-      for (int j = 0; j < mat.getColumns(); j++) {
-        std::cout << "(" << i << ", " << j << "): ";
-        std::cout << ((i+newRows)*cols + j) << " -> " << mat[i][j] << "\n";
-        temp[(i+rows)*cols + j] = mat[i][j];
-      }
-    }
-    rows = newRows;
-    delete matrix;
-    matrix = temp;
+    appendRows(mat);
+  }
+}
+
+/*
+* Makes room for a matrix of the given size, so that rows or columns can be
+* appended up to that size without allocating. The capacity never shrinks.
+*
+* num_rows - The number of rows to make room for
+* num_columns - The number of columns to make room for
+*/
+void Matrix::reserve(int num_rows, int num_columns) {
+  if ((long)num_rows * num_columns > capacity) {
+    reallocate((long)num_rows * num_columns);
+  }
+}
+
+/*
+* Releases the spare capacity, so that the array holds exactly the elements of
+* the matrix.
+*/
+void Matrix::shrinkToFit() {
+  if (capacity > (long)rows * cols) {
+    reallocate((long)rows * cols);
+  }
+}
+
+/*
+* Appends a row to the bottom of the matrix in amortized constant time per 
+* element. A matrix without elements takes the width of the row.
+*
+* row - A view of a single row or column, with one element per column of the
+*       matrix
+*/
+void Matrix::pushRow(const MatrixView& row) {
+  if ((row.getRows() != 1) && (row.getColumns() != 1)) {
+    std::cout << "Unable to append a row of size (" << row.getRows() << ", "
+              << row.getColumns() << ") to a matrix\n";
+    throw std::invalid_argument("Invalid matrix sizes for concatenation.");
+  }
+  appendRows((row.getRows() == 1) ? row : row.T());
+}
+
+/*
+* Appends a column to the right of the matrix. The rows are moved apart within
+* the spare capacity of the array, which grows geometrically, so no array is
+* allocated while the capacity lasts. A matrix without elements takes the
+* height of the column.
+*
+* column - A view of a single column or row, with one element per row of the
+*          matrix
+*/
+void Matrix::pushColumn(const MatrixView& column) {
+  if ((column.getRows() != 1) && (column.getColumns() != 1)) {
+    std::cout << "Unable to append a column of size (" << column.getRows() 
+              << ", " << column.getColumns() << ") to a matrix\n";
+    throw std::invalid_argument("Invalid matrix sizes for concatenation.");
   }
+  appendColumns((column.getColumns() == 1) ? column : column.T());
+}
+
+/*
+* Gives up the array without releasing it and returns it, leaving the matrix
+* empty with a size of (0, 0). An adopted or borrowed array goes back to the
+* caller without calling its deleter, and any other array must be released
+* with releaseMatrix.
+*/
+double* Matrix::release() {
+  double* data = matrix;
+  rows = 0;
+  cols = 0;
+  capacity = 0;
+  matrix = nullptr;
+  deleter = nullptr;
+  context = nullptr;
+  return data;
 }
 
 /******************************************************************************
@@ -626,29 +1004,46 @@ double& Matrix::operator()(int row, int column) {
 }
 
 /*
-* Replaces the current instance of the class with the given one.
+* Allows read-only indexing using (row, column) into a constant matrix. Index 
+* must exist within the size of the matrix.
 */
-Matrix& Matrix::operator=(Matrix mat) {
+const double& Matrix::operator()(int row, int column) const {
+  return const_cast<Matrix&>(*this)(row, column);
+}
+
+/*
+* Replaces the values of the current matrix with a copy of the given one. The 
+* existing array is reused if it has room for every element.
+*/
+Matrix& Matrix::operator=(const Matrix& mat) {
 
   // If assigned to the same pointer, nothing needs to be done
   if (this == &mat) {
     return *this;
   }
 
-  // If the rows and columns do not match up, need to create a new matrix.
-  if ((rows != mat.getRows()) || (cols != mat.getColumns())) {
-    rows = mat.getRows();
-    cols = mat.getColumns();
-    //delete matrix;
-    double matrix[rows*cols];
+  // If the array is too small, need to create a new array.
+  if ((long)mat.rows*mat.cols > capacity) {
+    HeapScope heap;
+    double* temp = allocateMatrix(mat.rows * mat.cols);
+    releaseArray();
+    matrix = temp;
+    capacity = (long)mat.rows * mat.cols;
   }
+  rows = mat.rows;
+  cols = mat.cols;
 
   // Update the values in matrix.
-  for (int i = 0; i < rows; i ++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] = mat[i][j];
-    }
-  }
+  std::copy(mat.matrix, mat.matrix + rows*cols, matrix);
+  return *this;
+}
+
+/*
+* Replaces the current instance of the class with the given one by taking over
+* its array. The previous array of this matrix is released by the given one.
+*/
+Matrix& Matrix::operator=(Matrix&& mat) noexcept {
+  swap(mat);
   return *this;
 }
 
@@ -656,214 +1051,98 @@ Matrix& Matrix::operator=(Matrix mat) {
 * Multiplies every value in the matrix by the given value.
 */
 Matrix& Matrix::operator*=(double num) {
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] *= num;
-    }
-  }
+  parallelKernel(kernels().multiplyScalar, matrix, matrix, num, rows*cols);
   return *this;
 }
 
 /*
 * Perform matrix multiplication with the given matrix.
 */
-Matrix& Matrix::operator*=(Matrix mat) {
-  Matrix multiplied = multiply(*this, mat);
-  return (*this = multiplied);
+Matrix& Matrix::operator*=(const Matrix& mat) {
+  return (*this = multiply(*this, mat));
 }
 
 /*
 * Adds the given value to every value in the matrix.
 */
 Matrix& Matrix::operator+=(double num) {
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] += num;
-    }
-  }
+  parallelKernel(kernels().addScalar, matrix, matrix, num, rows*cols);
   return *this;
 }
 
 /*
-* Perform matrix addition with the given matrix.
+* Perform matrix addition with the given matrix. A row or column, or a matrix
+* with a single element, is broadcast to the size of this matrix.
 */
-Matrix& Matrix::operator+=(Matrix mat) {
-  Matrix added = add(*this, mat);
-  return (*this = added);
+Matrix& Matrix::operator+=(const Matrix& mat) {
+  if ((cols != mat.cols) || (rows != mat.rows)) {
+    return (*this += MatrixLeaf(mat));
+  }
+
+  parallelKernel(kernels().add, matrix, matrix, mat.matrix, rows*cols);
+  return *this;
 }
 
 /*
 * Subtracts the given value from every value in the matrix.
 */
 Matrix& Matrix::operator-=(double num) {
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] -= num;
-    }
-  }
+  parallelKernel(kernels().addScalar, matrix, matrix, -num, rows*cols);
   return *this;
 }
 
 /*
-* Performs matrix subtraction with the given matrix.
+* Performs matrix subtraction with the given matrix. A row or column, or a
+* matrix with a single element, is broadcast to the size of this matrix.
 */
-Matrix& Matrix::operator-=(Matrix mat) {
-  Matrix added = subtract(*this, mat);
-  return (*this = added);
+Matrix& Matrix::operator-=(const Matrix& mat) {
+  if ((cols != mat.cols) || (rows != mat.rows)) {
+    return (*this -= MatrixLeaf(mat));
+  }
+
+  parallelKernel(kernels().subtract, matrix, matrix, mat.matrix, rows*cols);
+  return *this;
 }
 
 /*
 * Divides every element in the matrix by the given number value
 */
 Matrix& Matrix::operator/=(double num) {
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] /= num;
-    }
-  }
+  parallelKernel(kernels().divideScalar, matrix, matrix, num, rows*cols);
   return *this;
 }
 
 /*
 * Divides every element in the matrix by the corresponding element in the 
-* provided matrix. The matrices have to have the same shape.
+* provided matrix. The matrices have to have the same shape, or the provided
+* matrix has to be a row or column that is broadcast to the size of this one.
 */
-Matrix& Matrix::operator/=(Matrix mat) {
-  // If the rows and columns do not match up, need to create a new matrix.
+Matrix& Matrix::operator/=(const Matrix& mat) {
   if ((rows != mat.getRows()) || (cols != mat.getColumns())) {
-    std::string dim1 = "(" + std::to_string(rows) + "," + 
-                       std::to_string(cols) + ")";
-    std::string dim2 = "(" + std::to_string(mat.getRows()) + "," + 
-                        std::to_string(mat.getColumns()) + ")";
-    std::cout << "Mismatched sizes for matrices with dimensions: " << dim1
-              << " and " << dim2 << "\n";
-    throw std::invalid_argument("Mismatched matrix dimensions.");
+    return (*this /= MatrixLeaf(mat));
   }
 
-  // Subtract the matrices from one another and return
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      matrix[i*cols + j] /= mat[i][j];
-    }
-  }
+  // Divide the matrices by one another and return
+  parallelKernel(kernels().divide, matrix, matrix, mat.matrix, rows*cols);
   return *this;
 }
 
-/******************************************************************************
- * Operator functions for acting on matrices                                  *
-/******************************************************************************
-
 /*
-* Adds two matrices together
+* Replaces every element in the matrix with the given number value divided by
+* that element.
 */
-Matrix operator+(Matrix left, Matrix right) {
-  Matrix newMat = left.copy();
-  newMat += right;
-  return newMat;
-}
-
-/*
-* Adds a matrix and a number together
-*/
-Matrix operator+(Matrix left, double right) {
-  Matrix newMat = left.copy();
-  newMat += right;
-  return newMat;
-}
-
-/*
-* Adds a matrix and a number together
-*/
-Matrix operator+(double left, Matrix right) {
-  Matrix newMat = right.copy();
-  newMat += left;
-  return newMat;
-}
-
-/*
-* Subtracts the matrix on the right from the matrix on the left
-*/
-Matrix operator-(Matrix left, Matrix right) {
-  Matrix newMat = left.copy();
-  newMat -= right;
-  return newMat;
-}
-
-/*
-* Subtracts the number on the right from the matrix on the left
-*/
-Matrix operator-(Matrix left, double right) {
-  Matrix newMat = left.copy();
-  newMat -= right;
-  return newMat;
-}
-
-/*
-* Subtracts the matrix on the right from the number on the left
-*/
-Matrix operator-(double left, Matrix right) {
-  Matrix newMat = right.copy();
-  newMat *= -1;
-  newMat += left;
-  return newMat;
-}
-
-/*
-* Multiply the matrices together
-*/
-Matrix operator*(Matrix left, Matrix right) {
-  Matrix newMat = left.copy();
-  newMat *= right;
-  return newMat;
-}
-
-/*
-* Multiply the matrix with the given number
-*/
-Matrix operator*(Matrix left, double right) {
-  Matrix newMat = left.copy();
-  newMat *= right;
-  return newMat;
-}
-
-/*
-* Multiply the matrix with the given number
-*/
-Matrix operator*(double left, Matrix right) {
-  Matrix newMat = right.copy();
-  newMat *= left;
-  return newMat;
-}
-
-/*
-* Does element wise division on the two matrices. The matrices must have the 
-* same dimentions.
-*/
-Matrix operator/(Matrix left, Matrix right) {
-  Matrix newMat = left.copy();
-  newMat /= right;
-  return newMat;
+Matrix& Matrix::scalarDivide(double num) {
+  parallelKernel(kernels().scalarDivide, matrix, num, matrix, rows*cols);
+  return *this;
 }
 
-/*
-* Divides the matrix by the given number.
-*/
-Matrix operator/(Matrix left, double right) {
-  Matrix newMat = left.copy();
-  newMat /= right;
-  return newMat;
-}
+/******************************************************************************
+* OPERATOR FUNCTIONS FOR ACTING ON MATRICES                                   *
+******************************************************************************/
 
 /*
-* Returns a matrix where each element is equal to the number value divided by
-* the corresponding element in the given matrix.
+* Exchanges the contents of the two matrices.
 */
-Matrix operator/(double left, Matrix right) {
-  Matrix newMat = right.copy();
-  for (int i = 0; i < newMat.getRows(); i++) {
-    for (int j = 0; j < newMat.getColumns(); j++) {
-      newMat[i][j] = left/newMat[i][j];
-    }
-  }
-  return newMat;
+void swap(Matrix& left, Matrix& right) noexcept {
+  left.swap(right);
 }
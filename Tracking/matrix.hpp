@@ -1,13 +1,44 @@
 /******************************************************************************
 *                               Matrix class                                  *
 *                                                                             *
-* Allows for the creation of matrices with built in matrix operations. All    *
-* data is assumed to be of the type "double".                                 *
+* Allows for the creation of matrices with built in matrix operations. Matrix *
+* is the BasicMatrix of doubles, which is specialized here with the blocked   *
+* products, vectorized kernels, views and expressions. Matrices of other      *
+* element types, such as float images or uint8_t pixel buffers, are declared  *
+* in basic_matrix.hpp.                                                        *
+*                                                                             *
+* The array of a matrix may hold more elements than the matrix uses. Rows and *
+* columns appended with pushRow, pushColumn or concatenate go into this spare *
+* capacity, which doubles whenever it runs out, so a matrix built one row at  *
+* a time is copied O(log n) times rather than once per row. reserve() sets    *
+* the capacity up front and shrinkToFit() returns what is not used.           *
+*                                                                             *
+* borrow() and adopt() wrap an existing row major array without copying it.   *
+* A borrowed array stays owned by the caller, who must keep it alive for as   *
+* long as the matrix uses it. An adopted array is released with the given     *
+* deleter when the matrix is destroyed or moves to a larger array, and        *
+* release() hands the array back without releasing it:                        *
+*                                                                             *
+*   Matrix states = Matrix::adopt(buffer, tracks, 6, freeStates);             *
+*   double* handoff = states.release();                                       *
+*                                                                             *
+* Writes to such a matrix, including assignments that fit in its array, go    *
+* to the external array. Arrays with padding between the rows are wrapped     *
+* with a MatrixView and its row stride instead, since a Matrix is contiguous. *
 *                                                                             *
 ******************************************************************************/
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
 
 struct index {
   int r;
@@ -15,77 +46,130 @@ struct index {
 };
 
 class Row;
-class Matrix;
+template <typename T> class BasicMatrix;
+typedef BasicMatrix<double> Matrix;
+class MatrixView;
+template <typename Derived> class MatrixExpression;
 
-class Matrix {
+template <>
+class BasicMatrix<double> {
   private:
     int rows;
     int cols;
+    long capacity;
     double* matrix;
+    BufferDeleter<double> deleter;
+    void* context;
+
+    BasicMatrix(double* data, int num_rows, int num_columns,
+                BufferDeleter<double> buffer_deleter, void* buffer_context);
+    void releaseArray();
+    void reallocate(long count);
+    void grow(long count);
+    void appendRows(const MatrixView& part);
+    void appendColumns(const MatrixView& part);
 
   public:
+    typedef double Scalar;
 
     // Constructors and destructor
-    Matrix(int num_rows, int num_columns);
-    Matrix(int num_rows, int num_columns, double data[]);
-    ~Matrix();
+    BasicMatrix(int num_rows, int num_columns);
+    BasicMatrix(int num_rows, int num_columns, const double data[]);
+    BasicMatrix(const Matrix& mat);
+    BasicMatrix(Matrix&& mat) noexcept;
+    BasicMatrix(const MatrixView& view);
+    template <typename E> BasicMatrix(const MatrixExpression<E>& expr);
+    template <typename E> BasicMatrix(MatrixExpression<E>&& expr);
+    ~BasicMatrix();
 
     // Static methods for instatiating a specific type of matrix
     static Matrix zeros(int num_rows, int num_columns);
     static Matrix identity(int size);
-    static Matrix multiply(Matrix left, Matrix right);
-    static Matrix add(Matrix left, Matrix right);
-    static Matrix subtract(Matrix left, Matrix right);
-    static Matrix multiplyElementwise(Matrix left, Matrix right);
+    static Matrix multiply(const Matrix& left, const Matrix& right);
+    static Matrix multiply(const MatrixView& left, const MatrixView& right);
+    static Matrix add(const Matrix& left, const Matrix& right);
+    static Matrix subtract(const Matrix& left, const Matrix& right);
+    static Matrix multiplyElementwise(const Matrix& left, const Matrix& right);
+    static Matrix stack(const std::vector<MatrixView>& parts);
+    static Matrix hstack(const std::vector<MatrixView>& parts);
+    static Matrix borrow(double* data, int num_rows, int num_columns);
+    static Matrix adopt(double* data, int num_rows, int num_columns,
+                        BufferDeleter<double> buffer_deleter,
+                        void* buffer_context=nullptr);
 
     // Functions
 
     // Getter functions
-    int getRows();
-    int getColumns();
-    Matrix getRow(int row);
-    Matrix getColumn(int column);
-
-    void print(int decimals=5);
-    Matrix copy();
+    int getRows() const;
+    int getColumns() const;
+    long getCapacity() const;
+    bool isBorrowed() const;
+    double* getData();
+    const double* getData() const;
+    Matrix getRow(int row) const;
+    Matrix getColumn(int column) const;
+    MatrixView view();
+    const MatrixView view() const;
+    MatrixView block(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1);
+    const MatrixView block(int minRow=0, int maxRow=-1, int minCol=0, 
+                           int maxCol=-1) const;
+
+    void print(int decimals=5) const;
+    Matrix copy() const;
+    void swap(Matrix& mat) noexcept;
     void transpose();
-    Matrix T();
-    struct index minIndex();
-    struct index maxIndex();
-    double min();
-    double max();
-    double minRange(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1);
-    double maxRange(int minRow=0, int maxRow=-1, int minCol=0, int maxCol=-1);
+    Matrix T() const;
+    Matrix inverse() const;
+    struct index minIndex() const;
+    struct index maxIndex() const;
+    double min() const;
+    double max() const;
+    double minRange(int minRow=0, int maxRow=-1, int minCol=0, 
+                    int maxCol=-1) const;
+    double maxRange(int minRow=0, int maxRow=-1, int minCol=0, 
+                    int maxCol=-1) const;
     void resize(int rowLength, int columnLength);
-    void concatenate(Matrix mat, int axis=0);
+    void concatenate(const Matrix& mat, int axis=0);
+    void reserve(int num_rows, int num_columns);
+    void shrinkToFit();
+    void pushRow(const MatrixView& row);
+    void pushColumn(const MatrixView& column);
+    double* release();
+    template <typename U> 
+    BasicMatrix<U> convert(double scale=1, double shift=0) const;
 
 
     //int findIndex(double val);
     // TODO - Add matrix functions
     /*
-    * Concatenate
-    * Append row/column of given row/column vector or of zeros
-    * Inverse
     * Resize
     */
 
 
     // Operators
     double& operator()(int row, int column);
-    Matrix& operator=(Matrix mat);
+    const double& operator()(int row, int column) const;
+    Matrix& operator=(const Matrix& mat);
+    Matrix& operator=(Matrix&& mat) noexcept;
+    template <typename E> Matrix& operator=(const MatrixExpression<E>& expr);
+    template <typename E> Matrix& operator=(MatrixExpression<E>&& expr);
     Matrix& operator*=(double num);
-    Matrix& operator*=(Matrix mat);
+    Matrix& operator*=(const Matrix& mat);
     Matrix& operator+=(double num);
-    Matrix& operator+=(Matrix mat);
+    Matrix& operator+=(const Matrix& mat);
+    template <typename E> Matrix& operator+=(const MatrixExpression<E>& expr);
     Matrix& operator-=(double num);
-    Matrix& operator-=(Matrix mat);
+    Matrix& operator-=(const Matrix& mat);
+    template <typename E> Matrix& operator-=(const MatrixExpression<E>& expr);
     Matrix& operator/=(double num);
-    Matrix& operator/=(Matrix mat);
+    Matrix& operator/=(const Matrix& mat);
+    template <typename E> Matrix& operator/=(const MatrixExpression<E>& expr);
+    Matrix& scalarDivide(double num);
 
     // Friend class
     // Define friend class "Row" to allow for indexing using [][]
     class Row {
-      friend class Matrix;
+      friend class BasicMatrix<double>;
       private:
         Matrix& parent;
         int row;
@@ -126,16 +210,14 @@ class Matrix {
     }
 };
 
-// Operators functions for acting on matrices
-Matrix operator+(Matrix left, Matrix right);
-Matrix operator+(Matrix left, double right);
-Matrix operator+(double left, Matrix right);
-Matrix operator-(Matrix left, Matrix right);
-Matrix operator-(Matrix left, double right);
-Matrix operator-(double left, Matrix right);
-Matrix operator*(Matrix left, Matrix right);
-Matrix operator*(Matrix left, double right);
-Matrix operator*(double left, Matrix right);
-Matrix operator/(Matrix left, Matrix right);
-Matrix operator/(Matrix left, double right);
-Matrix operator/(double left, Matrix right);
+void swap(Matrix& left, Matrix& right) noexcept;
+
+// Views of matrices, and the operators for acting on matrices and views, 
+// which are defined as lazy expressions
+#include "matrix_view.hpp"
+#include "expression.hpp"
+
+// Matrices of other element types
+#include "basic_matrix.hpp"
+
+#endif
@@ -0,0 +1,434 @@
+/******************************************************************************
+*                              Matrix view                                    *
+*                                                                             *
+* Non-owning, strided views of matrix elements.                               *
+*                                                                             *
+******************************************************************************/
+#include "matrix.hpp"
+#include "reduce.hpp"
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+/*
+* Creates a view of the given array.
+*
+* view_data - A pointer to the first element of the view
+* num_rows - An integer denoting the number of rows in the view
+* num_columns - An integer denoting the number of columns in the view
+* row_stride - The number of elements between the starts of consecutive rows
+* column_stride - The number of elements between consecutive columns. Default
+*                 1
+*/
+MatrixView::MatrixView(double* view_data, int num_rows, int num_columns, 
+                       int row_stride, int column_stride) :
+  MatrixView(view_data, num_rows, num_columns, row_stride, column_stride,
+             true)
+{}
+
+/*
+* Creates a view that can be written through only if is_writable is true.
+*/
+MatrixView::MatrixView(double* view_data, int num_rows, int num_columns,
+                       int row_stride, int column_stride, bool is_writable) :
+  data(view_data),
+  rows(num_rows),
+  cols(num_columns),
+  rowStride(row_stride),
+  colStride(column_stride),
+  writable(is_writable)
+{}
+
+/*
+* Creates a view of every element of the given matrix.
+*
+* mat - The matrix that should be viewed
+*/
+MatrixView::MatrixView(Matrix& mat) :
+  MatrixView(mat.getData(), mat.getRows(), mat.getColumns(),
+             mat.getColumns(), 1, true)
+{}
+
+/*
+* Creates a read-only view of every element of a constant matrix. The
+* pointer is only cast to a mutable one to be stored, and every method that
+* writes through it checks that the view is writable first.
+*/
+MatrixView::MatrixView(const Matrix& mat) :
+  MatrixView(const_cast<double*>(mat.getData()), mat.getRows(),
+             mat.getColumns(), mat.getColumns(), 1, false)
+{}
+
+/******************************************************************************
+* PRIVATE METHODS                                                             *
+******************************************************************************/
+
+/*
+* Returns the offset of element (row, column) from the first element, after
+* checking the index. Negative indices count from the end.
+*/
+long MatrixView::offset(int row, int column) const {
+  // Ensure that the index is valid
+  if (((-rows > row) || (row >= rows)) ||
+      ((-cols > column) || (column >= cols))) {
+    std::string index = "(" + std::to_string(row) + "," + 
+                        std::to_string(column) + ")";
+    std::string size = "(" + std::to_string(rows) + "," + 
+                        std::to_string(cols) + ")";
+    std::cout << "Invalid index " << index << " for view with size " 
+              << size << "\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+
+  // Handle negative indexing
+  if (row < 0) {
+    row += rows;
+  }
+  if (column < 0) {
+    column += cols;
+  }
+  return (long)row*rowStride + (long)column*colStride;
+}
+
+/*
+* Throws if the view was created from a constant matrix.
+*/
+void MatrixView::checkWritable() const {
+  if (!writable) {
+    std::cout << "Unable to write through a view of a constant matrix\n";
+    throw std::invalid_argument("Read-only view.");
+  }
+}
+
+/******************************************************************************
+* PUBLIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Returns the number of rows in the view.
+*/
+int MatrixView::getRows() const {
+  return rows;
+}
+
+/*
+* Returns the number of columns in the view.
+*/
+int MatrixView::getColumns() const {
+  return cols;
+}
+
+/*
+* Returns the number of elements between the starts of consecutive rows.
+*/
+int MatrixView::getRowStride() const {
+  return rowStride;
+}
+
+/*
+* Returns the number of elements between consecutive columns.
+*/
+int MatrixView::getColumnStride() const {
+  return colStride;
+}
+
+/*
+* Returns a pointer to the first element of the view, which must be writable.
+*/
+double* MatrixView::getData() {
+  checkWritable();
+  return data;
+}
+
+/*
+* Returns a read-only pointer to the first element of the view.
+*/
+const double* MatrixView::getData() const {
+  return data;
+}
+
+/*
+* Returns false if the view was created from a constant matrix.
+*/
+bool MatrixView::isWritable() const {
+  return writable;
+}
+
+/*
+* Returns true if the elements of the view are stored contiguously in row 
+* major order, as in a Matrix.
+*/
+bool MatrixView::isContiguous() const {
+  return ((colStride == 1) || (cols == 1)) && 
+         ((rowStride == cols) || (rows == 1));
+}
+
+/*
+* Creates a view of a rectangular range of this view. The bounds are inclusive
+* and follow the same rules, including negative indexing, as Matrix::minRange.
+*
+* minRow - The lower bound row index of the block
+* maxRow - The upper bound row index of the block
+* minCol - The lower bound column index of the block
+* maxCol - The upper bound column index of the block
+*/
+MatrixView MatrixView::block(int minRow, int maxRow, int minCol, 
+                             int maxCol) const {
+  // Handle negative indexing
+  if (maxRow < 0) {
+    maxRow += rows;
+  }
+  if (maxCol < 0) {
+    maxCol += cols;
+  }
+  if (minRow < 0) {
+    minRow += rows;
+  }
+  if (minCol < 0) {
+    minCol += cols;
+  }
+
+  // Ensure that the range is valid
+  if (((minRow < 0) || (maxRow >= rows) || (minRow > maxRow)) ||
+      ((minCol < 0) || (maxCol >= cols) || (minCol > maxCol))) {
+    std::string slice = "(" + std::to_string(minRow) + ":" + 
+                        std::to_string(maxRow) + ", " +
+                        std::to_string(minCol) + ":" + 
+                        std::to_string(maxCol) + ")";
+    std::string size = "(" + std::to_string(rows) + "," + 
+                        std::to_string(cols) + ")";
+    std::cout << "Invalid range " << slice << " for view with size " 
+              << size << "\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+
+  return MatrixView(data + (long)minRow*rowStride + (long)minCol*colStride,
+                    maxRow - minRow + 1, maxCol - minCol + 1, rowStride, 
+                    colStride, writable);
+}
+
+/*
+* Creates a (1 x columns) view of a single row. Negative indices count from 
+* the last row.
+*
+* row - The integer index of the row
+*/
+MatrixView MatrixView::row(int row) const {
+  return block(row, row, 0, -1);
+}
+
+/*
+* Creates a (rows x 1) view of a single column. Negative indices count from 
+* the last column.
+*
+* column - The integer index of the column
+*/
+MatrixView MatrixView::column(int column) const {
+  return block(0, -1, column, column);
+}
+
+/*
+* Creates a view of the transpose, by swapping the dimensions and strides.
+*/
+MatrixView MatrixView::T() const {
+  return MatrixView(data, cols, rows, colStride, rowStride, writable);
+}
+
+/*
+* Prints out the values of the view to the console in the same format as 
+* Matrix::print
+*
+* decimals - The precision of the numbers that should be printed. Default 5
+*/
+void MatrixView::print(int decimals) const {
+  copy().print(decimals);
+}
+
+/*
+* Copies the viewed elements into a new matrix.
+*/
+Matrix MatrixView::copy() const {
+  return Matrix(*this);
+}
+
+/*
+* Finds and returns the minimum value in the view, ignoring NaN elements.
+*/
+double MatrixView::min() const {
+  // block() throws for an empty view, which has no elements to compare
+  return reduce(block()).min;
+}
+
+/*
+* Finds and returns the maximum value in the view, ignoring NaN elements.
+*/
+double MatrixView::max() const {
+  // block() throws for an empty view, which has no elements to compare
+  return reduce(block()).max;
+}
+
+/******************************************************************************
+* PUBLIC OPERATOR METHODS                                                     *
+******************************************************************************/
+
+/*
+* Allows indexing using (row, column) into the view. Index must exist within 
+* the size of the view. Negative indices count from the end.
+*/
+double& MatrixView::operator()(int row, int column) {
+  long position = offset(row, column);
+  checkWritable();
+  return data[position];
+}
+
+/*
+* Allows read-only indexing using (row, column) into a constant view.
+*/
+const double& MatrixView::operator()(int row, int column) const {
+  return data[offset(row, column)];
+}
+
+/*
+* Copies the values of the given view into the elements of this view. The 
+* views must have the same shape.
+*/
+MatrixView& MatrixView::operator=(const MatrixView& view) {
+  checkWritable();
+  assignExpression(data, rows, cols, rowStride, colStride, ViewLeaf(view));
+  return *this;
+}
+
+/*
+* Copies the values of the given matrix into the elements of this view. The 
+* matrix must have the same shape as the view.
+*/
+MatrixView& MatrixView::operator=(const Matrix& mat) {
+  checkWritable();
+  assignExpression(data, rows, cols, rowStride, colStride, MatrixLeaf(mat));
+  return *this;
+}
+
+/*
+* Sets every element of the view to the given value.
+*/
+MatrixView& MatrixView::operator=(double num) {
+  checkWritable();
+  assignExpression(data, rows, cols, rowStride, colStride, ScalarLeaf(num));
+  return *this;
+}
+
+/*
+* Multiplies every value in the view by the given value.
+*/
+MatrixView& MatrixView::operator*=(double num) {
+  return (*this = ViewLeaf(*this) * num);
+}
+
+/*
+* Adds the given value to every value in the view.
+*/
+MatrixView& MatrixView::operator+=(double num) {
+  return (*this = ViewLeaf(*this) + num);
+}
+
+/*
+* Adds the elements of the given view to the elements of this view.
+*/
+MatrixView& MatrixView::operator+=(const MatrixView& view) {
+  return (*this = ViewLeaf(*this) + ViewLeaf(view));
+}
+
+/*
+* Subtracts the given value from every value in the view.
+*/
+MatrixView& MatrixView::operator-=(double num) {
+  return (*this = ViewLeaf(*this) - num);
+}
+
+/*
+* Subtracts the elements of the given view from the elements of this view.
+*/
+MatrixView& MatrixView::operator-=(const MatrixView& view) {
+  return (*this = ViewLeaf(*this) - ViewLeaf(view));
+}
+
+/*
+* Divides every value in the view by the given value.
+*/
+MatrixView& MatrixView::operator/=(double num) {
+  return (*this = ViewLeaf(*this) / num);
+}
+
+/*
+* Divides the elements of this view by the elements of the given view.
+*/
+MatrixView& MatrixView::operator/=(const MatrixView& view) {
+  return (*this = ViewLeaf(*this) / ViewLeaf(view));
+}
+
+/******************************************************************************
+* FUNCTIONS ACTING ON VIEWS                                                   *
+******************************************************************************/
+
+/*
+* Computes the sum of the products of the corresponding elements of two views
+* with the same number of elements, such as a row and a column. The elements 
+* are paired in row major order.
+*/
+double dot(const MatrixView& left, const MatrixView& right) {
+  int size = left.getRows() * left.getColumns();
+  if (size != (right.getRows() * right.getColumns())) {
+    std::cout << "Unable to compute the dot product of views with sizes (" 
+              << left.getRows() << ", " << left.getColumns() << ") and ("
+              << right.getRows() << ", " << right.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+
+  // Both views are walked as vectors with a single stride when possible
+  int leftStride = (left.getColumns() == 1) ? left.getRowStride() 
+                                            : left.getColumnStride();
+  int rightStride = (right.getColumns() == 1) ? right.getRowStride() 
+                                              : right.getColumnStride();
+  const double* a = left.getData();
+  const double* b = right.getData();
+  double total = 0;
+  if (((left.getRows() == 1) || (left.getColumns() == 1)) && 
+      ((right.getRows() == 1) || (right.getColumns() == 1))) {
+    for (int i = 0; i < size; i++) {
+      total += a[(long)i*leftStride] * b[(long)i*rightStride];
+    }
+  } else {
+    for (int i = 0; i < size; i++) {
+      total += left(i / left.getColumns(), i % left.getColumns()) * 
+               right(i / right.getColumns(), i % right.getColumns());
+    }
+  }
+  return total;
+}
+
+/*
+* Returns true if the elements of two views may overlap, comparing the range
+* of memory from the first to the last element of each. Views without
+* elements never overlap.
+*/
+bool sharesElements(const MatrixView& left, const MatrixView& right) {
+  if ((left.getRows() == 0) || (left.getColumns() == 0) ||
+      (right.getRows() == 0) || (right.getColumns() == 0)) {
+    return false;
+  }
+  auto bounds = [](const MatrixView& view, const double*& first,
+                   const double*& last) {
+    long rowSpan = (long)(view.getRows() - 1)*view.getRowStride();
+    long columnSpan = (long)(view.getColumns() - 1)*view.getColumnStride();
+    first = view.getData() + std::min(rowSpan, 0L) + std::min(columnSpan, 0L);
+    last = view.getData() + std::max(rowSpan, 0L) + std::max(columnSpan, 0L);
+  };
+  const double* leftFirst;
+  const double* leftLast;
+  const double* rightFirst;
+  const double* rightLast;
+  bounds(left, leftFirst, leftLast);
+  bounds(right, rightFirst, rightLast);
+  return (leftFirst <= rightLast) && (rightFirst <= leftLast);
+}
@@ -0,0 +1,98 @@
+/******************************************************************************
+*                              Matrix view                                    *
+*                                                                             *
+* A view refers to a block of elements owned by a Matrix (or any other array) *
+* without copying them. It is described by a pointer to its first element,    *
+* its size and the distance in elements between consecutive rows and          *
+* consecutive columns. This allows rows, columns, sub-blocks and transposes   *
+* to be viewed in O(1), and writes through a view change the parent matrix.   *
+*                                                                             *
+* A view does not own its elements, so it must not outlive the matrix it      *
+* refers to, and becomes invalid if that matrix is resized or reassigned to a *
+* different size. A view created from a constant matrix is read-only, as are  *
+* the views taken from it: writing through it, or asking it for a mutable     *
+* pointer to its elements, throws. Assigning to a view copies values into the *
+* viewed elements rather than changing which elements the view refers to.     *
+*                                                                             *
+* This header is included at the end of matrix.hpp and should not be included *
+* on its own.                                                                 *
+*                                                                             *
+******************************************************************************/
+#ifndef MATRIX_VIEW_HPP
+#define MATRIX_VIEW_HPP
+
+class MatrixView {
+  private:
+    double* data;
+    int rows;
+    int cols;
+    int rowStride;
+    int colStride;
+    bool writable;
+
+    MatrixView(double* view_data, int num_rows, int num_columns,
+               int row_stride, int column_stride, bool is_writable);
+    long offset(int row, int column) const;
+    void checkWritable() const;
+
+  public:
+
+    // Constructors
+    MatrixView(double* view_data, int num_rows, int num_columns, 
+               int row_stride, int column_stride=1);
+    MatrixView(Matrix& mat);
+    MatrixView(const Matrix& mat);
+    MatrixView(const MatrixView& view) = default;
+
+    // Getter functions
+    int getRows() const;
+    int getColumns() const;
+    int getRowStride() const;
+    int getColumnStride() const;
+    double* getData();
+    const double* getData() const;
+    bool isContiguous() const;
+    bool isWritable() const;
+
+    // Functions for creating views of parts of this view
+    MatrixView block(int minRow=0, int maxRow=-1, int minCol=0, 
+                     int maxCol=-1) const;
+    MatrixView row(int row) const;
+    MatrixView column(int column) const;
+    MatrixView T() const;
+
+    void print(int decimals=5) const;
+    Matrix copy() const;
+
+    // Smallest and largest elements, ignoring NaN as reduce() does. NaN if
+    // every element is NaN, and the view must not be empty
+    double min() const;
+    double max() const;
+
+    // Operators
+    double& operator()(int row, int column);
+    const double& operator()(int row, int column) const;
+    MatrixView& operator=(const MatrixView& view);
+    MatrixView& operator=(const Matrix& mat);
+    MatrixView& operator=(double num);
+    template <typename E>
+    MatrixView& operator=(const MatrixExpression<E>& expr);
+    MatrixView& operator*=(double num);
+    MatrixView& operator+=(double num);
+    MatrixView& operator+=(const MatrixView& view);
+    template <typename E>
+    MatrixView& operator+=(const MatrixExpression<E>& expr);
+    MatrixView& operator-=(double num);
+    MatrixView& operator-=(const MatrixView& view);
+    template <typename E>
+    MatrixView& operator-=(const MatrixExpression<E>& expr);
+    MatrixView& operator/=(double num);
+    MatrixView& operator/=(const MatrixView& view);
+    template <typename E>
+    MatrixView& operator/=(const MatrixExpression<E>& expr);
+};
+
+double dot(const MatrixView& left, const MatrixView& right);
+bool sharesElements(const MatrixView& left, const MatrixView& right);
+
+#endif
@@ -0,0 +1,530 @@
+/******************************************************************************
+*                        Sliding minimum and maximum                          *
+*                                                                             *
+* Uses the van Herk/Gil-Werman algorithm in each direction. The elements are  *
+* cut into blocks of one window length. Within each block, the running        *
+* extreme from the start of the block (the prefix) and from its end (the      *
+* suffix) are computed. A window then starts in one block and ends in the     *
+* same or the next one, and its extreme is the suffix at its first element    *
+* combined with the prefix at its last: three comparisons per element for any *
+* window size.                                                                *
+*                                                                             *
+* The vertical pass runs first, from the input to the output. It works on     *
+* whole rows, so every comparison is a vectorized loop along a row, in tiles  *
+* of MORPHOLOGY_TILE values per row whose suffix blocks stay in the cache.    *
+* The tiles are split between the matrix threads. The horizontal pass then    *
+* filters each row of the output in place. The prefix and suffix of a row are *
+* chains along the row, and only the final combination is vectorized. The     *
+* rows are split between the matrix threads.                                  *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+
+#include "morphology.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Values of a row in a tile of columns of the vertical pass
+static const long MORPHOLOGY_TILE = 256;
+
+// Rows whose prefixes and suffixes are computed together in the horizontal
+// pass, so that their chains overlap
+static const int MORPHOLOGY_ROWS = 4;
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+// The smaller of two values, or the other one when one of them is NaN. The
+// plain comparison, which compiles to a single instruction instead of
+// branches, may be used when neither value is NaN
+template <typename T>
+struct Minimum {
+  static ALWAYS_INLINE T apply(T a, T b) {
+    return ((b < a) || (a != a)) ? b : a;
+  }
+  static ALWAYS_INLINE T plain(T a, T b) {
+    return (b < a) ? b : a;
+  }
+};
+
+// The larger of two values, or the other one when one of them is NaN
+template <typename T>
+struct Maximum {
+  static ALWAYS_INLINE T apply(T a, T b) {
+    return ((b > a) || (a != a)) ? b : a;
+  }
+  static ALWAYS_INLINE T plain(T a, T b) {
+    return (b > a) ? b : a;
+  }
+};
+
+/*
+* Sets out[i] to the extreme of a[i] and b[i]. out may be a or b.
+*/
+template <typename Op, typename T>
+static ALWAYS_INLINE void combineBody(T* out, const T* a, const T* b,
+                                      long n) {
+  for (long i = 0; i < n; i++) {
+    out[i] = Op::apply(a[i], b[i]);
+  }
+}
+
+/*
+* Returns true if any of the values is NaN.
+*/
+template <typename T>
+static ALWAYS_INLINE bool hasNaNBody(const T* x, long n) {
+  int found = 0;
+  for (long i = 0; i < n; i++) {
+    found |= (x[i] != x[i]);
+  }
+  return found != 0;
+}
+
+template <typename T>
+using CombineKernel = void (*)(T* out, const T* a, const T* b, long n);
+template <typename T>
+using NaNKernel = bool (*)(const T* x, long n);
+
+struct MorphologyKernels {
+  CombineKernel<double> minDouble;
+  CombineKernel<double> maxDouble;
+  CombineKernel<float> minFloat;
+  CombineKernel<float> maxFloat;
+  NaNKernel<double> nanDouble;
+  NaNKernel<float> nanFloat;
+};
+
+// Defines the kernels for one instruction set
+#define MORPHOLOGY_KERNELS(ISA, TARGET)                                       \
+  TARGET static void minDouble_##ISA(double* out, const double* a,            \
+                                     const double* b, long n) {               \
+    combineBody<Minimum<double>>(out, a, b, n);                               \
+  }                                                                           \
+  TARGET static void maxDouble_##ISA(double* out, const double* a,            \
+                                     const double* b, long n) {               \
+    combineBody<Maximum<double>>(out, a, b, n);                               \
+  }                                                                           \
+  TARGET static void minFloat_##ISA(float* out, const float* a,               \
+                                    const float* b, long n) {                 \
+    combineBody<Minimum<float>>(out, a, b, n);                                \
+  }                                                                           \
+  TARGET static void maxFloat_##ISA(float* out, const float* a,               \
+                                    const float* b, long n) {                 \
+    combineBody<Maximum<float>>(out, a, b, n);                                \
+  }                                                                           \
+  TARGET static bool nanDouble_##ISA(const double* x, long n) {               \
+    return hasNaNBody(x, n);                                                  \
+  }                                                                           \
+  TARGET static bool nanFloat_##ISA(const float* x, long n) {                 \
+    return hasNaNBody(x, n);                                                  \
+  }                                                                           \
+  static const MorphologyKernels morphologyKernels_##ISA = {                  \
+    minDouble_##ISA, maxDouble_##ISA, minFloat_##ISA, maxFloat_##ISA,         \
+    nanDouble_##ISA, nanFloat_##ISA                                           \
+  };
+
+INSTANTIATE_KERNELS(MORPHOLOGY_KERNELS)
+
+/*
+* Returns the kernels for the instruction set of the elementwise kernels.
+*/
+static const MorphologyKernels& morphologyKernels() {
+  SELECT_KERNELS(morphologyKernels)
+}
+
+static CombineKernel<double> combineKernel(Minimum<double>) {
+  return morphologyKernels().minDouble;
+}
+
+static CombineKernel<double> combineKernel(Maximum<double>) {
+  return morphologyKernels().maxDouble;
+}
+
+static CombineKernel<float> combineKernel(Minimum<float>) {
+  return morphologyKernels().minFloat;
+}
+
+static CombineKernel<float> combineKernel(Maximum<float>) {
+  return morphologyKernels().maxFloat;
+}
+
+static NaNKernel<double> nanKernel(double) {
+  return morphologyKernels().nanDouble;
+}
+
+static NaNKernel<float> nanKernel(float) {
+  return morphologyKernels().nanFloat;
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Filters the columns of an array of height rows with values elements each,
+* from in to out, which must not overlap.
+*/
+template <typename Op, typename T>
+static void filterColumns(const T* in, long inStride, T* out, long outStride,
+                          long values, int height, int radius) {
+  CombineKernel<T> combine = combineKernel(Op());
+  long window = 2L * radius + 1;
+  long tiles = (values + MORPHOLOGY_TILE - 1) / MORPHOLOGY_TILE;
+  long grain = std::max(1L, PARALLEL_GRAIN / (MORPHOLOGY_TILE * height));
+  parallelFor(tiles, grain, [&](long begin, long end) {
+    std::vector<T> suffix(window * MORPHOLOGY_TILE);
+    std::vector<T> prefix(MORPHOLOGY_TILE);
+    for (long tile = begin; tile < end; tile++) {
+      long x0 = tile * MORPHOLOGY_TILE;
+      long n = std::min(MORPHOLOGY_TILE, values - x0);
+      const T* column = in + x0;
+
+      // prefix holds the rows of the block of prefixRow from its start to
+      // prefixRow, and suffix the rows of block suffixBlock
+      long prefixRow = -1;
+      long suffixBlock = -1;
+      for (long y = 0; y < height; y++) {
+        long first = std::max(0L, y - radius);
+        long last = std::min((long)height - 1, y + radius);
+        while (prefixRow < last) {
+          prefixRow++;
+          const T* row = column + prefixRow*inStride;
+          if (prefixRow % window == 0) {
+            std::copy(row, row + n, prefix.data());
+          } else {
+            combine(prefix.data(), prefix.data(), row, n);
+          }
+        }
+        long start = first / window * window;
+        if (start / window != suffixBlock) {
+          suffixBlock = start / window;
+          long stop = std::min((long)height, start + window);
+          T* line = suffix.data() + (stop - 1 - start)*MORPHOLOGY_TILE;
+          const T* row = column + (stop - 1)*inStride;
+          std::copy(row, row + n, line);
+          for (long j = stop - 2; j >= start; j--) {
+            combine(line - MORPHOLOGY_TILE, line, column + j*inStride, n);
+            line -= MORPHOLOGY_TILE;
+          }
+        }
+        T* target = out + y*outStride + x0;
+        const T* firstSuffix = suffix.data() +
+                               (first - start)*MORPHOLOGY_TILE;
+        if (last / window != suffixBlock) {
+          combine(target, firstSuffix, prefix.data(), n);
+        } else if (first == start) {
+          std::copy(prefix.data(), prefix.data() + n, target);
+        } else {
+          std::copy(firstSuffix, firstSuffix + n, target);
+        }
+      }
+    }
+  });
+}
+
+/*
+* Writes the prefixes and suffixes of Rows rows of values elements, with
+* pixels of channels values, to Rows consecutive lines of prefix and suffix.
+* The chains of the rows are interleaved and kept in registers, so that the
+* comparisons of one row do not wait for those of the previous one. The plain
+* comparison is used when Plain is true.
+*/
+template <typename Op, bool Plain, int Rows, typename T>
+static void sweepRows(T* const* rows, long values, long window, int channels,
+                      T* prefix, T* suffix) {
+  auto extreme = [](T a, T b) {
+    return Plain ? Op::plain(a, b) : Op::apply(a, b);
+  };
+  long blockValues = window * channels;
+  for (long first = 0; first < values; first += blockValues) {
+    long stop = std::min(values, first + blockValues);
+    for (int c = 0; c < channels; c++) {
+      T running[Rows];
+      #pragma GCC unroll 4
+      for (int r = 0; r < Rows; r++) {
+        running[r] = rows[r][first + c];
+      }
+      for (long i = first + c; i < stop; i += channels) {
+        #pragma GCC unroll 4
+        for (int r = 0; r < Rows; r++) {
+          running[r] = extreme(running[r], rows[r][i]);
+          prefix[r*values + i] = running[r];
+        }
+      }
+      #pragma GCC unroll 4
+      for (int r = 0; r < Rows; r++) {
+        running[r] = rows[r][stop - channels + c];
+      }
+      for (long i = stop - channels + c; i >= first; i -= channels) {
+        #pragma GCC unroll 4
+        for (int r = 0; r < Rows; r++) {
+          running[r] = extreme(running[r], rows[r][i]);
+          suffix[r*values + i] = running[r];
+        }
+      }
+    }
+  }
+}
+
+/*
+* Filters the rows of an array of height rows with width pixels of channels
+* interleaved values each, in place, MORPHOLOGY_ROWS rows at a time.
+*/
+template <typename Op, typename T>
+static void filterRows(T* data, long stride, int width, int height,
+                       int channels, int radius) {
+  CombineKernel<T> combine = combineKernel(Op());
+  NaNKernel<T> hasNaN = nanKernel(T());
+  long window = 2L * radius + 1;
+  long values = (long)width * channels;
+  long grain = std::max(1L, PARALLEL_GRAIN / std::max(1L, values));
+  grain = (grain + MORPHOLOGY_ROWS - 1) / MORPHOLOGY_ROWS * MORPHOLOGY_ROWS;
+  parallelFor(height, grain, [&](long begin, long end) {
+    std::vector<T> prefixes(MORPHOLOGY_ROWS * values);
+    std::vector<T> suffixes(MORPHOLOGY_ROWS * values);
+    T* rows[MORPHOLOGY_ROWS];
+    for (long y0 = begin; y0 < end; y0 += MORPHOLOGY_ROWS) {
+      int count = (int)std::min((long)MORPHOLOGY_ROWS, end - y0);
+      bool plain = true;
+      for (int r = 0; r < count; r++) {
+        rows[r] = data + (y0 + r)*stride;
+        plain = plain && !hasNaN(rows[r], values);
+      }
+      T* prefix = prefixes.data();
+      T* suffix = suffixes.data();
+      if (count < MORPHOLOGY_ROWS) {
+        for (int r = 0; r < count; r++) {
+          if (plain) {
+            sweepRows<Op, true, 1>(rows + r, values, window, channels,
+                                   prefix + r*values, suffix + r*values);
+          } else {
+            sweepRows<Op, false, 1>(rows + r, values, window, channels,
+                                    prefix + r*values, suffix + r*values);
+          }
+        }
+      } else if (plain) {
+        sweepRows<Op, true, MORPHOLOGY_ROWS>(rows, values, window, channels,
+                                             prefix, suffix);
+      } else {
+        sweepRows<Op, false, MORPHOLOGY_ROWS>(rows, values, window,
+                                              channels, prefix, suffix);
+      }
+
+      // The windows of the pixels radius or more from both ends are not
+      // clipped, and end radius pixels after they start
+      long inner = std::min((long)radius, (long)width);
+      long innerEnd = std::max(inner, (long)width - radius);
+      for (int r = 0; r < count; r++) {
+        T* row = rows[r];
+        const T* rowPrefix = prefix + r*values;
+        const T* rowSuffix = suffix + r*values;
+        if (innerEnd > inner) {
+          combine(row + inner*channels, rowSuffix + (inner - radius)*channels,
+                  rowPrefix + (inner + radius)*channels,
+                  (innerEnd - inner)*channels);
+        }
+        for (long x = 0; x < width; x++) {
+          if ((x == inner) && (innerEnd > inner)) {
+            x = innerEnd - 1;
+            continue;
+          }
+          long first = std::max(0L, x - radius);
+          long last = std::min((long)width - 1, x + radius);
+          for (int c = 0; c < channels; c++) {
+            T head = rowSuffix[first*channels + c];
+            T tail = rowPrefix[last*channels + c];
+            if (first / window != last / window) {
+              row[x*channels + c] = Op::apply(head, tail);
+            } else {
+              row[x*channels + c] = (first % window == 0) ? tail : head;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+/*
+* Filters an array of height rows with width pixels of channels interleaved
+* values each into another one. The vertical pass writes every value of the
+* output, which the horizontal pass then filters in place.
+*/
+template <typename Op, typename T>
+static void filterExtremes(const T* in, long inStride, T* out, long outStride,
+                           int width, int height, int channels, int radiusX,
+                           int radiusY) {
+  long values = (long)width * channels;
+  if ((values == 0) || (height == 0)) {
+    return;
+  }
+
+  // The windows are clipped to the array, so a radius beyond its last row or
+  // column gives the same result, and the scratch lines, which grow with the
+  // window, stay bounded by the size of the array
+  radiusX = std::min(radiusX, width - 1);
+  radiusY = std::min(radiusY, height - 1);
+  if (radiusY > 0) {
+    filterColumns<Op>(in, inStride, out, outStride, values, height, radiusY);
+  } else {
+    for (long y = 0; y < height; y++) {
+      std::copy(in + y*inStride, in + y*inStride + values, out + y*outStride);
+    }
+  }
+  if (radiusX > 0) {
+    filterRows<Op>(out, outStride, width, height, channels, radiusX);
+  }
+}
+
+/*
+* Throws if a radius of a window is negative.
+*/
+static void checkRadius(int radiusRows, int radiusCols) {
+  if ((radiusRows < 0) || (radiusCols < 0)) {
+    std::cout << "Invalid window radius (" << radiusRows << ", "
+              << radiusCols << ")\n";
+    throw std::invalid_argument("Invalid window radius.");
+  }
+}
+
+/*
+* Filters a matrix or view, and sets the mask to 1 where the input equals
+* the output.
+*/
+template <typename Op>
+static void filterMatrix(const MatrixView& in, Matrix& out, int radiusRows,
+                         int radiusCols, Matrix* mask) {
+  checkRadius(radiusRows, radiusCols);
+  if (in.getColumnStride() != 1) {
+    Matrix contiguous(in);
+    filterMatrix<Op>(contiguous.view(), out, radiusRows, radiusCols, mask);
+    return;
+  }
+  if (sharesElements(in, out) ||
+      ((mask != nullptr) && sharesElements(in, *mask))) {
+    Matrix result(in.getRows(), in.getColumns());
+    Matrix resultMask(0, 0);
+    filterMatrix<Op>(in, result, radiusRows, radiusCols,
+                     (mask == nullptr) ? nullptr : &resultMask);
+    out = std::move(result);
+    if (mask != nullptr) {
+      *mask = std::move(resultMask);
+    }
+    return;
+  }
+  int rows = in.getRows();
+  int cols = in.getColumns();
+  if ((out.getRows() != rows) || (out.getColumns() != cols)) {
+    HeapScope heap;
+    out = Matrix(rows, cols);
+  }
+  filterExtremes<Op>(in.getData(), in.getRowStride(), out.getData(), cols,
+                     cols, rows, 1, radiusCols, radiusRows);
+  if (mask == nullptr) {
+    return;
+  }
+  if ((mask->getRows() != rows) || (mask->getColumns() != cols)) {
+    HeapScope heap;
+    *mask = Matrix(rows, cols);
+  }
+  for (int i = 0; i < rows; i++) {
+    const double* inRow = in.getData() + (long)i*in.getRowStride();
+    const double* outRow = out.getData() + (long)i*cols;
+    double* maskRow = mask->getData() + (long)i*cols;
+    for (int j = 0; j < cols; j++) {
+      maskRow[j] = (inRow[j] == outRow[j]) ? 1 : 0;
+    }
+  }
+}
+
+/*
+* Filters every channel of an image.
+*/
+template <typename Op>
+static void filterImage(const Image& in, Image& out, int radiusX,
+                        int radiusY) {
+  checkRadius(radiusY, radiusX);
+  if (sharesPixels(in, out)) {
+    Image result;
+    filterImage<Op>(in, result, radiusX, radiusY);
+    out = result;
+    return;
+  }
+  out.setSize(in.getWidth(), in.getHeight(), in.getChannels());
+  filterExtremes<Op>(in.getData(), in.getStride(), out.getData(),
+                     out.getStride(), in.getWidth(), in.getHeight(),
+                     in.getChannels(), radiusX, radiusY);
+}
+
+/******************************************************************************
+* FILTERS                                                                     *
+******************************************************************************/
+
+/*
+* Sets out to the minimum of the window around every element, and the mask,
+* if given, to 1 at the local minima.
+*/
+void minFilter(const MatrixView& in, Matrix& out, int radiusRows,
+               int radiusCols, Matrix* mask) {
+  filterMatrix<Minimum<double>>(in, out, radiusRows, radiusCols, mask);
+}
+
+Matrix minFilter(const MatrixView& in, int radiusRows, int radiusCols) {
+  Matrix out(in.getRows(), in.getColumns());
+  minFilter(in, out, radiusRows, radiusCols);
+  return out;
+}
+
+/*
+* Sets out to the maximum of the window around every element, and the mask,
+* if given, to 1 at the local maxima.
+*/
+void maxFilter(const MatrixView& in, Matrix& out, int radiusRows,
+               int radiusCols, Matrix* mask) {
+  filterMatrix<Maximum<double>>(in, out, radiusRows, radiusCols, mask);
+}
+
+Matrix maxFilter(const MatrixView& in, int radiusRows, int radiusCols) {
+  Matrix out(in.getRows(), in.getColumns());
+  maxFilter(in, out, radiusRows, radiusCols);
+  return out;
+}
+
+/*
+* Returns the positions of the local maxima greater than the threshold.
+*/
+std::vector<struct index> localMaxima(const MatrixView& in, int radiusRows,
+                                      int radiusCols, double threshold) {
+  Matrix filtered(in.getRows(), in.getColumns());
+  maxFilter(in, filtered, radiusRows, radiusCols);
+  std::vector<struct index> maxima;
+  for (int i = 0; i < in.getRows(); i++) {
+    const double* inRow = in.getData() + (long)i*in.getRowStride();
+    const double* filteredRow = filtered.getData() + (long)i*in.getColumns();
+    for (int j = 0; j < in.getColumns(); j++) {
+      double value = inRow[(long)j*in.getColumnStride()];
+      if ((value > threshold) && (value == filteredRow[j])) {
+        maxima.push_back({i, j});
+      }
+    }
+  }
+  return maxima;
+}
+
+/*
+* Sets every pixel of out to the minimum of its window in the same channel.
+*/
+void erode(const Image& in, Image& out, int radiusX, int radiusY) {
+  filterImage<Minimum<float>>(in, out, radiusX, radiusY);
+}
+
+/*
+* Sets every pixel of out to the maximum of its window in the same channel.
+*/
+void dilate(const Image& in, Image& out, int radiusX, int radiusY) {
+  filterImage<Maximum<float>>(in, out, radiusX, radiusY);
+}
@@ -0,0 +1,50 @@
+/******************************************************************************
+*                        Sliding minimum and maximum                          *
+*                                                                             *
+* Replaces every element by the minimum or the maximum of the window of      *
+* (2 * radiusRows + 1) x (2 * radiusCols + 1) elements around it, which is    *
+* the erosion and dilation of grayscale morphology. The windows are clipped   *
+* to the matrix, so each result is what minRange or maxRange would give for   *
+* the window, and NaN elements are ignored in the same way. The cost per      *
+* element does not depend on the size of the window:                         *
+*                                                                             *
+*   Matrix peaks;                                                             *
+*   Matrix isPeak;                                                            *
+*   maxFilter(heatmap, peaks, 5, 5, &isPeak);                                 *
+*                                                                             *
+* The optional mask is 1 where an element equals the result of its window,   *
+* that is at the local maxima of maxFilter() and the local minima of          *
+* minFilter(), and 0 elsewhere. localMaxima() returns the positions of the    *
+* local maxima above a threshold directly, for non-maximum suppression of     *
+* detection heatmaps. Every element of a plateau of equal maxima is reported. *
+*                                                                             *
+* erode() and dilate() filter every channel of an image in the same way. The  *
+* output may be the input itself, in which case the result goes through a     *
+* temporary.                                                                  *
+*                                                                             *
+******************************************************************************/
+#ifndef MORPHOLOGY_HPP
+#define MORPHOLOGY_HPP
+
+#include <limits>
+#include <vector>
+
+#include "image.hpp"
+
+void minFilter(const MatrixView& in, Matrix& out, int radiusRows,
+               int radiusCols, Matrix* mask=nullptr);
+Matrix minFilter(const MatrixView& in, int radiusRows, int radiusCols);
+void maxFilter(const MatrixView& in, Matrix& out, int radiusRows,
+               int radiusCols, Matrix* mask=nullptr);
+Matrix maxFilter(const MatrixView& in, int radiusRows, int radiusCols);
+
+// Positions of the elements that are the maximum of their window and
+// greater than the threshold, in row major order
+std::vector<struct index> localMaxima(
+  const MatrixView& in, int radiusRows, int radiusCols,
+  double threshold=-std::numeric_limits<double>::infinity());
+
+void erode(const Image& in, Image& out, int radiusX, int radiusY);
+void dilate(const Image& in, Image& out, int radiusX, int radiusY);
+
+#endif
@@ -0,0 +1,250 @@
+/******************************************************************************
+*                          Parallel execution                                 *
+*                                                                             *
+* The pool hands out the tasks of one job at a time through an atomic         *
+* counter. Workers copy the job when they wake up and register as active, and *
+* the caller clears the job once it has run out of tasks and every active     *
+* worker has finished, so a worker that wakes up late never sees a job whose  *
+* function has already gone out of scope.                                     *
+*                                                                             *
+* A task that throws stops the job: the counter is moved past the last task,  *
+* so no more tasks start, and the first exception is kept until the caller    *
+* has waited for the active workers and cleared the job, and is then rethrown *
+* on the calling thread.                                                      *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#include "parallel.hpp"
+
+// Set while a thread is running a task, so that nested operations run serially
+static thread_local bool insideTask = false;
+
+// Sets insideTask while it exists and restores the previous value when it is
+// destroyed, also when a task throws
+class TaskScope {
+  private:
+    bool outer;
+
+  public:
+    TaskScope() : outer(insideTask) {
+      insideTask = true;
+    }
+    ~TaskScope() {
+      insideTask = outer;
+    }
+};
+
+/******************************************************************************
+* THREAD POOL                                                                 *
+******************************************************************************/
+
+/*
+* Creates a pool for the given number of threads, including the thread that
+* calls run, so threads - 1 workers are started.
+*/
+ThreadPool::ThreadPool(int threads) :
+  job(nullptr),
+  jobTasks(0),
+  active(0),
+  generation(0),
+  stopping(false),
+  next(0)
+{
+  for (int i = 1; i < threads; i++) {
+    workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+int ThreadPool::getThreads() const {
+  return (int)workers.size() + 1;
+}
+
+/*
+* Claims and runs tasks of the current job until none are left. If a task
+* throws, no more tasks are handed out and the first exception of the job is
+* kept for run() to rethrow.
+*/
+void ThreadPool::runTasks(const std::function<void(int)>& task, int tasks) {
+  TaskScope scope;
+  try {
+    for (int t = next.fetch_add(1); t < tasks; t = next.fetch_add(1)) {
+      task(t);
+    }
+  } catch (...) {
+    next.store(tasks);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!error) {
+      error = std::current_exception();
+    }
+  }
+}
+
+/*
+* Main loop of a worker thread.
+*/
+void ThreadPool::work() {
+  long seen = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    wake.wait(lock, [&]() { return stopping || (generation != seen); });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    if (job == nullptr) {
+      continue;
+    }
+    const std::function<void(int)>* task = job;
+    int tasks = jobTasks;
+    active++;
+    lock.unlock();
+    runTasks(*task, tasks);
+    lock.lock();
+    if (--active == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+/*
+* Runs task(0) ... task(tasks - 1) on the pool and the calling thread. If the
+* pool is already running a job for another thread, the tasks are run on the
+* calling thread instead of waiting for it. If a task throws, the tasks that
+* have not started are skipped, and the first exception is rethrown once the
+* others have finished.
+*/
+void ThreadPool::run(int tasks, const std::function<void(int)>& task) {
+  std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+  if (!running.owns_lock() || workers.empty()) {
+    for (int t = 0; t < tasks; t++) {
+      task(t);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = &task;
+    jobTasks = tasks;
+    next.store(0);
+    generation++;
+  }
+  wake.notify_all();
+  runTasks(task, tasks);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]() { return active == 0; });
+  job = nullptr;
+  std::exception_ptr thrown = error;
+  error = nullptr;
+  lock.unlock();
+  if (thrown) {
+    std::rethrow_exception(thrown);
+  }
+}
+
+/******************************************************************************
+* GLOBAL SETTINGS                                                             *
+******************************************************************************/
+
+static std::atomic<int> threadCount{0};
+static std::unique_ptr<ThreadPool> pool;
+static std::mutex poolMutex;
+static MatrixExecutor executor;
+
+/*
+* Returns the number of hardware threads, or 1 if it is unknown. The count is
+* looked up once, since the lookup reads system files on some platforms and
+* every operation asks for it.
+*/
+static int hardwareThreads() {
+  static const int threads = 
+    std::max(1, (int)std::thread::hardware_concurrency());
+  return threads;
+}
+
+/*
+* Sets the number of threads used for large operations, including the calling
+* thread. 0 selects one thread per hardware thread and 1 runs everything on
+* the calling thread. Also switches back from an executor to the pool.
+*/
+void setMatrixThreads(int threads) {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  executor = nullptr;
+  pool.reset();
+  threadCount.store((threads > 0) ? threads : hardwareThreads());
+}
+
+/*
+* Returns the number of threads used for large operations.
+*/
+int getMatrixThreads() {
+  int threads = threadCount.load(std::memory_order_relaxed);
+  return (threads > 0) ? threads : hardwareThreads();
+}
+
+/*
+* Runs the chunks of large operations on the given executor instead of the
+* internal pool, which is shut down. Concurrency is the number of chunks the
+* executor can usefully run at once.
+*/
+void setMatrixExecutor(MatrixExecutor matrix_executor, int concurrency) {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  pool.reset();
+  executor = std::move(matrix_executor);
+  threadCount.store(std::max(1, concurrency));
+}
+
+/*
+* Returns the number of chunks an operation over count items should be split
+* into, which is 1 for small operations, single threaded settings and
+* operations started from inside a chunk.
+*/
+int parallelChunks(long count, long grain) {
+  int threads = getMatrixThreads();
+  if ((threads <= 1) || (count < 2*grain) || insideTask) {
+    return 1;
+  }
+  return (int)std::min((long)threads, count / grain);
+}
+
+/*
+* Runs task(0) ... task(chunks - 1) on the executor or the pool, creating the
+* pool if needed.
+*/
+void runParallel(int chunks, const std::function<void(int)>& task) {
+  ThreadPool* current;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (executor) {
+      current = nullptr;
+    } else {
+      if (pool == nullptr) {
+        pool.reset(new ThreadPool(getMatrixThreads()));
+      }
+      current = pool.get();
+    }
+  }
+  if (current == nullptr) {
+    executor(chunks, [&](int chunk) {
+      TaskScope scope;
+      task(chunk);
+    });
+  } else {
+    current->run(chunks, task);
+  }
+}
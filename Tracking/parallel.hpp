@@ -0,0 +1,96 @@
+/******************************************************************************
+*                          Parallel execution                                 *
+*                                                                             *
+* Large matrix operations are split into chunks that run on a pool of worker  *
+* threads, with the calling thread working on chunks as well. The pool is     *
+* created the first time it is needed and has one thread per hardware thread  *
+* by default. setMatrixThreads changes the number of threads, and 1 turns the *
+* pool off. setMatrixExecutor hands the chunks to an executor of the          *
+* application instead, such as the task system of a tracker, so that the      *
+* library does not start threads of its own.                                  *
+*                                                                             *
+* Operations on fewer elements than their grain size are not split at all,    *
+* and then cost a single relaxed atomic load, so small matrices never pay for *
+* synchronization. Operations started from inside a chunk run on the calling  *
+* thread, and so do operations started while another thread is using the      *
+* pool. The settings are global and must not be changed while matrix          *
+* operations are running on other threads.                                    *
+*                                                                             *
+* If a chunk throws, the chunks that have not started are skipped and the     *
+* first exception is rethrown on the calling thread once the running chunks   *
+* have finished, after which the pool can be used again.                      *
+*                                                                             *
+******************************************************************************/
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Minimum number of elements per chunk for elementwise operations and
+// reductions. Smaller chunks would spend more time waking threads than working
+const long PARALLEL_GRAIN = 1L << 16;
+
+// Runs task(0) ... task(tasks - 1), possibly on several threads, and returns
+// once every task has finished
+typedef std::function<void(int tasks, const std::function<void(int)>& task)>
+  MatrixExecutor;
+
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::mutex runMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(int)>* job;
+    int jobTasks;
+    int active;
+    long generation;
+    bool stopping;
+    std::atomic<int> next;
+    std::exception_ptr error;
+
+    void work();
+    void runTasks(const std::function<void(int)>& task, int tasks);
+
+  public:
+    explicit ThreadPool(int threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int getThreads() const;
+    void run(int tasks, const std::function<void(int)>& task);
+};
+
+void setMatrixThreads(int threads);
+int getMatrixThreads();
+void setMatrixExecutor(MatrixExecutor executor, int concurrency);
+int parallelChunks(long count, long grain);
+void runParallel(int chunks, const std::function<void(int)>& task);
+
+/*
+* Calls body(begin, end) on consecutive ranges covering [0, count), each at
+* least grain long. The ranges run in parallel when count is large enough and
+* more than one thread is available, otherwise body(0, count) is called
+* directly.
+*/
+template <typename Body>
+void parallelFor(long count, long grain, const Body& body) {
+  int chunks = parallelChunks(count, grain);
+  if (chunks <= 1) {
+    body(0L, count);
+    return;
+  }
+  runParallel(chunks, [&](int chunk) {
+    body(count * chunk / chunks, count * (chunk + 1) / chunks);
+  });
+}
+
+#endif
@@ -0,0 +1,275 @@
+/******************************************************************************
+*                              Image pyramids                                 *
+*                                                                             *
+* pyrDown() blurs and decimates in one pass over the output rows. Output row  *
+* y needs the input rows 2y - 2 to 2y + 2, which are summed with the weights  *
+* 1 4 6 4 1 into a line of the full width. The line has two reflected pixels  *
+* on each side, taken from the columns of the line that the border gives      *
+* them, and the output pixels are the sums of every second group of five      *
+* pixels of the line. The rows that are dropped by the decimation are never   *
+* blurred, and the columns are only blurred once per output row.              *
+*                                                                             *
+* The weights are integers and the sums are scaled by 1 / 256 at the end. The *
+* products by 4 and 6 round like any other float operation, so the results    *
+* are the same for every instruction set only because the kernels are         *
+* compiled with fp-contract=off, which keeps products and sums from being     *
+* fused, and add in the same fixed order everywhere. Each parallel chunk of   *
+* output rows has its own line.                                               *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "filter.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+#include "pyramid.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Pixels added to each side of the line of blurred columns
+static const int PYRAMID_PAD = 2;
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Sets line[i] to the binomial sum of the five rows at element i.
+*/
+static ALWAYS_INLINE void blurColumnsBody(float* __restrict line,
+                                          const float* __restrict row0,
+                                          const float* __restrict row1,
+                                          const float* __restrict row2,
+                                          const float* __restrict row3,
+                                          const float* __restrict row4,
+                                          long n) {
+  for (long i = 0; i < n; i++) {
+    line[i] = ((row0[i] + row4[i]) + 4.0f*(row1[i] + row3[i])) +
+              6.0f*row2[i];
+  }
+}
+
+/*
+* Sets output pixel x to the binomial sum of the pixels 2x to 2x + 4 of the
+* padded line, scaled by 1 / 256.
+*/
+static ALWAYS_INLINE void decimateBody(float* __restrict out,
+                                       const float* __restrict line,
+                                       int width, int channels) {
+  const float scale = 1.0f / 256;
+  long c = channels;
+  for (long x = 0; x < width; x++) {
+    const float* pixel = line + 2*x*c;
+    for (long k = 0; k < c; k++) {
+      out[x*c + k] = (((pixel[k] + pixel[k + 4*c]) +
+                       4.0f*(pixel[k + c] + pixel[k + 3*c])) +
+                      6.0f*pixel[k + 2*c]) * scale;
+    }
+  }
+}
+
+typedef void (*BlurColumnsKernel)(float* line, const float* row0,
+                                  const float* row1, const float* row2,
+                                  const float* row3, const float* row4,
+                                  long n);
+typedef void (*DecimateKernel)(float* out, const float* line, int width,
+                               int channels);
+
+// The kernels of one instruction set
+struct PyramidKernels {
+  BlurColumnsKernel blurColumns;
+  DecimateKernel decimate;
+};
+
+// Defines the kernels for one instruction set. The common channel counts
+// get loops with a constant pixel size
+#define PYRAMID_KERNELS(ISA, TARGET)                                          \
+  TARGET static void blurColumns_##ISA(float* line, const float* row0,        \
+                                       const float* row1, const float* row2,  \
+                                       const float* row3, const float* row4,  \
+                                       long n) {                              \
+    blurColumnsBody(line, row0, row1, row2, row3, row4, n);                   \
+  }                                                                           \
+  TARGET static void decimate_##ISA(float* out, const float* line,            \
+                                    int width, int channels) {                \
+    switch (channels) {                                                       \
+      case 1:                                                                 \
+        decimateBody(out, line, width, 1);                                    \
+        break;                                                                \
+      case 3:                                                                 \
+        decimateBody(out, line, width, 3);                                    \
+        break;                                                                \
+      case 4:                                                                 \
+        decimateBody(out, line, width, 4);                                    \
+        break;                                                                \
+      default:                                                                \
+        decimateBody(out, line, width, channels);                             \
+        break;                                                                \
+    }                                                                         \
+  }                                                                           \
+  static const PyramidKernels pyramidKernels_##ISA = {                        \
+    blurColumns_##ISA, decimate_##ISA                                         \
+  };
+
+INSTANTIATE_KERNELS(PYRAMID_KERNELS)
+
+/*
+* Returns the kernels for the instruction set of the elementwise kernels.
+*/
+static const PyramidKernels& pyramidKernels() {
+  SELECT_KERNELS(pyramidKernels)
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns the number of output rows computed together by a thread, so that a
+* chunk does at least PARALLEL_GRAIN additions. An output row adds five input
+* rows and then five pixels for every second pixel of the line.
+*/
+static long pyramidGrain(const Image& in) {
+  long work = std::max(1L, (long)in.getWidth() * in.getChannels() * 8);
+  return std::max(1L, PARALLEL_GRAIN / work);
+}
+
+/*
+* Computes the next level of the input into an output of the right size that
+* does not share pixels with it.
+*/
+static void pyrDownRows(const Image& in, Image& out) {
+  int width = in.getWidth();
+  int height = in.getHeight();
+  int channels = in.getChannels();
+  long c = channels;
+  const PyramidKernels& kernels = pyramidKernels();
+  parallelFor(out.getHeight(), pyramidGrain(in), [&](long begin, long end) {
+    std::vector<float> buffer((long)(width + 2*PYRAMID_PAD) * c);
+    float* line = buffer.data() + PYRAMID_PAD*c;
+    for (long y = begin; y < end; y++) {
+      const float* rows[5];
+      for (int t = 0; t < 5; t++) {
+        rows[t] = in.row((int)borderIndex(2*y + t - 2, height,
+                                             BorderMode::Reflect));
+      }
+      kernels.blurColumns(line, rows[0], rows[1], rows[2], rows[3], rows[4],
+                          (long)width * c);
+
+      // The vertical sums do not depend on the column, so the pixels
+      // outside the line are copies of the pixels they reflect to
+      for (long x = -PYRAMID_PAD; x < width + PYRAMID_PAD; x++) {
+        if (x == 0) {
+          x = width - 1;
+          continue;
+        }
+        long source = borderIndex(x, width, BorderMode::Reflect);
+        std::copy(line + source*c, line + (source + 1)*c, line + x*c);
+      }
+      kernels.decimate(out.row((int)y), line - PYRAMID_PAD*c,
+                       out.getWidth(), channels);
+    }
+  });
+}
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+/*
+* Creates a pyramid of the given number of levels, including the frame
+* itself. A lazy pyramid builds each level on first access.
+*/
+ImagePyramid::ImagePyramid(int num_levels, bool lazy_levels) :
+  ready(0),
+  lazy(lazy_levels)
+{
+  if (num_levels < 1) {
+    std::cout << "Unable to create a pyramid of " << num_levels
+              << " levels\n";
+    throw std::invalid_argument("Invalid pyramid size.");
+  }
+  levels.resize(num_levels);
+}
+
+/******************************************************************************
+* PUBLIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Copies the frame into level 0 and builds the other levels, unless the
+* pyramid is lazy. Levels of the same size as in the previous frame keep
+* their arrays.
+*/
+void ImagePyramid::build(const Image& frame) {
+  levels[0] = frame;
+  ready = 1;
+  if (!lazy) {
+    level((int)levels.size() - 1);
+  }
+}
+
+int ImagePyramid::getLevels() const {
+  return (int)levels.size();
+}
+
+bool ImagePyramid::isLazy() const {
+  return lazy;
+}
+
+/*
+* Returns true if the level holds the current frame.
+*/
+bool ImagePyramid::isBuilt(int index) const {
+  return (index >= 0) && (index < ready);
+}
+
+/*
+* Returns the level, computing it and the levels before it from the current
+* frame if they are not built yet.
+*/
+const Image& ImagePyramid::level(int index) {
+  if ((index < 0) || (index >= (int)levels.size())) {
+    std::cout << "Unable to access level " << index << " of a pyramid of "
+              << levels.size() << " levels\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  if (ready == 0) {
+    std::cout << "Unable to access a pyramid before the first frame\n";
+    throw std::invalid_argument("Invalid pyramid.");
+  }
+  for (; ready <= index; ready++) {
+    pyrDown(levels[ready - 1], levels[ready]);
+  }
+  return levels[index];
+}
+
+/******************************************************************************
+* FUNCTIONS                                                                   *
+******************************************************************************/
+
+/*
+* Sets out to the next level of the pyramid of the input. The output may be
+* the input itself, in which case the result goes through a temporary.
+*/
+void pyrDown(const Image& in, Image& out) {
+  if (sharesPixels(in, out)) {
+    Image result;
+    pyrDown(in, result);
+    out = std::move(result);
+    return;
+  }
+  out.setSize((in.getWidth() + 1) / 2, (in.getHeight() + 1) / 2,
+              in.getChannels());
+  if ((out.getWidth() > 0) && (out.getHeight() > 0)) {
+    pyrDownRows(in, out);
+  }
+}
+
+Image pyrDown(const Image& in) {
+  Image out;
+  pyrDown(in, out);
+  return out;
+}
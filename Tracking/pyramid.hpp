@@ -0,0 +1,68 @@
+/******************************************************************************
+*                              Image pyramids                                 *
+*                                                                             *
+* A Gaussian pyramid holds an image at successively halved resolutions, for   *
+* multi-scale detection and coarse-to-fine tracking. Level 0 is the image     *
+* itself, and every next level is the previous one blurred with the 5 x 5     *
+* binomial kernel [1 4 6 4 1] / 16 in both directions and then decimated by   *
+* keeping every second row and column, so a level of w x h pixels is followed *
+* by one of (w + 1) / 2 x (h + 1) / 2 pixels. Pixels outside the image are    *
+* reflected (BorderMode::Reflect).                                            *
+*                                                                             *
+* pyrDown() computes one level from the previous one in a single pass: only   *
+* the kept pixels are blurred, so a level costs a quarter of a full blur, and *
+* no blurred image is stored in between. ImagePyramid keeps the arrays of all *
+* levels across frames, so once the first frame has been built no level is    *
+* allocated again while the frame size stays the same:                        *
+*                                                                             *
+*   ImagePyramid pyramid(4);                                                  *
+*   while (camera.read(frame)) {                                              *
+*     pyramid.build(frame);                                                   *
+*     detect(pyramid.level(3));                                               *
+*   }                                                                         *
+*                                                                             *
+* A lazy pyramid only copies the frame in build(), and computes each level    *
+* the first time it, or a level above it, is asked for, so levels that are    *
+* not used for a frame cost nothing.                                          *
+*                                                                             *
+* The sums are vectorized for the instruction set of the elementwise kernels  *
+* and added in the same order for every instruction set, so the levels are    *
+* identical. The rows of large levels are split between the matrix threads.   *
+*                                                                             *
+******************************************************************************/
+#ifndef PYRAMID_HPP
+#define PYRAMID_HPP
+
+#include <vector>
+
+#include "image.hpp"
+
+class ImagePyramid {
+  private:
+    std::vector<Image> levels;
+    int ready;
+    bool lazy;
+
+  public:
+    // Constructor. Levels after the first are built when the frame is given
+    // to build(), or on first access when lazy_levels is true
+    explicit ImagePyramid(int num_levels=4, bool lazy_levels=false);
+
+    // Copies the frame into level 0, reusing the arrays of the previous
+    // frame, and builds the other levels unless the pyramid is lazy
+    void build(const Image& frame);
+
+    // Getter functions. level() computes the level and the ones above it if
+    // the pyramid is lazy and they are not built yet
+    int getLevels() const;
+    bool isLazy() const;
+    bool isBuilt(int index) const;
+    const Image& level(int index);
+};
+
+// Blurs with the binomial kernel and keeps every second row and column,
+// giving an image of (width + 1) / 2 x (height + 1) / 2 pixels
+void pyrDown(const Image& in, Image& out);
+Image pyrDown(const Image& in);
+
+#endif
@@ -0,0 +1,572 @@
+/******************************************************************************
+*                              Reductions                                     *
+*                                                                             *
+* A run of elements, such as a row or a whole contiguous matrix, is reduced  *
+* in blocks of BLOCK elements. Each block is accumulated into LANES separate *
+* minimums, maximums and sums, which the compiler keeps in vector registers, *
+* and the lanes are then combined in a fixed order. Only when a block        *
+* improves the minimum or maximum is it scanned again for the position, which *
+* happens rarely once the first blocks have been seen.                        *
+*                                                                             *
+* Reductions along the axis that is not contiguous in memory, such as the    *
+* columns of a Matrix, instead keep one accumulator per column and update    *
+* all of them for every row, so the rows are still read in order.            *
+*                                                                             *
+* Large inputs are split into chunks of a fixed size that do not depend on   *
+* the number of threads. The chunks run in parallel and their results are    *
+* merged in order.                                                            *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "reduce.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Number of independent accumulators of a run, and elements per block
+static const int LANES = 8;
+static const long BLOCK = 512;
+
+// Positions reduced together across lines, so that their accumulators stay
+// in the first level cache
+static const long ACROSS_BLOCK = 256;
+
+// Elements per chunk of a parallel reduction, a multiple of BLOCK
+static const long CHUNK = PARALLEL_GRAIN;
+
+// Accumulated statistics of a run, with positions as row major offsets
+struct ReduceState {
+  long count;
+  double min;
+  double max;
+  long minAt;
+  long maxAt;
+  double sum;
+  double squares;
+  double shifted;
+  double shiftedSquares;
+};
+
+// Accumulators of the reductions across lines, one element per position
+struct AcrossState {
+  const double* shift;
+  double* min;
+  double* max;
+  long* minAt;
+  long* maxAt;
+  double* sum;
+  double* squares;
+  double* shifted;
+  double* shiftedSquares;
+};
+
+/******************************************************************************
+* KERNELS                                                                     *
+******************************************************************************/
+
+/*
+* Adds n elements read from x with the given stride to the state. Element k
+* has the row major position position + k*step.
+*/
+static ALWAYS_INLINE void reduceRunBody(const double* x, long n, long stride,
+                                        double shift, long position,
+                                        long step, ReduceState& state) {
+  for (long start = 0; start < n; start += BLOCK) {
+    long length = std::min(BLOCK, n - start);
+    const double* block = x + start*stride;
+    double low[LANES];
+    double high[LANES];
+    double sum[LANES];
+    double squares[LANES];
+    double shifted[LANES];
+    double shiftedSquares[LANES];
+    for (int l = 0; l < LANES; l++) {
+      low[l] = std::numeric_limits<double>::infinity();
+      high[l] = -std::numeric_limits<double>::infinity();
+      sum[l] = 0;
+      squares[l] = 0;
+      shifted[l] = 0;
+      shiftedSquares[l] = 0;
+    }
+    auto add = [&](int l, double value) {
+      low[l] = (value < low[l]) ? value : low[l];
+      high[l] = (value > high[l]) ? value : high[l];
+      sum[l] += value;
+      squares[l] += value * value;
+      double difference = value - shift;
+      shifted[l] += difference;
+      shiftedSquares[l] += difference * difference;
+    };
+    long full = length - length % LANES;
+    if (stride == 1) {
+      for (long k = 0; k < full; k += LANES) {
+        for (int l = 0; l < LANES; l++) {
+          add(l, block[k + l]);
+        }
+      }
+    } else {
+      for (long k = 0; k < full; k += LANES) {
+        for (int l = 0; l < LANES; l++) {
+          add(l, block[(k + l)*stride]);
+        }
+      }
+    }
+    for (long k = full; k < length; k++) {
+      add((int)(k - full), block[k*stride]);
+    }
+
+    // Combine the lanes in a fixed order
+    double blockLow = low[0];
+    double blockHigh = high[0];
+    for (int l = 1; l < LANES; l++) {
+      blockLow = (low[l] < blockLow) ? low[l] : blockLow;
+      blockHigh = (high[l] > blockHigh) ? high[l] : blockHigh;
+    }
+    for (int width = LANES / 2; width > 0; width /= 2) {
+      for (int l = 0; l < width; l++) {
+        sum[l] += sum[l + width];
+        squares[l] += squares[l + width];
+        shifted[l] += shifted[l + width];
+        shiftedSquares[l] += shiftedSquares[l + width];
+      }
+    }
+    state.count += length;
+    state.sum += sum[0];
+    state.squares += squares[0];
+    state.shifted += shifted[0];
+    state.shiftedSquares += shiftedSquares[0];
+
+    // Find the first position of a new minimum or maximum. A block of only
+    // NaN has no position, and an infinite minimum or maximum is only taken
+    // when none has been found yet
+    if ((blockLow < state.min) || (state.minAt == -1)) {
+      long k = 0;
+      while ((k < length) && (block[k*stride] != blockLow)) {
+        k++;
+      }
+      if (k < length) {
+        state.min = blockLow;
+        state.minAt = position + (start + k)*step;
+      }
+    }
+    if ((blockHigh > state.max) || (state.maxAt == -1)) {
+      long k = 0;
+      while ((k < length) && (block[k*stride] != blockHigh)) {
+        k++;
+      }
+      if (k < length) {
+        state.max = blockHigh;
+        state.maxAt = position + (start + k)*step;
+      }
+    }
+  }
+}
+
+/*
+* Adds element j of line i to the accumulator of position j, for the
+* positions begin to end - 1. The accumulators never overlap and are updated
+* without branches, which lets the loop be vectorized.
+*/
+static ALWAYS_INLINE void reduceAcrossLine(const double* __restrict line,
+                                           long i, long begin, long end,
+                                           long elementStride,
+                                           const double* __restrict shift,
+                                           double* __restrict min,
+                                           double* __restrict max,
+                                           long* __restrict minAt,
+                                           long* __restrict maxAt,
+                                           double* __restrict sum,
+                                           double* __restrict squares,
+                                           double* __restrict shifted,
+                                           double* __restrict shiftedSquares) {
+  for (long j = begin; j < end; j++) {
+    double value = line[j*elementStride];
+    bool number = (value == value);
+    bool below = (value < min[j]) | ((minAt[j] == -1) & number);
+    bool above = (value > max[j]) | ((maxAt[j] == -1) & number);
+    minAt[j] = below ? i : minAt[j];
+    min[j] = below ? value : min[j];
+    maxAt[j] = above ? i : maxAt[j];
+    max[j] = above ? value : max[j];
+    sum[j] += value;
+    squares[j] += value * value;
+    double difference = value - shift[j];
+    shifted[j] += difference;
+    shiftedSquares[j] += difference * difference;
+  }
+}
+
+/*
+* Adds element j of each of the lines to the accumulator of position j, for
+* the positions begin to end - 1. Element j of line i is read from
+* data[i*lineStride + j*elementStride].
+*/
+static ALWAYS_INLINE void reduceAcrossBody(const double* data, long lines,
+                                           long lineStride, long begin,
+                                           long end, long elementStride,
+                                           const AcrossState& state) {
+  for (long i = 0; i < lines; i++) {
+    reduceAcrossLine(data + i*lineStride, i, begin, end, elementStride,
+                     state.shift, state.min, state.max, state.minAt,
+                     state.maxAt, state.sum, state.squares, state.shifted,
+                     state.shiftedSquares);
+  }
+}
+
+typedef void (*RunKernel)(const double* x, long n, long stride, double shift,
+                          long position, long step, ReduceState& state);
+typedef void (*AcrossKernel)(const double* data, long lines, long lineStride,
+                             long begin, long end, long elementStride,
+                             const AcrossState& state);
+
+struct ReduceKernels {
+  RunKernel run;
+  AcrossKernel across;
+};
+
+// Defines the kernels for one instruction set
+#define REDUCE_KERNELS(ISA, TARGET)                                           \
+  TARGET static void run_##ISA(const double* x, long n, long stride,         \
+                               double shift, long position, long step,        \
+                               ReduceState& state) {                          \
+    reduceRunBody(x, n, stride, shift, position, step, state);                \
+  }                                                                           \
+  TARGET static void across_##ISA(const double* data, long lines,            \
+                                  long lineStride, long begin, long end,      \
+                                  long elementStride,                         \
+                                  const AcrossState& state) {                 \
+    reduceAcrossBody(data, lines, lineStride, begin, end, elementStride,      \
+                     state);                                                  \
+  }                                                                           \
+  static const ReduceKernels reduceKernels_##ISA = {                          \
+    run_##ISA, across_##ISA                                                   \
+  };
+
+INSTANTIATE_KERNELS(REDUCE_KERNELS)
+
+/*
+* Returns the kernels for the instruction set of the elementwise kernels.
+*/
+static const ReduceKernels& reduceKernels() {
+  SELECT_KERNELS(reduceKernels)
+}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns a state without any elements.
+*/
+static ReduceState emptyState() {
+  ReduceState state;
+  state.count = 0;
+  state.min = std::numeric_limits<double>::infinity();
+  state.max = -std::numeric_limits<double>::infinity();
+  state.minAt = -1;
+  state.maxAt = -1;
+  state.sum = 0;
+  state.squares = 0;
+  state.shifted = 0;
+  state.shiftedSquares = 0;
+  return state;
+}
+
+/*
+* Adds the state of the elements that follow into the state of the elements
+* before them, so ties keep the earlier position.
+*/
+static void mergeState(ReduceState& into, const ReduceState& from) {
+  into.count += from.count;
+  if ((from.min < into.min) || ((into.minAt == -1) && (from.minAt != -1))) {
+    into.min = from.min;
+    into.minAt = from.minAt;
+  }
+  if ((from.max > into.max) || ((into.maxAt == -1) && (from.maxAt != -1))) {
+    into.max = from.max;
+    into.maxAt = from.maxAt;
+  }
+  into.sum += from.sum;
+  into.squares += from.squares;
+  into.shifted += from.shifted;
+  into.shiftedSquares += from.shiftedSquares;
+}
+
+/*
+* Returns the statistics of the given sums. Positions are converted to
+* (row, column) with the given number of columns.
+*/
+static Statistics finish(long count, double min, double max, long minAt,
+                         long maxAt, double sum, double squares, double shift,
+                         double shifted, double shiftedSquares, long cols) {
+  Statistics result;
+  result.count = count;
+  result.sum = sum;
+  result.sumSquares = squares;
+  result.min = std::numeric_limits<double>::quiet_NaN();
+  result.max = std::numeric_limits<double>::quiet_NaN();
+  result.minIndex.r = result.minIndex.c = -1;
+  result.maxIndex.r = result.maxIndex.c = -1;
+  if (minAt != -1) {
+    result.min = min;
+    result.minIndex.r = (int)(minAt / cols);
+    result.minIndex.c = (int)(minAt % cols);
+  }
+  if (maxAt != -1) {
+    result.max = max;
+    result.maxIndex.r = (int)(maxAt / cols);
+    result.maxIndex.c = (int)(maxAt % cols);
+  }
+  if (count == 0) {
+    result.mean = std::numeric_limits<double>::quiet_NaN();
+    result.variance = std::numeric_limits<double>::quiet_NaN();
+  } else {
+    result.mean = shift + shifted / count;
+    result.variance = std::max(0.0, (shiftedSquares - shifted*shifted/count) /
+                                    count);
+  }
+  return result;
+}
+
+/*
+* Returns the statistics of a state whose shift was the given value.
+*/
+static Statistics finish(const ReduceState& state, double shift, long cols) {
+  return finish(state.count, state.min, state.max, state.minAt, state.maxAt,
+                state.sum, state.squares, shift, state.shifted,
+                state.shiftedSquares, cols);
+}
+
+/*
+* Prints an error and throws if the axis is not 0 or 1.
+*/
+static void checkAxis(int axis) {
+  if ((axis != 0) && (axis != 1)) {
+    std::cout << "Invalid axis " << axis << " for a reduction, which must be "
+              << "0 for columns or 1 for rows\n";
+    throw std::invalid_argument("Invalid axis for reduction.");
+  }
+}
+
+/*
+* Reduces each of the lines separately, where element k of line i is read
+* from data[i*lineStride + k*elementStride] and has the row major position
+* i*lineStep + k*elementStep.
+*/
+static void reduceLines(const double* data, long lines, long length,
+                        long lineStride, long elementStride, long lineStep,
+                        long elementStep, long cols,
+                        std::vector<Statistics>& results) {
+  const ReduceKernels& kernel = reduceKernels();
+  results.resize(lines);
+  parallelFor(lines, CHUNK / std::max(1L, length) + 1,
+              [&](long begin, long end) {
+    for (long i = begin; i < end; i++) {
+      const double* line = data + i*lineStride;
+      ReduceState state = emptyState();
+      double shift = (length > 0) ? line[0] : 0;
+      kernel.run(line, length, elementStride, shift, i*lineStep, elementStep,
+                 state);
+      results[i] = finish(state, shift, cols);
+    }
+  });
+}
+
+/*
+* Reduces element j of all lines together, for every position j, where
+* element j of line i is read from data[i*lineStride + j*elementStride]. The
+* positions of the minimum and maximum are (i, j) for per column results and
+* (j, i) otherwise.
+*/
+static void reduceAcross(const double* data, long lines, long length,
+                         long lineStride, long elementStride, bool perColumn,
+                         std::vector<Statistics>& results) {
+  std::vector<double> shift(length);
+  std::vector<double> min(length, std::numeric_limits<double>::infinity());
+  std::vector<double> max(length, -std::numeric_limits<double>::infinity());
+  std::vector<long> minAt(length, -1);
+  std::vector<long> maxAt(length, -1);
+  std::vector<double> sum(length, 0);
+  std::vector<double> squares(length, 0);
+  std::vector<double> shifted(length, 0);
+  std::vector<double> shiftedSquares(length, 0);
+  for (long j = 0; j < length; j++) {
+    shift[j] = (lines > 0) ? data[j*elementStride] : 0;
+  }
+  AcrossState state = {shift.data(), min.data(), max.data(), minAt.data(),
+                       maxAt.data(), sum.data(), squares.data(),
+                       shifted.data(), shiftedSquares.data()};
+  const ReduceKernels& kernel = reduceKernels();
+  parallelFor(length, CHUNK / std::max(1L, lines) + 1,
+              [&](long begin, long end) {
+    for (long first = begin; first < end; first += ACROSS_BLOCK) {
+      kernel.across(data, lines, lineStride, first,
+                    std::min(end, first + ACROSS_BLOCK), elementStride, state);
+    }
+  });
+
+  results.resize(length);
+  for (long j = 0; j < length; j++) {
+    Statistics& result = results[j];
+    result = finish(lines, min[j], max[j], minAt[j], maxAt[j], sum[j],
+                    squares[j], shift[j], shifted[j], shiftedSquares[j], 1);
+    if (perColumn) {
+      result.minIndex.c = (minAt[j] != -1) ? (int)j : -1;
+      result.maxIndex.c = (maxAt[j] != -1) ? (int)j : -1;
+    } else {
+      result.minIndex.c = result.minIndex.r;
+      result.maxIndex.c = result.maxIndex.r;
+      result.minIndex.r = (minAt[j] != -1) ? (int)j : -1;
+      result.maxIndex.r = (maxAt[j] != -1) ? (int)j : -1;
+    }
+  }
+}
+
+/******************************************************************************
+* REDUCTIONS                                                                  *
+******************************************************************************/
+
+/*
+* Returns the statistics of all elements of the matrix or view.
+*/
+Statistics reduce(const MatrixView& mat) {
+  const ReduceKernels& kernel = reduceKernels();
+  long rows = mat.getRows();
+  long cols = mat.getColumns();
+  long rowStride = mat.getRowStride();
+  long colStride = mat.getColumnStride();
+  const double* data = mat.getData();
+  double shift = (rows*cols > 0) ? data[0] : 0;
+
+  // A contiguous matrix is one run, split into chunks of CHUNK elements, and
+  // other views are split into chunks of whole rows
+  bool contiguous = mat.isContiguous();
+  long units = contiguous ? rows*cols : rows;
+  long unitsPerChunk = contiguous ? CHUNK : CHUNK / std::max(1L, cols) + 1;
+  auto reduceUnits = [&](long begin, long end, ReduceState& state) {
+    if (contiguous) {
+      kernel.run(data + begin, end - begin, 1, shift, begin, 1, state);
+      return;
+    }
+    for (long i = begin; i < end; i++) {
+      kernel.run(data + i*rowStride, cols, colStride, shift, i*cols, 1,
+                 state);
+    }
+  };
+
+  ReduceState state = emptyState();
+  long chunks = (units + unitsPerChunk - 1) / unitsPerChunk;
+  if (chunks <= 1) {
+    reduceUnits(0, units, state);
+    return finish(state, shift, cols);
+  }
+  std::vector<ReduceState> states(chunks, emptyState());
+  parallelFor(chunks, 1, [&](long begin, long end) {
+    for (long c = begin; c < end; c++) {
+      reduceUnits(c*unitsPerChunk, std::min(units, (c + 1)*unitsPerChunk),
+                  states[c]);
+    }
+  });
+  for (long c = 0; c < chunks; c++) {
+    mergeState(state, states[c]);
+  }
+  return finish(state, shift, cols);
+}
+
+/*
+* Returns the statistics of every column (axis 0) or every row (axis 1) of
+* the matrix or view.
+*/
+std::vector<Statistics> reduce(const MatrixView& mat, int axis) {
+  checkAxis(axis);
+  long rows = mat.getRows();
+  long cols = mat.getColumns();
+  long rowStride = mat.getRowStride();
+  long colStride = mat.getColumnStride();
+  const double* data = mat.getData();
+  std::vector<Statistics> results;
+
+  // Each row or column is reduced as a run when its elements are next to
+  // each other in memory, and otherwise all of them are reduced together
+  if (axis == 1) {
+    if ((colStride == 1) || (rowStride != 1)) {
+      reduceLines(data, rows, cols, rowStride, colStride, cols, 1, cols,
+                  results);
+    } else {
+      reduceAcross(data, cols, rows, colStride, rowStride, false, results);
+    }
+  } else {
+    if ((rowStride == 1) && (colStride != 1)) {
+      reduceLines(data, cols, rows, colStride, rowStride, 1, cols, cols,
+                  results);
+    } else {
+      reduceAcross(data, rows, cols, rowStride, colStride, true, results);
+    }
+  }
+  return results;
+}
+
+/******************************************************************************
+* STATISTICS ALONG AN AXIS                                                    *
+******************************************************************************/
+
+/*
+* Collects one statistic of every column (axis 0) or every row (axis 1) into
+* a row or a column, so that it broadcasts against the reduced matrix.
+*/
+template <typename Select>
+static Matrix collect(const MatrixView& mat, int axis, Select select) {
+  std::vector<Statistics> statistics = reduce(mat, axis);
+  int count = (int)statistics.size();
+  Matrix result = (axis == 0) ? Matrix(1, count) : Matrix(count, 1);
+  double* data = result.getData();
+  for (int i = 0; i < count; i++) {
+    data[i] = select(statistics[i]);
+  }
+  return result;
+}
+
+/*
+* Collects the position of the minimum or maximum of every column (axis 0)
+* or every row (axis 1), counted along the axis. Lines without any number
+* give -1.
+*/
+static std::vector<int> collectPositions(const MatrixView& mat, int axis,
+                                         bool maximum) {
+  std::vector<Statistics> statistics = reduce(mat, axis);
+  std::vector<int> positions(statistics.size());
+  for (size_t i = 0; i < statistics.size(); i++) {
+    struct index at = maximum ? statistics[i].maxIndex :
+                                statistics[i].minIndex;
+    positions[i] = (axis == 0) ? at.r : at.c;
+  }
+  return positions;
+}
+
+Matrix sum(const MatrixView& mat, int axis) {
+  return collect(mat, axis, [](const Statistics& s) { return s.sum; });
+}
+
+Matrix mean(const MatrixView& mat, int axis) {
+  return collect(mat, axis, [](const Statistics& s) { return s.mean; });
+}
+
+Matrix min(const MatrixView& mat, int axis) {
+  return collect(mat, axis, [](const Statistics& s) { return s.min; });
+}
+
+Matrix max(const MatrixView& mat, int axis) {
+  return collect(mat, axis, [](const Statistics& s) { return s.max; });
+}
+
+std::vector<int> argmin(const MatrixView& mat, int axis) {
+  return collectPositions(mat, axis, false);
+}
+
+std::vector<int> argmax(const MatrixView& mat, int axis) {
+  return collectPositions(mat, axis, true);
+}
@@ -0,0 +1,61 @@
+/******************************************************************************
+*                              Reductions                                     *
+*                                                                             *
+* Computes the minimum and maximum with their positions, the sum, the sum of  *
+* squares, the mean and the variance of a matrix in a single pass over its   *
+* elements, instead of one pass per statistic. The whole matrix, any view or *
+* block of it, or every row or column separately can be reduced:            *
+*                                                                             *
+*   Statistics peak = reduce(response);                                       *
+*   Statistics window = reduce(response.block(10, 41, 10, 41));               *
+*   std::vector<Statistics> perColumn = reduce(features, 0);                 *
+*                                                                             *
+* The axis follows NumPy: axis 0 reduces over the rows and gives one result  *
+* per column, and axis 1 gives one result per row. Positions are relative to  *
+* the reduced view, and ties go to the first element in row major order.     *
+* NaN elements are ignored by the minimum and maximum, but make the sums     *
+* NaN. The variance is the population variance, computed from sums shifted   *
+* by the first element so that large offsets do not cancel.                 *
+*                                                                             *
+* sum(), mean(), min(), max(), argmin() and argmax() return one statistic    *
+* along an axis. The statistics are kept as a row or a column, so they can be *
+* used directly in broadcasting expressions:                                  *
+*                                                                             *
+*   Matrix centered = features - mean(features, 0);                           *
+*                                                                             *
+* The elements are summed in a fixed order in blocks of eight lanes, so the  *
+* results are identical for every instruction set and number of threads.     *
+*                                                                             *
+******************************************************************************/
+#ifndef REDUCE_HPP
+#define REDUCE_HPP
+
+#include <vector>
+
+#include "matrix.hpp"
+
+struct Statistics {
+  long count;
+  double min;
+  double max;
+  struct index minIndex;
+  struct index maxIndex;
+  double sum;
+  double sumSquares;
+  double mean;
+  double variance;
+};
+
+Statistics reduce(const MatrixView& mat);
+std::vector<Statistics> reduce(const MatrixView& mat, int axis);
+
+// Single statistics along an axis, shaped (1, columns) for axis 0 and
+// (rows, 1) for axis 1 so that they broadcast against the reduced matrix
+Matrix sum(const MatrixView& mat, int axis);
+Matrix mean(const MatrixView& mat, int axis);
+Matrix min(const MatrixView& mat, int axis);
+Matrix max(const MatrixView& mat, int axis);
+std::vector<int> argmin(const MatrixView& mat, int axis);
+std::vector<int> argmax(const MatrixView& mat, int axis);
+
+#endif
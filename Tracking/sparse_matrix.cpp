@@ -0,0 +1,572 @@
+/******************************************************************************
+*                            Sparse matrix                                    *
+*                                                                             *
+* CSR and CSC are handled by the same code: a CSR matrix is a list of rows   *
+* (the outer dimension) that each hold sorted column indices (the inner       *
+* dimension), and a CSC matrix the other way around. Converting between the *
+* formats is a counting sort on the inner indices, which also sorts the       *
+* indices of every row or column. Triplets are put in order with the same    *
+* sort applied twice, after which duplicates are next to each other and are  *
+* summed.                                                                     *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <cmath>
+
+#include "sparse_matrix.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Prints an error and throws if the sizes of two sparse matrices differ.
+*/
+static void checkSameSize(const SparseMatrix& left, const SparseMatrix& right,
+                          const char* operation) {
+  if ((left.getRows() != right.getRows()) ||
+      (left.getColumns() != right.getColumns())) {
+    std::cout << "Unable to " << operation << " sparse matrices with "
+              << "differing dimensions: (" << left.getRows() << ", "
+              << left.getColumns() << ") and (" << right.getRows() << ", "
+              << right.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+}
+
+/*
+* Returns right in the format of left, converting it into converted when the
+* formats differ.
+*/
+static const SparseMatrix& inFormatOf(const SparseMatrix& left,
+                                      const SparseMatrix& right,
+                                      SparseMatrix& converted) {
+  if (right.getFormat() == left.getFormat()) {
+    return right;
+  }
+  converted = (left.getFormat() == SparseFormat::CSR) ? right.toCSR()
+                                                      : right.toCSC();
+  return converted;
+}
+
+/*
+* Combines two compressed matrices with the same outer size, one outer index
+* at a time. Inner indices stored in only one of them are combined with zero
+* when keepUnion is set and skipped otherwise, and results that are exactly
+* zero are not stored.
+*/
+template <typename Operation>
+static void mergeCompressed(int outer, const long* aStarts, const int* aIndices,
+                            const double* aValues, const long* bStarts,
+                            const int* bIndices, const double* bValues,
+                            bool keepUnion, Operation operation,
+                            std::vector<long>& starts,
+                            std::vector<int>& indices,
+                            std::vector<double>& values) {
+  long aCount = aStarts[outer];
+  long bCount = bStarts[outer];
+  long capacity = keepUnion ? aCount + bCount : std::min(aCount, bCount);
+  starts.assign(outer + 1, 0);
+  indices.clear();
+  values.clear();
+  indices.reserve(capacity);
+  values.reserve(capacity);
+  for (int o = 0; o < outer; o++) {
+    long a = aStarts[o];
+    long b = bStarts[o];
+    while ((a < aStarts[o + 1]) || (b < bStarts[o + 1])) {
+      int index;
+      double value;
+      if ((b == bStarts[o + 1]) ||
+          ((a < aStarts[o + 1]) && (aIndices[a] < bIndices[b]))) {
+        index = aIndices[a];
+        value = operation(aValues[a++], 0.0);
+        if (!keepUnion) {
+          continue;
+        }
+      } else if ((a == aStarts[o + 1]) || (bIndices[b] < aIndices[a])) {
+        index = bIndices[b];
+        value = operation(0.0, bValues[b++]);
+        if (!keepUnion) {
+          continue;
+        }
+      } else {
+        index = aIndices[a];
+        value = operation(aValues[a++], bValues[b++]);
+      }
+      if (value != 0) {
+        indices.push_back(index);
+        values.push_back(value);
+      }
+    }
+    starts[o + 1] = (long)indices.size();
+  }
+}
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+SparseMatrix::SparseMatrix() :
+  rows(0),
+  cols(0),
+  format(SparseFormat::CSR),
+  starts(1, 0)
+{}
+
+/*
+* Creates a sparse matrix of the given size without any nonzeros.
+*/
+SparseMatrix::SparseMatrix(int num_rows, int num_columns,
+                           SparseFormat sparse_format) :
+  rows(num_rows),
+  cols(num_columns),
+  format(sparse_format)
+{
+  if ((rows < 0) || (cols < 0)) {
+    std::cout << "Unable to create a sparse matrix of size (" << rows << ", "
+              << cols << ")\n";
+    throw std::invalid_argument("Invalid sparse matrix size.");
+  }
+  starts.assign(getOuter() + 1, 0);
+}
+
+/******************************************************************************
+* STATIC METHODS                                                              *
+******************************************************************************/
+
+/*
+* Creates a sparse matrix from the elements of a matrix or view whose
+* magnitude is larger than tolerance.
+*/
+SparseMatrix SparseMatrix::fromDense(const MatrixView& mat,
+                                     SparseFormat sparse_format,
+                                     double tolerance) {
+  SparseMatrix result(mat.getRows(), mat.getColumns(), sparse_format);
+  bool csr = (sparse_format == SparseFormat::CSR);
+  long outerStride = csr ? mat.getRowStride() : mat.getColumnStride();
+  long innerStride = csr ? mat.getColumnStride() : mat.getRowStride();
+  const double* data = mat.getData();
+  for (int o = 0; o < result.getOuter(); o++) {
+    const double* line = data + o*outerStride;
+    for (int i = 0; i < result.getInner(); i++) {
+      double value = line[i*innerStride];
+      if (!(std::fabs(value) <= tolerance)) {
+        result.indices.push_back(i);
+        result.values.push_back(value);
+      }
+    }
+    result.starts[o + 1] = (long)result.indices.size();
+  }
+  return result;
+}
+
+/*
+* Creates a sparse matrix from (row, column, value) triplets in any order.
+* The values of repeated positions are summed.
+*/
+SparseMatrix SparseMatrix::fromTriplets(int num_rows, int num_columns,
+                                        long count, const int rowIndices[],
+                                        const int columnIndices[],
+                                        const double entries[],
+                                        SparseFormat sparse_format) {
+  // Sort by the inner index into the other format
+  bool csr = (sparse_format == SparseFormat::CSR);
+  SparseMatrix sorted(num_rows, num_columns,
+                      csr ? SparseFormat::CSC : SparseFormat::CSR);
+  int outer = sorted.getOuter();
+  const int* outerIndices = csr ? columnIndices : rowIndices;
+  const int* innerIndices = csr ? rowIndices : columnIndices;
+  for (long k = 0; k < count; k++) {
+    if ((rowIndices[k] < 0) || (rowIndices[k] >= num_rows) ||
+        (columnIndices[k] < 0) || (columnIndices[k] >= num_columns)) {
+      std::cout << "Invalid index (" << rowIndices[k] << ", "
+                << columnIndices[k] << ") for sparse matrix with size ("
+                << num_rows << ", " << num_columns << ")\n";
+      throw std::invalid_argument("Invalid index.");
+    }
+  }
+  sorted.starts.assign(outer + 2, 0);
+  for (long k = 0; k < count; k++) {
+    sorted.starts[outerIndices[k] + 2]++;
+  }
+  for (int o = 2; o < outer + 2; o++) {
+    sorted.starts[o] += sorted.starts[o - 1];
+  }
+  sorted.indices.resize(count);
+  sorted.values.resize(count);
+  for (long k = 0; k < count; k++) {
+    long position = sorted.starts[outerIndices[k] + 1]++;
+    sorted.indices[position] = innerIndices[k];
+    sorted.values[position] = entries[k];
+  }
+  sorted.starts.pop_back();
+
+  // Sorting back orders the indices of every row or column, and repeated
+  // positions become neighbours that are summed
+  SparseMatrix result = sorted.compressedTranspose();
+  long kept = 0;
+  for (int o = 0; o < result.getOuter(); o++) {
+    long begin = result.starts[o];
+    result.starts[o] = kept;
+    for (long k = begin; k < result.starts[o + 1]; k++) {
+      if ((kept > result.starts[o]) &&
+          (result.indices[kept - 1] == result.indices[k])) {
+        result.values[kept - 1] += result.values[k];
+      } else {
+        result.indices[kept] = result.indices[k];
+        result.values[kept] = result.values[k];
+        kept++;
+      }
+    }
+  }
+  result.starts[result.getOuter()] = kept;
+  result.indices.resize(kept);
+  result.values.resize(kept);
+  return result;
+}
+
+/*
+* Multiplies a sparse matrix with a dense matrix, view or column vector. In
+* CSR format the rows of the result are split between the threads, and in CSC
+* format its columns.
+*/
+Matrix SparseMatrix::multiply(const SparseMatrix& left,
+                              const MatrixView& right) {
+  if (left.getColumns() != right.getRows()) {
+    std::cout << "Unable to multiply matrices with incompatible dimensions: ("
+              << left.getRows() << ", " << left.getColumns() << ") x ("
+              << right.getRows() << ", " << right.getColumns() << ")\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  int n = right.getColumns();
+  const double* b = right.getData();
+  long bRowStride = right.getRowStride();
+  long bColStride = right.getColumnStride();
+  const long* starts = left.starts.data();
+  const int* indices = left.indices.data();
+  const double* values = left.values.data();
+
+  if (left.format == SparseFormat::CSR) {
+    Matrix result(left.rows, n);
+    double* out = result.getData();
+    long rowWork = (left.getNonZeros() / std::max(left.rows, 1) + 1) * n;
+    parallelFor(left.rows, PARALLEL_GRAIN / std::max(1L, rowWork) + 1,
+                [&](long begin, long end) {
+      for (long i = begin; i < end; i++) {
+        double* row = out + i*n;
+        if (n == 1) {
+          double total = 0;
+          for (long k = starts[i]; k < starts[i + 1]; k++) {
+            total += values[k] * b[indices[k]*bRowStride];
+          }
+          row[0] = total;
+          continue;
+        }
+        std::fill(row, row + n, 0.0);
+        for (long k = starts[i]; k < starts[i + 1]; k++) {
+          double value = values[k];
+          const double* bRow = b + indices[k]*bRowStride;
+          if (bColStride == 1) {
+            for (int c = 0; c < n; c++) {
+              row[c] += value * bRow[c];
+            }
+          } else {
+            for (int c = 0; c < n; c++) {
+              row[c] += value * bRow[c*bColStride];
+            }
+          }
+        }
+      }
+    });
+    return result;
+  }
+
+  Matrix result = Matrix::zeros(left.rows, n);
+  double* out = result.getData();
+  long columnWork = left.getNonZeros() + 1;
+  parallelFor(n, PARALLEL_GRAIN / columnWork + 1,
+              [&](long begin, long end) {
+    for (int j = 0; j < left.cols; j++) {
+      const double* bRow = b + j*bRowStride;
+      for (long k = starts[j]; k < starts[j + 1]; k++) {
+        double value = values[k];
+        double* row = out + (long)indices[k]*n;
+        for (long c = begin; c < end; c++) {
+          row[c] += value * bRow[c*bColStride];
+        }
+      }
+    }
+  });
+  return result;
+}
+
+/*
+* Adds two sparse matrices. The result has the format of the left matrix and
+* stores the union of their nonzeros.
+*/
+SparseMatrix SparseMatrix::add(const SparseMatrix& left,
+                               const SparseMatrix& right) {
+  checkSameSize(left, right, "add");
+  SparseMatrix converted;
+  const SparseMatrix& other = inFormatOf(left, right, converted);
+  SparseMatrix result(left.rows, left.cols, left.format);
+  mergeCompressed(left.getOuter(), left.starts.data(), left.indices.data(),
+                  left.values.data(), other.starts.data(),
+                  other.indices.data(), other.values.data(), true,
+                  [](double a, double b) { return a + b; }, result.starts,
+                  result.indices, result.values);
+  return result;
+}
+
+/*
+* Subtracts the right sparse matrix from the left. The result has the format
+* of the left matrix and stores the union of their nonzeros.
+*/
+SparseMatrix SparseMatrix::subtract(const SparseMatrix& left,
+                                    const SparseMatrix& right) {
+  checkSameSize(left, right, "subtract");
+  SparseMatrix converted;
+  const SparseMatrix& other = inFormatOf(left, right, converted);
+  SparseMatrix result(left.rows, left.cols, left.format);
+  mergeCompressed(left.getOuter(), left.starts.data(), left.indices.data(),
+                  left.values.data(), other.starts.data(),
+                  other.indices.data(), other.values.data(), true,
+                  [](double a, double b) { return a - b; }, result.starts,
+                  result.indices, result.values);
+  return result;
+}
+
+/*
+* Multiplies two sparse matrices elementwise. The result has the format of
+* the left matrix and only stores the positions that are nonzero in both.
+*/
+SparseMatrix SparseMatrix::multiplyElementwise(const SparseMatrix& left,
+                                               const SparseMatrix& right) {
+  checkSameSize(left, right, "multiply");
+  SparseMatrix converted;
+  const SparseMatrix& other = inFormatOf(left, right, converted);
+  SparseMatrix result(left.rows, left.cols, left.format);
+  mergeCompressed(left.getOuter(), left.starts.data(), left.indices.data(),
+                  left.values.data(), other.starts.data(),
+                  other.indices.data(), other.values.data(), false,
+                  [](double a, double b) { return a * b; }, result.starts,
+                  result.indices, result.values);
+  return result;
+}
+
+/******************************************************************************
+* GETTER FUNCTIONS                                                            *
+******************************************************************************/
+
+int SparseMatrix::getRows() const {
+  return rows;
+}
+
+int SparseMatrix::getColumns() const {
+  return cols;
+}
+
+SparseFormat SparseMatrix::getFormat() const {
+  return format;
+}
+
+long SparseMatrix::getNonZeros() const {
+  return (long)values.size();
+}
+
+/*
+* Returns the getOuter() + 1 offsets of the rows (CSR) or columns (CSC) into
+* the indices and values.
+*/
+const long* SparseMatrix::getStarts() const {
+  return starts.data();
+}
+
+/*
+* Returns the column (CSR) or row (CSC) index of every nonzero.
+*/
+const int* SparseMatrix::getIndices() const {
+  return indices.data();
+}
+
+double* SparseMatrix::getValues() {
+  return values.data();
+}
+
+const double* SparseMatrix::getValues() const {
+  return values.data();
+}
+
+/*
+* Returns the number of rows in CSR format and of columns in CSC format.
+*/
+int SparseMatrix::getOuter() const {
+  return (format == SparseFormat::CSR) ? rows : cols;
+}
+
+int SparseMatrix::getInner() const {
+  return (format == SparseFormat::CSR) ? cols : rows;
+}
+
+/******************************************************************************
+* CONVERSIONS                                                                 *
+******************************************************************************/
+
+/*
+* Returns the same matrix in the other format, with a counting sort on the
+* inner indices.
+*/
+SparseMatrix SparseMatrix::compressedTranspose() const {
+  SparseMatrix result(rows, cols, (format == SparseFormat::CSR) ?
+                                  SparseFormat::CSC : SparseFormat::CSR);
+  int outer = result.getOuter();
+  result.starts.assign(outer + 2, 0);
+  for (int index : indices) {
+    result.starts[index + 2]++;
+  }
+  for (int o = 2; o < outer + 2; o++) {
+    result.starts[o] += result.starts[o - 1];
+  }
+  result.indices.resize(indices.size());
+  result.values.resize(values.size());
+  for (int o = 0; o < getOuter(); o++) {
+    for (long k = starts[o]; k < starts[o + 1]; k++) {
+      long position = result.starts[indices[k] + 1]++;
+      result.indices[position] = o;
+      result.values[position] = values[k];
+    }
+  }
+  result.starts.pop_back();
+  return result;
+}
+
+/*
+* Returns the matrix as a dense Matrix.
+*/
+Matrix SparseMatrix::toDense() const {
+  Matrix result = Matrix::zeros(rows, cols);
+  double* data = result.getData();
+  bool csr = (format == SparseFormat::CSR);
+  for (int o = 0; o < getOuter(); o++) {
+    for (long k = starts[o]; k < starts[o + 1]; k++) {
+      long position = csr ? (long)o*cols + indices[k]
+                          : (long)indices[k]*cols + o;
+      data[position] = values[k];
+    }
+  }
+  return result;
+}
+
+SparseMatrix SparseMatrix::toCSR() const {
+  return (format == SparseFormat::CSR) ? *this : compressedTranspose();
+}
+
+SparseMatrix SparseMatrix::toCSC() const {
+  return (format == SparseFormat::CSC) ? *this : compressedTranspose();
+}
+
+/*
+* Returns the transpose. The nonzeros are copied without sorting, since the
+* CSR arrays of a matrix are the CSC arrays of its transpose, so the result
+* has the other format.
+*/
+SparseMatrix SparseMatrix::T() const {
+  SparseMatrix result = *this;
+  std::swap(result.rows, result.cols);
+  result.format = (format == SparseFormat::CSR) ? SparseFormat::CSC
+                                                : SparseFormat::CSR;
+  return result;
+}
+
+/*
+* Prints the size and the nonzeros as (row, column) value.
+*/
+void SparseMatrix::print(int decimals) const {
+  std::cout << std::fixed;
+  std::cout << std::setprecision(decimals);
+  std::cout << "Sparse (" << rows << ", " << cols << ") with "
+            << getNonZeros() << " nonzeros\n";
+  bool csr = (format == SparseFormat::CSR);
+  for (int o = 0; o < getOuter(); o++) {
+    for (long k = starts[o]; k < starts[o + 1]; k++) {
+      std::cout << "  (" << (csr ? o : indices[k]) << ", "
+                << (csr ? indices[k] : o) << ") " << values[k] << "\n";
+    }
+  }
+}
+
+/******************************************************************************
+* OPERATORS                                                                   *
+******************************************************************************/
+
+/*
+* Returns the element at the given position, which is zero if it is not
+* stored.
+*/
+double SparseMatrix::operator()(int row, int column) const {
+  if ((row < 0) || (row >= rows) || (column < 0) || (column >= cols)) {
+    std::cout << "Invalid index (" << row << "," << column << ") for sparse "
+              << "matrix with size (" << rows << "," << cols << ")\n";
+    throw std::invalid_argument("Invalid index.");
+  }
+  int o = (format == SparseFormat::CSR) ? row : column;
+  int i = (format == SparseFormat::CSR) ? column : row;
+  const int* begin = indices.data() + starts[o];
+  const int* end = indices.data() + starts[o + 1];
+  const int* found = std::lower_bound(begin, end, i);
+  return ((found != end) && (*found == i)) ? values[found - indices.data()]
+                                           : 0;
+}
+
+/*
+* Multiplies every nonzero by the given number, keeping the nonzeros stored.
+*/
+SparseMatrix& SparseMatrix::operator*=(double num) {
+  double* data = values.data();
+  parallelFor(getNonZeros(), PARALLEL_GRAIN, [&](long begin, long end) {
+    kernels().multiplyScalar(data + begin, data + begin, num, end - begin);
+  });
+  return *this;
+}
+
+/*
+* Divides every nonzero by the given number, keeping the nonzeros stored.
+*/
+SparseMatrix& SparseMatrix::operator/=(double num) {
+  double* data = values.data();
+  parallelFor(getNonZeros(), PARALLEL_GRAIN, [&](long begin, long end) {
+    kernels().divideScalar(data + begin, data + begin, num, end - begin);
+  });
+  return *this;
+}
+
+Matrix operator*(const SparseMatrix& left, const MatrixView& right) {
+  return SparseMatrix::multiply(left, right);
+}
+
+SparseMatrix operator+(const SparseMatrix& left, const SparseMatrix& right) {
+  return SparseMatrix::add(left, right);
+}
+
+SparseMatrix operator-(const SparseMatrix& left, const SparseMatrix& right) {
+  return SparseMatrix::subtract(left, right);
+}
+
+SparseMatrix operator*(const SparseMatrix& mat, double num) {
+  SparseMatrix result = mat;
+  result *= num;
+  return result;
+}
+
+SparseMatrix operator*(double num, const SparseMatrix& mat) {
+  return mat * num;
+}
+
+SparseMatrix operator/(const SparseMatrix& mat, double num) {
+  SparseMatrix result = mat;
+  result /= num;
+  return result;
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+*                            Sparse matrix                                    *
+*                                                                             *
+* A matrix that only stores its nonzero elements, in compressed sparse row    *
+* (CSR) or compressed sparse column (CSC) format. In CSR format, the nonzeros *
+* of row i are values[k] at column indices[k] for k from starts[i] to         *
+* starts[i + 1], with the columns of a row in increasing order. CSC format    *
+* stores the columns the same way. Storage and the time of every operation   *
+* grow with the number of nonzeros, plus one start per row or column.        *
+*                                                                             *
+* Products with dense matrices and vectors return a Matrix and run on the     *
+* matrix threads; CSR splits the rows of the result between the threads and   *
+* is the better format for products with a single vector. Elementwise         *
+* operations keep the result sparse: sums only store the union of the        *
+* nonzeros and elementwise products their intersection, without the zeros    *
+* that cancel out.                                                            *
+*                                                                             *
+*   SparseMatrix jacobian = SparseMatrix::fromDense(H);                       *
+*   Matrix projected = jacobian * covariance;                                 *
+*                                                                             *
+******************************************************************************/
+#ifndef SPARSE_MATRIX_HPP
+#define SPARSE_MATRIX_HPP
+
+#include <vector>
+
+#include "matrix.hpp"
+
+enum class SparseFormat { CSR, CSC };
+
+class SparseMatrix {
+  private:
+    int rows;
+    int cols;
+    SparseFormat format;
+    std::vector<long> starts;
+    std::vector<int> indices;
+    std::vector<double> values;
+
+    int getOuter() const;
+    int getInner() const;
+    SparseMatrix compressedTranspose() const;
+
+  public:
+    // Constructors, where a new sparse matrix is all zeros
+    SparseMatrix();
+    SparseMatrix(int num_rows, int num_columns,
+                 SparseFormat sparse_format=SparseFormat::CSR);
+
+    // Static methods for creating and combining sparse matrices
+    static SparseMatrix fromDense(const MatrixView& mat,
+                                  SparseFormat sparse_format=SparseFormat::CSR,
+                                  double tolerance=0);
+    static SparseMatrix fromTriplets(int num_rows, int num_columns,
+                                     long count, const int rowIndices[],
+                                     const int columnIndices[],
+                                     const double entries[],
+                                     SparseFormat sparse_format=
+                                       SparseFormat::CSR);
+    static Matrix multiply(const SparseMatrix& left, const MatrixView& right);
+    static SparseMatrix add(const SparseMatrix& left,
+                            const SparseMatrix& right);
+    static SparseMatrix subtract(const SparseMatrix& left,
+                                 const SparseMatrix& right);
+    static SparseMatrix multiplyElementwise(const SparseMatrix& left,
+                                            const SparseMatrix& right);
+
+    // Getter functions
+    int getRows() const;
+    int getColumns() const;
+    SparseFormat getFormat() const;
+    long getNonZeros() const;
+    const long* getStarts() const;
+    const int* getIndices() const;
+    double* getValues();
+    const double* getValues() const;
+
+    Matrix toDense() const;
+    SparseMatrix toCSR() const;
+    SparseMatrix toCSC() const;
+    SparseMatrix T() const;
+    void print(int decimals=5) const;
+
+    // Operators
+    double operator()(int row, int column) const;
+    SparseMatrix& operator*=(double num);
+    SparseMatrix& operator/=(double num);
+};
+
+Matrix operator*(const SparseMatrix& left, const MatrixView& right);
+SparseMatrix operator+(const SparseMatrix& left, const SparseMatrix& right);
+SparseMatrix operator-(const SparseMatrix& left, const SparseMatrix& right);
+SparseMatrix operator*(const SparseMatrix& mat, double num);
+SparseMatrix operator*(double num, const SparseMatrix& mat);
+SparseMatrix operator/(const SparseMatrix& mat, double num);
+
+#endif
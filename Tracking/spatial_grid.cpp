@@ -0,0 +1,196 @@
+/******************************************************************************
+*                            Spatial grid                                     *
+*                                                                             *
+* The grid covers the bounding box of the points, and its cells are numbered *
+* row by row. The points are sorted by cell with a counting sort, so the      *
+* points of neighbouring cells in one row of the grid are contiguous, and a   *
+* query visits one contiguous range of points per row of cells it overlaps.  *
+* The coordinates are copied in sorted order to keep those ranges in cache.  *
+* When the points are spread over an area that would need many more cells   *
+* than there are points, the cells are enlarged, so the grid never uses more *
+* than about two cells per point.                                             *
+*                                                                             *
+******************************************************************************/
+#include <cmath>
+
+#include "spatial_grid.hpp"
+
+/******************************************************************************
+* CONSTRUCTORS                                                                *
+******************************************************************************/
+
+SpatialGrid::SpatialGrid() :
+  cellSize(1),
+  originX(0),
+  originY(0),
+  gridColumns(1),
+  gridRows(1),
+  count(0),
+  cellStart(3, 0)
+{}
+
+/******************************************************************************
+* HELPER FUNCTIONS                                                            *
+******************************************************************************/
+
+/*
+* Returns the column of the cell that contains x, clamped to the grid.
+*/
+int SpatialGrid::cellColumn(double x) const {
+  double column = (x - originX) / cellSize;
+  if (!(column >= 0)) {
+    return 0;
+  }
+  return (column >= gridColumns) ? gridColumns - 1 : (int)column;
+}
+
+/*
+* Returns the row of the cell that contains y, clamped to the grid.
+*/
+int SpatialGrid::cellRow(double y) const {
+  double row = (y - originY) / cellSize;
+  if (!(row >= 0)) {
+    return 0;
+  }
+  return (row >= gridRows) ? gridRows - 1 : (int)row;
+}
+
+/******************************************************************************
+* GRID                                                                        *
+******************************************************************************/
+
+/*
+* Sorts the points into a grid with cells of the given size, replacing the
+* previous points.
+*
+* points - The points, one per row, with x in column 0 and y in column 1
+* cell_size - Width of a cell, which is best close to the gating distance
+*/
+void SpatialGrid::build(const MatrixView& points, double cell_size) {
+  if (points.getColumns() < 2) {
+    std::cout << "Unable to build a spatial grid from points with "
+              << points.getColumns() << " coordinates, since the grid needs "
+              << "an x and a y coordinate\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  if (!(cell_size > 0) || !std::isfinite(cell_size)) {
+    std::cout << "Unable to build a spatial grid with cell size "
+              << cell_size << "\n";
+    throw std::invalid_argument("Invalid spatial grid cell size.");
+  }
+  count = points.getRows();
+  const double* data = points.getData();
+  long rowStride = points.getRowStride();
+  long colStride = points.getColumnStride();
+
+  // Bounding box of the finite points
+  double minX = INFINITY;
+  double minY = INFINITY;
+  double maxX = -INFINITY;
+  double maxY = -INFINITY;
+  for (long i = 0; i < count; i++) {
+    double x = data[i*rowStride];
+    double y = data[i*rowStride + colStride];
+    if (std::isfinite(x) && std::isfinite(y)) {
+      minX = std::min(minX, x);
+      maxX = std::max(maxX, x);
+      minY = std::min(minY, y);
+      maxY = std::max(maxY, y);
+    }
+  }
+  if (minX > maxX) {
+    minX = maxX = minY = maxY = 0;
+  }
+
+  // Enlarge the cells until there are at most about two per point. The
+  // extent is halved before subtracting, since the distance between two
+  // finite points can overflow. A cell size that overflows in turn leaves
+  // a single cell, since every extent divided by it is zero
+  double maxCells = 2.0*count + 64;
+  double halfWidth = 0.5*maxX - 0.5*minX;
+  double halfHeight = 0.5*maxY - 0.5*minY;
+  cellSize = cell_size;
+  double width = halfWidth / cellSize * 2 + 1;
+  double height = halfHeight / cellSize * 2 + 1;
+  if (width * height > maxCells) {
+    cellSize *= std::sqrt(width * height / maxCells);
+    width = halfWidth / cellSize * 2 + 1;
+    height = halfHeight / cellSize * 2 + 1;
+    while (std::floor(width) * std::floor(height) > maxCells) {
+      cellSize *= 1.25;
+      width = halfWidth / cellSize * 2 + 1;
+      height = halfHeight / cellSize * 2 + 1;
+    }
+  }
+  originX = minX;
+  originY = minY;
+  gridColumns = (int)width;
+  gridRows = (int)height;
+  long cells = (long)gridColumns * gridRows;
+
+  // Counting sort by cell, counting the points of cell c in cellStart[c + 2]
+  // and then filling cell c from cellStart[c + 1]
+  cellStart.assign(cells + 2, 0);
+  pointCell.resize(count);
+  for (long i = 0; i < count; i++) {
+    double x = data[i*rowStride];
+    double y = data[i*rowStride + colStride];
+    int cell = cellRow(y)*gridColumns + cellColumn(x);
+    pointCell[i] = cell;
+    cellStart[cell + 2]++;
+  }
+  for (long c = 2; c < cells + 2; c++) {
+    cellStart[c] += cellStart[c - 1];
+  }
+  sortedIndex.resize(count);
+  sortedX.resize(count);
+  sortedY.resize(count);
+  for (long i = 0; i < count; i++) {
+    long position = cellStart[pointCell[i] + 1]++;
+    sortedIndex[position] = i;
+    sortedX[position] = data[i*rowStride];
+    sortedY[position] = data[i*rowStride + colStride];
+  }
+}
+
+long SpatialGrid::getCount() const {
+  return count;
+}
+
+/*
+* Returns the size of the cells of the last build, which may be larger than
+* the requested size for widely spread points.
+*/
+double SpatialGrid::getCellSize() const {
+  return cellSize;
+}
+
+/*
+* Replaces the candidates with every pair of a point of the grid and a query
+* that are at most radius apart. Points are the rows and queries the columns
+* of the candidates, and the costs are the squared distances.
+*
+* queries - The query points, one per row, with x in column 0 and y in
+*           column 1
+* radius - The gating distance
+* candidates - Receives the pairs, keeping its storage
+*/
+void SpatialGrid::findPairs(const MatrixView& queries, double radius,
+                            SparseCost& candidates) const {
+  if (queries.getColumns() < 2) {
+    std::cout << "Unable to query a spatial grid with points of "
+              << queries.getColumns() << " coordinates\n";
+    throw std::invalid_argument("Matrix dimension do not match.");
+  }
+  candidates.reset((int)count, queries.getRows());
+  const double* data = queries.getData();
+  long rowStride = queries.getRowStride();
+  long colStride = queries.getColumnStride();
+  for (int j = 0; j < queries.getRows(); j++) {
+    double x = data[j*rowStride];
+    double y = data[j*rowStride + colStride];
+    visitNear(x, y, radius, [&](long index, double distance) {
+      candidates.add((int)index, j, distance);
+    });
+  }
+}
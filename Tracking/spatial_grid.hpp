@@ -0,0 +1,91 @@
+/******************************************************************************
+*                            Spatial grid                                     *
+*                                                                             *
+* A uniform grid over a set of 2D points, such as the predicted positions of *
+* all tracks, for finding the points within a gating distance of a query     *
+* without comparing it to every point. The grid is rebuilt every frame with  *
+* a counting sort, which takes O(points) time and reuses its storage, and a  *
+* query only visits the cells that overlap the gating circle. With a cell    *
+* size close to the gating distance, associating N tracks with M detections  *
+* then takes O(N + M + pairs) instead of O(N * M).                            *
+*                                                                             *
+* findPairs writes the candidate pairs straight into a SparseCost for the     *
+* assignment solver, with the squared distances as costs:                    *
+*                                                                             *
+*   grid.build(predictedPositions, gate);                                     *
+*   grid.findPairs(detections, gate, candidates);                             *
+*   association.solve(candidates, gate*gate);                                 *
+*                                                                             *
+******************************************************************************/
+#ifndef SPATIAL_GRID_HPP
+#define SPATIAL_GRID_HPP
+
+#include <vector>
+
+#include "matrix.hpp"
+#include "assignment.hpp"
+
+class SpatialGrid {
+  private:
+    double cellSize;
+    double originX;
+    double originY;
+    int gridColumns;
+    int gridRows;
+    long count;
+
+    // Points sorted by cell. The points of cell c are sortedIndex[k] for k
+    // from cellStart[c] to cellStart[c + 1], at (sortedX[k], sortedY[k])
+    std::vector<long> cellStart;
+    std::vector<long> sortedIndex;
+    std::vector<double> sortedX;
+    std::vector<double> sortedY;
+    std::vector<int> pointCell;
+
+    int cellColumn(double x) const;
+    int cellRow(double y) const;
+
+  public:
+    SpatialGrid();
+
+    void build(const MatrixView& points, double cell_size);
+    long getCount() const;
+    double getCellSize() const;
+
+    template <typename Visit>
+    void visitNear(double x, double y, double radius, Visit visit) const;
+    void findPairs(const MatrixView& queries, double radius,
+                   SparseCost& candidates) const;
+};
+
+/*
+* Calls visit(index, squaredDistance) for every point within radius of
+* (x, y), where index is the row of the point in the matrix the grid was
+* built from.
+*/
+template <typename Visit>
+void SpatialGrid::visitNear(double x, double y, double radius,
+                            Visit visit) const {
+  if ((count == 0) || !(radius >= 0)) {
+    return;
+  }
+  int firstColumn = cellColumn(x - radius);
+  int lastColumn = cellColumn(x + radius);
+  int firstRow = cellRow(y - radius);
+  int lastRow = cellRow(y + radius);
+  double limit = radius * radius;
+  for (int row = firstRow; row <= lastRow; row++) {
+    long begin = cellStart[(long)row*gridColumns + firstColumn];
+    long end = cellStart[(long)row*gridColumns + lastColumn + 1];
+    for (long k = begin; k < end; k++) {
+      double dx = sortedX[k] - x;
+      double dy = sortedY[k] - y;
+      double distance = dx*dx + dy*dy;
+      if (distance <= limit) {
+        visit(sortedIndex[k], distance);
+      }
+    }
+  }
+}
+
+#endif
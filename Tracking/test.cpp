@@ -1,6 +1,143 @@
 #include <iostream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#include <limits>
 
 #include "matrix.hpp"
+#include "kernels.hpp"
+#include "fixed_matrix.hpp"
+#include "parallel.hpp"
+#include "decomposition.hpp"
+#include "kalman.hpp"
+#include "kalman_batch.hpp"
+#include "assignment.hpp"
+#include "spatial_grid.hpp"
+#include "sparse_matrix.hpp"
+#include "reduce.hpp"
+#include "gemm.hpp"
+#include "transpose.hpp"
+#include "image.hpp"
+#include "filter.hpp"
+#include "integral.hpp"
+#include "morphology.hpp"
+#include "fft.hpp"
+#include "correlation.hpp"
+#include "pyramid.hpp"
+
+// Count every heap allocation made by the program, so that tests can check 
+// how many arrays a matrix expression creates, and keep the largest one
+static std::atomic<long> allocations{0};
+static std::atomic<std::size_t> largestAllocation{0};
+
+void* operator new(std::size_t size) {
+  allocations++;
+  std::size_t largest = largestAllocation;
+  while ((size > largest) &&
+         !largestAllocation.compare_exchange_weak(largest, size)) {
+  }
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+// Deleter for arrays adopted by matrices, counting how often it is called
+static void deleteAdopted(double* data, void* calls) {
+  delete[] data;
+  (*(int*)calls)++;
+}
+
+// Correlates one channel of an image with a kernel at pixel (y, x), as a
+// reference for the filters. Pixels outside the image are found by walking
+// back into it according to the border mode, and are 0 for Constant
+static double referenceFilter(const Image& image, const Matrix& kernel,
+                              int y, int x, int channel, BorderMode border) {
+  auto inside = [&](long i, long n) -> long {
+    while ((i < 0) || (i >= n)) {
+      if (border == BorderMode::Constant) {
+        return -1;
+      } else if (border == BorderMode::Replicate) {
+        i = (i < 0) ? 0 : n - 1;
+      } else if (border == BorderMode::Wrap) {
+        i += (i < 0) ? n : -n;
+      } else if (n == 1) {
+        i = 0;
+      } else {
+        i = (i < 0) ? -i : 2*(n - 1) - i;
+      }
+    }
+    return i;
+  };
+  double sum = 0;
+  for (int i = 0; i < kernel.getRows(); i++) {
+    for (int j = 0; j < kernel.getColumns(); j++) {
+      long row = inside(y + i - kernel.getRows() / 2, image.getHeight());
+      long column = inside(x + j - kernel.getColumns() / 2, image.getWidth());
+      if ((row >= 0) && (column >= 0)) {
+        sum += kernel(i, j) * image((int)row, (int)column, channel);
+      }
+    }
+  }
+  return sum;
+}
+
+// Returns the largest difference between a filtered image and the reference
+static double filterError(const Image& image, const Image& filtered,
+                          const Matrix& kernel, BorderMode border) {
+  double error = 0;
+  for (int y = 0; y < image.getHeight(); y++) {
+    for (int x = 0; x < image.getWidth(); x++) {
+      for (int c = 0; c < image.getChannels(); c++) {
+        double expected = referenceFilter(image, kernel, y, x, c, border);
+        error = std::max(error, std::fabs(filtered(y, x, c) - expected));
+      }
+    }
+  }
+  return error;
+}
+
+/*
+* Returns the largest difference between a pyramid level and the binomial
+* blur of the level before it, evaluated at every second row and column.
+*/
+static double pyramidError(const Image& image, const Image& level) {
+  double binomial[] = {1, 4, 6, 4, 1};
+  Matrix kernel = Matrix(Matrix(5, 1, binomial) * Matrix(1, 5, binomial));
+  kernel *= 1.0 / 256;
+  double error = 0;
+  if ((level.getWidth() != (image.getWidth() + 1) / 2) ||
+      (level.getHeight() != (image.getHeight() + 1) / 2) ||
+      (level.getChannels() != image.getChannels())) {
+    return 1e9;
+  }
+  for (int y = 0; y < level.getHeight(); y++) {
+    for (int x = 0; x < level.getWidth(); x++) {
+      for (int c = 0; c < level.getChannels(); c++) {
+        double expected = referenceFilter(image, kernel, 2*y, 2*x, c,
+                                          BorderMode::Reflect);
+        error = std::max(error, std::fabs(level(y, x, c) - expected));
+      }
+    }
+  }
+  return error;
+}
 
 int main() {
   double a[2][3] = {{1, 2, 3}, 
@@ -215,4 +352,2387 @@ int main() {
   mat5.print();
   mat5.concatenate(mat5);
   mat5.print();
+
+  std::cout << "\n\nTest copy and move semantics:\n";
+  Matrix original = Matrix::identity(3);
+  Matrix copied(original);
+  copied[1][1] = 7;
+  original.print();
+  copied.print();
+  Matrix moved(std::move(copied));
+  moved.print();
+  std::cout << "Moved-from size: (" << copied.getRows() << ", " 
+            << copied.getColumns() << ")\n";
+  copied = original;
+  copied.print();
+
+  std::cout << "\n\nTest allocation count:\n";
+  double c[4] = {1, 2, 3, 4};
+  Matrix matA(2, 2, c);
+  Matrix matB = Matrix::identity(2);
+  Matrix matC(2, 2, c);
+  long before = allocations;
+  Matrix chain = matA*matB + matC;
+  long used = allocations - before;
+  chain.print();
+  std::cout << "Allocations for A*B + C: " << used << "\n";
+  before = allocations;
+  chain = matA*matB + matC*2.0 - 1.0;
+  used = allocations - before;
+  std::cout << "Allocations for A*B + C*2 - 1: " << used << "\n";
+  if (used > 1) {
+    std::cout << "FAILED: expected at most 1 allocation\n";
+    return 1;
+  }
+  before = allocations;
+  chain = 2.5 + chain * 2 - matC / (matB + 1) + 1;
+  used = allocations - before;
+  chain.print();
+  std::cout << "Allocations for 2.5 + X*2 - C/(B + 1) + 1: " << used << "\n";
+  if (used != 0) {
+    std::cout << "FAILED: expected a fused expression without allocations\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest SIMD kernels against the scalar kernels:\n";
+  double left[37];
+  double right[37];
+  for (int i = 0; i < 37; i++) {
+    left[i] = (i - 18) * 0.37 + 0.01;
+    right[i] = (i % 7) * 1.3 - 3.7;
+  }
+  Matrix kernelLeft(1, 37, left);
+  Matrix kernelRight(1, 37, right);
+  setKernelIsa(KernelIsa::Scalar);
+  Matrix expected[] = {
+    kernelLeft + kernelRight, kernelLeft - kernelRight, 
+    Matrix::multiplyElementwise(kernelLeft, kernelRight), 
+    kernelLeft / kernelRight, kernelLeft + 0.3, kernelLeft - 0.3, 
+    kernelLeft * 0.3, kernelLeft / 0.3, 0.3 / kernelLeft
+  };
+  KernelIsa isas[] = {KernelIsa::SSE2, KernelIsa::AVX2, KernelIsa::AVX512};
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      std::cout << isaName(isa) << ": not supported\n";
+      continue;
+    }
+    Matrix actual[] = {
+      kernelLeft + kernelRight, kernelLeft - kernelRight, 
+      Matrix::multiplyElementwise(kernelLeft, kernelRight), 
+      kernelLeft / kernelRight, kernelLeft + 0.3, kernelLeft - 0.3, 
+      kernelLeft * 0.3, kernelLeft / 0.3, 0.3 / kernelLeft
+    };
+    int mismatches = 0;
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 37; j++) {
+        if (actual[i](0, j) != expected[i](0, j)) {
+          mismatches++;
+        }
+      }
+    }
+    std::cout << isaName(isa) << ": " << mismatches << " mismatches\n";
+    if (mismatches != 0) {
+      std::cout << "FAILED: SIMD results differ from the scalar results\n";
+      return 1;
+    }
+  }
+
+  std::cout << "\n\nTest fixed size matrices:\n";
+  FixedMatrix<2, 3> fixedA = {1, 2, 3, 4, 5, 6};
+  FixedMatrix<3, 2> fixedB = fixedA.T();
+  FixedMatrix<2, 2> fixedProduct = fixedA * fixedB;
+  fixedProduct = 0.5 * fixedProduct + FixedMatrix<2, 2>::identity();
+  fixedProduct.toMatrix().print();
+  Matrix dynamicA = fixedA.toMatrix();
+  Matrix dynamicProduct = 0.5 * (dynamicA * dynamicA.T()) + 
+                          Matrix::identity(2);
+  dynamicProduct.print();
+  FixedMatrix<2, 2> converted(dynamicProduct);
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 2; j++) {
+      if (converted(i, j) != fixedProduct(i, j)) {
+        std::cout << "FAILED: fixed and dynamic products differ\n";
+        return 1;
+      }
+    }
+  }
+  try {
+    FixedMatrix<3, 3> wrongSize(dynamicProduct);
+    std::cout << "FAILED: converted a matrix of the wrong size\n";
+    return 1;
+  } catch (std::invalid_argument&) {
+    std::cout << "Caught conversion of a matrix with the wrong size\n";
+  }
+  int listFailures = 2;
+  try {
+    FixedMatrix<2, 3>({1, 2, 3, 4, 5});
+  } catch (std::invalid_argument&) {
+    listFailures--;
+  }
+  try {
+    FixedMatrix<2, 3>({1, 2, 3, 4, 5, 6, 7});
+  } catch (std::invalid_argument&) {
+    listFailures--;
+  }
+  if (listFailures != 0) {
+    std::cout << "FAILED: created a matrix from a list of the wrong size\n";
+    return 1;
+  }
+  FixedMatrix<1, 3> divisors = {1, 4, -8};
+  FixedMatrix<1, 3> quotients = 2.0 / divisors;
+  if ((quotients(0, 0) != 2) || (quotients(0, 1) != 0.5) ||
+      (quotients(0, 2) != -0.25)) {
+    std::cout << "FAILED: number divided by a fixed size matrix\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest views:\n";
+  double v[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+  Matrix viewed(3, 4, v);
+  viewed.print();
+  MatrixView secondColumn = viewed.view().column(1);
+  secondColumn.print();
+  viewed.view().T().print();
+  viewed.block(1, 2, 1, 3).print();
+  std::cout << "Dot of column 0 and column 1: " 
+            << dot(viewed.view().column(0), viewed.view().column(1)) << "\n";
+  secondColumn *= 10;
+  viewed.block(0, 0) += 100;
+  viewed.block(-1, -1, 0, 1) = viewed.block(0, 0, 2, 3) - 0.5;
+  viewed.print();
+  Matrix square(3, 3, v);
+  square = square.view().T() + 1;
+  square.print();
+  Matrix product = viewed.view().T() * viewed.block(0, -1, 0, 1);
+  Matrix expectedProduct = viewed.T() * viewed.block(0, -1, 0, 1).copy();
+  product.print();
+  for (int i = 0; i < product.getRows(); i++) {
+    for (int j = 0; j < product.getColumns(); j++) {
+      if (product(i, j) != expectedProduct(i, j)) {
+        std::cout << "FAILED: product of views differs from product of "
+                  << "copies\n";
+        return 1;
+      }
+    }
+  }
+
+  // min() and max() ignore NaN wherever it is, as reduce() does, so views
+  // and matrices agree, and empty views throw instead of reading
+  Matrix withNaN(2, 3, v);
+  withNaN(0, 0) = std::nan("");
+  withNaN(1, 1) = std::nan("");
+  MatrixView nanView = withNaN.view().T();
+  std::cout << "Extremes ignoring NaN: " << nanView.min() << ", "
+            << nanView.max() << "\n";
+  int viewFailures = (nanView.min() != 1) || (nanView.max() != 5) ||
+                     (withNaN.min() != 1) || (withNaN.max() != 5) ||
+                     (withNaN.block(0, 0, 1, 2).min() != 1);
+  double leadingNaN[] = {std::nan(""), 2, 1};
+  Matrix nanFirst(1, 3, leadingNaN);
+  struct index extremes[] = {withNaN.minIndex(), withNaN.maxIndex(),
+                             nanFirst.minIndex(), nanFirst.maxIndex()};
+  struct index expectedExtremes[] = {{0, 1}, {1, 2}, {0, 2}, {0, 1}};
+  for (int i = 0; i < 4; i++) {
+    viewFailures += (extremes[i].r != expectedExtremes[i].r) ||
+                    (extremes[i].c != expectedExtremes[i].c);
+  }
+  MatrixView emptyView(v, 0, 3, 3);
+  Matrix emptyMatrix(0, 3);
+  for (int attempt = 0; attempt < 4; attempt++) {
+    try {
+      if (attempt == 0) {
+        emptyView.min();
+      } else if (attempt == 1) {
+        emptyMatrix.min();
+      } else if (attempt == 2) {
+        emptyMatrix.minIndex();
+      } else {
+        emptyMatrix.maxIndex();
+      }
+    } catch (const std::invalid_argument&) {
+      viewFailures--;
+    }
+    viewFailures++;
+  }
+
+  // Views of a constant matrix, and views taken from them, are read-only
+  const Matrix& constant = viewed;
+  MatrixView readOnly = constant.view();
+  MatrixView readOnlyBlock = readOnly.block(0, 1, 0, 1).T();
+  viewFailures += !viewed.view().isWritable() || readOnly.isWritable() ||
+                  readOnlyBlock.isWritable() ||
+                  (readOnlyBlock.min() != constant.minRange(0, 1, 0, 1));
+  for (int attempt = 0; attempt < 3; attempt++) {
+    try {
+      if (attempt == 0) {
+        readOnly(0, 0) = 1;
+      } else if (attempt == 1) {
+        readOnlyBlock += 1;
+      } else {
+        readOnly.getData()[0] = 1;
+      }
+    } catch (const std::invalid_argument&) {
+      viewFailures--;
+    }
+    viewFailures++;
+  }
+  if (viewFailures != 0) {
+    std::cout << "FAILED: view extremes or read-only views are wrong\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest arena and pool allocation:\n";
+  MatrixArena arena(1 << 16);
+  Matrix arenaF = Matrix::identity(4);
+  Matrix arenaP = Matrix::identity(4) * 2;
+  before = allocations;
+  {
+    ArenaScope scope(arena);
+    for (int i = 0; i < 10; i++) {
+      Matrix predicted = arenaF * arenaP * arenaF.T() + arenaP;
+      Matrix scaled = predicted / 3.0;
+    }
+    std::cout << "Arena bytes in use inside scope: " << arena.getUsed() 
+              << "\n";
+  }
+  used = allocations - before;
+  AllocatorStatistics arenaStatistics = arena.getStatistics();
+  std::cout << "Heap allocations with arena: " << used << "\n";
+  std::cout << "Arena allocations: " << arenaStatistics.allocations 
+            << ", bytes served: " << arenaStatistics.bytesServed 
+            << ", high-water mark: " << arenaStatistics.highWaterMark 
+            << ", heap fallbacks: " << arenaStatistics.heapFallbacks 
+            << ", in use after scope: " << arena.getUsed() << "\n";
+  if ((used != 0) || (arena.getUsed() != 0)) {
+    std::cout << "FAILED: arena scope used the heap or kept memory\n";
+    return 1;
+  }
+
+  // Matrices declared before a scope grow and are reassigned from the heap,
+  // so the next scope does not write over them
+  double pushed[] = {1, 2};
+  Matrix frameRows(0, 0);
+  Matrix frameSum(1, 1);
+  Matrix frameCopy(1, 1);
+  for (int frame = 0; frame < 2; frame++) {
+    ArenaScope scope(arena);
+    if (frame == 0) {
+      frameRows.pushRow(Matrix(1, 2, pushed));
+      frameSum = arenaF.T() * 2.0 + arenaP;
+      HeapScope heap;
+      frameCopy = arenaF.T();
+    } else {
+      for (int i = 0; i < 10; i++) {
+        Matrix overwrite = Matrix::zeros(4, 4) - 9.0;
+      }
+    }
+  }
+  if ((frameRows(0, 0) != 1) || (frameRows(0, 1) != 2) ||
+      (frameSum(0, 0) != 4) || (frameSum(0, 1) != 0) ||
+      (frameCopy(3, 3) != 1) ||
+      isArenaArray(frameRows.getData()) || isArenaArray(frameSum.getData()) ||
+      isArenaArray(frameCopy.getData())) {
+    std::cout << "FAILED: matrices that outlive a scope kept arena arrays\n";
+    return 1;
+  }
+  setMatrixPooling(true);
+  for (int i = 0; i < 10; i++) {
+    Matrix predicted = arenaF * arenaP * arenaF.T() + arenaP;
+  }
+  setMatrixPooling(false);
+  AllocatorStatistics poolStatistics = allocatorStatistics();
+  std::cout << "Pool hits: " << poolStatistics.poolHits << "\n";
+  releaseMatrixPools();
+
+  std::cout << "\n\nTest matrices of other element types:\n";
+  std::uint8_t pixels[40];
+  for (int i = 0; i < 40; i++) {
+    pixels[i] = (std::uint8_t)(i * 37);
+  }
+  BasicMatrix<std::uint8_t> frame(4, 10, pixels);
+  BasicMatrix<float> image = frame.convert<float>(1.0 / 255);
+  image = image * 2.0f - 0.5f;
+  image.T().print(3);
+  BasicMatrix<std::uint8_t> saturated = image.convert<std::uint8_t>(255);
+  saturated.print();
+  if ((saturated.min() != 0) || (saturated.max() != 255)) {
+    std::cout << "FAILED: conversion did not round and saturate\n";
+    return 1;
+  }
+  BasicMatrix<int> counts = BasicMatrix<int>::identity(3) * 2 + 1;
+  (counts * counts).print();
+
+  // Numbers are not converted to the element type before the operation
+  std::uint8_t levels[] = {0, 1, 3, 100, 200, 255};
+  BasicMatrix<std::uint8_t> bytes(1, 6, levels);
+  BasicMatrix<std::uint8_t> scalarResults[] = {
+    bytes * 0.5, 0.5 * bytes, bytes + 300, 300 + bytes, bytes - 100,
+    100 - bytes, bytes / 0.5, 510 / bytes, bytes + 0.5
+  };
+  std::uint8_t expectedScalar[][6] = {
+    {0, 0, 2, 50, 100, 128}, {0, 0, 2, 50, 100, 128},
+    {255, 255, 255, 255, 255, 255}, {255, 255, 255, 255, 255, 255},
+    {0, 0, 0, 0, 100, 155}, {100, 99, 97, 0, 0, 0},
+    {0, 2, 6, 200, 255, 255}, {255, 255, 170, 5, 3, 2},
+    {0, 2, 4, 100, 200, 255}
+  };
+  int scalarMismatches = 0;
+  for (int i = 0; i < 9; i++) {
+    for (int j = 0; j < 6; j++) {
+      scalarMismatches += (scalarResults[i](0, j) != expectedScalar[i][j]);
+    }
+  }
+  BasicMatrix<float> tenths = BasicMatrix<float>::identity(2) * 0.1;
+  float quarter[] = {4.0f, 0.5f};
+  BasicMatrix<float> quarters(1, 2, quarter);
+  BasicMatrix<float> reversed[] = {1 - quarters, 1 / quarters};
+  scalarMismatches += (tenths(0, 0) != 0.1f) || (tenths(0, 1) != 0);
+  scalarMismatches += (reversed[0](0, 0) != -3) || (reversed[0](0, 1) != 0.5f);
+  scalarMismatches += (reversed[1](0, 0) != 0.25f) || (reversed[1](0, 1) != 2);
+  if (scalarMismatches > 0) {
+    std::cout << "FAILED: " << scalarMismatches
+              << " operations with a number were not saturated\n";
+    return 1;
+  }
+
+  // The operators move their result out of the operand taken by value, so
+  // a chain only allocates the first temporary
+  BasicMatrix<float> movedQuarters = quarters;
+  before = allocations;
+  BasicMatrix<float> movedSum = std::move(movedQuarters) + quarters;
+  long movedAllocations = allocations - before;
+  before = allocations;
+  BasicMatrix<float> chained = quarters * 2.0 + 1.0;
+  long chainAllocations = allocations - before;
+  std::cout << "Allocations for std::move(A) + B: " << movedAllocations
+            << ", for A*2 + 1: " << chainAllocations << "\n";
+  if ((movedAllocations != 0) || (chainAllocations != 1) ||
+      (movedSum(0, 0) != 8) || (chained(0, 1) != 2)) {
+    std::cout << "FAILED: operators copied their operands\n";
+    return 1;
+  }
+
+  // Extremes skip NaN and empty matrices throw, as for Matrix
+  float leadingFloatNaN[] = {NAN, -5.0f, 7.0f};
+  BasicMatrix<float> floatNaN(1, 3, leadingFloatNaN);
+  struct index floatExtremes[] = {floatNaN.minIndex(), floatNaN.maxIndex()};
+  int extremeFailures = (floatExtremes[0].c != 1) ||
+                        (floatExtremes[1].c != 2) ||
+                        (floatNaN.min() != -5) || (floatNaN.max() != 7);
+  BasicMatrix<float> emptyFloats(0, 0);
+  for (int attempt = 0; attempt < 2; attempt++) {
+    try {
+      if (attempt == 0) {
+        emptyFloats.minIndex();
+      } else {
+        emptyFloats.max();
+      }
+    } catch (const std::invalid_argument&) {
+      extremeFailures--;
+    }
+    extremeFailures++;
+  }
+  if (extremeFailures > 0) {
+    std::cout << "FAILED: BasicMatrix extremes differ from Matrix\n";
+    return 1;
+  }
+
+  // Every instruction set must convert exactly like the scalar loops
+  float floats[37];
+  double doubles[37];
+  for (int i = 0; i < 37; i++) {
+    floats[i] = (i - 5) * 7.5f;
+    doubles[i] = (i - 5) * 7.5 + 0.5;
+  }
+  floats[3] = NAN;
+  doubles[4] = NAN;
+  BasicMatrix<float> floatMatrix(1, 37, floats);
+  Matrix doubleMatrix(1, 37, doubles);
+  BasicMatrix<std::uint8_t> byteMatrix(1, 40, pixels);
+  setKernelIsa(KernelIsa::Scalar);
+  BasicMatrix<std::uint8_t> expectedBytes[] = {
+    floatMatrix.convert<std::uint8_t>(1.5, 2),
+    doubleMatrix.convert<std::uint8_t>(1.5, 2)
+  };
+  BasicMatrix<float> expectedFloats[] = {
+    byteMatrix.convert<float>(0.1, 3), doubleMatrix.convert<float>(0.1, 3),
+    floatMatrix + floatMatrix, floatMatrix / 0.3f
+  };
+  Matrix expectedDoubles[] = {
+    byteMatrix.convert<double>(0.1, 3), floatMatrix.convert<double>(0.1, 3)
+  };
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    BasicMatrix<std::uint8_t> actualBytes[] = {
+      floatMatrix.convert<std::uint8_t>(1.5, 2),
+      doubleMatrix.convert<std::uint8_t>(1.5, 2)
+    };
+    BasicMatrix<float> actualFloats[] = {
+      byteMatrix.convert<float>(0.1, 3), doubleMatrix.convert<float>(0.1, 3),
+      floatMatrix + floatMatrix, floatMatrix / 0.3f
+    };
+    Matrix actualDoubles[] = {
+      byteMatrix.convert<double>(0.1, 3), floatMatrix.convert<double>(0.1, 3)
+    };
+    int mismatches = 0;
+    for (int i = 0; i < 2; i++) {
+      for (int j = 0; j < actualBytes[i].getColumns(); j++) {
+        mismatches += (actualBytes[i](0, j) != expectedBytes[i](0, j));
+      }
+      for (int j = 0; j < actualDoubles[i].getColumns(); j++) {
+        double a = actualDoubles[i](0, j);
+        double b = expectedDoubles[i](0, j);
+        mismatches += (a != b) && !((a != a) && (b != b));
+      }
+    }
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < actualFloats[i].getColumns(); j++) {
+        float a = actualFloats[i](0, j);
+        float b = expectedFloats[i](0, j);
+        mismatches += (a != b) && !((a != a) && (b != b));
+      }
+    }
+    std::cout << isaName(isa) << ": " << mismatches 
+              << " conversion mismatches\n";
+    if (mismatches != 0) {
+      std::cout << "FAILED: SIMD conversions differ from the scalar loops\n";
+      return 1;
+    }
+  }
+
+  std::cout << "\n\nTest matrix multiplication:\n";
+  // gemm must match a direct triple loop on both sides of the thresholds of
+  // the blocked and parallel paths, for sizes that leave partial register
+  // tiles and cache blocks, with transposed, strided and accumulated operands,
+  // and give identical products for every instruction set
+  int gemmSizes[][3] = {{1, 1, 1}, {3, 5, 7}, {31, 32, 33}, {32, 32, 32},
+                        {33, 31, 33}, {97, 13, 257}, {5, 4100, 7},
+                        {127, 128, 129}, {128, 128, 129}, {200, 9, 300}};
+  const char* gemmLayouts[] = {"plain", "transposed A, accumulated",
+                               "transposed B, padded C",
+                               "strided A and B, accumulated"};
+  int gemmFailures = 0;
+  KernelIsa gemmIsa = kernels().isa;
+  setMatrixThreads(4);
+  for (int layout = 0; layout < 4; layout++) {
+    double worst = 0;
+    for (auto& size : gemmSizes) {
+      int m = size[0];
+      int n = size[1];
+      int k = size[2];
+      bool accumulate = (layout == 1) || (layout == 3);
+      int aRowStride = k;
+      int aColStride = 1;
+      int bRowStride = n;
+      int bColStride = 1;
+      int cRowStride = n;
+      if (layout == 1) {
+        aRowStride = 1;
+        aColStride = m;
+      } else if (layout == 2) {
+        bRowStride = 1;
+        bColStride = k;
+        cRowStride = n + 3;
+      } else if (layout == 3) {
+        aRowStride = 2*k + 1;
+        aColStride = 2;
+        bRowStride = n + 5;
+      }
+      std::vector<double> a((long)m * (2*k + 1));
+      std::vector<double> b((long)k * (n + 5));
+      std::vector<double> c((long)m * cRowStride);
+      for (long i = 0; i < (long)a.size(); i++) {
+        a[i] = ((i * 7919) % 1000) * 0.001 - 0.5;
+      }
+      for (long i = 0; i < (long)b.size(); i++) {
+        b[i] = ((i * 7907) % 997) * 0.002 - 1;
+      }
+      for (long i = 0; i < (long)c.size(); i++) {
+        c[i] = (i % 7) - 3;
+      }
+      std::vector<double> initial = c;
+      gemm(m, n, k, a.data(), aRowStride, aColStride, b.data(), bRowStride,
+           bColStride, c.data(), cRowStride, accumulate);
+      for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+          double expected = accumulate ? initial[(long)i*cRowStride + j] : 0;
+          double magnitude = std::fabs(expected);
+          for (int p = 0; p < k; p++) {
+            double product = a[(long)i*aRowStride + (long)p*aColStride] *
+                             b[(long)p*bRowStride + (long)j*bColStride];
+            expected += product;
+            magnitude += std::fabs(product);
+          }
+          double error = std::fabs(c[(long)i*cRowStride + j] - expected) /
+                         (magnitude + 1);
+          worst = std::max(worst, error);
+        }
+      }
+      for (KernelIsa isa : {KernelIsa::Scalar, KernelIsa::SSE2,
+                            KernelIsa::AVX2, KernelIsa::AVX512}) {
+        if (!setKernelIsa(isa)) {
+          continue;
+        }
+        std::vector<double> isaC = initial;
+        gemm(m, n, k, a.data(), aRowStride, aColStride, b.data(), bRowStride,
+             bColStride, isaC.data(), cRowStride, accumulate);
+        gemmFailures += (isaC != c);
+      }
+      setKernelIsa(gemmIsa);
+
+      // Padding between the rows of C is left alone
+      for (int i = 0; i < m; i++) {
+        for (int j = n; j < cRowStride; j++) {
+          gemmFailures += (c[(long)i*cRowStride + j] !=
+                           initial[(long)i*cRowStride + j]);
+        }
+      }
+    }
+    std::cout << gemmLayouts[layout] << ": relative error "
+              << ((worst < 1e-14) ? "< 1e-14" : "too large") << "\n";
+    gemmFailures += !(worst < 1e-14);
+  }
+  setMatrixThreads(0);
+  if (gemmFailures != 0) {
+    std::cout << "FAILED: gemm does not match the direct product\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest parallel execution:\n";
+  Matrix bigA(400, 500);
+  Matrix bigB(500, 400);
+  for (int i = 0; i < 400*500; i++) {
+    bigA.getData()[i] = ((i * 7919) % 1000) * 0.001 - 0.5;
+    bigB.getData()[i] = ((i * 7907) % 997) * 0.002 - 1;
+  }
+  bigA(123, 321) = -5;
+  bigA(200, 17) = 5;
+  setMatrixThreads(1);
+  Matrix serialProduct = bigA * bigB;
+  Matrix serialSum = bigA * 2.0 + bigA / 3.0;
+  Matrix serialTranspose = bigA.T();
+  struct index serialMin = bigA.minIndex();
+  int executorCalls = 0;
+  for (int mode = 0; mode < 2; mode++) {
+    if (mode == 0) {
+      setMatrixThreads(4);
+    } else {
+      setMatrixExecutor([&](int tasks, const std::function<void(int)>& task) {
+        executorCalls++;
+        for (int t = tasks - 1; t >= 0; t--) {
+          task(t);
+        }
+      }, 3);
+    }
+    Matrix parallelProduct = bigA * bigB;
+    Matrix parallelSum = bigA * 2.0 + bigA / 3.0;
+    Matrix parallelTranspose = bigA.T();
+    struct index parallelMax = bigA.maxIndex();
+    struct index parallelMin = bigA.minIndex();
+    int mismatches = 0;
+    for (int i = 0; i < 400*500; i++) {
+      mismatches += (parallelSum.getData()[i] != serialSum.getData()[i]);
+      mismatches += (parallelTranspose.getData()[i] != 
+                     serialTranspose.getData()[i]);
+    }
+    for (int i = 0; i < 400*400; i++) {
+      mismatches += (parallelProduct.getData()[i] != 
+                     serialProduct.getData()[i]);
+    }
+    std::cout << ((mode == 0) ? "4 threads: " : "executor: ") << mismatches 
+              << " mismatches, max at (" << parallelMax.r << ", " 
+              << parallelMax.c << "), min at (" << parallelMin.r << ", " 
+              << parallelMin.c << ")\n";
+    if ((mismatches != 0) || (parallelMax.r != 200) || 
+        (parallelMax.c != 17) || (parallelMin.r != serialMin.r) || 
+        (parallelMin.c != serialMin.c)) {
+      std::cout << "FAILED: parallel results differ from serial results\n";
+      return 1;
+    }
+  }
+  std::cout << "Executor calls: " << executorCalls << "\n";
+  if (executorCalls < 5) {
+    std::cout << "FAILED: the executor was not used for every operation\n";
+    return 1;
+  }
+
+  // A chunk that throws on the calling thread or on a worker stops the job,
+  // the exception reaches the caller once the workers are done, and the pool
+  // keeps working in parallel afterwards
+  setMatrixThreads(4);
+  std::thread::id caller = std::this_thread::get_id();
+  int caught = 0;
+  for (bool onCaller : {true, false}) {
+    try {
+      parallelFor(8, 1, [&](long, long) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        if ((std::this_thread::get_id() == caller) == onCaller) {
+          throw std::runtime_error("chunk failed");
+        }
+      });
+    } catch (const std::runtime_error&) {
+      caught++;
+    }
+  }
+  Matrix retriedProduct = bigA * bigB;
+  int retryMismatches = 0;
+  for (int i = 0; i < 400*400; i++) {
+    retryMismatches += (retriedProduct.getData()[i] !=
+                        serialProduct.getData()[i]);
+  }
+  std::cout << "Exceptions caught: " << caught << "\n";
+  if ((caught != 2) || (retryMismatches != 0) ||
+      (parallelChunks(1L << 20, 1) != 4)) {
+    std::cout << "FAILED: the pool did not recover from an exception\n";
+    return 1;
+  }
+  setMatrixThreads(0);
+
+  std::cout << "\n\nTest transposes:\n";
+  double fractions[] = {0.5, 1.25, 2.75, 3.5, 4.25, 5.75, 6.5, 7.25, 8.75};
+  Matrix fractional(3, 3, fractions);
+  fractional.transpose();
+  fractional.print();
+
+  // Every shape must transpose correctly in place, out of place and from a
+  // transposed view, including shapes whose sides share a common divisor
+  int shapes[][2] = {{1, 9}, {9, 1}, {7, 5}, {6, 4}, {12, 18}, {24, 8}, 
+                     {8, 24}, {33, 33}, {64, 48}, {37, 101}, {300, 700}};
+  KernelIsa originalIsa = kernels().isa;
+  KernelIsa transposeIsas[] = {KernelIsa::Scalar, KernelIsa::SSE2, 
+                               KernelIsa::AVX2, KernelIsa::AVX512};
+  setMatrixThreads(4);
+  for (KernelIsa isa : transposeIsas) {
+    if (!setKernelIsa(isa)) {
+      std::cout << isaName(isa) << ": not supported\n";
+      continue;
+    }
+    int mismatches = 0;
+    for (auto& shape : shapes) {
+      Matrix source(shape[0], shape[1]);
+      for (int i = 0; i < shape[0]; i++) {
+        for (int j = 0; j < shape[1]; j++) {
+          source(i, j) = i * shape[1] + j + 0.25;
+        }
+      }
+      Matrix copied = source.T();
+      Matrix fromView(source.view().T());
+      Matrix inPlace = source.copy();
+      inPlace.transpose();
+      if ((copied.getRows() != shape[1]) || (inPlace.getRows() != shape[1]) ||
+          (fromView.getRows() != shape[1])) {
+        mismatches++;
+        continue;
+      }
+      for (int i = 0; i < shape[0]; i++) {
+        for (int j = 0; j < shape[1]; j++) {
+          mismatches += (copied(j, i) != source(i, j));
+          mismatches += (fromView(j, i) != source(i, j));
+          mismatches += (inPlace(j, i) != source(i, j));
+        }
+      }
+    }
+    std::cout << isaName(isa) << ": " << mismatches << " mismatches\n";
+    if (mismatches != 0) {
+      std::cout << "FAILED: transposed elements are in the wrong place\n";
+      return 1;
+    }
+  }
+  setKernelIsa(originalIsa);
+
+  // Tall and wide arrays transpose in place with bounded scratch space, by
+  // following cycles when a column group or a row would not fit
+  int boundedShapes[][2] = {{300000, 2}, {2, 300000}, {20000, 13}};
+  for (auto& shape : boundedShapes) {
+    Matrix source(shape[0], shape[1]);
+    for (long i = 0; i < (long)shape[0] * shape[1]; i++) {
+      source.getData()[i] = i + 0.5;
+    }
+    Matrix inPlace = source.copy();
+    largestAllocation = 0;
+    inPlace.transpose();
+    std::size_t scratch = largestAllocation;
+    int mismatches = 0;
+    for (int i = 0; i < shape[0]; i++) {
+      for (int j = 0; j < shape[1]; j++) {
+        mismatches += (inPlace(j, i) != source(i, j));
+      }
+    }
+    std::cout << "In place (" << shape[0] << ", " << shape[1] << "): "
+              << mismatches << " mismatches, largest scratch "
+              << ((scratch <= TRANSPOSE_SCRATCH * sizeof(double))
+                  ? "within the bound" : "too large") << "\n";
+    if ((mismatches != 0) ||
+        (scratch > TRANSPOSE_SCRATCH * sizeof(double))) {
+      std::cout << "FAILED: in-place transpose of a tall or wide array\n";
+      return 1;
+    }
+  }
+  setMatrixThreads(0);
+
+  std::cout << "\n\nTest linear solvers:\n";
+  double tridiagonal[] = {2, -1, 0, -1, 2, -1, 0, -1, 2};
+  Matrix second(3, 3, tridiagonal);
+  std::cout << "Determinant: " << LUDecomposition(second).determinant() 
+            << ", " << CholeskyDecomposition(second).determinant() << ", " 
+            << LDLTDecomposition(second).determinant() << "\n";
+  second.inverse().print();
+  std::cout << "\n";
+  CholeskyDecomposition(second).getL().print();
+  std::cout << "\n";
+
+  // Sizes around the block size use both the simple loops and the blocked 
+  // updates, and every solution must satisfy its system
+  int solverSizes[] = {1, 5, 63, 64, 65, 150, 200};
+  for (int size : solverSizes) {
+    Matrix base(size, size);
+    Matrix rhs(size, 3);
+    for (int i = 0; i < size; i++) {
+      for (int j = 0; j < size; j++) {
+        base(i, j) = ((i * 37 + j * 11) % 17) / 17.0 - 0.5;
+      }
+      for (int j = 0; j < 3; j++) {
+        rhs(i, j) = ((i * 7 + j * 5) % 13) / 13.0;
+      }
+    }
+    Matrix spd = base * base.T() + Matrix::identity(size) * size;
+    Matrix general = base + Matrix::identity(size) * 3;
+    Matrix luSolution = LUDecomposition(general).solve(rhs);
+    Matrix choleskySolution = CholeskyDecomposition(spd).solve(rhs);
+    Matrix ldltSolution = LDLTDecomposition(spd).solve(rhs);
+    Matrix rightSolution = CholeskyDecomposition(spd).solveRight(rhs.T());
+    Matrix ldltRightSolution = LDLTDecomposition(spd).solveRight(rhs.T());
+    Matrix residuals[] = {
+      general * luSolution - rhs, spd * choleskySolution - rhs, 
+      spd * ldltSolution - rhs, rightSolution * spd - rhs.T(),
+      ldltRightSolution * spd - rhs.T()
+    };
+    double worst = 0;
+    for (Matrix& residual : residuals) {
+      worst = std::max({worst, residual.max(), -residual.min()});
+    }
+    std::cout << "Size " << size << ": largest residual " 
+              << ((worst < 1e-10) ? "below 1e-10" : "too large") << "\n";
+    if (!(worst < 1e-10)) {
+      std::cout << "FAILED: solution does not satisfy the system\n";
+      return 1;
+    }
+  }
+
+  // The Kalman gain from a solve matches the gain from the inverse, and 
+  // refactoring the innovation covariance reuses the decomposition
+  double covariance[] = {4, 1, 0.5, 0, 1, 3, 0, 0.2, 0.5, 0, 2, 0.1, 
+                         0, 0.2, 0.1, 1};
+  double measurement[] = {1, 0, 0, 0, 0, 1, 0, 0};
+  Matrix P(4, 4, covariance);
+  Matrix H(2, 4, measurement);
+  Matrix R = Matrix::identity(2) * 0.5;
+  Matrix S = H * P * H.T() + R;
+  CholeskyDecomposition innovation(S);
+  Matrix gain = innovation.solveRight(P * H.T());
+  Matrix gainFromInverse = P * H.T() * S.inverse();
+  Matrix gainError = gain - gainFromInverse;
+  if (!(std::max(gainError.max(), -gainError.min()) < 1e-12)) {
+    std::cout << "FAILED: Kalman gain differs from the gain of the inverse\n";
+    return 1;
+  }
+  std::cout << "Kalman gain matches the inverse\n";
+  Matrix innovationVector(2, 1);
+  before = allocations;
+  for (int i = 0; i < 10; i++) {
+    innovationVector(0, 0) = i;
+    innovationVector(1, 0) = -i;
+    innovation.compute(S);
+    innovation.solveInPlace(innovationVector);
+  }
+  std::cout << "Allocations while refactoring: " << allocations - before 
+            << "\n";
+  if (allocations != before) {
+    std::cout << "FAILED: expected the decomposition to reuse its storage\n";
+    return 1;
+  }
+
+  double rankOne[] = {1, 2, 2, 4};
+  Matrix singular(2, 2, rankOne);
+  std::cout << "Singular: " << LUDecomposition(singular).isSingular() 
+            << ", positive definite: " 
+            << CholeskyDecomposition(singular).isPositiveDefinite() << "\n";
+  try {
+    singular.inverse();
+    std::cout << "FAILED: inverted a singular matrix\n";
+    return 1;
+  } catch (const std::invalid_argument& error) {
+    std::cout << "Caught: " << error.what() << "\n";
+  }
+
+  std::cout << "\n\nTest Kalman filter:\n";
+  // Constant velocity model with a state of (x, vx, y, vy), tracked from 
+  // noisy positions, compared against the textbook equations
+  double dt = 0.1;
+  double cvTransition[] = {1, dt, 0, 0, 0, 1, 0, 0, 0, 0, 1, dt, 0, 0, 0, 1};
+  double cvMeasurement[] = {1, 0, 0, 0, 0, 0, 1, 0};
+  Matrix F(4, 4, cvTransition);
+  Matrix cvH(2, 4, cvMeasurement);
+  Matrix Q = Matrix::identity(4) * 0.01;
+  Matrix cvR = Matrix::identity(2) * 0.25;
+  KalmanFilter filter(4, 2);
+  KalmanFilter josephFilter(4, 2);
+  KalmanFilter extendedFilter(4, 2);
+  for (KalmanFilter* kf : {&filter, &josephFilter, &extendedFilter}) {
+    kf->setTransition(F);
+    kf->setProcessNoise(Q);
+    kf->setMeasurementMatrix(cvH);
+    kf->setMeasurementNoise(cvR);
+    kf->setCovariance(Matrix::identity(4) * 10);
+  }
+  josephFilter.setJosephForm(true);
+  Matrix referenceState = Matrix::zeros(4, 1);
+  Matrix referenceCovariance = Matrix::identity(4) * 10;
+  Matrix z(2, 1);
+  Matrix predictedState(4, 1);
+  Matrix expectedMeasurement(2, 1);
+  double largestDifference = 0;
+  long frameAllocations = 0;
+  bool symmetric = true;
+  for (int frame = 0; frame < 50; frame++) {
+    double t = frame * dt;
+    z(0, 0) = 1 + 2*t + 0.3*std::sin(frame * 1.7);
+    z(1, 0) = -3 + 0.5*t + 0.3*std::cos(frame * 2.3);
+
+    referenceState = F * referenceState;
+    referenceCovariance = F * referenceCovariance * F.T() + Q;
+    Matrix referenceS = cvH * referenceCovariance * cvH.T() + cvR;
+    Matrix referenceGain = referenceCovariance * cvH.T() * referenceS.inverse();
+    referenceState += referenceGain * (z - cvH * referenceState);
+    referenceCovariance = (Matrix::identity(4) - referenceGain * cvH) * 
+                          referenceCovariance;
+
+    before = allocations;
+    filter.predict();
+    filter.update(z);
+    josephFilter.predict();
+    josephFilter.update(z);
+    gemm(4, 1, 4, F.getData(), 4, 1, extendedFilter.getState().getData(), 1,
+         1, predictedState.getData(), 1);
+    extendedFilter.predict(predictedState, F);
+    gemm(2, 1, 4, cvH.getData(), 4, 1, extendedFilter.getState().getData(), 
+         1, 1, expectedMeasurement.getData(), 1);
+    extendedFilter.update(z, expectedMeasurement, cvH);
+    frameAllocations += allocations - before;
+
+    for (KalmanFilter* kf : {&filter, &josephFilter, &extendedFilter}) {
+      for (int i = 0; i < 4; i++) {
+        largestDifference = std::max(largestDifference, std::fabs(
+          kf->getState()(i, 0) - referenceState(i, 0)));
+        for (int j = 0; j < 4; j++) {
+          largestDifference = std::max(largestDifference, std::fabs(
+            kf->getCovariance()(i, j) - referenceCovariance(i, j)));
+          symmetric &= (kf->getCovariance()(i, j) == 
+                        kf->getCovariance()(j, i));
+        }
+      }
+    }
+  }
+  filter.getState().print();
+  std::cout << "\nMatches the textbook equations: " 
+            << ((largestDifference < 1e-9) ? "yes" : "no") 
+            << ", symmetric covariance: " << (symmetric ? "yes" : "no") 
+            << ", allocations in predict and update: " << frameAllocations 
+            << "\n";
+  if (!(largestDifference < 1e-9) || !symmetric || (frameAllocations != 0)) {
+    std::cout << "FAILED: Kalman filter does not match the reference\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest batched Kalman filter:\n";
+  // Every track of the batch must follow its own KalmanFilter, including 
+  // tracks in the last, partial group of lanes and tracks left out of an 
+  // update, with identical results for every instruction set
+  const int tracks = 3001;
+  const int frames = 5;
+  Matrix referenceStates(tracks, 4);
+  Matrix referenceCovariances(tracks, 16);
+  Matrix referenceDistances(1, tracks);
+  BasicMatrix<uint8_t> measured(1, tracks);
+  Matrix positions(2, tracks);
+  for (int t = 0; t < tracks; t++) {
+    KalmanFilter single(4, 2);
+    single.setTransition(F);
+    single.setProcessNoise(Q);
+    single.setMeasurementMatrix(cvH);
+    single.setMeasurementNoise(cvR);
+    single.setCovariance(Matrix::identity(4) * 10);
+    double initial[] = {t * 0.01, 1, -t * 0.02, 0.5};
+    single.setState(Matrix(4, 1, initial));
+    for (int frame = 0; frame < frames; frame++) {
+      single.predict();
+      if ((t + frame) % 5 != 0) {
+        z(0, 0) = t * 0.01 + frame * 0.2 + 0.1 * std::sin(t + frame);
+        z(1, 0) = -t * 0.02 + frame * 0.05 + 0.1 * std::cos(t * frame);
+        single.update(z);
+        Matrix whitened = CholeskyDecomposition(
+          single.getInnovationCovariance()).solve(single.getInnovation());
+        referenceDistances(0, t) = 
+          (single.getInnovation().T() * whitened)(0, 0);
+      }
+    }
+    std::copy(single.getState().getData(), single.getState().getData() + 4,
+              referenceStates.getData() + t*4);
+    std::copy(single.getCovariance().getData(), 
+              single.getCovariance().getData() + 16,
+              referenceCovariances.getData() + t*16);
+  }
+
+  Matrix firstStates(4, tracks);
+  bool firstRun = true;
+  int isaMismatches = 0;
+  double batchDifference = 0;
+  setMatrixThreads(4);
+  for (KernelIsa isa : transposeIsas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    KalmanBatch batch(4, 2);
+    batch.setTransition(F);
+    batch.setProcessNoise(Q);
+    batch.setMeasurementMatrix(cvH);
+    batch.setMeasurementNoise(cvR);
+    for (int t = 0; t < tracks; t++) {
+      double initial[] = {t * 0.01, 1, -t * 0.02, 0.5};
+      batch.addTrack(Matrix(4, 1, initial), Matrix::identity(4) * 10);
+    }
+    for (int frame = 0; frame < frames; frame++) {
+      batch.predict();
+      for (int t = 0; t < tracks; t++) {
+        measured(0, t) = ((t + frame) % 5 != 0);
+        positions(0, t) = t * 0.01 + frame * 0.2 + 0.1 * std::sin(t + frame);
+        positions(1, t) = -t * 0.02 + frame * 0.05 + 
+                          0.1 * std::cos(t * frame);
+      }
+      batch.update(positions, measured.getData());
+    }
+    for (int t = 0; t < tracks; t++) {
+      Matrix stateDifference = batch.getState(t) - 
+                               Matrix(4, 1, referenceStates.getData() + t*4);
+      Matrix covarianceDifference = 
+        batch.getCovariance(t) - 
+        Matrix(4, 4, referenceCovariances.getData() + t*16);
+      batchDifference = std::max({batchDifference, stateDifference.max(), 
+                                  -stateDifference.min(), 
+                                  covarianceDifference.max(), 
+                                  -covarianceDifference.min()});
+      if (measured(0, t)) {
+        batchDifference = std::max(batchDifference, std::fabs(
+          batch.getDistances()[t] - referenceDistances(0, t)));
+      }
+      for (int s = 0; s < 4; s++) {
+        if (firstRun) {
+          firstStates(s, t) = batch.getStates(s)[t];
+        } else {
+          isaMismatches += (firstStates(s, t) != batch.getStates(s)[t]);
+        }
+      }
+    }
+    firstRun = false;
+
+    Matrix lastState = batch.getState(tracks - 1);
+    batch.removeTrack(0);
+    Matrix movedDifference = batch.getState(0) - lastState;
+    if ((batch.getCount() != tracks - 1) || (movedDifference.max() != 0) ||
+        (movedDifference.min() != 0)) {
+      std::cout << "FAILED: removing a track did not move the last track\n";
+      return 1;
+    }
+
+    // A track left out by the mask keeps its values bit for bit, even when
+    // its measurement slot holds NaN and infinity
+    for (int t = 0; t < tracks; t++) {
+      measured(0, t) = (t != 3);
+    }
+    positions(0, 3) = std::nan("");
+    positions(1, 3) = std::numeric_limits<double>::infinity();
+    batch.predict();
+    Matrix heldState = batch.getState(3);
+    Matrix heldCovariance = batch.getCovariance(3);
+    double heldDistance = batch.getDistances()[3];
+    batch.update(positions.getData(), tracks, measured.getData());
+    if ((std::memcmp(batch.getState(3).getData(), heldState.getData(),
+                     4 * sizeof(double)) != 0) ||
+        (std::memcmp(batch.getCovariance(3).getData(),
+                     heldCovariance.getData(), 16 * sizeof(double)) != 0) ||
+        (std::memcmp(&batch.getDistances()[3], &heldDistance,
+                     sizeof(double)) != 0) ||
+        !std::isfinite(batch.getStates(0)[2] + batch.getStates(2)[2])) {
+      std::cout << "FAILED: a track left out of an update changed\n";
+      return 1;
+    }
+
+    // A track whose innovation covariance is not positive definite is left
+    // out and reported, and the other tracks of its group are corrected
+    positions(0, 3) = 0;
+    positions(1, 3) = 0;
+    batch.setTrack(5, batch.getState(5), Matrix::identity(4) * -10);
+    Matrix degenerateState = batch.getState(5);
+    Matrix degenerateCovariance = batch.getCovariance(5);
+    Matrix neighbourState = batch.getState(6);
+    long failedTracks = batch.update(positions.getData(), tracks,
+                                     measured.getData());
+    int failureMismatches = 0;
+    for (int t = 0; t < tracks - 1; t++) {
+      failureMismatches += (batch.getFailures()[t] != (t == 5));
+    }
+    if ((failedTracks != 1) || (failureMismatches != 0) ||
+        (std::memcmp(batch.getState(5).getData(), degenerateState.getData(),
+                     4 * sizeof(double)) != 0) ||
+        (std::memcmp(batch.getCovariance(5).getData(),
+                     degenerateCovariance.getData(),
+                     16 * sizeof(double)) != 0) ||
+        (batch.getState(6)(0, 0) == neighbourState(0, 0)) ||
+        !std::isfinite(batch.getState(6)(0, 0) + batch.getDistances()[6])) {
+      std::cout << "FAILED: a track that is not positive definite was not "
+                << "left out and reported\n";
+      return 1;
+    }
+  }
+  setKernelIsa(originalIsa);
+  setMatrixThreads(0);
+  std::cout << "Matches separate filters: " 
+            << ((batchDifference < 1e-9) ? "yes" : "no") 
+            << ", mismatches between instruction sets: " << isaMismatches 
+            << "\n";
+  if (!(batchDifference < 1e-9) || (isaMismatches != 0)) {
+    std::cout << "FAILED: batched filter does not match separate filters\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest linear assignment:\n";
+  // Small problems, with and without a gate and with more rows or columns, 
+  // are compared with every possible assignment. Rows i >= rows and columns
+  // j >= columns of the permutation are dummies, and in the gated problems
+  // a row given a dummy column stays unassigned at the cost of the gate
+  unsigned seed = 12345;
+  auto nextRandom = [&seed](int range) {
+    seed = seed * 1103515245u + 12345u;
+    return (int)((seed >> 16) % range);
+  };
+  LinearAssignment association;
+  int assignmentFailures = 0;
+  for (int trial = 0; trial < 300; trial++) {
+    bool gated = (trial % 2 == 1);
+    int costRows = 1 + nextRandom(gated ? 3 : 4);
+    int costColumns = 1 + nextRandom(gated ? 4 : 5);
+    double gate = gated ? 6 + nextRandom(6) : INFINITY;
+    Matrix costs(costRows, costColumns);
+    for (int i = 0; i < costRows; i++) {
+      for (int j = 0; j < costColumns; j++) {
+        costs(i, j) = (gated && (nextRandom(4) == 0)) ? INFINITY 
+                                                      : nextRandom(15);
+      }
+    }
+
+    int size = gated ? costRows + costColumns 
+                     : std::max(costRows, costColumns);
+    int permutation[9];
+    for (int k = 0; k < size; k++) {
+      permutation[k] = k;
+    }
+    double best = INFINITY;
+    do {
+      double total = 0;
+      for (int i = 0; i < costRows; i++) {
+        int j = permutation[i];
+        if (j >= costColumns) {
+          total += gated ? gate : 0;
+        } else {
+          total += (costs(i, j) <= gate) ? costs(i, j) : INFINITY;
+        }
+      }
+      best = std::min(best, total);
+    } while (std::next_permutation(permutation, permutation + size));
+
+    double total = association.solve(costs, gate);
+    const std::vector<int>& rowAssignment = association.getRowAssignment();
+    const std::vector<int>& columnAssignment = 
+      association.getColumnAssignment();
+    double assigned = 0;
+    double objective = 0;
+    for (int i = 0; i < costRows; i++) {
+      int j = rowAssignment[i];
+      if (j == -1) {
+        objective += gated ? gate : 0;
+      } else if ((columnAssignment[j] != i) || !(costs(i, j) <= gate)) {
+        assignmentFailures++;
+      } else {
+        assigned += costs(i, j);
+      }
+    }
+    objective += assigned;
+    if ((objective != best) || (assigned != total) ||
+        (!gated && (association.getAssignedCount() != 
+                    std::min(costRows, costColumns)))) {
+      assignmentFailures++;
+    }
+  }
+  std::cout << "Matches every possible assignment: " 
+            << ((assignmentFailures == 0) ? "yes" : "no") << "\n";
+
+  // Sparse candidate pairs and a transposed view must give the same total
+  // as the dense costs, and solving again must reuse the work buffers
+  Matrix detections(60, 80);
+  SparseCost candidates(60, 80);
+  for (int i = 0; i < 60; i++) {
+    for (int j = 0; j < 80; j++) {
+      detections(i, j) = nextRandom(1000) * 0.01;
+      if (detections(i, j) <= 0.3) {
+        candidates.add(i, j, detections(i, j));
+      }
+    }
+  }
+  double denseTotal = association.solve(detections, 0.3);
+  int denseCount = association.getAssignedCount();
+  double sparseTotal = association.solve(candidates, 0.3);
+  double transposedTotal = association.solve(detections.view().T(), 0.3);
+  double ungatedTotal = association.solve(detections);
+  double ungatedTransposed = association.solve(detections.view().T());
+  before = allocations;
+  association.solve(detections);
+  association.solve(candidates, 0.3);
+  long assignmentAllocations = allocations - before;
+  std::cout << "Gated assignments: " << denseCount << " of 60, sparse "
+            << "matches dense: " 
+            << ((std::fabs(sparseTotal - denseTotal) < 1e-9) ? "yes" : "no")
+            << ", allocations when solving again: " << assignmentAllocations
+            << "\n";
+  if ((assignmentFailures != 0) || (assignmentAllocations != 0) ||
+      (std::fabs(sparseTotal - denseTotal) > 1e-9) ||
+      (std::fabs(transposedTotal - denseTotal) > 1e-9) || 
+      (std::fabs(ungatedTransposed - ungatedTotal) > 1e-9)) {
+    std::cout << "FAILED: assignment is not optimal\n";
+    return 1;
+  }
+  try {
+    Matrix blocked = Matrix::zeros(2, 2);
+    blocked(0, 0) = INFINITY;
+    blocked(0, 1) = INFINITY;
+    association.solve(blocked);
+    std::cout << "FAILED: solved an infeasible assignment\n";
+    return 1;
+  } catch (const std::invalid_argument&) {
+    std::cout << "Caught an infeasible assignment\n";
+  }
+
+  std::cout << "\n\nTest spatial grid:\n";
+  // The grid must find exactly the pairs within the gating distance, also
+  // when one far away point forces larger cells, and its candidates must 
+  // give the same association as the dense distances
+  SpatialGrid grid;
+  SparseCost gridPairs;
+  Matrix predicted(2000, 2);
+  Matrix measuredPositions(1500, 2);
+  for (int i = 0; i < 2000; i++) {
+    predicted(i, 0) = nextRandom(100000) * 0.001;
+    predicted(i, 1) = nextRandom(100000) * 0.001;
+  }
+  for (int j = 0; j < 1500; j++) {
+    measuredPositions(j, 0) = predicted(j, 0) + (nextRandom(200) - 100)*0.01;
+    measuredPositions(j, 1) = predicted(j, 1) + (nextRandom(200) - 100)*0.01;
+  }
+  const double radius = 1.5;
+  int gridFailures = 0;
+  for (int layout = 0; layout < 2; layout++) {
+    if (layout == 1) {
+      predicted(0, 0) = 1e6;
+    }
+    grid.build(predicted, radius);
+    grid.findPairs(measuredPositions, radius, gridPairs);
+    Matrix distances(2000, 1500);
+    long expectedPairs = 0;
+    for (int i = 0; i < 2000; i++) {
+      for (int j = 0; j < 1500; j++) {
+        double dx = predicted(i, 0) - measuredPositions(j, 0);
+        double dy = predicted(i, 1) - measuredPositions(j, 1);
+        distances(i, j) = dx*dx + dy*dy;
+        expectedPairs += (distances(i, j) <= radius*radius);
+      }
+    }
+    for (long e = 0; e < gridPairs.getCount(); e++) {
+      if (distances(gridPairs.getRow(e), gridPairs.getColumn(e)) != 
+          gridPairs.getCost(e)) {
+        gridFailures++;
+      }
+    }
+    double gridTotal = association.solve(gridPairs, radius*radius);
+    double distanceTotal = association.solve(distances, radius*radius);
+    std::cout << "Cell size " << grid.getCellSize() << ": " 
+              << gridPairs.getCount() << " of " << expectedPairs 
+              << " pairs found\n";
+    if ((gridPairs.getCount() != expectedPairs) ||
+        (std::fabs(gridTotal - distanceTotal) > 1e-9)) {
+      gridFailures++;
+    }
+  }
+  before = allocations;
+  grid.build(predicted, radius);
+  grid.findPairs(measuredPositions, radius, gridPairs);
+  long gridAllocations = allocations - before;
+  std::cout << "Allocations when rebuilding: " << gridAllocations << "\n";
+
+  // Finite points whose distance overflows a double still build a grid in
+  // which every point finds itself
+  double farCoordinates[] = {-1e308, -1e308, 1e308, 1e308, 1e308, -1e308,
+                             -1e308, 1e308, 0, 0, 1, 1};
+  Matrix extremePoints(6, 2, farCoordinates);
+  for (double cell : {1e-300, 1.0, 1e300}) {
+    grid.build(extremePoints, cell);
+    grid.findPairs(extremePoints, 0.5, gridPairs);
+    gridFailures += (gridPairs.getCount() != 6);
+    for (long e = 0; e < gridPairs.getCount(); e++) {
+      gridFailures += (gridPairs.getRow(e) != gridPairs.getColumn(e));
+    }
+  }
+  if ((gridFailures != 0) || (gridAllocations != 0)) {
+    std::cout << "FAILED: spatial grid did not find the gated pairs\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest sparse matrices:\n";
+  // Every operation in both formats must match the same operation on dense
+  // matrices, with products large enough to be split between threads
+  Matrix sparseLeft = Matrix::zeros(1200, 900);
+  Matrix sparseRight = Matrix::zeros(1200, 900);
+  for (int k = 0; k < 20000; k++) {
+    sparseLeft(nextRandom(1200), nextRandom(900)) = nextRandom(100) - 50;
+    sparseRight(nextRandom(1200), nextRandom(900)) = nextRandom(100) - 50;
+  }
+  sparseRight(0, 0) = -sparseLeft(0, 0) + 1;
+  sparseRight(0, 1) = -sparseLeft(0, 1);
+  Matrix denseFactor(900, 7);
+  Matrix denseVector(900, 1);
+  for (int i = 0; i < 900; i++) {
+    for (int j = 0; j < 7; j++) {
+      denseFactor(i, j) = nextRandom(1000) * 0.001;
+    }
+    denseVector(i, 0) = nextRandom(1000) * 0.001;
+  }
+  auto nonZeros = [](const Matrix& mat) {
+    long count = 0;
+    for (long k = 0; k < (long)mat.getRows() * mat.getColumns(); k++) {
+      count += (mat.getData()[k] != 0);
+    }
+    return count;
+  };
+  auto sameMatrix = [](const Matrix& left, const Matrix& right) {
+    Matrix difference = left - right;
+    return (difference.max() < 1e-9) && (difference.min() > -1e-9);
+  };
+  int sparseFailures = 0;
+  setMatrixThreads(4);
+  for (SparseFormat sparseFormat : {SparseFormat::CSR, SparseFormat::CSC}) {
+    SparseMatrix left = SparseMatrix::fromDense(sparseLeft, sparseFormat);
+    SparseMatrix right = SparseMatrix::fromDense(sparseRight);
+    sparseFailures += !sameMatrix(left.toDense(), sparseLeft);
+    sparseFailures += (left.getNonZeros() != nonZeros(sparseLeft));
+    sparseFailures += !sameMatrix(left.T().toDense(), sparseLeft.T());
+    sparseFailures += !sameMatrix(left.toCSR().toDense(), sparseLeft);
+    sparseFailures += !sameMatrix(left.toCSC().toDense(), sparseLeft);
+    sparseFailures += !sameMatrix(left * denseFactor, 
+                                  sparseLeft * denseFactor);
+    sparseFailures += !sameMatrix(left * denseVector, 
+                                  sparseLeft * denseVector);
+    sparseFailures += !sameMatrix(left.T() * sparseLeft.block(0, -1, 3, 9), 
+                                  sparseLeft.T() * sparseLeft.block(0, -1, 3, 
+                                                                    9));
+    MatrixView strided = sparseRight.view().T().block(0, -1, 0, 6);
+    sparseFailures += !sameMatrix(left * strided, sparseLeft * strided);
+    Matrix denseSum = sparseLeft + sparseRight;
+    Matrix denseDifference = sparseLeft - sparseRight;
+    Matrix denseProduct = Matrix::multiplyElementwise(sparseLeft, 
+                                                      sparseRight);
+    SparseMatrix sum = left + right;
+    SparseMatrix difference = left - right;
+    SparseMatrix product = SparseMatrix::multiplyElementwise(left, right);
+    sparseFailures += !sameMatrix(sum.toDense(), denseSum);
+    sparseFailures += (sum.getNonZeros() != nonZeros(denseSum));
+    sparseFailures += !sameMatrix(difference.toDense(), denseDifference);
+    sparseFailures += !sameMatrix(product.toDense(), denseProduct);
+    sparseFailures += (product.getNonZeros() != nonZeros(denseProduct));
+    sparseFailures += !sameMatrix((left * 2.5 / 5).toDense(), 
+                                  sparseLeft * 0.5);
+    sparseFailures += (left(0, 1) != sparseLeft(0, 1)) || 
+                      (left(1199, 899) != sparseLeft(1199, 899));
+  }
+  setMatrixThreads(0);
+  int tripletRows[] = {2, 0, 2, 1, 2};
+  int tripletColumns[] = {1, 3, 1, 0, 0};
+  double tripletValues[] = {1, 2, 3, 4, 5};
+  SparseMatrix triplets = SparseMatrix::fromTriplets(
+    3, 4, 5, tripletRows, tripletColumns, tripletValues, SparseFormat::CSC);
+  triplets.print(1);
+  sparseFailures += (triplets.getNonZeros() != 4) || (triplets(2, 1) != 4);
+  std::cout << "Matches dense operations: " 
+            << ((sparseFailures == 0) ? "yes" : "no") << "\n";
+  if (sparseFailures != 0) {
+    std::cout << "FAILED: sparse operations do not match dense\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest reductions:\n";
+  // The fused statistics of whole matrices, blocks, transposed views and 
+  // every row and column must match separate loops over the elements, and 
+  // must not depend on the instruction set or the number of threads
+  Matrix reduced(700, 300);
+  for (int i = 0; i < 700; i++) {
+    for (int j = 0; j < 300; j++) {
+      reduced(i, j) = 1000 + nextRandom(100000) * 0.01;
+    }
+  }
+  reduced(123, 45) = 900;
+  reduced(456, 78) = 900;
+  reduced(600, 12) = 2100;
+  auto expectStatistics = [](const MatrixView& view) {
+    Statistics expected = {0, INFINITY, -INFINITY, {-1, -1}, {-1, -1}, 0, 0, 
+                           0, 0};
+    for (int i = 0; i < view.getRows(); i++) {
+      for (int j = 0; j < view.getColumns(); j++) {
+        double value = view(i, j);
+        expected.count++;
+        expected.sum += value;
+        expected.sumSquares += value * value;
+        if (value < expected.min) {
+          expected.min = value;
+          expected.minIndex = {i, j};
+        }
+        if (value > expected.max) {
+          expected.max = value;
+          expected.maxIndex = {i, j};
+        }
+      }
+    }
+    expected.mean = expected.sum / expected.count;
+    for (int i = 0; i < view.getRows(); i++) {
+      for (int j = 0; j < view.getColumns(); j++) {
+        double difference = view(i, j) - expected.mean;
+        expected.variance += difference * difference / expected.count;
+      }
+    }
+    return expected;
+  };
+  auto sameStatistics = [](const Statistics& a, const Statistics& b) {
+    auto close = [](double x, double y) {
+      return std::fabs(x - y) <= 1e-9 * std::max(1.0, std::fabs(y));
+    };
+    return (a.count == b.count) && (a.min == b.min) && (a.max == b.max) &&
+           (a.minIndex.r == b.minIndex.r) && (a.minIndex.c == b.minIndex.c) &&
+           (a.maxIndex.r == b.maxIndex.r) && (a.maxIndex.c == b.maxIndex.c) &&
+           close(a.sum, b.sum) && close(a.sumSquares, b.sumSquares) && 
+           close(a.mean, b.mean) && 
+           (std::fabs(a.variance - b.variance) < 1e-6);
+  };
+  auto identical = [](const Statistics& a, const Statistics& b) {
+    return (a.sum == b.sum) && (a.sumSquares == b.sumSquares) && 
+           (a.variance == b.variance) && (a.minIndex.r == b.minIndex.r) &&
+           (a.maxIndex.c == b.maxIndex.c);
+  };
+  MatrixView reducedViews[] = {reduced.view(), 
+                               reduced.block(100, 650, 7, 290), 
+                               reduced.view().T(), 
+                               reduced.view().T().block(3, 250, 40, 500)};
+  int reduceFailures = 0;
+  Statistics firstReduction = reduce(reduced);
+  for (KernelIsa isa : transposeIsas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    for (int threads : {1, 4}) {
+      setMatrixThreads(threads);
+      reduceFailures += !identical(reduce(reduced), firstReduction);
+      for (const MatrixView& view : reducedViews) {
+        reduceFailures += !sameStatistics(reduce(view), 
+                                          expectStatistics(view));
+        std::vector<Statistics> perColumn = reduce(view, 0);
+        std::vector<Statistics> perRow = reduce(view, 1);
+        for (int j = 0; j < view.getColumns(); j++) {
+          Statistics expected = expectStatistics(view.column(j));
+          expected.minIndex.c = expected.maxIndex.c = j;
+          reduceFailures += !sameStatistics(perColumn[j], expected);
+        }
+        for (int i = 0; i < view.getRows(); i++) {
+          Statistics expected = expectStatistics(view.row(i));
+          expected.minIndex.r = expected.maxIndex.r = i;
+          reduceFailures += !sameStatistics(perRow[i], expected);
+        }
+      }
+    }
+  }
+  setKernelIsa(originalIsa);
+  setMatrixThreads(0);
+  Statistics whole = reduce(reduced);
+  std::cout << "Minimum " << whole.min << " at (" << whole.minIndex.r << ", "
+            << whole.minIndex.c << "), maximum " << whole.max << " at (" 
+            << whole.maxIndex.r << ", " << whole.maxIndex.c << ")\n";
+
+  // NaN is skipped by the minimum and maximum, and infinities are found
+  double special[] = {NAN, INFINITY, INFINITY, NAN};
+  Statistics infinite = reduce(Matrix(2, 2, special).block(0, 1, 1, 1));
+  Statistics withNan = reduce(Matrix(2, 2, special));
+  reduceFailures += (infinite.min != INFINITY) || (infinite.minIndex.r != 0) ||
+                    (withNan.maxIndex.r != 0) || (withNan.maxIndex.c != 1) ||
+                    !std::isnan(withNan.sum);
+  std::cout << "Matches separate loops: " 
+            << ((reduceFailures == 0) ? "yes" : "no") << "\n";
+  if (reduceFailures != 0) {
+    std::cout << "FAILED: reductions do not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest broadcasting:\n";
+  // Rows, columns and single elements combined with matrices and views must
+  // match explicit loops, without being copied to the full size, and the
+  // statistics along an axis must match reduce()
+  double smallValues[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  Matrix small(3, 4, smallValues);
+  Matrix smallCentered = small - mean(small, 0);
+  smallCentered.print(2);
+  std::cout << "\n";
+  Matrix(small / max(small, 1)).print(2);
+
+  Matrix samples(37, 23);
+  for (int i = 0; i < 37; i++) {
+    for (int j = 0; j < 23; j++) {
+      samples(i, j) = nextRandom(1000) * 0.1 + 1;
+    }
+  }
+  int broadcastFailures = 0;
+  Matrix columnMeans = mean(samples, 0);
+  Matrix columnSums = sum(samples, 0);
+  Matrix rowMinima = min(samples, 1);
+  Matrix rowMaxima = max(samples, 1);
+  std::vector<int> rowPeaks = argmax(samples, 1);
+  std::vector<int> columnLows = argmin(samples, 0);
+  std::vector<Statistics> perColumn = reduce(samples, 0);
+  std::vector<Statistics> perRow = reduce(samples, 1);
+  broadcastFailures += (columnMeans.getRows() != 1) || 
+                       (columnMeans.getColumns() != 23) ||
+                       (rowMaxima.getRows() != 37) || 
+                       (rowMaxima.getColumns() != 1) ||
+                       (rowPeaks.size() != 37) || (columnLows.size() != 23);
+  for (int j = 0; j < 23; j++) {
+    broadcastFailures += (columnMeans(0, j) != perColumn[j].mean) ||
+                         (columnSums(0, j) != perColumn[j].sum) ||
+                         (columnLows[j] != perColumn[j].minIndex.r);
+  }
+  for (int i = 0; i < 37; i++) {
+    broadcastFailures += (rowMinima(i, 0) != perRow[i].min) ||
+                         (rowMaxima(i, 0) != perRow[i].max) ||
+                         (samples(i, rowPeaks[i]) != rowMaxima(i, 0));
+  }
+
+  double scaleValue = 4;
+  Matrix scale(1, 1, &scaleValue);
+  Matrix centered = samples - columnMeans;
+  Matrix ratios = rowMaxima / samples;
+  Matrix normalized = (samples - columnMeans) / (rowMaxima - rowMinima) + 
+                      scale;
+  Matrix outer = columnMeans + rowMaxima;
+  Matrix products = Matrix::multiplyElementwise(samples, rowMinima);
+  Matrix transposed = samples.view().T() - rowMaxima.view().T();
+  Matrix compound = samples;
+  compound -= columnMeans;
+  compound /= rowMaxima;
+  compound += scale;
+  Matrix padded = Matrix::zeros(37, 30);
+  padded.block(0, -1, 4, 26) = Matrix::add(rowMinima, samples);
+  auto near = [](double x, double y) {
+    return std::fabs(x - y) <= 1e-12 * std::max(1.0, std::fabs(y));
+  };
+  for (int i = 0; i < 37; i++) {
+    for (int j = 0; j < 23; j++) {
+      double x = samples(i, j);
+      double m = columnMeans(0, j);
+      broadcastFailures += 
+        !near(centered(i, j), x - m) || 
+        !near(ratios(i, j), rowMaxima(i, 0) / x) ||
+        !near(normalized(i, j), 
+              (x - m) / (rowMaxima(i, 0) - rowMinima(i, 0)) + 4) ||
+        !near(outer(i, j), m + rowMaxima(i, 0)) ||
+        !near(products(i, j), x * rowMinima(i, 0)) ||
+        !near(transposed(j, i), x - rowMaxima(i, 0)) ||
+        !near(compound(i, j), (x - m) / rowMaxima(i, 0) + 4) ||
+        !near(padded(i, j + 4), rowMinima(i, 0) + x);
+    }
+  }
+  broadcastFailures += (padded.block(0, -1, 0, 3).max() != 0) ||
+                       (padded.block(0, -1, 27, 29).max() != 0);
+
+  // A temporary that is broadcast must not be reused for the larger result
+  Matrix fromTemporary = samples + scale * columnMeans;
+  for (int j = 0; j < 23; j++) {
+    broadcastFailures += !near(fromTemporary(36, j), 
+                               samples(36, j) + 4 * columnMeans(0, j));
+  }
+
+  // Evaluating into an existing matrix of the right size allocates nothing
+  before = allocations;
+  centered = samples - columnMeans;
+  compound += rowMaxima;
+  broadcastFailures += (allocations != before);
+  std::cout << "Allocations when broadcasting into existing matrices: "
+            << (allocations - before) << "\n";
+
+  // Sizes that cannot be broadcast, or a result larger than the destination
+  int broadcastErrors = 0;
+  try {
+    Matrix mismatched = samples + Matrix(2, 23);
+  } catch (const std::invalid_argument&) {
+    broadcastErrors++;
+  }
+  try {
+    columnMeans += samples;
+  } catch (const std::invalid_argument&) {
+    broadcastErrors++;
+  }
+  broadcastFailures += (broadcastErrors != 2);
+  std::cout << "Matches explicit loops: " 
+            << ((broadcastFailures == 0) ? "yes" : "no") << "\n";
+  if (broadcastFailures != 0) {
+    std::cout << "FAILED: broadcasting does not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest growing matrices:\n";
+  // Rows appended one at a time must only reallocate O(log n) times, columns 
+  // must be appended in place while the capacity lasts, and stacking must 
+  // allocate the result once
+  int growFailures = 0;
+  Matrix events(0, 0);
+  double detection[3];
+  MatrixView detectionRow(detection, 1, 3, 3);
+  before = allocations;
+  for (int i = 0; i < 1000; i++) {
+    detection[0] = i;
+    detection[1] = i * 0.5;
+    detection[2] = -i;
+    events.pushRow(detectionRow);
+  }
+  long growAllocations = allocations - before;
+  for (int i = 0; i < 1000; i++) {
+    growFailures += (events(i, 0) != i) || (events(i, 1) != i * 0.5) ||
+                    (events(i, 2) != -i);
+  }
+  growFailures += (events.getRows() != 1000) || (growAllocations > 12) ||
+                  (events.getCapacity() < 3000);
+  std::cout << "Allocations for 1000 appended rows: " << growAllocations 
+            << "\n";
+
+  // Reserved capacity is used without allocating, and columns are appended
+  // by moving the rows apart
+  Matrix grown(2, 2, smallValues);
+  Matrix unit = Matrix::identity(2);
+  grown.reserve(3, 4);
+  before = allocations;
+  grown.pushRow(unit.view().row(1));
+  grown.pushColumn(small.view().column(0));
+  grown.pushColumn(small.view().row(0).block(0, 0, 0, 2));
+  growFailures += (allocations != before);
+  grown.print(1);
+  double grownValues[] = {1, 2, 1, 1, 3, 4, 5, 2, 0, 1, 9, 3};
+  growFailures += (Matrix(grown - Matrix(3, 4, grownValues)).max() != 0) ||
+                  (Matrix(grown - Matrix(3, 4, grownValues)).min() != 0);
+  grown.shrinkToFit();
+  growFailures += (grown.getCapacity() != 12);
+
+  // A matrix may be appended to itself, and many parts are stacked at once
+  Matrix doubled = small;
+  doubled.concatenate(doubled, 1);
+  doubled.pushRow(doubled.view().row(0));
+  growFailures += (doubled.getRows() != 7) || (doubled(6, 3) != 4) ||
+                  (doubled(5, 0) != 9);
+  Matrix padding = Matrix::zeros(3, 2);
+  before = allocations;
+  Matrix stacked = Matrix::stack({small, small.block(1, 2), 
+                                  small.view().T().block(0, 3, 0, 0).T()});
+  Matrix sideBySide = Matrix::hstack({small, small.block(0, -1, 3, 3), 
+                                      padding});
+  // One array per result, and one for each list of parts
+  growFailures += (allocations - before != 4);
+  growFailures += (stacked.getRows() != 6) || (stacked(3, 0) != 5) ||
+                  (stacked(5, 3) != 4) || (sideBySide.getColumns() != 7) ||
+                  (sideBySide(2, 4) != 12) || (sideBySide(1, 6) != 0);
+  try {
+    Matrix::stack({small, Matrix(2, 3)});
+  } catch (const std::invalid_argument&) {
+    growFailures--;
+  }
+  growFailures++;
+  std::cout << "Matches the appended values: " 
+            << ((growFailures == 0) ? "yes" : "no") << "\n";
+  if (growFailures != 0) {
+    std::cout << "FAILED: growing matrices does not match\n";
+    return 1;
+  }
+
+
+  std::cout << "\n\nTest external buffers:\n";
+  // Borrowed and adopted arrays are used in place, adopted arrays are
+  // released exactly once by their deleter, and release() hands them back
+  int bufferFailures = 0;
+  double received[6] = {1, 2, 3, 4, 5, 6};
+  before = allocations;
+  Matrix borrowed = Matrix::borrow(received, 2, 3);
+  borrowed *= 2;
+  Matrix shifted = Matrix::borrow(received, 2, 3) + 1.0;
+  bufferFailures += (allocations - before != 1) || !borrowed.isBorrowed() ||
+                    (borrowed.getData() != received) || (received[5] != 12) ||
+                    (shifted(1, 2) != 13) || (shifted.getData() == received);
+  borrowed.print(1);
+
+  int deleted = 0;
+  double* owned = new double[6];
+  std::copy(received, received + 6, owned);
+  {
+    Matrix adopted = Matrix::adopt(owned, 3, 2, deleteAdopted, &deleted);
+    Matrix handedOver = std::move(adopted);
+    bufferFailures += (handedOver.getData() != owned) || 
+                      handedOver.isBorrowed() || (handedOver(2, 1) != 12);
+    handedOver.pushRow(handedOver.view().row(0));
+    bufferFailures += (deleted != 1) || (handedOver(3, 1) != 4);
+  }
+  bufferFailures += (deleted != 1);
+  owned = new double[6];
+  {
+    Matrix adopted = Matrix::adopt(owned, 2, 3, deleteAdopted, &deleted);
+    double* returned = adopted.release();
+    bufferFailures += (returned != owned) || (adopted.getRows() != 0);
+  }
+  bufferFailures += (deleted != 1);
+  delete[] owned;
+  try {
+    Matrix::adopt(received, 2, 3, nullptr);
+  } catch (const std::invalid_argument&) {
+    bufferFailures--;
+  }
+  bufferFailures++;
+
+  // Frames of other element types are wrapped the same way
+  uint8_t decoded[4] = {0, 51, 102, 255};
+  BasicMatrix<uint8_t> wrapped = BasicMatrix<uint8_t>::borrow(decoded, 2, 2);
+  BasicMatrix<float> scaled = wrapped.convert<float>(1.0 / 255);
+  wrapped += 1;
+  bufferFailures += (decoded[0] != 1) || (decoded[3] != 255) ||
+                    (std::fabs(scaled(0, 1) - 0.2f) > 1e-6) ||
+                    (wrapped.release() != decoded);
+  std::cout << "Matches the wrapped values: " 
+            << ((bufferFailures == 0) ? "yes" : "no") << "\n";
+  if (bufferFailures != 0) {
+    std::cout << "FAILED: external buffers do not match\n";
+    return 1;
+  }
+
+
+  std::cout << "\n\nTest image filtering:\n";
+  // Every filter must match a direct correlation for every border mode, give
+  // identical results for every instruction set, and work in place
+  int filterFailures = 0;
+  Image colors(37, 23, 3);
+  for (int y = 0; y < colors.getHeight(); y++) {
+    for (int x = 0; x < colors.getWidth(); x++) {
+      for (int c = 0; c < 3; c++) {
+        colors(y, x, c) = (float)std::sin(0.37*x + 0.71*y + 1.3*c);
+      }
+    }
+  }
+  filterFailures += (colors.getStride() % 16 != 0) || 
+                    (colors.getStride() < 37 * 3);
+  double smoothing[] = {1, 4, 6, 4, 1};
+  double derivative[] = {-1, 0, 1};
+  std::vector<float> rowKernel = {1, 4, 6, 4, 1};
+  std::vector<float> columnKernel = {-1, 0, 1};
+  Matrix separable = Matrix(Matrix(3, 1, derivative) * 
+                            Matrix(1, 5, smoothing));
+  double laplacian[] = {0, 1, 0, 1, -4, 1, 0, 1, 0};
+  Matrix cross(3, 3, laplacian);
+  BorderMode borders[] = {BorderMode::Constant, BorderMode::Replicate, 
+                          BorderMode::Reflect, BorderMode::Wrap};
+  const char* borderNames[] = {"constant", "replicate", "reflect", "wrap"};
+  Image filtered;
+  for (int b = 0; b < 4; b++) {
+    filterSeparable(colors, filtered, rowKernel, columnKernel, borders[b]);
+    double separableError = filterError(colors, filtered, separable, 
+                                        borders[b]);
+    filter2D(colors, filtered, cross, borders[b]);
+    double directError = filterError(colors, filtered, cross, borders[b]);
+    std::cout << borderNames[b] << ": separable error " 
+              << (separableError < 1e-4 ? "< 1e-4" : "too large") 
+              << ", direct error " 
+              << (directError < 1e-4 ? "< 1e-4" : "too large") << "\n";
+    filterFailures += (separableError >= 1e-4) || (directError >= 1e-4);
+  }
+
+  // Kernels larger than the image walk back into it more than once
+  Image tiny(3, 2, 1);
+  for (int i = 0; i < 6; i++) {
+    tiny(i / 3, i % 3) = (float)(i * i);
+  }
+  Matrix tall(7, 1);
+  for (int i = 0; i < 7; i++) {
+    tall(i, 0) = 1 + i;
+  }
+  Matrix tinyKernel = Matrix(tall * Matrix(1, 5, smoothing));
+  for (int b = 0; b < 4; b++) {
+    filter2D(tiny, filtered, tinyKernel, borders[b]);
+    filterFailures += (filterError(tiny, filtered, tinyKernel, borders[b]) 
+                       >= 1e-3);
+  }
+
+  // A separable kernel given as a matrix takes the two pass path
+  Image detected;
+  filter2D(colors, detected, separable);
+  filterSeparable(colors, filtered, rowKernel, columnKernel);
+  double pathDifference = 0;
+  for (int y = 0; y < colors.getHeight(); y++) {
+    for (int x = 0; x < colors.getWidth() * 3; x++) {
+      pathDifference = std::max(pathDifference, 
+                                (double)std::fabs(detected.row(y)[x] - 
+                                                  filtered.row(y)[x]));
+    }
+  }
+  filterFailures += (pathDifference != 0);
+
+  // Gaussian blur and Sobel gradients, compared on a single channel image
+  Image gray = Image::fromMatrix(Matrix(colors.toMatrix(1)));
+  std::vector<float> gaussian = gaussianKernel(1.5);
+  double gaussianSum = 0;
+  for (float weight : gaussian) {
+    gaussianSum += weight;
+  }
+  Matrix gaussianRow(1, (int)gaussian.size());
+  for (std::size_t i = 0; i < gaussian.size(); i++) {
+    gaussianRow(0, (int)i) = gaussian[i];
+  }
+  Image blurred;
+  gaussianBlur(gray, blurred, 1.5);
+  double blurError = filterError(gray, blurred, 
+                                 Matrix(gaussianRow.T() * gaussianRow), 
+                                 BorderMode::Reflect);
+  Image dx;
+  Image dy;
+  sobel(gray, dx, dy);
+  double sobelX[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+  double sobelError = std::max(
+    filterError(gray, dx, Matrix(3, 3, sobelX), BorderMode::Reflect),
+    filterError(gray, dy, Matrix(Matrix(3, 3, sobelX).T()), 
+                BorderMode::Reflect));
+  std::cout << "Gaussian of " << gaussian.size() << " taps, sum " 
+            << std::setprecision(5) << gaussianSum << ", blur error " 
+            << (blurError < 1e-5 ? "< 1e-5" : "too large") 
+            << ", Sobel error " << (sobelError < 1e-5 ? "< 1e-5" : "too large")
+            << "\n";
+  filterFailures += (blurError >= 1e-5) || (sobelError >= 1e-5) || 
+                    (std::fabs(gaussianSum - 1) > 1e-6);
+
+  // Filtering in place matches filtering into another image, and an output
+  // of the right size keeps its array
+  Image inPlace = colors;
+  float* outputArray = filtered.getData();
+  gaussianBlur(colors, filtered, 1.0);
+  gaussianBlur(inPlace, inPlace, 1.0);
+  int inPlaceMismatches = 0;
+  for (int y = 0; y < colors.getHeight(); y++) {
+    for (int x = 0; x < colors.getWidth() * 3; x++) {
+      inPlaceMismatches += (inPlace.row(y)[x] != filtered.row(y)[x]);
+    }
+  }
+  filterFailures += (inPlaceMismatches != 0) || 
+                    (filtered.getData() != outputArray);
+
+  // Every instruction set gives the same values as the scalar loops
+  setKernelIsa(KernelIsa::Scalar);
+  Image scalarBlur = gaussianBlur(colors, 2.0);
+  Image scalarDirect = filter2D(colors, cross);
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    Image isaBlur = gaussianBlur(colors, 2.0);
+    Image isaDirect = filter2D(colors, cross);
+    int isaMismatches = 0;
+    for (int y = 0; y < colors.getHeight(); y++) {
+      for (int x = 0; x < colors.getWidth() * 3; x++) {
+        isaMismatches += (isaBlur.row(y)[x] != scalarBlur.row(y)[x]) ||
+                         (isaDirect.row(y)[x] != scalarDirect.row(y)[x]);
+      }
+    }
+    std::cout << isaName(isa) << " filter mismatches: " << isaMismatches 
+              << "\n";
+    filterFailures += isaMismatches;
+  }
+  setKernelIsa(originalIsa);
+
+  // 8 bit frames with padded rows are converted in and out
+  std::uint8_t paddedFrame[4 * 8];
+  for (int i = 0; i < 32; i++) {
+    paddedFrame[i] = (std::uint8_t)(i * 7);
+  }
+  Image fromFrame = Image::fromPixels(paddedFrame, 2, 4, 3, 8, 1 / 255.0);
+  std::uint8_t roundTrip[4 * 6];
+  fromFrame.toPixels(roundTrip, 6, 255);
+  for (int y = 0; y < 4; y++) {
+    for (int i = 0; i < 6; i++) {
+      filterFailures += (roundTrip[y*6 + i] != paddedFrame[y*8 + i]);
+    }
+  }
+  Image wrappedFrame = Image::borrow(colors.getData(), 10, 5, 3, 
+                                     colors.getStride());
+  filterFailures += (wrappedFrame(4, 9, 2) != colors(4, 9, 2)) ||
+                    !wrappedFrame.isBorrowed();
+
+  // A borrowed region of a larger frame takes filter outputs of its size in
+  // place, without touching the values between its rows, and an output of
+  // another size gets an array of its own
+  Image region(10, 5, 3);
+  for (int y = 0; y < 5; y++) {
+    std::copy(colors.row(y), colors.row(y) + 30, region.row(y));
+  }
+  std::vector<float> frameBuffer(4 * 40 + 30, -7.0f);
+  Image borrowedOutput = Image::borrow(frameBuffer.data(), 10, 5, 3, 40);
+  gaussianBlur(region, borrowedOutput, 1.0);
+  Image regionBlur = gaussianBlur(region, 1.0);
+  int regionMismatches = (borrowedOutput.getCapacity() != 190) ||
+                         (borrowedOutput.getData() != frameBuffer.data());
+  for (int i = 0; i < 190; i++) {
+    int y = i / 40;
+    int x = i % 40;
+    regionMismatches += (x < 30) ? (frameBuffer[i] != regionBlur.row(y)[x])
+                                 : (frameBuffer[i] != -7.0f);
+  }
+  std::vector<float> regionValues = frameBuffer;
+  gaussianBlur(colors, borrowedOutput, 1.0);
+  regionMismatches += borrowedOutput.isBorrowed() ||
+                      (borrowedOutput.getWidth() != 37) ||
+                      (frameBuffer != regionValues);
+  filterFailures += regionMismatches;
+  try {
+    Image::borrow(colors.getData(), 37, 23, 3, 100);
+  } catch (const std::invalid_argument&) {
+    filterFailures--;
+  }
+  filterFailures++;
+  std::cout << "Matches the reference filters: " 
+            << ((filterFailures == 0) ? "yes" : "no") << "\n";
+  if (filterFailures != 0) {
+    std::cout << "FAILED: image filtering does not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest integral images:\n";
+  // Rectangle statistics must match rescanning the pixels, 8 bit sums must
+  // be exact, and the tables must not depend on the number of threads
+  int integralFailures = 0;
+  Image patches(45, 70, 2);
+  for (int y = 0; y < patches.getHeight(); y++) {
+    for (int x = 0; x < patches.getWidth(); x++) {
+      patches(y, x, 0) = (float)std::cos(0.23*x - 0.41*y);
+      patches(y, x, 1) = (float)(100 + ((x * 31 + y * 17) % 23));
+    }
+  }
+  IntegralImage patchSums(patches, true);
+  int windows[][4] = {{0, 69, 0, 44}, {3, 3, 7, 7}, {10, 41, 5, 36},
+                      {64, 69, 40, 44}, {0, 0, 0, 44}, {-6, -1, -5, -1}};
+  for (auto& window : windows) {
+    int minRow = (window[0] < 0) ? window[0] + 70 : window[0];
+    int maxRow = (window[1] < 0) ? window[1] + 70 : window[1];
+    int minCol = (window[2] < 0) ? window[2] + 45 : window[2];
+    int maxCol = (window[3] < 0) ? window[3] + 45 : window[3];
+    for (int c = 0; c < 2; c++) {
+      Matrix plane = patches.toMatrix(c);
+      Statistics scanned = reduce(plane.block(minRow, maxRow, minCol,
+                                              maxCol));
+      double total = patchSums.sum(window[0], window[1], window[2],
+                                   window[3], c);
+      double average = patchSums.mean(window[0], window[1], window[2],
+                                      window[3], c);
+      double spread = patchSums.variance(window[0], window[1], window[2],
+                                         window[3], c);
+      double squaresTotal = patchSums.sumSquares(window[0], window[1],
+                                                 window[2], window[3], c);
+      integralFailures += 
+        (std::abs(total - scanned.sum) > 1e-9 * (1 + std::abs(scanned.sum))) ||
+        (std::abs(average - scanned.mean) > 1e-9) ||
+        (std::abs(spread - scanned.variance) > 1e-7 * (1 + scanned.mean)) ||
+        (std::abs(squaresTotal - scanned.sumSquares) > 
+         1e-9 * scanned.sumSquares);
+    }
+  }
+
+  // A matrix view with a column stride gives the same sums as its copy
+  Matrix integralSource = patches.toMatrix(0);
+  IntegralImage viewSums(integralSource.view().T());
+  IntegralImage copySums(integralSource.T());
+  integralFailures += (viewSums.getWidth() != 70) ||
+                      (viewSums.getHeight() != 45) ||
+                      (viewSums.sum(2, 30, 4, 50) != 
+                       copySums.sum(2, 30, 4, 50));
+
+  // 8 bit sums are exact, even for the squares of a large bright frame
+  const int brightWidth = 1500;
+  const int brightHeight = 1100;
+  long brightStride = brightWidth * 3 + 5;
+  long brightBytes = brightStride * brightHeight;
+  std::uint8_t* bright = (std::uint8_t*)std::malloc(brightBytes);
+  for (long i = 0; i < brightBytes; i++) {
+    bright[i] = (std::uint8_t)(250 + i % 6);
+  }
+  double exactSum = 0;
+  double exactSquares = 0;
+  for (int y = 100; y < 1000; y++) {
+    for (int x = 7; x < 1400; x++) {
+      double value = bright[y*brightStride + x*3 + 2];
+      exactSum += value;
+      exactSquares += value * value;
+    }
+  }
+  IntegralImage brightSums;
+  brightSums.compute(bright, brightWidth, brightHeight, 3, 
+                     brightStride, true);
+  integralFailures += (brightSums.sum(100, 999, 7, 1399, 2) != exactSum) ||
+                      (brightSums.sumSquares(100, 999, 7, 1399, 2) != 
+                       exactSquares);
+  std::free(bright);
+
+  // The tables are the same for one thread and for several
+  Image wide(600, 300, 1);
+  for (int y = 0; y < wide.getHeight(); y++) {
+    for (int x = 0; x < wide.getWidth(); x++) {
+      wide(y, x) = (float)std::sin(0.013*x*y + 0.1*x);
+    }
+  }
+  setMatrixThreads(1);
+  IntegralImage serialSums(wide, true);
+  setMatrixThreads(4);
+  IntegralImage threadedSums(wide, true);
+  setMatrixThreads(0);
+  for (long i = 0; i < 301L * 601; i++) {
+    integralFailures += 
+      (serialSums.getSums().getData()[i] != 
+       threadedSums.getSums().getData()[i]) ||
+      (serialSums.getSquares().getData()[i] != 
+       threadedSums.getSquares().getData()[i]);
+  }
+
+  // Rebuilding keeps the tables, and box filters average the clipped window
+  const double* sumsArray = threadedSums.getSums().getData();
+  before = allocations;
+  threadedSums.compute(wide, true);
+  long rebuildAllocations = allocations - before;
+  std::cout << "Allocations when rebuilding: " << rebuildAllocations << "\n";
+  integralFailures += (threadedSums.getSums().getData() != sumsArray) ||
+                      (rebuildAllocations != 0);
+  Image boxed;
+  boxFilter(patches, boxed, 3, 2);
+  for (int y = 0; y < patches.getHeight(); y++) {
+    for (int x = 0; x < patches.getWidth(); x++) {
+      for (int c = 0; c < 2; c++) {
+        double expected = 0;
+        int count = 0;
+        for (int i = std::max(0, y - 2); i <= std::min(69, y + 2); i++) {
+          for (int j = std::max(0, x - 3); j <= std::min(44, x + 3); j++) {
+            expected += patches(i, j, c);
+            count++;
+          }
+        }
+        integralFailures += 
+          (std::abs(boxed(y, x, c) - expected / count) > 1e-4);
+      }
+    }
+  }
+
+  // Rectangles outside the image and missing squares throw
+  try {
+    patchSums.sum(0, 70, 0, 10);
+  } catch (const std::invalid_argument&) {
+    integralFailures--;
+  }
+  try {
+    viewSums.variance();
+  } catch (const std::invalid_argument&) {
+    integralFailures--;
+  }
+  integralFailures += 2;
+  std::cout << "Matches rescanned windows: " 
+            << ((integralFailures == 0) ? "yes" : "no") << "\n";
+  if (integralFailures != 0) {
+    std::cout << "FAILED: integral image statistics do not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest sliding minimum and maximum:\n";
+  // Every window must give what minRange and maxRange give for it, for any
+  // radius, including radii far beyond the matrix that must not allocate
+  // scratch lines for the whole window, and the same values for every
+  // instruction set
+  int slidingFailures = 0;
+  Matrix terrain(41, 37);
+  for (int i = 0; i < 41; i++) {
+    for (int j = 0; j < 37; j++) {
+      terrain(i, j) = std::sin(0.7*i + 0.3*j*j) + 0.01*((i * 13 + j * 7) % 5);
+    }
+  }
+  int radii[][2] = {{0, 0}, {1, 2}, {3, 1}, {0, 4}, {5, 5}, {20, 50},
+                    {1000000, 100000000}};
+  for (auto& radius : radii) {
+    Matrix lows = minFilter(terrain, radius[0], radius[1]);
+    Matrix highs(1, 1);
+    Matrix isHigh(1, 1);
+    maxFilter(terrain, highs, radius[0], radius[1], &isHigh);
+    for (int i = 0; i < 41; i++) {
+      for (int j = 0; j < 37; j++) {
+        int top = std::max(0, i - radius[0]);
+        int bottom = std::min(40, i + radius[0]);
+        int left = std::max(0, j - radius[1]);
+        int right = std::min(36, j + radius[1]);
+        slidingFailures += 
+          (lows(i, j) != terrain.minRange(top, bottom, left, right)) ||
+          (highs(i, j) != terrain.maxRange(top, bottom, left, right)) ||
+          (isHigh(i, j) != ((terrain(i, j) == highs(i, j)) ? 1 : 0));
+      }
+    }
+  }
+
+  // NaN elements are ignored, a strided view gives the same result as its
+  // copy, and filtering in place gives the same result as into another matrix
+  Matrix holes = terrain;
+  holes(7, 9) = std::nan("");
+  Matrix holesHigh = maxFilter(holes, 1, 1);
+  slidingFailures += (holesHigh(7, 9) != holes.maxRange(6, 8, 8, 10)) ||
+                     (holesHigh(8, 10) != holes.maxRange(7, 9, 9, 11));
+  Matrix transposedHigh = maxFilter(terrain.view().T(), 2, 3);
+  Matrix copiedHigh = maxFilter(terrain.T(), 2, 3);
+  Matrix filteredInPlace = terrain;
+  minFilter(filteredInPlace, filteredInPlace, 2, 3);
+  Matrix filteredApart = minFilter(terrain, 2, 3);
+  for (int i = 0; i < 37; i++) {
+    for (int j = 0; j < 41; j++) {
+      slidingFailures += (transposedHigh(i, j) != copiedHigh(i, j)) ||
+                         (filteredInPlace(j, i) != filteredApart(j, i));
+    }
+  }
+
+  // Only the highest peak of a cluster survives non-maximum suppression
+  Matrix heatmap = Matrix::zeros(40, 50);
+  double peaks[][3] = {{10, 12, 5}, {30, 25, 3}, {31, 27, 2}, {2, 47, 0.4}};
+  for (auto& peak : peaks) {
+    for (int i = 0; i < 40; i++) {
+      for (int j = 0; j < 50; j++) {
+        double distance = (i - peak[0])*(i - peak[0]) + 
+                          (j - peak[1])*(j - peak[1]);
+        heatmap(i, j) += peak[2] * std::exp(-distance / 4);
+      }
+    }
+  }
+  std::vector<struct index> maxima = localMaxima(heatmap, 3, 3, 0.5);
+  slidingFailures += (maxima.size() != 2) || (maxima[0].r != 10) ||
+                     (maxima[0].c != 12) || (maxima[1].r != 30) || 
+                     (maxima[1].c != 25);
+
+  // Each channel of an image is filtered on its own
+  Image landscape(29, 17, 3);
+  for (int y = 0; y < 17; y++) {
+    for (int x = 0; x < 29; x++) {
+      for (int c = 0; c < 3; c++) {
+        landscape(y, x, c) = (float)std::cos(0.9*x - 0.4*y*c + c);
+      }
+    }
+  }
+  Image eroded;
+  Image dilated;
+  erode(landscape, eroded, 3, 2);
+  dilate(landscape, dilated, 3, 2);
+  for (int c = 0; c < 3; c++) {
+    Matrix plane = landscape.toMatrix(c);
+    Matrix planeLows = minFilter(plane, 2, 3);
+    Matrix planeHighs = maxFilter(plane, 2, 3);
+    for (int y = 0; y < 17; y++) {
+      for (int x = 0; x < 29; x++) {
+        slidingFailures += (eroded(y, x, c) != planeLows(y, x)) ||
+                           (dilated(y, x, c) != planeHighs(y, x));
+      }
+    }
+  }
+  setKernelIsa(KernelIsa::Scalar);
+  Matrix scalarHighs = maxFilter(terrain, 4, 2);
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    Matrix isaHighs = maxFilter(terrain, 4, 2);
+    for (int i = 0; i < 41 * 37; i++) {
+      slidingFailures += (isaHighs.getData()[i] != scalarHighs.getData()[i]);
+    }
+  }
+  setKernelIsa(originalIsa);
+
+  // Empty images and views never share elements, even when they still hold
+  // an array, and filtering them gives empty outputs
+  Image shrunk(8, 4);
+  shrunk.setSize(8, 0);
+  Image shrunkEroded;
+  erode(shrunk, shrunkEroded, 1, 1);
+  MatrixView noRows(terrain.getData(), 0, 37, 37);
+  slidingFailures += sharesPixels(shrunk, shrunk) ||
+                     !sharesPixels(patches, patches) ||
+                     sharesElements(noRows, terrain) ||
+                     !sharesElements(terrain.block(3, 5, 3, 5).T(), terrain) ||
+                     sharesElements(terrain.block(0, 0), terrain.block(1, 1)) ||
+                     (shrunkEroded.getHeight() != 0) ||
+                     (minFilter(noRows, 2, 2).getRows() != 0);
+  try {
+    minFilter(terrain, -1, 2);
+  } catch (const std::invalid_argument&) {
+    slidingFailures--;
+  }
+  slidingFailures++;
+  std::cout << "Matches minRange and maxRange: " 
+            << ((slidingFailures == 0) ? "yes" : "no") << "\n";
+  if (slidingFailures != 0) {
+    std::cout << "FAILED: sliding minimum and maximum do not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest FFT correlation:\n";
+  // The transforms must match the sums of their definitions, and both
+  // correlation methods the direct sums, for lengths with any prime factors
+  int fftFailures = 0;
+  const double pi = 3.14159265358979323846;
+  for (int n : {1, 6, 7, 16, 60, 97}) {
+    std::vector<std::complex<double>> values(n);
+    for (int k = 0; k < n; k++) {
+      values[k] = std::complex<double>(std::cos(0.3*k*k), std::sin(1.7*k));
+    }
+    std::vector<std::complex<double>> spectrum = values;
+    fft(spectrum.data(), n);
+    for (int k = 0; k < n; k++) {
+      std::complex<double> expected = 0;
+      for (int j = 0; j < n; j++) {
+        expected += values[j] * std::polar(1.0, -2*pi*((j*k) % n) / n);
+      }
+      fftFailures += (std::abs(spectrum[k] - expected) > 1e-9);
+    }
+    fft(spectrum.data(), n, true);
+    for (int k = 0; k < n; k++) {
+      fftFailures += (std::abs(spectrum[k] - values[k]) > 1e-12);
+    }
+  }
+  Matrix scene(30, 37);
+  for (int i = 0; i < 30; i++) {
+    for (int j = 0; j < 37; j++) {
+      scene(i, j) = std::sin(0.9*i + 0.2*j*j) + 0.1*((i * 7 + j * 3) % 4);
+    }
+  }
+  Matrix sceneSpectrum = rfft2(scene.block(0, 8, 0, 13), 12, 19);
+  for (int u = 0; u < 12; u++) {
+    for (int v = 0; v < 10; v++) {
+      std::complex<double> expected = 0;
+      for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 14; j++) {
+          double turns = (double)((u*i) % 12) / 12 + (double)((v*j) % 19) / 19;
+          expected += scene(i, j) * std::polar(1.0, -2*pi*turns);
+        }
+      }
+      std::complex<double> value(sceneSpectrum(u, 2*v),
+                                 sceneSpectrum(u, 2*v + 1));
+      fftFailures += (std::abs(value - expected) > 1e-9);
+    }
+  }
+  Matrix restored = irfft2(rfft2(scene), 37);
+  for (int i = 0; i < 30 * 37; i++) {
+    fftFailures += (std::abs(restored.getData()[i] - scene.getData()[i]) >
+                    1e-12);
+  }
+  Matrix patch = scene.block(11, 17, 20, 24).copy();
+  Matrix spatial = correlate(scene, patch, CorrelationMethod::Spatial);
+  Matrix frequency = correlate(scene, patch, CorrelationMethod::Frequency);
+
+  // An output that is also the input, or a transposed view of it, is
+  // computed into a temporary first
+  Matrix aliased = scene.copy();
+  correlate(aliased, patch, aliased, CorrelationMethod::Spatial);
+  Matrix aliasedSpectrum = scene.copy();
+  rfft2(aliasedSpectrum.view().T(), aliasedSpectrum);
+  Matrix transposedSpectrum = rfft2(scene.view().T());
+  for (int i = 0; i < 24 * 33; i++) {
+    fftFailures += (aliased.getData()[i] != spatial.getData()[i]);
+  }
+  for (long i = 0; i < (long)transposedSpectrum.getRows() *
+                       transposedSpectrum.getColumns(); i++) {
+    fftFailures += (aliasedSpectrum.getData()[i] !=
+                    transposedSpectrum.getData()[i]);
+  }
+  for (int i = 0; i < 24; i++) {
+    for (int j = 0; j < 33; j++) {
+      double expected = 0;
+      for (int a = 0; a < 7; a++) {
+        for (int b = 0; b < 5; b++) {
+          expected += patch(a, b) * scene(i + a, j + b);
+        }
+      }
+      fftFailures += (std::abs(spatial(i, j) - expected) > 1e-12) ||
+                     (std::abs(frequency(i, j) - expected) > 1e-9);
+    }
+  }
+  for (CorrelationMethod method : {CorrelationMethod::Spatial,
+                                   CorrelationMethod::Frequency}) {
+    TemplateMatch best = findTemplate(scene, patch,
+                                      MatchMethod::NormalizedCorrelation,
+                                      method);
+    TemplateMatch closest = findTemplate(scene, patch,
+                                         MatchMethod::SquaredDifference,
+                                         method);
+    fftFailures += (best.position.r != 11) || (best.position.c != 20) ||
+                   (std::abs(best.score - 1) > 1e-9);
+    fftFailures += (closest.position.r != 11) || (closest.position.c != 20) ||
+                   (closest.score > 1e-9);
+  }
+  setKernelIsa(KernelIsa::Scalar);
+  Matrix scalarSpatial = correlate(scene, patch, CorrelationMethod::Spatial);
+  Matrix scalarFrequency = correlate(scene, patch,
+                                     CorrelationMethod::Frequency);
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    Matrix isaSpatial = correlate(scene, patch, CorrelationMethod::Spatial);
+    Matrix isaFrequency = correlate(scene, patch,
+                                    CorrelationMethod::Frequency);
+    for (int i = 0; i < 24 * 33; i++) {
+      fftFailures += (isaSpatial.getData()[i] != scalarSpatial.getData()[i]) ||
+                     (isaFrequency.getData()[i] !=
+                      scalarFrequency.getData()[i]);
+    }
+  }
+  setKernelIsa(originalIsa);
+  try {
+    correlate(patch, scene);
+  } catch (const std::invalid_argument&) {
+    fftFailures--;
+  }
+  fftFailures++;
+  std::cout << "Matches direct sums: "
+            << ((fftFailures == 0) ? "yes" : "no") << "\n";
+  if (fftFailures != 0) {
+    std::cout << "FAILED: FFT correlation does not match\n";
+    return 1;
+  }
+
+  std::cout << "\n\nTest image pyramids:\n";
+  // Every level must be the binomial blur of the level before it at every
+  // second pixel, lazy levels must equal eager ones, and the levels must
+  // keep their arrays from one video to the next
+  int pyramidFailures = 0;
+  for (int channels : {1, 2, 3}) {
+    for (int size : {1, 2, 5, 8, 37}) {
+      Image small(size, size / 2 + 3, channels);
+      for (int y = 0; y < small.getHeight(); y++) {
+        for (int x = 0; x < small.getWidth(); x++) {
+          for (int c = 0; c < channels; c++) {
+            small(y, x, c) = (float)std::cos(0.9*x - 0.4*y + 2.1*c);
+          }
+        }
+      }
+      pyramidFailures += (pyramidError(small, pyrDown(small)) >= 1e-5);
+    }
+  }
+  Image video(301, 203, 3);
+  for (int y = 0; y < video.getHeight(); y++) {
+    for (int x = 0; x < video.getWidth(); x++) {
+      for (int c = 0; c < 3; c++) {
+        video(y, x, c) = (float)std::sin(0.13*x + 0.29*y + 0.7*c*x);
+      }
+    }
+  }
+  ImagePyramid pyramid(5);
+  ImagePyramid lazyPyramid(5, true);
+  std::vector<const float*> levelArrays;
+  for (int f = 0; f < 2; f++) {
+    if (f == 1) {
+      video(100, 100, 1) += 1;
+    }
+    pyramid.build(video);
+    lazyPyramid.build(video);
+    pyramidFailures += !lazyPyramid.isBuilt(0) || lazyPyramid.isBuilt(1);
+    const Image& lazyLevel = lazyPyramid.level(3);
+    pyramidFailures += !lazyPyramid.isBuilt(3) || lazyPyramid.isBuilt(4);
+    for (int k = 0; k < pyramid.getLevels(); k++) {
+      const Image& level = pyramid.level(k);
+      if (k > 0) {
+        pyramidFailures += (pyramidError(pyramid.level(k - 1), level)
+                            >= 1e-5);
+      }
+      if (f == 0) {
+        levelArrays.push_back(level.getData());
+      }
+      pyramidFailures += (level.getData() != levelArrays[k]);
+    }
+    pyramidFailures += (pyramid.level(4).getWidth() != 19) ||
+                       (pyramid.level(4).getHeight() != 13);
+    pyramidFailures += (pyramid.level(0)(100, 100, 1) != video(100, 100, 1));
+    for (int i = 0; i < lazyLevel.getHeight(); i++) {
+      pyramidFailures += !std::equal(lazyLevel.row(i), lazyLevel.row(i) + 38*3,
+                                     pyramid.level(3).row(i));
+    }
+  }
+  std::cout << "Level sizes:";
+  for (int k = 0; k < pyramid.getLevels(); k++) {
+    std::cout << " " << pyramid.level(k).getWidth() << "x"
+              << pyramid.level(k).getHeight();
+  }
+  std::cout << "\n";
+
+  // Every instruction set and thread count gives the same levels, and the
+  // output may be the input
+  Image luma(640, 480, 1);
+  for (int y = 0; y < luma.getHeight(); y++) {
+    for (int x = 0; x < luma.getWidth(); x++) {
+      luma(y, x) = (float)std::cos(0.05*x*y + 0.3*x);
+    }
+  }
+  setKernelIsa(KernelIsa::Scalar);
+  setMatrixThreads(1);
+  Image scalarLuma = pyrDown(luma);
+  Image scalarVideo = pyrDown(video);
+  for (KernelIsa isa : isas) {
+    if (!setKernelIsa(isa)) {
+      continue;
+    }
+    for (int threads : {1, 4}) {
+      setMatrixThreads(threads);
+      Image isaLuma = pyrDown(luma);
+      Image isaVideo = video;
+      pyrDown(isaVideo, isaVideo);
+      for (int i = 0; i < 240; i++) {
+        pyramidFailures += !std::equal(isaLuma.row(i), isaLuma.row(i) + 320,
+                                       scalarLuma.row(i));
+      }
+      for (int i = 0; i < 102; i++) {
+        pyramidFailures += !std::equal(isaVideo.row(i),
+                                       isaVideo.row(i) + 151*3,
+                                       scalarVideo.row(i));
+      }
+    }
+  }
+  setKernelIsa(originalIsa);
+  setMatrixThreads(0);
+  try {
+    ImagePyramid empty(0);
+  } catch (const std::invalid_argument&) {
+    pyramidFailures--;
+  }
+  pyramidFailures++;
+  std::cout << "Matches binomial blur: "
+            << ((pyramidFailures == 0) ? "yes" : "no") << "\n";
+  if (pyramidFailures != 0) {
+    std::cout << "FAILED: image pyramid does not match\n";
+    return 1;
+  }
 }
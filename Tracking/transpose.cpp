@@ -0,0 +1,456 @@
+/******************************************************************************
+*                              Transposition                                  *
+*                                                                             *
+* The out-of-place and square transposes walk the array in BLOCK x BLOCK     *
+* blocks and hand every 4x4 tile to a kernel that transposes it in vector    *
+* registers. The kernels are selected for the same instruction set as the    *
+* elementwise kernels. Machines with AVX512 use the AVX2 tiles, since an 8x8 *
+* block of doubles is just four 4x4 tiles and the transpose is limited by     *
+* memory traffic rather than by shuffles.                                     *
+*                                                                             *
+* The rectangular in-place transpose follows Catanzaro, Keller and Garland,   *
+* "A decomposition for in-place matrix transposition". Transposing a (m x n) *
+* array moves element (i, j) to position j*m + i. Viewing the storage as the *
+* same (m x n) grid, that move is split into three steps that each permute    *
+* elements only within a column or only within a row, so each step needs a   *
+* buffer of one row or of a group of columns instead of a copy of the array:  *
+*                                                                             *
+* 1. Column j is rotated down by j / b, where c = gcd(m, n) and b = n / c.   *
+*    This spreads the elements of every row over distinct final columns.      *
+* 2. Every element is moved within its row to its final column.               *
+* 3. Every element is moved within its column to its final row.               *
+*                                                                             *
+* The column steps need a whole column of the group, so a tall array, and the *
+* row step a whole row, so a wide one, would need as much scratch space as    *
+* the array itself. When either exceeds TRANSPOSE_SCRATCH elements the        *
+* elements are instead moved along the cycles of the permutation one at a     *
+* time, which is slower but only needs one bit per element to mark the        *
+* elements already moved.                                                     *
+*                                                                             *
+******************************************************************************/
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "transpose.hpp"
+#include "kernels.hpp"
+#include "parallel.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANSPOSE_X86
+#endif
+
+// Size of the blocks that are transposed at once, which fit in L1 for both
+// the source and the destination
+static const int BLOCK = 32;
+
+// Number of columns moved together by the column steps of the in-place
+// transpose, so that every row is read in runs rather than single elements
+static const int COLUMN_GROUP = 16;
+
+// Writes the transpose of the 4x4 tile at in to out
+typedef void (*CopyTile)(const double* in, long inStride, double* out,
+                         long outStride);
+
+// Writes the transpose of the 4x4 tile at a to b and the transpose of the
+// tile at b to a. a and b may be the same tile
+typedef void (*SwapTiles)(double* a, double* b, long stride);
+
+/******************************************************************************
+* TILE KERNELS                                                                *
+******************************************************************************/
+
+static void copyTileScalar(const double* in, long inStride, double* out,
+                           long outStride) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      out[j*outStride + i] = in[i*inStride + j];
+    }
+  }
+}
+
+static void swapTilesScalar(double* a, double* b, long stride) {
+  double tileA[16];
+  double tileB[16];
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      tileA[j*4 + i] = a[i*stride + j];
+      tileB[j*4 + i] = b[i*stride + j];
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      b[i*stride + j] = tileA[i*4 + j];
+      a[i*stride + j] = tileB[i*4 + j];
+    }
+  }
+}
+
+#ifdef TRANSPOSE_X86
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+/*
+* Transposes a 4x4 tile held as two registers per row, the left and right
+* halves, by transposing its four 2x2 sub-tiles.
+*/
+SSE2_TARGET static inline void transposeSSE2(__m128d (&left)[4],
+                                             __m128d (&right)[4]) {
+  __m128d outLeft[4];
+  __m128d outRight[4];
+  outLeft[0] = _mm_unpacklo_pd(left[0], left[1]);
+  outLeft[1] = _mm_unpackhi_pd(left[0], left[1]);
+  outLeft[2] = _mm_unpacklo_pd(right[0], right[1]);
+  outLeft[3] = _mm_unpackhi_pd(right[0], right[1]);
+  outRight[0] = _mm_unpacklo_pd(left[2], left[3]);
+  outRight[1] = _mm_unpackhi_pd(left[2], left[3]);
+  outRight[2] = _mm_unpacklo_pd(right[2], right[3]);
+  outRight[3] = _mm_unpackhi_pd(right[2], right[3]);
+  for (int i = 0; i < 4; i++) {
+    left[i] = outLeft[i];
+    right[i] = outRight[i];
+  }
+}
+
+SSE2_TARGET static void copyTileSSE2(const double* in, long inStride,
+                                     double* out, long outStride) {
+  __m128d left[4];
+  __m128d right[4];
+  for (int i = 0; i < 4; i++) {
+    left[i] = _mm_loadu_pd(in + i*inStride);
+    right[i] = _mm_loadu_pd(in + i*inStride + 2);
+  }
+  transposeSSE2(left, right);
+  for (int i = 0; i < 4; i++) {
+    _mm_storeu_pd(out + i*outStride, left[i]);
+    _mm_storeu_pd(out + i*outStride + 2, right[i]);
+  }
+}
+
+SSE2_TARGET static void swapTilesSSE2(double* a, double* b, long stride) {
+  __m128d leftA[4], rightA[4], leftB[4], rightB[4];
+  for (int i = 0; i < 4; i++) {
+    leftA[i] = _mm_loadu_pd(a + i*stride);
+    rightA[i] = _mm_loadu_pd(a + i*stride + 2);
+    leftB[i] = _mm_loadu_pd(b + i*stride);
+    rightB[i] = _mm_loadu_pd(b + i*stride + 2);
+  }
+  transposeSSE2(leftA, rightA);
+  transposeSSE2(leftB, rightB);
+  for (int i = 0; i < 4; i++) {
+    _mm_storeu_pd(b + i*stride, leftA[i]);
+    _mm_storeu_pd(b + i*stride + 2, rightA[i]);
+    _mm_storeu_pd(a + i*stride, leftB[i]);
+    _mm_storeu_pd(a + i*stride + 2, rightB[i]);
+  }
+}
+
+/*
+* Transposes a 4x4 tile held as one register per row. The unpacks transpose
+* the 2x2 sub-tiles within each 128 bit lane and the permutes swap the two
+* off-diagonal sub-tiles.
+*/
+AVX2_TARGET static inline void transposeAVX2(__m256d (&rows)[4]) {
+  __m256d t0 = _mm256_unpacklo_pd(rows[0], rows[1]);
+  __m256d t1 = _mm256_unpackhi_pd(rows[0], rows[1]);
+  __m256d t2 = _mm256_unpacklo_pd(rows[2], rows[3]);
+  __m256d t3 = _mm256_unpackhi_pd(rows[2], rows[3]);
+  rows[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+  rows[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+  rows[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+  rows[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+AVX2_TARGET static void copyTileAVX2(const double* in, long inStride,
+                                     double* out, long outStride) {
+  __m256d rows[4];
+  for (int i = 0; i < 4; i++) {
+    rows[i] = _mm256_loadu_pd(in + i*inStride);
+  }
+  transposeAVX2(rows);
+  for (int i = 0; i < 4; i++) {
+    _mm256_storeu_pd(out + i*outStride, rows[i]);
+  }
+}
+
+AVX2_TARGET static void swapTilesAVX2(double* a, double* b, long stride) {
+  __m256d rowsA[4];
+  __m256d rowsB[4];
+  for (int i = 0; i < 4; i++) {
+    rowsA[i] = _mm256_loadu_pd(a + i*stride);
+    rowsB[i] = _mm256_loadu_pd(b + i*stride);
+  }
+  transposeAVX2(rowsA);
+  transposeAVX2(rowsB);
+  for (int i = 0; i < 4; i++) {
+    _mm256_storeu_pd(b + i*stride, rowsA[i]);
+    _mm256_storeu_pd(a + i*stride, rowsB[i]);
+  }
+}
+
+#endif
+
+/*
+* Returns the tile kernels for the instruction set of the elementwise kernels.
+*/
+static void selectTiles(CopyTile& copyTile, SwapTiles& swapTiles) {
+  copyTile = copyTileScalar;
+  swapTiles = swapTilesScalar;
+#ifdef TRANSPOSE_X86
+  KernelIsa isa = kernels().isa;
+  if ((isa == KernelIsa::AVX2) || (isa == KernelIsa::AVX512)) {
+    copyTile = copyTileAVX2;
+    swapTiles = swapTilesAVX2;
+  } else if (isa == KernelIsa::SSE2) {
+    copyTile = copyTileSSE2;
+    swapTiles = swapTilesSSE2;
+  }
+#endif
+}
+
+/******************************************************************************
+* BLOCKED TRANSPOSES                                                          *
+******************************************************************************/
+
+/*
+* Transposes one block of at most BLOCK x BLOCK elements from in to out. The
+* edges that do not fill a whole tile are copied one element at a time.
+*/
+static void copyBlock(const double* in, int rows, int cols, long inStride,
+                      double* out, long outStride, CopyTile copyTile) {
+  int i = 0;
+  for (; i + 4 <= rows; i += 4) {
+    int j = 0;
+    for (; j + 4 <= cols; j += 4) {
+      copyTile(in + i*inStride + j, inStride, out + j*outStride + i,
+               outStride);
+    }
+    for (; j < cols; j++) {
+      for (int k = 0; k < 4; k++) {
+        out[j*outStride + i + k] = in[(i + k)*inStride + j];
+      }
+    }
+  }
+  for (; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      out[j*outStride + i] = in[i*inStride + j];
+    }
+  }
+}
+
+/*
+* Writes the transpose of the (rows x cols) array in, whose rows are
+* inRowStride elements apart, into the (cols x rows) array out, whose rows are
+* outRowStride elements apart. Large arrays are split into bands of rows that
+* are transposed in parallel.
+*/
+void transposeCopy(const double* in, int rows, int cols, int inRowStride,
+                   double* out, int outRowStride) {
+  CopyTile copyTile;
+  SwapTiles swapTiles;
+  selectTiles(copyTile, swapTiles);
+  int bands = (rows + BLOCK - 1) / BLOCK;
+  long grain = std::max(1L, PARALLEL_GRAIN / ((long)BLOCK * std::max(cols, 1)));
+  parallelFor(bands, grain, [&](long first, long last) {
+    for (long band = first; band < last; band++) {
+      int i = (int)band * BLOCK;
+      int blockRows = std::min(BLOCK, rows - i);
+      for (int j = 0; j < cols; j += BLOCK) {
+        copyBlock(in + (long)i*inRowStride + j, blockRows,
+                  std::min(BLOCK, cols - j), inRowStride,
+                  out + (long)j*outRowStride + i, outRowStride, copyTile);
+      }
+    }
+  });
+}
+
+/*
+* Transposes a (size x size) array in place, whose rows are rowStride elements
+* apart. Each pair of tiles on opposite sides of the diagonal is exchanged and
+* transposed in registers, and the tiles on the diagonal are transposed where
+* they are. Rows and columns past the last whole tile are swapped one element
+* at a time.
+*/
+void transposeSquare(double* data, int size, int rowStride) {
+  CopyTile copyTile;
+  SwapTiles swapTiles;
+  selectTiles(copyTile, swapTiles);
+  int tiled = size - size % 4;
+  int bands = (tiled + BLOCK - 1) / BLOCK;
+  long grain = std::max(1L, PARALLEL_GRAIN / ((long)BLOCK * std::max(size, 1)));
+  parallelFor(bands, grain, [&](long first, long last) {
+    for (long band = first; band < last; band++) {
+      int i0 = (int)band * BLOCK;
+      int i1 = std::min(tiled, i0 + BLOCK);
+      for (int j0 = i0; j0 < tiled; j0 += BLOCK) {
+        int j1 = std::min(tiled, j0 + BLOCK);
+        for (int i = i0; i < i1; i += 4) {
+          for (int j = std::max(i, j0); j < j1; j += 4) {
+            swapTiles(data + (long)i*rowStride + j,
+                      data + (long)j*rowStride + i, rowStride);
+          }
+        }
+      }
+    }
+  });
+  for (int j = tiled; j < size; j++) {
+    for (int i = 0; i < j; i++) {
+      std::swap(data[(long)i*rowStride + j], data[(long)j*rowStride + i]);
+    }
+  }
+}
+
+/******************************************************************************
+* IN-PLACE RECTANGULAR TRANSPOSE                                              *
+******************************************************************************/
+
+/*
+* Transposes a contiguous (m x n) array in place by following the cycles of
+* the permutation, in which element (i, j) at position i*n + j moves to
+* position j*m + i. The first and last elements stay where they are.
+*/
+static void transposeCycles(double* data, long m, long n) {
+  const long last = m*n - 1;
+  std::vector<bool> moved(last + 1, false);
+  for (long start = 1; start < last; start++) {
+    if (moved[start]) {
+      continue;
+    }
+    double carried = data[start];
+    long position = start;
+    do {
+      long target = (position % n)*m + position / n;
+      std::swap(carried, data[target]);
+      moved[target] = true;
+      position = target;
+    } while (position != start);
+  }
+}
+
+/*
+* Transposes a contiguous (rows x cols) array in place. Besides the array, it
+* needs one row and up to COLUMN_GROUP columns of scratch space per thread, or
+* one bit per element when that is more than TRANSPOSE_SCRATCH elements.
+*/
+void transposeInPlace(double* data, int rows, int cols) {
+  if ((rows <= 1) || (cols <= 1)) {
+    return;
+  }
+  if (rows == cols) {
+    transposeSquare(data, rows, cols);
+    return;
+  }
+  const long m = rows;
+  const long n = cols;
+  const long groupWidth = std::min((long)COLUMN_GROUP, n);
+  if ((m*groupWidth > TRANSPOSE_SCRATCH) || (n > TRANSPOSE_SCRATCH)) {
+    transposeCycles(data, m, n);
+    return;
+  }
+  const long b = n / std::gcd(m, n);
+  const long step = m % n;
+  const long runStep = ((b*m - 1) % n + n) % n;
+  const long groups = (n + COLUMN_GROUP - 1) / COLUMN_GROUP;
+  const long columnGrain = std::max(1L, PARALLEL_GRAIN / (m*COLUMN_GROUP));
+  const long rowGrain = std::max(1L, PARALLEL_GRAIN / n);
+
+  // 1. Rotate column j down by j / b. Groups of columns are gathered into a
+  // buffer at their rotated rows and then written back
+  if (b < n) {
+    parallelFor(groups, columnGrain, [&](long first, long last) {
+      std::vector<double> buffer(m * groupWidth);
+      for (long group = first; group < last; group++) {
+        long j0 = group * COLUMN_GROUP;
+        long width = std::min((long)COLUMN_GROUP, n - j0);
+        long shifts[COLUMN_GROUP];
+        for (long k = 0; k < width; k++) {
+          shifts[k] = (j0 + k) / b % m;
+        }
+        for (long i = 0; i < m; i++) {
+          for (long k = 0; k < width; k++) {
+            long target = (i + shifts[k] < m) ? i + shifts[k] 
+                                              : i + shifts[k] - m;
+            buffer[target*groupWidth + k] = data[i*n + j0 + k];
+          }
+        }
+        for (long i = 0; i < m; i++) {
+          std::copy(buffer.data() + i*groupWidth,
+                    buffer.data() + i*groupWidth + width,
+                    data + i*n + j0);
+        }
+      }
+    });
+  }
+
+  // 2. Move every element within its row to its final column. Column j of
+  // row r holds the element from row i = (r - j / b) mod m, which ends up at
+  // position j*m + i
+  parallelFor(m, rowGrain, [&](long first, long last) {
+    std::vector<double> buffer(n);
+    for (long r = first; r < last; r++) {
+      double* row = data + r*n;
+      // Within each run of b columns the source row is the same, and the
+      // target column advances by m modulo n. The next run reads from the
+      // row above, wrapping around to the last row
+      long i = r;
+      long start = r % n;
+      for (long j0 = 0; j0 < n; j0 += b) {
+        long f = start;
+        for (long j = j0; j < j0 + b; j++) {
+          buffer[f] = row[j];
+          f += step;
+          f = (f >= n) ? f - n : f;
+        }
+        start += runStep;
+        start = (start >= n) ? start - n : start;
+        if (i == 0) {
+          i = m - 1;
+          start += step;
+          start = (start >= n) ? start - n : start;
+        } else {
+          i--;
+        }
+      }
+      std::copy(buffer.begin(), buffer.end(), row);
+    }
+  });
+
+  // 3. Move every element within its column to its final row. Row t of
+  // column f receives the element that belongs at position L = f + t*n, which
+  // came from (i, j) = (L mod m, L / m) and was left in row (i + j / b) mod m
+  parallelFor(groups, columnGrain, [&](long first, long last) {
+    std::vector<double> buffer(m * groupWidth);
+    for (long group = first; group < last; group++) {
+      long f0 = group * COLUMN_GROUP;
+      long width = std::min((long)COLUMN_GROUP, n - f0);
+      for (long t = 0; t < m; t++) {
+        // Moving along the row advances i, carrying into j at the end of a
+        // column of the original array
+        long position = f0 + t*n;
+        long i = position % m;
+        long j = position / m;
+        long quotient = j / b;
+        long remainder = j % b;
+        for (long k = 0; k < width; k++) {
+          long r = i + quotient;
+          r = (r >= m) ? r - m : r;
+          buffer[t*groupWidth + k] = data[r*n + f0 + k];
+          if (++i == m) {
+            i = 0;
+            if (++remainder == b) {
+              remainder = 0;
+              quotient++;
+            }
+          }
+        }
+      }
+      for (long t = 0; t < m; t++) {
+        std::copy(buffer.data() + t*groupWidth,
+                  buffer.data() + t*groupWidth + width,
+                  data + t*n + f0);
+      }
+    }
+  });
+}
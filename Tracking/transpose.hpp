@@ -0,0 +1,34 @@
+/******************************************************************************
+*                              Transposition                                  *
+*                                                                             *
+* Blocked transposes of row major arrays of doubles, used by the Matrix      *
+* class. The arrays are processed in blocks that fit in L1, and each block is *
+* transposed in 4x4 tiles held in vector registers, so every cache line that *
+* is read or written is used completely.                                      *
+*                                                                             *
+* transposeInPlace transposes a rectangular array within its own storage,     *
+* using scratch space for a few rows and columns instead of a second copy of *
+* the array. The scratch space is bounded by TRANSPOSE_SCRATCH elements per   *
+* thread, beyond which the elements are moved along cycles instead.          *
+*                                                                             *
+******************************************************************************/
+#ifndef TRANSPOSE_HPP
+#define TRANSPOSE_HPP
+
+// Largest number of elements of scratch space that transposeInPlace uses per
+// thread for a row or a group of columns
+const long TRANSPOSE_SCRATCH = 1L << 18;
+
+// Writes the transpose of the (rows x cols) array in into the (cols x rows)
+// array out. The arrays must not overlap
+void transposeCopy(const double* in, int rows, int cols, int inRowStride,
+                   double* out, int outRowStride);
+
+// Transposes a (size x size) array in place
+void transposeSquare(double* data, int size, int rowStride);
+
+// Transposes a contiguous (rows x cols) array in place, leaving a contiguous
+// (cols x rows) array
+void transposeInPlace(double* data, int rows, int cols);
+
+#endif